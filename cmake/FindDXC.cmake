@@ -0,0 +1,39 @@
+# Finds the DirectX shader compiler, from a release of https://github.com/microsoft/DirectXShaderCompiler or the
+# Vulkan SDK. Set DXC_ROOT to the directory the release was unpacked into when it is not installed on the system.
+#
+# The shader compiler of DXRCore loads the library at runtime and only needs the headers to build. Outside of Windows,
+# dxcapi.h includes WinAdapter.h, which comes with the release as well.
+#
+#   DXC_FOUND            - the headers and the library were found
+#   DXC_INCLUDE_DIRS     - directories of dxcapi.h and, outside of Windows, WinAdapter.h
+#   DXC_LIBRARY          - dxcompiler.dll or libdxcompiler.so, for loading at runtime
+#   DXC::Headers         - imported target with the include directories
+
+find_path(DXC_INCLUDE_DIR dxcapi.h PATH_SUFFIXES include/dxc dxc include)
+
+if(WIN32)
+	find_file(DXC_LIBRARY dxcompiler.dll PATH_SUFFIXES bin/x64 bin)
+else()
+	find_path(DXC_WINADAPTER_INCLUDE_DIR WinAdapter.h HINTS ${DXC_INCLUDE_DIR} PATH_SUFFIXES include/dxc dxc include)
+	find_library(DXC_LIBRARY dxcompiler PATH_SUFFIXES lib)
+endif()
+
+include(FindPackageHandleStandardArgs)
+
+if(WIN32)
+	find_package_handle_standard_args(DXC REQUIRED_VARS DXC_LIBRARY DXC_INCLUDE_DIR)
+else()
+	find_package_handle_standard_args(DXC REQUIRED_VARS DXC_LIBRARY DXC_INCLUDE_DIR DXC_WINADAPTER_INCLUDE_DIR)
+endif()
+
+if(DXC_FOUND)
+	set(DXC_INCLUDE_DIRS ${DXC_INCLUDE_DIR} ${DXC_WINADAPTER_INCLUDE_DIR})
+	list(REMOVE_DUPLICATES DXC_INCLUDE_DIRS)
+
+	if(NOT TARGET DXC::Headers)
+		add_library(DXC::Headers INTERFACE IMPORTED)
+		set_target_properties(DXC::Headers PROPERTIES INTERFACE_INCLUDE_DIRECTORIES "${DXC_INCLUDE_DIRS}")
+	endif()
+endif()
+
+mark_as_advanced(DXC_INCLUDE_DIR DXC_WINADAPTER_INCLUDE_DIR DXC_LIBRARY)
@@ -2,15 +2,20 @@
 
 #include <DXRCore/Renderer/Renderer.hpp>
 
-#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
 #include <DXRCore/Renderer/Attributes/Mesh.hpp>
 #include <DXRCore/Renderer/Attributes/TLAS.hpp>
 
+#include <DXRCore/CPU/Backend.hpp>
+
+#if !defined(DXR_HEADLESS)
+#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
+
 #if defined _DEBUG
 #include "Shaders/RaytracingBasic_Debug.hpp"
 #else 
 #include "Shaders/RaytracingBasic_Release.hpp"
 #endif
+#endif
 
 #include <DirectXMath.h>
 
@@ -27,7 +32,10 @@ public:
 	};
 
 	void InitializeSample() override;
+#if !defined(DXR_HEADLESS)
 	void RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList) override;
+#endif
+	void RenderSampleCPU(cpu::Backend& backend) override;
 private:
 	Mesh* m_Mesh = nullptr;
 	MeshInstance* m_MeshInstance = nullptr;
@@ -48,8 +56,8 @@ void Basic::InitializeSample()
 	uint16_t indices[] = { 0, 1, 2 };
 
 	m_Mesh = new Mesh();
-	m_Mesh->SetPositionBuffer(_countof(positions), positions);
-	m_Mesh->SetIndexBuffer(_countof(indices), indices);
+	m_Mesh->SetPositionBuffer(std::size(positions), positions);
+	m_Mesh->SetIndexBuffer(std::size(indices), indices);
 	m_Mesh->BuildBLAS();
 
 	m_MeshInstance = new MeshInstance();
@@ -59,6 +67,7 @@ void Basic::InitializeSample()
 	m_TLAS->AddMesh(m_MeshInstance);
 	m_TLAS->Build();
 
+#if !defined(DXR_HEADLESS)
 	RaytracingPipelineDesc desc = {};
 	desc.RayGenEntry.EntryName = L"RayGenMain";
 	desc.HitGroups.emplace_back(L"ClosestMain", L"", L"", L"HitGroup", D3D12_HIT_GROUP_TYPE_TRIANGLES);
@@ -76,9 +85,12 @@ void Basic::InitializeSample()
 
 	desc.RootSignatureDesc = CD3DX12_ROOT_SIGNATURE_DESC(_countof(params), params, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED);
 
-	m_Pipeline = new RaytracingPipeline(desc);
+	CreatePipeline(desc, "RaytracingBasic.hlsl");
+#endif
 }
 
+#if !defined(DXR_HEADLESS)
+
 void Basic::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
 {
 	cmdList->SetComputeRootSignature(m_Pipeline->GetRootSignature().Get());
@@ -88,7 +100,7 @@ void Basic::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdL
 	D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
 	dispatchDesc.HitGroupTable.StartAddress = m_Pipeline->GetHitGroupTable()->GetGPUVirtualAddress();
 	dispatchDesc.HitGroupTable.SizeInBytes = m_Pipeline->GetHitGroupTable()->GetDesc().Width;
-	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
+	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetHitGroupStride();
 	dispatchDesc.MissShaderTable.StartAddress = m_Pipeline->GetMissTable()->GetGPUVirtualAddress();
 	dispatchDesc.MissShaderTable.SizeInBytes = m_Pipeline->GetMissTable()->GetDesc().Width;
 	dispatchDesc.MissShaderTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
@@ -100,4 +112,27 @@ void Basic::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdL
 
 	cmdList->SetPipelineState1(m_Pipeline->GetStateObject().Get());
 	cmdList->DispatchRays(&dispatchDesc);
+}
+#endif
+
+void Basic::RenderSampleCPU(cpu::Backend& backend)
+{
+	// The shaders trace parallel rays along +z from the plane at z = 0, with x and y from -1 to 1 over the image and y
+	// going down. A camera far behind that plane, looking through it, comes close.
+	cpu::FrameDesc frame = {};
+	frame.InverseViewProjection.m[0][0] = 1.0f;
+	frame.InverseViewProjection.m[1][1] = -1.0f;
+	frame.InverseViewProjection.m[3][3] = 1.0f;
+	frame.CameraPosition = { 0.0f, 0.0f, -50.0f };
+
+	// Without barycentric shading on the CPU backend, the triangle has the color of its instance
+	frame.Light.Direction = { 0.0f, 0.0f, 1.0f };
+	frame.Light.Intensity = 0.0f;
+
+	frame.Scene = &m_TLAS->GetCPUScene();
+	frame.Diffuse = 0.0f;
+	frame.Ambient = 1.0f;
+	frame.Shadows = false;
+
+	backend.Render(frame);
 }
\ No newline at end of file
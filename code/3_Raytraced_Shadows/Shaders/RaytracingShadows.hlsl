@@ -12,32 +12,29 @@ struct RayPayloadShadow
     bool IsOccluded;
 };
 
-StructuredBuffer<hlsl::Mesh> g_MeshData : register(t0);
 RaytracingAccelerationStructure g_Scene : register(t1);
 
-cbuffer Core : register(b0)
-{
-    float4x4 g_InverseViewProjection;
-    float3 g_CameraPosition;
-    uint g_UAV;
-}
+ConstantBuffer<hlsl::Core> g_Core : register(b0);
 
 ConstantBuffer<hlsl::DirectionalLight> g_Light : register(b1);
 
+// The mesh of the instance that was hit, from its hit group record
+ConstantBuffer<hlsl::Mesh> l_Mesh : register(b0, space1);
+
 RayDesc GetPrimaryRay(uint2 index)
 {
     RayDesc ray;
-    ray.Origin = g_CameraPosition;
+    ray.Origin = g_Core.CameraPosition;
 
     float2 screenPos = float2(index) + 0.5f.xx;
     screenPos = screenPos / (float2)DispatchRaysDimensions();
     screenPos = mad(screenPos, 2.0f, -1.0f);
     screenPos.y = -screenPos.y;
 
-    float4 world = mul(g_InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
+    float4 world = mul(g_Core.InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
     world.xyz /= world.w;
 
-    ray.Direction = normalize(world.xyz - g_CameraPosition);
+    ray.Direction = normalize(world.xyz - g_Core.CameraPosition);
     ray.TMin = 0.01f;
     ray.TMax = 100.0f;
     
@@ -47,7 +44,7 @@ RayDesc GetPrimaryRay(uint2 index)
 [shader("raygeneration")]
 void RayGenMain()
 {
-    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_UAV];
+    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_Core.UAV];
     
     RayDesc ray = GetPrimaryRay((uint2) DispatchRaysIndex());
     
@@ -62,7 +59,7 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
 {
     float3 barycentrics = float3(1 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
     
-    hlsl::Mesh mesh = g_MeshData[InstanceIndex()];
+    hlsl::Mesh mesh = l_Mesh;
     
     ByteAddressBuffer indexBuffer = ResourceDescriptorHeap[mesh.IndexIdx]; // this needs to be flexible with 16bit and 32bit. byteaddressbuffer would work here :)
     StructuredBuffer<float3> normalBuffer = ResourceDescriptorHeap[mesh.NormalIdx];
@@ -15,10 +15,12 @@ using float4 = DirectX::XMFLOAT4;
 
 namespace hlsl
 {
-	struct Camera
+	// The constants of a frame, bound as a root constant buffer view
+	struct Core
 	{
 		float4x4 InverseViewProjection;
-		float3 Position;
+		float3 CameraPosition;
+		uint UAV;
 	};
 
 	struct Mesh
@@ -4,17 +4,21 @@
 
 #include <DXRCore/Renderer/Attributes/TLAS.hpp>
 #include <DXRCore/Renderer/Attributes/Mesh.hpp>
-#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
 
 #include <DirectXMath.h>
 
+#if !defined(DXR_HEADLESS)
+#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
+#include <DXRCore/Renderer/Attributes/ConstantAllocator.hpp>
+
 #if defined _DEBUG
 #include "Shaders/RaytracingShadows_Debug.hpp"
 #else 
 #include "Shaders/RaytracingShadows_Release.hpp"
 #endif
+#endif
 
-#include <DXRCore/Utils/Error.hpp>
+#include <DXRCore/CPU/Backend.hpp>
 
 #include <Shaders/Shared.hpp>
 
@@ -26,13 +30,15 @@ class Shadows : public Renderer
 	{
 		Core,
 		Light,
-		GeometryData,
 		BVH,
 		Count
 	};
 
 	void InitializeSample() override;
+#if !defined(DXR_HEADLESS)
 	void RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList) override;
+#endif
+	void RenderSampleCPU(cpu::Backend& backend) override;
 
 	void Update(float deltaTime) override;
 private:
@@ -144,26 +150,29 @@ void Shadows::InitializeSample()
 	};
 
 	m_Mesh = new Mesh();
-	m_Mesh->SetPositionBuffer(_countof(positions), positions);
-	m_Mesh->SetNormalBuffer(_countof(normals), normals);
-	m_Mesh->SetIndexBuffer(_countof(indices), indices);
+	m_Mesh->SetPositionBuffer(std::size(positions), positions);
+	m_Mesh->SetNormalBuffer(std::size(normals), normals);
+	m_Mesh->SetIndexBuffer(std::size(indices), indices);
 	m_Mesh->BuildBLAS();
 
 	m_MeshInstance[0] = new MeshInstance();
 	m_MeshInstance[0]->SetMesh(m_Mesh);
 	m_MeshInstance[0]->SetColor(XMFLOAT4(0.25f, 0.5f, 1.0f, 1.0f));
-	m_MeshInstance[0]->Translation = XMFLOAT3(0.0f, 0.0f, 2.0f);
+	m_MeshInstance[0]->SetTranslation(XMFLOAT3(0.0f, 0.0f, 2.0f));
 
 	m_MeshInstance[1] = new MeshInstance();
 	m_MeshInstance[1]->SetMesh(m_Mesh);
 	m_MeshInstance[1]->SetColor(XMFLOAT4(1.0f, 0.5f, 1.0f, 1.0f));
-	m_MeshInstance[1]->Scale = XMFLOAT3(5.0f, 5.0f, 0.5f);
+	m_MeshInstance[1]->SetScale(XMFLOAT3(5.0f, 5.0f, 0.5f));
 
 	m_TLAS = new TLAS();
 	m_TLAS->AddMesh(m_MeshInstance[0]);
 	m_TLAS->AddMesh(m_MeshInstance[1]);
+	// Every instance gets its own hit group record, which holds its mesh
+	m_TLAS->SetPerInstanceRecords(true);
 	m_TLAS->Build();
 
+#if !defined(DXR_HEADLESS)
 	RaytracingPipelineDesc desc = {};
 	desc.RayGenEntry.EntryName = L"RayGenMain";
 	desc.HitGroups.emplace_back(L"ClosestMain", L"", L"", L"HitGroup", D3D12_HIT_GROUP_TYPE_TRIANGLES);
@@ -177,22 +186,23 @@ void Shadows::InitializeSample()
 	desc.PayloadSize = sizeof(float) * 4;
 
 	CD3DX12_ROOT_PARAMETER params[Count] = {};
-	params[Core].InitAsConstants(20, 0);
-	params[Light].InitAsConstants(sizeof(hlsl::DirectionalLight) / sizeof(uint32_t), 1);
-	params[GeometryData].InitAsShaderResourceView(0);
+	params[Core].InitAsConstantBufferView(0);
+	params[Light].InitAsConstantBufferView(1);
 	params[BVH].InitAsShaderResourceView(1);
 
 	desc.RootSignatureDesc = CD3DX12_ROOT_SIGNATURE_DESC(_countof(params), params, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED);
 
-	m_Pipeline = new RaytracingPipeline(desc);
+	// The closest hit shader reads the mesh from the local root constants instead of looking it up by the instance
+	CD3DX12_ROOT_PARAMETER localParams[1] = {};
+	localParams[0].InitAsConstants(sizeof(hlsl::Mesh) / sizeof(uint32_t), 0, 1);
 
-	m_Camera = static_cast<Shadows::Camera*>(_aligned_malloc(sizeof(Shadows::Camera), alignof(Shadows::Camera)));
+	desc.LocalRootSignatureDesc = CD3DX12_ROOT_SIGNATURE_DESC(_countof(localParams), localParams);
 
-	if (m_Camera == nullptr)
-	{
-		FatalError("Failed to allocate memory for the camera");
-		return;
-	}
+	CreatePipeline(desc, "RaytracingShadows.hlsl");
+	m_TLAS->WriteHitGroupRecords(*m_Pipeline);
+#endif
+
+	m_Camera = new Camera();
 
 	m_Camera->Position = XMVectorSet(0.0f, -7.0f, 6.0f, 1.0f);
 	m_Camera->Yaw = 90.0f;
@@ -204,26 +214,30 @@ void Shadows::InitializeSample()
 }
 
 
+#if !defined(DXR_HEADLESS)
 void Shadows::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
 {
 	//m_TLAS->Build(cmdList);
 
 	cmdList->SetComputeRootSignature(m_Pipeline->GetRootSignature().Get());
 
-	cmdList->SetComputeRoot32BitConstants(Core, 16, &m_Camera->InverseViewProjection, 0);
-	cmdList->SetComputeRoot32BitConstants(Core, 3, &m_Camera->Position, 16);
-	cmdList->SetComputeRoot32BitConstants(Core, 1, &m_UAV, 19);
+	hlsl::Core core;
+	XMStoreFloat4x4(&core.InverseViewProjection, m_Camera->InverseViewProjection);
+	XMStoreFloat3(&core.CameraPosition, m_Camera->Position);
+	core.UAV = m_UAV;
 
-	cmdList->SetComputeRoot32BitConstants(Light, sizeof(hlsl::DirectionalLight) / sizeof(uint32_t), &m_DirectionalLight, 0);
+	// Copied into the constants of the frame, which stay alive until the GPU is done with the frame
+	ConstantAllocator& constants = GetConstantAllocator();
 
-	cmdList->SetComputeRootShaderResourceView(GeometryData, m_TLAS->GetGeometryData());
+	cmdList->SetComputeRootConstantBufferView(Core, constants.Allocate(core));
+	cmdList->SetComputeRootConstantBufferView(Light, constants.Allocate(m_DirectionalLight));
 
 	cmdList->SetComputeRootShaderResourceView(BVH, m_TLAS->GetVirtualAddress());
 
 	D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
 	dispatchDesc.HitGroupTable.StartAddress = m_Pipeline->GetHitGroupTable()->GetGPUVirtualAddress();
 	dispatchDesc.HitGroupTable.SizeInBytes = m_Pipeline->GetHitGroupTable()->GetDesc().Width;
-	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
+	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetHitGroupStride();
 	dispatchDesc.MissShaderTable.StartAddress = m_Pipeline->GetMissTable()->GetGPUVirtualAddress();
 	dispatchDesc.MissShaderTable.SizeInBytes = m_Pipeline->GetMissTable()->GetDesc().Width;
 	dispatchDesc.MissShaderTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
@@ -236,68 +250,84 @@ void Shadows::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cm
 	cmdList->SetPipelineState1(m_Pipeline->GetStateObject().Get());
 	cmdList->DispatchRays(&dispatchDesc);
 }
+#endif
+
+void Shadows::RenderSampleCPU(cpu::Backend& backend)
+{
+	cpu::FrameDesc frame = {};
+	XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(&frame.InverseViewProjection), m_Camera->InverseViewProjection);
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&frame.CameraPosition), m_Camera->Position);
+
+	frame.Light.Direction = { m_DirectionalLight.Direction.x, m_DirectionalLight.Direction.y, m_DirectionalLight.Direction.z };
+	frame.Light.Color = { m_DirectionalLight.Color.x, m_DirectionalLight.Color.y, m_DirectionalLight.Color.z };
+	frame.Light.Intensity = m_DirectionalLight.Intensity;
+
+	frame.Scene = &m_TLAS->GetCPUScene();
+	frame.Diffuse = 1.0f;
+	frame.ShadowRayFlags = cpu::RayFlagCullBackFacingTriangles | cpu::RayFlagSkipClosestHitShader;
+
+	backend.Render(frame);
+}
 
 void Shadows::Update(float deltaTime)
 {
 	static float time = deltaTime;
 	time += deltaTime;
 
-	const static XMVECTOR forward = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	const static XMVECTOR right = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
 	const static XMVECTOR up = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
 
 	XMVECTOR dT = XMVectorSet(deltaTime, deltaTime, deltaTime, 0.0f);
 
-	if (GetAsyncKeyState('W') & 0x8000)
+	if (IsKeyDown('W'))
 	{
 		m_Camera->Position += XMVectorMultiply(m_Camera->Forward, dT);
 	}
 
-	if (GetAsyncKeyState('S') & 0x8000)
+	if (IsKeyDown('S'))
 	{
 		m_Camera->Position -= XMVectorMultiply(m_Camera->Forward, dT);
 	}
 
-	if (GetAsyncKeyState('D') & 0x8000)
+	if (IsKeyDown('D'))
 	{
 		m_Camera->Position += XMVectorMultiply(XMVector3Cross(m_Camera->Forward, up), dT);
 	}
 
-	if (GetAsyncKeyState('A') & 0x8000)
+	if (IsKeyDown('A'))
 	{
 		m_Camera->Position -= XMVectorMultiply(XMVector3Cross(m_Camera->Forward, up), dT);
 	}
 
-	if (GetAsyncKeyState('Q') & 0x8000)
+	if (IsKeyDown('Q'))
 	{
 		m_Camera->Position += XMVectorMultiply(up, dT);
 	}
 
-	if (GetAsyncKeyState('E') & 0x8000)
+	if (IsKeyDown('E'))
 	{
 		m_Camera->Position -= XMVectorMultiply(up, dT);
 	}
 
 	constexpr float rotateSpeed = 15.0f;
 
-	if (GetAsyncKeyState(VK_UP) & 0x8000)
+	if (IsKeyDown(KeyUp))
 	{
 		m_Camera->Pitch += deltaTime * rotateSpeed;
 		m_Camera->Pitch = std::min(m_Camera->Pitch, 89.0f);
 	}
 
-	if (GetAsyncKeyState(VK_DOWN) & 0x8000)
+	if (IsKeyDown(KeyDown))
 	{
 		m_Camera->Pitch -= deltaTime * rotateSpeed;
 		m_Camera->Pitch = std::max(m_Camera->Pitch, -89.0f);
 	}
 
-	if (GetAsyncKeyState(VK_LEFT) & 0x8000)
+	if (IsKeyDown(KeyLeft))
 	{
 		m_Camera->Yaw += deltaTime * rotateSpeed;
 	}
 
-	if (GetAsyncKeyState(VK_RIGHT) & 0x8000)
+	if (IsKeyDown(KeyRight))
 	{
 		m_Camera->Yaw -= deltaTime * rotateSpeed;
 	}
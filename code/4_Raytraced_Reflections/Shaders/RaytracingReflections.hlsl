@@ -1,11 +1,16 @@
 typedef BuiltInTriangleIntersectionAttributes MyAttributes;
 
 #include "Shared.hpp"
+#include "../../DXRCore/Shaders/SkySampling.hpp"
 
 struct RayPayload
 {
     float4 Color;
     uint Depth;
+
+    // Angle between the primary rays of neighbouring pixels, for the mip level of the sky. Reflected rays keep the
+    // one of their pixel, which is close enough for the sky.
+    float SpreadAngle;
 };
 
 struct RayPayloadShadow
@@ -13,19 +18,15 @@ struct RayPayloadShadow
     bool IsOccluded;
 };
 
-StructuredBuffer<hlsl:: Mesh> g_MeshData : register(t0);
 RaytracingAccelerationStructure g_Scene : register(t1);
 
-cbuffer Core : register(b0)
-{
-    float4x4 g_InverseViewProjection;
-    float3 g_CameraPosition;
-    uint g_UAV;
-    uint g_SkySRV;
-}
+ConstantBuffer<hlsl::Core> g_Core : register(b0);
 
 ConstantBuffer<hlsl:: DirectionalLight> g_Light : register(b1);
 
+// The mesh of the instance that was hit, from its hit group record
+ConstantBuffer<hlsl::Mesh> l_Mesh : register(b0, space1);
+
 SamplerState g_LinearSampler : register(s0);
 
 static const float INVPI = 0.31830988618379067153777f;
@@ -35,17 +36,17 @@ static const float PI = 3.14159265;
 RayDesc GetPrimaryRay(uint2 index)
 {
     RayDesc ray;
-    ray.Origin = g_CameraPosition;
+    ray.Origin = g_Core.CameraPosition;
 
     float2 screenPos = float2(index) + 0.5f.xx;
     screenPos = screenPos / (float2) DispatchRaysDimensions();
     screenPos = mad(screenPos, 2.0f, -1.0f);
     screenPos.y = -screenPos.y;
 
-    float4 world = mul(g_InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
+    float4 world = mul(g_Core.InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
     world.xyz /= world.w;
 
-    ray.Direction = normalize(world.xyz - g_CameraPosition);
+    ray.Direction = normalize(world.xyz - g_Core.CameraPosition);
     ray.TMin = 0.01f;
     ray.TMax = 100.0f;
     
@@ -55,11 +56,14 @@ RayDesc GetPrimaryRay(uint2 index)
 [shader("raygeneration")]
 void RayGenMain()
 {
-    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_UAV];
+    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_Core.UAV];
     
     RayDesc ray = GetPrimaryRay((uint2) DispatchRaysIndex());
     
-    RayPayload payload = { float4(0, 0, 0, 0), 0 };
+    // For angles this small the distance between the directions is the angle
+    float spreadAngle = length(GetPrimaryRay((uint2) DispatchRaysIndex() + uint2(1, 0)).Direction - ray.Direction);
+    
+    RayPayload payload = { float4(0, 0, 0, 0), 0, spreadAngle };
     TraceRay(g_Scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, ray, payload);
     
     RenderTarget[DispatchRaysIndex().xy] = payload.Color;
@@ -76,7 +80,7 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
     
     float3 barycentrics = float3(1 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
     
-    hlsl::Mesh mesh = g_MeshData[InstanceIndex()];
+    hlsl::Mesh mesh = l_Mesh;
     
     ByteAddressBuffer indexBuffer = ResourceDescriptorHeap[mesh.IndexIdx]; // this needs to be flexible with 16bit and 32bit. byteaddressbuffer would work here :)
     StructuredBuffer<float3> normalBuffer = ResourceDescriptorHeap[mesh.NormalIdx];
@@ -102,9 +106,9 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
     
     float shadowValue = shadowPayload.IsOccluded ? 0.0f : 1.0f;
     
-    RayPayload radiancePayload = { float4(0.0f.xxx, 1.0f), ++payload.Depth };
+    RayPayload radiancePayload = { float4(0.0f.xxx, 1.0f), ++payload.Depth, payload.SpreadAngle };
     
-    if (mesh.Reflectance > 0.001)
+    if (REFLECTIONS && mesh.Reflectance > 0.001)
     {
         // Note: We use the same closest hit and miss shaders as the regular pipeline
         RayDesc ray;
@@ -130,7 +134,7 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
 [shader("miss")]
 void MissMain(inout RayPayload payload)
 {
-    Texture2D<float4> sky = ResourceDescriptorHeap[g_SkySRV];
+    Texture2D<float4> sky = ResourceDescriptorHeap[g_Core.SkySRV];
     
     // Calculate the uvs 
     float3 rayDirection = WorldRayDirection();
@@ -141,7 +145,14 @@ void MissMain(inout RayPayload payload)
     float u = phi / (2 * PI);
     float v = 1.0 - (theta / PI);
     
-    payload.Color = float4(sky.SampleLevel(g_LinearSampler, float2(u, v), 0).rgb, 1.0f);
+    uint width;
+    uint height;
+    uint mipCount;
+    sky.GetDimensions(0, width, height, mipCount);
+    
+    float mipLevel = min(sky::GetSkyMipLevel(rayDirection, payload.SpreadAngle, width, height), mipCount - 1.0f);
+    
+    payload.Color = float4(sky.SampleLevel(g_LinearSampler, float2(u, v), mipLevel).rgb, 1.0f);
 }
 
 [shader("miss")]
@@ -16,14 +16,27 @@ using float4 = DirectX::XMFLOAT4;
 #define CONSTANT static const
 #endif
 
-CONSTANT uint MAX_RECURSION = 3;
+// Permutations compiled at runtime pass their own depth, see '-recursion-depth'
+#ifndef RECURSION_DEPTH
+#define RECURSION_DEPTH 3
+#endif
+
+// Without reflective instances in the scene, the reflection rays are compiled out
+#ifndef REFLECTIONS
+#define REFLECTIONS 1
+#endif
+
+CONSTANT uint MAX_RECURSION = RECURSION_DEPTH;
 
 namespace hlsl
 {
-	struct Camera
+	// The constants of a frame, bound as a root constant buffer view
+	struct Core
 	{
 		float4x4 InverseViewProjection;
-		float3 Position;
+		float3 CameraPosition;
+		uint UAV;
+		uint SkySRV;
 	};
 
 	struct Mesh
@@ -5,18 +5,24 @@
 #include <DXRCore/Renderer/Attributes/TLAS.hpp>
 #include <DXRCore/Renderer/Attributes/Mesh.hpp>
 #include <DXRCore/Renderer/Attributes/ProceduralPrimitive.hpp>
-#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
 #include <DXRCore/Renderer/Attributes/Texture.hpp>
 
 #include <DirectXMath.h>
 
+#if !defined(DXR_HEADLESS)
+#include <DXRCore/Renderer/Attributes/RaytracingPipeline.hpp>
+#include <DXRCore/Renderer/Attributes/ConstantAllocator.hpp>
+
 #if defined _DEBUG
 #include "Shaders/RaytracingIntersection_Debug.hpp"
 #else 
 #include "Shaders/RaytracingIntersection_Release.hpp"
 #endif
+#endif
 
-#include <DXRCore/Utils/Error.hpp>
+#include <DXRCore/Utils/CLI.hpp>
+
+#include <DXRCore/CPU/Backend.hpp>
 
 #include <Shaders/Shared.hpp>
 
@@ -28,13 +34,15 @@ class Intersection : public Renderer
 	{
 		Core,
 		Light,
-		GeometryData,
 		BVH,
 		Count
 	};
 
 	void InitializeSample() override;
+#if !defined(DXR_HEADLESS)
 	void RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList) override;
+#endif
+	void RenderSampleCPU(cpu::Backend& backend) override;
 
 	void Update(float deltaTime) override;
 private:
@@ -153,51 +161,36 @@ void Intersection::InitializeSample()
 	};
 
 	m_Mesh = new Mesh();
-	m_Mesh->SetPositionBuffer(_countof(positions), positions);
-	m_Mesh->SetNormalBuffer(_countof(normals), normals);
-	m_Mesh->SetIndexBuffer(_countof(indices), indices);
+	m_Mesh->SetPositionBuffer(std::size(positions), positions);
+	m_Mesh->SetNormalBuffer(std::size(normals), normals);
+	m_Mesh->SetIndexBuffer(std::size(indices), indices);
 	m_Mesh->BuildBLAS();
 
 	m_MeshInstance[0] = new MeshInstance();
 	m_MeshInstance[0]->SetMesh(m_Mesh);
 	m_MeshInstance[0]->SetColor({0.5f, 1.0f, 0.5f, 1.0f});
 	m_MeshInstance[0]->SetReflectanceCoefficient(0.0f);
-	m_MeshInstance[0]->Translation = XMFLOAT3(0.0f, 0.0f, 1.5f);
+	m_MeshInstance[0]->SetTranslation(XMFLOAT3(0.0f, 0.0f, 1.5f));
 
 	m_MeshInstance[1] = new MeshInstance();
 	m_MeshInstance[1]->SetMesh(m_Mesh);
 	m_MeshInstance[1]->SetColor({ 1.0f, 0.0f, 1.0f, 1.0f });
 	m_MeshInstance[1]->SetReflectanceCoefficient(0.1f);
-	m_MeshInstance[1]->Scale = XMFLOAT3(5.0f, 5.0f, 0.5f);
+	m_MeshInstance[1]->SetScale(XMFLOAT3(5.0f, 5.0f, 0.5f));
 
 	m_ProceduralPrimitive = new ProceduralPrimitive();
 
-	D3D12_RAYTRACING_AABB aabb = {};
-	aabb.MinX = 1.0f;
-	aabb.MinY = 1.0f;
-	aabb.MinZ = 1.0f;
-
-	aabb.MaxX = 2.0f;
-	aabb.MaxY = 2.0f;
-	aabb.MaxZ = 2.0f;
-
-	m_ProceduralPrimitive->AddEntry({ aabb, {} });
+	// One BLAS can hold any mix of primitives, the intersection shader reads the type from the entry
+	m_ProceduralPrimitive->AddEntry(ProceduralPrimitive::MakeEntry({ primitives::PRIMITIVE_SPHERE, { 1.5f, 1.5f, 1.5f }, { 0.5f, 0.0f, 0.0f, 0.0f } }));
+	m_ProceduralPrimitive->AddEntry(ProceduralPrimitive::MakeEntry({ primitives::PRIMITIVE_BOX, { -1.5f, 1.5f, 1.5f }, { 0.4f, 0.4f, 0.4f, 0.0f } }));
+	m_ProceduralPrimitive->AddEntry(ProceduralPrimitive::MakeEntry({ primitives::PRIMITIVE_CYLINDER, { 1.5f, -1.5f, 1.5f }, { 0.4f, 0.5f, 0.0f, 0.0f } }));
+	m_ProceduralPrimitive->AddEntry(ProceduralPrimitive::MakeEntry({ primitives::PRIMITIVE_CAPSULE, { -1.5f, -1.5f, 1.5f }, { 0.3f, 0.4f, 0.0f, 0.0f } }));
 	m_ProceduralPrimitive->SetHitGroupIndex(1);
 	m_ProceduralPrimitive->BuildBLAS();
 
 	m_ProceduralPrimitiveTorus = new ProceduralPrimitive();
-
-	aabb = {};
-	aabb.MinX = 2.0f;
-	aabb.MinY = 2.0f;
-	aabb.MinZ = 2.0f;
-
-	aabb.MaxX = 3.0f;
-	aabb.MaxY = 3.0f;
-	aabb.MaxZ = 3.0f;
-
-	m_ProceduralPrimitiveTorus->AddEntry({ aabb, {} });
-	m_ProceduralPrimitiveTorus->SetHitGroupIndex(2);
+	m_ProceduralPrimitiveTorus->AddEntry(ProceduralPrimitive::MakeEntry({ primitives::PRIMITIVE_TORUS, { 2.5f, 2.5f, 2.5f }, { 0.3f, 0.1f, 0.0f, 0.0f } }));
+	m_ProceduralPrimitiveTorus->SetHitGroupIndex(1);
 	m_ProceduralPrimitiveTorus->BuildBLAS();
 
 	m_ProceduralPrimitiveInstance = new ProceduralPrimitiveInstance();
@@ -211,13 +204,15 @@ void Intersection::InitializeSample()
 	m_TLAS->AddMesh(m_MeshInstance[1]);
 	m_TLAS->AddProceduralPrimitive(m_ProceduralPrimitiveInstance);
 	m_TLAS->AddProceduralPrimitive(m_ProceduralPrimitiveInstanceTorus);
+	// Every instance gets its own hit group record, which holds its mesh
+	m_TLAS->SetPerInstanceRecords(true);
 	m_TLAS->Build();
 
+#if !defined(DXR_HEADLESS)
 	RaytracingPipelineDesc desc = {};
 	desc.RayGenEntry.EntryName = L"RayGenMain";
 	desc.HitGroups.emplace_back(L"ClosestMain", L"", L"", L"HitGroup", D3D12_HIT_GROUP_TYPE_TRIANGLES);
-	desc.HitGroups.emplace_back(L"ClosestMainPrimitive", L"", L"IntersectionMainSphere", L"HitGroupPrimitive", D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE);
-	desc.HitGroups.emplace_back(L"ClosestMainPrimitive", L"", L"IntersectionMainTorus", L"HitGroupPrimitiveTorus", D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE);
+	desc.HitGroups.emplace_back(L"ClosestMainPrimitive", L"", L"IntersectionMain", L"HitGroupPrimitive", D3D12_HIT_GROUP_TYPE_PROCEDURAL_PRIMITIVE);
 	desc.MissShaders.emplace_back(L"MissMain");
 	desc.MissShaders.emplace_back(L"MissMainShadow");
 	desc.ShaderCode.pShaderBytecode = g_RaytracingIntersection;
@@ -226,27 +221,33 @@ void Intersection::InitializeSample()
 
 	// NOTE: we use a larger attribute size for the AABB intersection shader. we need to pass more data than just the barycentrics.
 	desc.AttributeSize = sizeof(float) * 3; 
-	desc.PayloadSize = sizeof(float) * 4 + sizeof(uint);
+	desc.PayloadSize = sizeof(float) * 4 + sizeof(uint) + sizeof(float);
 
 	CD3DX12_ROOT_PARAMETER params[Count] = {};
-	params[Core].InitAsConstants(53, 0);
-	params[Light].InitAsConstants(sizeof(hlsl::DirectionalLight) / sizeof(uint32_t), 1);
-	params[GeometryData].InitAsShaderResourceView(0);
+	params[Core].InitAsConstantBufferView(0);
+	params[Light].InitAsConstantBufferView(1);
 	params[BVH].InitAsShaderResourceView(1);
 
 	CD3DX12_STATIC_SAMPLER_DESC sampler(0, D3D12_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT);
 
 	desc.RootSignatureDesc = CD3DX12_ROOT_SIGNATURE_DESC(_countof(params), params, 1, &sampler, D3D12_ROOT_SIGNATURE_FLAG_CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED);
 
-	m_Pipeline = new RaytracingPipeline(desc);
+	// The closest hit shader reads the mesh from the local root constants instead of looking it up by the instance
+	CD3DX12_ROOT_PARAMETER localParams[1] = {};
+	localParams[0].InitAsConstants(sizeof(hlsl::Mesh) / sizeof(uint32_t), 0, 1);
 
-	m_Camera = static_cast<Intersection::Camera*>(_aligned_malloc(sizeof(Intersection::Camera), alignof(Intersection::Camera)));
+	desc.LocalRootSignatureDesc = CD3DX12_ROOT_SIGNATURE_DESC(_countof(localParams), localParams);
 
-	if (m_Camera == nullptr)
-	{
-		FatalError("Failed to allocate memory for the camera");
-		return;
-	}
+	// Permutations compiled at runtime leave out the reflection rays when nothing reflects, and the primitive types
+	// that are not in the scene
+	const bool reflections = m_MeshInstance[0]->GetReflectanceCoefficient() > 0.001f || m_MeshInstance[1]->GetReflectanceCoefficient() > 0.001f;
+	const uint32_t primitiveTypes = m_ProceduralPrimitive->GetPrimitiveTypes() | m_ProceduralPrimitiveTorus->GetPrimitiveTypes();
+
+	CreatePipeline(desc, "RaytracingIntersection.hlsl", { { "REFLECTIONS", reflections ? "1" : "0" }, { "PRIMITIVE_TYPES", std::to_string(primitiveTypes) } });
+	m_TLAS->WriteHitGroupRecords(*m_Pipeline);
+#endif
+
+	m_Camera = new Camera();
 
 	m_Camera->Position = XMVectorSet(0.0f, -7.0f, 6.0f, 1.0f);
 	m_Camera->Yaw = 90.0f;
@@ -260,33 +261,29 @@ void Intersection::InitializeSample()
 }
 
 
+#if !defined(DXR_HEADLESS)
 void Intersection::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
 {
 	cmdList->SetComputeRootSignature(m_Pipeline->GetRootSignature().Get());
 
-	cmdList->SetComputeRoot32BitConstants(Core, 16, &m_Camera->InverseViewProjection, 0);
-
-	auto transform = XMMatrixTranslation(2.5f, 2.5f, 2.5f);
-	auto transformInverse = XMMatrixInverse(nullptr, transform);
-
-	cmdList->SetComputeRoot32BitConstants(Core, 16, &transform, 16);
-	cmdList->SetComputeRoot32BitConstants(Core, 16, &transformInverse, 32);
-
-	cmdList->SetComputeRoot32BitConstants(Core, 3, &m_Camera->Position, 48);
+	hlsl::Core core;
+	XMStoreFloat4x4(&core.InverseViewProjection, m_Camera->InverseViewProjection);
+	XMStoreFloat3(&core.CameraPosition, m_Camera->Position);
+	core.UAV = m_UAV;
+	core.SkySRV = m_SkyDome->GetSRV();
 
-	cmdList->SetComputeRoot32BitConstant(Core, m_UAV, 51);
-	cmdList->SetComputeRoot32BitConstant(Core, m_SkyDome->GetSRV(), 52);
+	// Copied into the constants of the frame, which stay alive until the GPU is done with the frame
+	ConstantAllocator& constants = GetConstantAllocator();
 
-	cmdList->SetComputeRoot32BitConstants(Light, sizeof(hlsl::DirectionalLight) / sizeof(uint32_t), &m_DirectionalLight, 0);
-
-	cmdList->SetComputeRootShaderResourceView(GeometryData, m_TLAS->GetGeometryData());
+	cmdList->SetComputeRootConstantBufferView(Core, constants.Allocate(core));
+	cmdList->SetComputeRootConstantBufferView(Light, constants.Allocate(m_DirectionalLight));
 
 	cmdList->SetComputeRootShaderResourceView(BVH, m_TLAS->GetVirtualAddress());
 
 	D3D12_DISPATCH_RAYS_DESC dispatchDesc = {};
 	dispatchDesc.HitGroupTable.StartAddress = m_Pipeline->GetHitGroupTable()->GetGPUVirtualAddress();
 	dispatchDesc.HitGroupTable.SizeInBytes = m_Pipeline->GetHitGroupTable()->GetDesc().Width;
-	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
+	dispatchDesc.HitGroupTable.StrideInBytes = m_Pipeline->GetHitGroupStride();
 	dispatchDesc.MissShaderTable.StartAddress = m_Pipeline->GetMissTable()->GetGPUVirtualAddress();
 	dispatchDesc.MissShaderTable.SizeInBytes = m_Pipeline->GetMissTable()->GetDesc().Width;
 	dispatchDesc.MissShaderTable.StrideInBytes = m_Pipeline->GetShaderTableSize();
@@ -299,68 +296,88 @@ void Intersection::RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList
 	cmdList->SetPipelineState1(m_Pipeline->GetStateObject().Get());
 	cmdList->DispatchRays(&dispatchDesc);
 }
+#endif
+
+void Intersection::RenderSampleCPU(cpu::Backend& backend)
+{
+	cpu::FrameDesc frame = {};
+	XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(&frame.InverseViewProjection), m_Camera->InverseViewProjection);
+	XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(&frame.CameraPosition), m_Camera->Position);
+
+	frame.Light.Direction = { m_DirectionalLight.Direction.x, m_DirectionalLight.Direction.y, m_DirectionalLight.Direction.z };
+	frame.Light.Color = { m_DirectionalLight.Color.x, m_DirectionalLight.Color.y, m_DirectionalLight.Color.z };
+	frame.Light.Intensity = m_DirectionalLight.Intensity;
+
+	frame.Scene = &m_TLAS->GetCPUScene();
+	frame.Sky = &m_SkyDome->GetCPUImage();
+
+	if (GetCLI().SkyLight)
+	{
+		frame.SkyLight = &m_SkyDome->GetSkyDistribution();
+	}
+
+	backend.Render(frame);
+}
 
 void Intersection::Update(float deltaTime)
 {
 	static float time = deltaTime;
 	time += deltaTime;
 
-	const static XMVECTOR forward = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
-	const static XMVECTOR right = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
 	const static XMVECTOR up = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
 
 	XMVECTOR dT = XMVectorSet(deltaTime, deltaTime, deltaTime, 0.0f);
 
-	if (GetAsyncKeyState('W') & 0x8000)
+	if (IsKeyDown('W'))
 	{
 		m_Camera->Position += XMVectorMultiply(m_Camera->Forward, dT);
 	}
 
-	if (GetAsyncKeyState('S') & 0x8000)
+	if (IsKeyDown('S'))
 	{
 		m_Camera->Position -= XMVectorMultiply(m_Camera->Forward, dT);
 	}
 
-	if (GetAsyncKeyState('D') & 0x8000)
+	if (IsKeyDown('D'))
 	{
 		m_Camera->Position += XMVectorMultiply(XMVector3Cross(m_Camera->Forward, up), dT);
 	}
 
-	if (GetAsyncKeyState('A') & 0x8000)
+	if (IsKeyDown('A'))
 	{
 		m_Camera->Position -= XMVectorMultiply(XMVector3Cross(m_Camera->Forward, up), dT);
 	}
 
-	if (GetAsyncKeyState('Q') & 0x8000)
+	if (IsKeyDown('Q'))
 	{
 		m_Camera->Position += XMVectorMultiply(up, dT);
 	}
 
-	if (GetAsyncKeyState('E') & 0x8000)
+	if (IsKeyDown('E'))
 	{
 		m_Camera->Position -= XMVectorMultiply(up, dT);
 	}
 
 	constexpr float rotateSpeed = 15.0f;
 
-	if (GetAsyncKeyState(VK_UP) & 0x8000)
+	if (IsKeyDown(KeyUp))
 	{
 		m_Camera->Pitch += deltaTime * rotateSpeed;
 		m_Camera->Pitch = std::min(m_Camera->Pitch, 89.0f);
 	}
 
-	if (GetAsyncKeyState(VK_DOWN) & 0x8000)
+	if (IsKeyDown(KeyDown))
 	{
 		m_Camera->Pitch -= deltaTime * rotateSpeed;
 		m_Camera->Pitch = std::max(m_Camera->Pitch, -89.0f);
 	}
 
-	if (GetAsyncKeyState(VK_LEFT) & 0x8000)
+	if (IsKeyDown(KeyLeft))
 	{
 		m_Camera->Yaw += deltaTime * rotateSpeed;
 	}
 
-	if (GetAsyncKeyState(VK_RIGHT) & 0x8000)
+	if (IsKeyDown(KeyRight))
 	{
 		m_Camera->Yaw -= deltaTime * rotateSpeed;
 	}
@@ -1,6 +1,8 @@
 typedef BuiltInTriangleIntersectionAttributes MyAttributes;
 
 #include "Shared.hpp"
+#include "../../DXRCore/Shaders/SkySampling.hpp"
+#include "../../DXRCore/Shaders/Primitives.hpp"
 
 struct MyPrimitiveAttributes
 {
@@ -11,6 +13,10 @@ struct RayPayload
 {
     float4 Color;
     uint Depth;
+
+    // Angle between the primary rays of neighbouring pixels, for the mip level of the sky. Reflected rays keep the
+    // one of their pixel, which is close enough for the sky.
+    float SpreadAngle;
 };
 
 struct RayPayloadShadow
@@ -18,21 +24,15 @@ struct RayPayloadShadow
     bool IsOccluded;
 };
 
-StructuredBuffer<hlsl:: Mesh> g_MeshData : register(t0);
 RaytracingAccelerationStructure g_Scene : register(t1);
 
-cbuffer Core : register(b0)
-{
-    float4x4 g_InverseViewProjection;
-    float4x4 g_Transform;
-    float4x4 g_TransformInverse;
-    float3 g_CameraPosition;
-    uint g_UAV;
-    uint g_SkySRV;
-}
+ConstantBuffer<hlsl::Core> g_Core : register(b0);
 
 ConstantBuffer<hlsl:: DirectionalLight> g_Light : register(b1);
 
+// The mesh of the instance that was hit, from its hit group record
+ConstantBuffer<hlsl::Mesh> l_Mesh : register(b0, space1);
+
 SamplerState g_LinearSampler : register(s0);
 
 static const float INVPI = 0.31830988618379067153777f;
@@ -42,17 +42,17 @@ static const float PI = 3.14159265;
 RayDesc GetPrimaryRay(uint2 index)
 {
     RayDesc ray;
-    ray.Origin = g_CameraPosition;
+    ray.Origin = g_Core.CameraPosition;
 
     float2 screenPos = float2(index) + 0.5f.xx;
     screenPos = screenPos / (float2) DispatchRaysDimensions();
     screenPos = mad(screenPos, 2.0f, -1.0f);
     screenPos.y = -screenPos.y;
 
-    float4 world = mul(g_InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
+    float4 world = mul(g_Core.InverseViewProjection, float4(screenPos, 0.0f, 1.0f));
     world.xyz /= world.w;
 
-    ray.Direction = normalize(world.xyz - g_CameraPosition);
+    ray.Direction = normalize(world.xyz - g_Core.CameraPosition);
     ray.TMin = 0.01f;
     ray.TMax = 100.0f;
     
@@ -62,11 +62,14 @@ RayDesc GetPrimaryRay(uint2 index)
 [shader("raygeneration")]
 void RayGenMain()
 {
-    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_UAV];
+    RWTexture2D<float4> RenderTarget = ResourceDescriptorHeap[g_Core.UAV];
     
     RayDesc ray = GetPrimaryRay((uint2) DispatchRaysIndex());
     
-    RayPayload payload = { float4(0, 0, 0, 0), 0 };
+    // For angles this small the distance between the directions is the angle
+    float spreadAngle = length(GetPrimaryRay((uint2) DispatchRaysIndex() + uint2(1, 0)).Direction - ray.Direction);
+    
+    RayPayload payload = { float4(0, 0, 0, 0), 0, spreadAngle };
     TraceRay(g_Scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, ray, payload);
     
     RenderTarget[DispatchRaysIndex().xy] = payload.Color;
@@ -83,7 +86,7 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
     
     float3 barycentrics = float3(1 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
     
-    hlsl::Mesh mesh = g_MeshData[InstanceIndex()];
+    hlsl::Mesh mesh = l_Mesh;
     
     ByteAddressBuffer indexBuffer = ResourceDescriptorHeap[mesh.IndexIdx]; // this needs to be flexible with 16bit and 32bit. byteaddressbuffer would work here :)
     StructuredBuffer<float3> normalBuffer = ResourceDescriptorHeap[mesh.NormalIdx];
@@ -109,9 +112,9 @@ void ClosestMain(inout RayPayload payload, in MyAttributes attr)
     
     float shadowValue = shadowPayload.IsOccluded ? 0.0f : 1.0f;
     
-    RayPayload radiancePayload = { float4(0.0f.xxx, 1.0f), ++payload.Depth };
+    RayPayload radiancePayload = { float4(0.0f.xxx, 1.0f), ++payload.Depth, payload.SpreadAngle };
     
-    if (mesh.Reflectance > 0.001)
+    if (REFLECTIONS && mesh.Reflectance > 0.001)
     {
         // Note: We use the same closest hit and miss shaders as the regular pipeline
         RayDesc ray;
@@ -143,7 +146,7 @@ void ClosestMainPrimitive(inout RayPayload payload, in MyPrimitiveAttributes att
 [shader("miss")]
 void MissMain(inout RayPayload payload)
 {
-    Texture2D<float4> sky = ResourceDescriptorHeap[g_SkySRV];
+    Texture2D<float4> sky = ResourceDescriptorHeap[g_Core.SkySRV];
     
     // Calculate the uvs 
     float3 rayDirection = WorldRayDirection();
@@ -154,7 +157,14 @@ void MissMain(inout RayPayload payload)
     float u = phi / (2 * PI);
     float v = 1.0 - (theta / PI);
     
-    payload.Color = float4(sky.SampleLevel(g_LinearSampler, float2(u, v), 0).rgb, 1.0f);
+    uint width;
+    uint height;
+    uint mipCount;
+    sky.GetDimensions(0, width, height, mipCount);
+    
+    float mipLevel = min(sky::GetSkyMipLevel(rayDirection, payload.SpreadAngle, width, height), mipCount - 1.0f);
+    
+    payload.Color = float4(sky.SampleLevel(g_LinearSampler, float2(u, v), mipLevel).rgb, 1.0f);
 }
 
 [shader("miss")]
@@ -164,125 +174,21 @@ void MissMainShadow(inout RayPayloadShadow payload)
 }
 
 [shader("intersection")]
-void IntersectionMainSphere()
+void IntersectionMain()
 {
-    // https://raytracing.github.io/books/RayTracingInOneWeekend.html#addingasphere/ray-sphereintersection
+    // The BLAS of the instance stores its entries in a structured buffer, InstanceID() is its descriptor
+    StructuredBuffer<primitives::PrimitiveEntry> entries = ResourceDescriptorHeap[InstanceID()];
+    primitives::Primitive primitive = entries[PrimitiveIndex()].Primitive;
     
-    float3 oc = 1.5f.xxx - WorldRayOrigin();
-    float a = dot(WorldRayDirection(), WorldRayDirection());
-    float h = dot(WorldRayDirection(), oc);
-    float c = dot(oc, oc) - 0.5f * 0.5f; // radius
-    float discriminant = h * h - a * c;
-
-    if (discriminant >= 0.0f)
+    float t;
+    if (primitives::IntersectPrimitive(primitive, ObjectRayOrigin(), ObjectRayDirection(), RayTMin(), RayTCurrent(), t))
     {
-        MyPrimitiveAttributes attr;
-        attr.Color = 1.0f.xxx;
-        
-        float t = (h - sqrt(discriminant)) / a;
-        float3 normal = normalize((WorldRayDirection() * t + WorldRayOrigin()) - 1.5f.xxx);
+        float3 normal = primitives::GetPrimitiveNormal(primitive, ObjectRayOrigin() + ObjectRayDirection() * t);
+        normal = normalize(mul(normal, (float3x3) WorldToObject3x4()));
         
+        MyPrimitiveAttributes attr;
         attr.Color = mad(normal, 0.5, 0.5);
         
         ReportHit(t, 0, attr);
     }
 }
-
-[shader("intersection")]
-void IntersectionMainTorus()
-{
-    float3 ro = mul(g_TransformInverse, float4(ObjectRayOrigin(), 1.0f)).xyz;
-    float3 rd = mul(g_TransformInverse, float4(ObjectRayDirection(), 0.0f)).xyz;
-    
-    float2 tor = float2(0.3f, 0.1f);
-    
-    float po = 1.0;
-    float Ra2 = tor.x * tor.x;
-    float ra2 = tor.y * tor.y;
-    float m = dot(ro, ro);
-    float n = dot(ro, rd);
-    float k = (m + Ra2 - ra2) / 2.0;
-    float k3 = n;
-    float k2 = n * n - Ra2 * dot(rd.xy, rd.xy) + k;
-    float k1 = n * k - Ra2 * dot(rd.xy, ro.xy);
-    float k0 = k * k - Ra2 * dot(ro.xy, ro.xy);
-    
-    if (abs(k3 * (k3 * k3 - k2) + k1) < 0.01)
-    {
-        po = -1.0;
-        float tmp = k1;
-        k1 = k3;
-        k3 = tmp;
-        k0 = 1.0 / k0;
-        k1 = k1 * k0;
-        k2 = k2 * k0;
-        k3 = k3 * k0;
-    }
-    
-    float c2 = k2 * 2.0 - 3.0 * k3 * k3;
-    float c1 = k3 * (k3 * k3 - k2) + k1;
-    float c0 = k3 * (k3 * (c2 + 2.0 * k2) - 8.0 * k1) + 4.0 * k0;
-    c2 /= 3.0;
-    c1 *= 2.0;
-    c0 /= 3.0;
-    float Q = c2 * c2 + c0;
-    float R = c2 * c2 * c2 - 3.0 * c2 * c0 + c1 * c1;
-    float h = R * R - Q * Q * Q;
-    
-    if (h >= 0.0)
-    {
-        MyPrimitiveAttributes attr;
-        attr.Color = 1.0f.xxx;
-        
-        h = sqrt(h);
-        float v = sign(R + h) * pow(abs(R + h), 1.0 / 3.0); // cube root
-        float u = sign(R - h) * pow(abs(R - h), 1.0 / 3.0); // cube root
-        float2 s = float2((v + u) + 4.0 * c2, (v - u) * sqrt(3.0));
-        float y = sqrt(0.5 * (length(s) + s.x));
-        float x = 0.5 * s.y / y;
-        float r = 2.0 * c1 / (x * x + y * y);
-        float t1 = x - r - k3;
-        t1 = (po < 0.0) ? 2.0 / t1 : t1;
-        float t2 = -x - r - k3;
-        t2 = (po < 0.0) ? 2.0 / t2 : t2;
-        float t = 1e20;
-        if (t1 > 0.0)
-            t = t1;
-        if (t2 > 0.0)
-            t = min(t, t2);
-        
-        ReportHit(t, 0, attr);
-    }
-    
-    float sQ = sqrt(Q);
-    float w = sQ * cos(acos(-R / (sQ * Q)) / 3.0);
-    float d2 = -(w + c2);
-    if (d2 > 0.0)
-    {
-        MyPrimitiveAttributes attr;
-        attr.Color = 1.0f.xxx;
-        
-        float d1 = sqrt(d2);
-        float h1 = sqrt(w - 2.0 * c2 + c1 / d1);
-        float h2 = sqrt(w - 2.0 * c2 - c1 / d1);
-        float t1 = -d1 - h1 - k3;
-        t1 = (po < 0.0) ? 2.0 / t1 : t1;
-        float t2 = -d1 + h1 - k3;
-        t2 = (po < 0.0) ? 2.0 / t2 : t2;
-        float t3 = d1 - h2 - k3;
-        t3 = (po < 0.0) ? 2.0 / t3 : t3;
-        float t4 = d1 + h2 - k3;
-        t4 = (po < 0.0) ? 2.0 / t4 : t4;
-        float t = 1e20;
-        if (t1 > 0.0)
-            t = t1;
-        if (t2 > 0.0)
-            t = min(t, t2);
-        if (t3 > 0.0)
-            t = min(t, t3);
-        if (t4 > 0.0)
-            t = min(t, t4);
-        
-        ReportHit(t, 0, attr);
-    }
-}
\ No newline at end of file
@@ -7,9 +7,15 @@
 
 #include <vector>
 
+#include <algorithm>
+#include <iterator>
+
+// Headless builds run on the CPU backend only, see Renderer
+#if !defined(DXR_HEADLESS)
 #include <d3d12.h>
 #include <dxgi1_6.h>
 
 #include <d3dx12/d3dx12.h>
 
-#include <wrl/client.h>
\ No newline at end of file
+#include <wrl/client.h>
+#endif
\ No newline at end of file
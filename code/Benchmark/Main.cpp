@@ -0,0 +1,23 @@
+#include <DXRCore/Utils/CLI.hpp>
+#include <DXRCore/CPU/Benchmark.hpp>
+
+// Runs the CPU benchmarks without a window or a device, on any platform. Takes the same '-benchmark-*' arguments as
+// the samples.
+int main(int argc, char** argv)
+{
+	ParseCLI(argc, argv);
+
+	cpu::BenchmarkDesc desc = {};
+
+	if (GetCLI().BenchmarkTriangleCount != 0)
+	{
+		desc.TriangleCount = GetCLI().BenchmarkTriangleCount;
+	}
+
+	if (GetCLI().BenchmarkPrimitiveCount != 0)
+	{
+		desc.PrimitiveCount = GetCLI().BenchmarkPrimitiveCount;
+	}
+
+	return cpu::RunBenchmarks(desc) ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include "Accumulator.hpp"
+#include "ThreadPool.hpp"
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint64_t PixelGrainSize = 4096;
+
+		float RadicalInverse(uint32_t index, uint32_t base)
+		{
+			const float invBase = 1.0f / static_cast<float>(base);
+
+			float result = 0.0f;
+			float fraction = invBase;
+
+			while (index > 0)
+			{
+				result += static_cast<float>(index % base) * fraction;
+				index /= base;
+				fraction *= invBase;
+			}
+
+			return result;
+		}
+
+		float GetLuminance(const Float4& color)
+		{
+			return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+		}
+	}
+
+	Accumulator::Accumulator(ThreadPool& threadPool)
+		: m_ThreadPool(threadPool)
+	{
+	}
+
+	void Accumulator::Resize(uint32_t width, uint32_t height)
+	{
+		const size_t pixelCount = static_cast<size_t>(width) * height;
+
+		m_Sum.resize(pixelCount);
+		m_LuminanceSum.resize(pixelCount);
+		m_LuminanceSquaredSum.resize(pixelCount);
+
+		Reset();
+	}
+
+	void Accumulator::Reset()
+	{
+		// The sums are overwritten by the first sample, so there is nothing to clear
+		m_Statistics = {};
+		m_Start = std::chrono::steady_clock::now();
+	}
+
+	Float2 Accumulator::GetSampleOffset() const
+	{
+		if (m_Statistics.SampleCount == 0)
+		{
+			return { 0.5f, 0.5f };
+		}
+
+		return { RadicalInverse(m_Statistics.SampleCount, 2), RadicalInverse(m_Statistics.SampleCount, 3) };
+	}
+
+	void Accumulator::Add(Image& frame)
+	{
+		const uint32_t sampleCount = ++m_Statistics.SampleCount;
+		const bool first = sampleCount == 1;
+		const float invSampleCount = 1.0f / static_cast<float>(sampleCount);
+
+		// Unbiased variance of the samples, divided by the sample count to get the variance of their mean
+		const float varianceScale = sampleCount > 1 ? 1.0f / (static_cast<float>(sampleCount) * static_cast<float>(sampleCount - 1)) : 0.0f;
+
+		std::vector<uint32_t> convergedPixelCounts(m_ThreadPool.GetThreadCount(), 0);
+		std::vector<float> maxVariances(m_ThreadPool.GetThreadCount(), 0.0f);
+
+		Float4* pixels = frame.GetData();
+
+		m_ThreadPool.ParallelFor(m_Sum.size(), PixelGrainSize, [&](uint64_t begin, uint64_t end, uint32_t threadIndex)
+			{
+				uint32_t convergedPixelCount = 0;
+				float maxVariance = 0.0f;
+
+				for (uint64_t i = begin; i < end; i++)
+				{
+					Float4& pixel = pixels[i];
+					const Float3 color(pixel.x, pixel.y, pixel.z);
+					const float luminance = GetLuminance(pixel);
+
+					if (first)
+					{
+						m_Sum[i] = color;
+						m_LuminanceSum[i] = luminance;
+						m_LuminanceSquaredSum[i] = luminance * luminance;
+					}
+					else
+					{
+						m_Sum[i] += color;
+						m_LuminanceSum[i] += luminance;
+						m_LuminanceSquaredSum[i] += luminance * luminance;
+					}
+
+					const float mean = m_LuminanceSum[i] * invSampleCount;
+					const float variance = std::max(m_LuminanceSquaredSum[i] - m_LuminanceSum[i] * mean, 0.0f) * varianceScale;
+
+					convergedPixelCount += variance <= m_Desc.VarianceTarget ? 1 : 0;
+					maxVariance = std::max(maxVariance, variance);
+
+					const Float3 average = m_Sum[i] * invSampleCount;
+					pixel = { average.x, average.y, average.z, 1.0f };
+				}
+
+				convergedPixelCounts[threadIndex] += convergedPixelCount;
+				maxVariances[threadIndex] = std::max(maxVariances[threadIndex], maxVariance);
+			});
+
+		m_Statistics.ConvergedPixelCount = 0;
+		m_Statistics.MaxVariance = 0.0f;
+
+		for (uint32_t i = 0; i < m_ThreadPool.GetThreadCount(); i++)
+		{
+			m_Statistics.ConvergedPixelCount += convergedPixelCounts[i];
+			m_Statistics.MaxVariance = std::max(m_Statistics.MaxVariance, maxVariances[i]);
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_Start;
+		m_Statistics.Time = elapsed.count();
+
+		const bool varianceReached = m_Desc.VarianceTarget > 0.0f && sampleCount >= m_Desc.MinSampleCount &&
+			m_Statistics.ConvergedPixelCount == m_Sum.size();
+		const bool timeReached = m_Desc.TimeBudget > 0.0 && m_Statistics.Time >= m_Desc.TimeBudget;
+
+		m_Statistics.Converged = varianceReached || timeReached || sampleCount >= m_Desc.MaxSampleCount;
+	}
+}
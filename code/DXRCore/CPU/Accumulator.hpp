@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <chrono>
+#include <vector>
+
+namespace cpu
+{
+	class ThreadPool;
+
+	struct AccumulationDesc
+	{
+		// Accumulation stops once the variance of the mean luminance of every pixel is below this. 0 disables the check.
+		float VarianceTarget = 1.0e-4f;
+
+		// Accumulation stops after this many seconds of wall-clock time. 0 means that there is no limit.
+		double TimeBudget = 0.0;
+
+		// Samples per pixel before the variance estimate is trusted, and the most samples per pixel
+		uint32_t MinSampleCount = 8;
+		uint32_t MaxSampleCount = 4096;
+	};
+
+	struct AccumulationStatistics
+	{
+		uint32_t SampleCount = 0;
+
+		// Pixels of which the variance of the mean is below the target, and the largest variance of the mean
+		uint32_t ConvergedPixelCount = 0;
+		float MaxVariance = 0.0f;
+
+		// Wall-clock time since the last reset
+		double Time = 0.0;
+
+		bool Converged = false;
+	};
+
+	// Running average of the frames of a static scene. Every frame is one sample per pixel at a different position
+	// inside the pixel. Next to the sum of the colors it keeps the sum and the squared sum of the luminance, which
+	// give the variance of the mean per pixel to decide when the image has converged.
+	class Accumulator
+	{
+	public:
+		explicit Accumulator(ThreadPool& threadPool);
+
+		void SetDesc(const AccumulationDesc& desc)
+		{
+			m_Desc = desc;
+		}
+
+		const AccumulationDesc& GetDesc() const
+		{
+			return m_Desc;
+		}
+
+		// Resizing throws the samples away as well. The time budget starts at the reset, so reset right before the
+		// first sample.
+		void Resize(uint32_t width, uint32_t height);
+		void Reset();
+
+		// Position inside the pixel of the next sample. The first sample is the center of the pixel, like the shaders,
+		// the rest follow the Halton (2, 3) sequence.
+		Float2 GetSampleOffset() const;
+
+		// Adds the frame as the next sample, and replaces it with the average of all samples so far
+		void Add(Image& frame);
+
+		bool IsConverged() const
+		{
+			return m_Statistics.Converged;
+		}
+
+		const AccumulationStatistics& GetStatistics() const
+		{
+			return m_Statistics;
+		}
+
+	private:
+		ThreadPool& m_ThreadPool;
+
+		AccumulationDesc m_Desc;
+		AccumulationStatistics m_Statistics;
+
+		std::vector<Float3> m_Sum;
+		std::vector<float> m_LuminanceSum;
+		std::vector<float> m_LuminanceSquaredSum;
+
+		std::chrono::steady_clock::time_point m_Start;
+	};
+}
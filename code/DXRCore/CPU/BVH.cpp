@@ -0,0 +1,532 @@
+#include "BVH.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint32_t BinCount = 16;
+		constexpr uint32_t MaxLeafSize = 8;
+
+		// Nodes with fewer primitives than this are binned by a single thread
+		constexpr uint32_t ParallelBinThreshold = 64 * 1024;
+
+		// The top levels stop being split once there are this many subtrees per thread, or the subtrees get this small
+		constexpr uint32_t SubtreesPerThread = 4;
+		constexpr uint32_t MinSubtreeSize = 4 * 1024;
+
+		struct Bin
+		{
+			AABB Bounds;
+			uint32_t Count = 0;
+		};
+
+		struct Bins
+		{
+			Bin Axis[3][BinCount];
+
+			void Merge(const Bins& other)
+			{
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					for (uint32_t i = 0; i < BinCount; i++)
+					{
+						Axis[axis][i].Bounds.Grow(other.Axis[axis][i].Bounds);
+						Axis[axis][i].Count += other.Axis[axis][i].Count;
+					}
+				}
+			}
+		};
+
+		struct Split
+		{
+			uint32_t Axis = 0;
+			uint32_t Bin = 0;
+			float Cost = FloatMax;
+
+			AABB LeftBounds;
+			AABB RightBounds;
+		};
+
+		// Maps centroids to bins. The partition step uses the same mapping, so both always agree on the side of a primitive.
+		struct BinMapping
+		{
+			Float3 Min;
+			Float3 Scale;
+
+			explicit BinMapping(const AABB& centroidBounds)
+				: Min(centroidBounds.Min)
+			{
+				const Float3 extent = centroidBounds.Extent();
+
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					Scale[axis] = extent[axis] > 0.0f ? static_cast<float>(BinCount) / extent[axis] : 0.0f;
+				}
+			}
+
+			uint32_t operator()(const Float3& centroid, uint32_t axis) const
+			{
+				const int32_t bin = static_cast<int32_t>((centroid[axis] - Min[axis]) * Scale[axis]);
+				return static_cast<uint32_t>(std::min(std::max(bin, 0), static_cast<int32_t>(BinCount - 1)));
+			}
+		};
+	}
+
+	// The builder partitions copies of the primitive bounds instead of indices, so every pass reads memory in order
+	struct PrimitiveReference
+	{
+		AABB Bounds;
+		Float3 Centroid;
+		uint32_t Index;
+	};
+
+	// Work item of the builder: a node that still has to be split, with the bounds of the centroids of its primitives
+	struct BuildTask
+	{
+		uint32_t NodeIndex;
+		uint32_t Depth;
+		AABB CentroidBounds;
+	};
+
+	class BVHBuilder
+	{
+	public:
+		BVHBuilder(BVH& bvh, const AABB* primitiveBounds, ThreadPool& threadPool)
+			: m_BVH(bvh)
+			, m_PrimitiveBounds(primitiveBounds)
+			, m_ThreadPool(threadPool)
+		{
+		}
+
+		void Build(uint32_t count)
+		{
+			m_References.resize(count);
+
+			const uint32_t threadCount = m_ThreadPool.GetThreadCount();
+			std::vector<AABB> bounds(threadCount);
+			std::vector<AABB> centroidBounds(threadCount);
+
+			m_ThreadPool.ParallelFor(count, ParallelBinThreshold, [&](uint64_t begin, uint64_t end, uint32_t threadIndex)
+				{
+					for (uint32_t i = static_cast<uint32_t>(begin); i < static_cast<uint32_t>(end); i++)
+					{
+						PrimitiveReference& reference = m_References[i];
+						reference.Bounds = m_PrimitiveBounds[i];
+						reference.Centroid = reference.Bounds.Center();
+						reference.Index = i;
+
+						bounds[threadIndex].Grow(reference.Bounds);
+						centroidBounds[threadIndex].Grow(reference.Centroid);
+					}
+				});
+
+			BVHNode root = {};
+			root.LeftFirst = 0;
+			root.Count = count;
+
+			BuildTask rootTask = {};
+			rootTask.NodeIndex = 0;
+
+			for (uint32_t i = 0; i < threadCount; i++)
+			{
+				root.Bounds.Grow(bounds[i]);
+				rootTask.CentroidBounds.Grow(centroidBounds[i]);
+			}
+
+			std::vector<BVHNode>& nodes = m_BVH.m_Nodes;
+			nodes.reserve(static_cast<size_t>(count) * 2);
+			nodes.push_back(root);
+
+			// Split the top levels one node at the time, largest first, with every thread helping to bin the node
+			std::vector<BuildTask> tasks = { rootTask };
+			const size_t taskTarget = static_cast<size_t>(threadCount) * SubtreesPerThread;
+
+			while (tasks.size() < taskTarget)
+			{
+				auto largest = std::max_element(tasks.begin(), tasks.end(), [&nodes](const BuildTask& a, const BuildTask& b)
+					{
+						return nodes[a.NodeIndex].Count < nodes[b.NodeIndex].Count;
+					});
+
+				if (largest == tasks.end() || nodes[largest->NodeIndex].Count < MinSubtreeSize)
+				{
+					break;
+				}
+
+				const BuildTask task = *largest;
+				*largest = tasks.back();
+				tasks.pop_back();
+
+				BuildTask children[2];
+				if (SplitNode(nodes, task, true, children))
+				{
+					tasks.push_back(children[0]);
+					tasks.push_back(children[1]);
+				}
+			}
+
+			// Build the remaining subtrees in parallel, each into its own node array
+			std::vector<std::vector<BVHNode>> subtrees(tasks.size());
+
+			m_ThreadPool.ParallelFor(tasks.size(), 1, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint64_t i = begin; i < end; i++)
+					{
+						std::vector<BVHNode>& subtree = subtrees[i];
+						subtree.reserve(static_cast<size_t>(nodes[tasks[i].NodeIndex].Count) * 2);
+						subtree.push_back(nodes[tasks[i].NodeIndex]);
+
+						BuildTask task = tasks[i];
+						task.NodeIndex = 0;
+
+						BuildRecursive(subtree, task);
+					}
+				});
+
+			// Append the subtrees. Their root replaces the node of the task, the other nodes move to the back of the array.
+			for (size_t i = 0; i < tasks.size(); i++)
+			{
+				const std::vector<BVHNode>& subtree = subtrees[i];
+				const uint32_t offset = static_cast<uint32_t>(nodes.size()) - 1;
+
+				for (size_t j = 0; j < subtree.size(); j++)
+				{
+					BVHNode node = subtree[j];
+
+					if (!node.IsLeaf())
+					{
+						node.LeftFirst += offset;
+					}
+
+					if (j == 0)
+					{
+						nodes[tasks[i].NodeIndex] = node;
+					}
+					else
+					{
+						nodes.push_back(node);
+					}
+				}
+			}
+
+			std::vector<uint32_t>& indices = m_BVH.m_Indices;
+			indices.resize(count);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				indices[i] = m_References[i].Index;
+			}
+		}
+
+	private:
+		void BuildRecursive(std::vector<BVHNode>& nodes, const BuildTask& task)
+		{
+			BuildTask children[2];
+
+			if (SplitNode(nodes, task, false, children))
+			{
+				BuildRecursive(nodes, children[0]);
+				BuildRecursive(nodes, children[1]);
+			}
+		}
+
+		// Splits a node in two when the surface area heuristic says it is worth it. The children are appended to nodes
+		// and returned as new tasks.
+		bool SplitNode(std::vector<BVHNode>& nodes, const BuildTask& task, bool parallel, BuildTask children[2])
+		{
+			const BVHNode node = nodes[task.NodeIndex];
+
+			if (node.Count <= 1 || task.Depth + 2 >= BVH::MaxDepth)
+			{
+				return false;
+			}
+
+			const uint32_t first = node.LeftFirst;
+			const uint32_t count = node.Count;
+			PrimitiveReference* references = m_References.data();
+
+			const BinMapping mapping(task.CentroidBounds);
+			const Bins bins = parallel && count >= ParallelBinThreshold ? BinParallel(first, count, mapping) : BinRange(first, count, mapping);
+
+			Split split;
+			FindBestSplit(bins, split);
+
+			const float area = node.Bounds.HalfArea();
+			const float leafCost = BVH::IntersectionCost * static_cast<float>(count);
+			const float splitCost = area > 0.0f ? BVH::TraversalCost + BVH::IntersectionCost * split.Cost / area : leafCost;
+
+			uint32_t leftCount = 0;
+
+			if (split.Cost != FloatMax)
+			{
+				if (splitCost >= leafCost && count <= MaxLeafSize)
+				{
+					return false;
+				}
+
+				PrimitiveReference* middle = std::partition(references + first, references + first + count, [&](const PrimitiveReference& reference)
+					{
+						return mapping(reference.Centroid, split.Axis) < split.Bin;
+					});
+
+				leftCount = static_cast<uint32_t>(middle - (references + first));
+			}
+			else
+			{
+				// Every centroid is in the same spot, so no plane separates them. Split big leaves in half anyway.
+				if (count <= MaxLeafSize)
+				{
+					return false;
+				}
+
+				leftCount = count / 2;
+
+				split.LeftBounds = ComputeBounds(first, leftCount);
+				split.RightBounds = ComputeBounds(first + leftCount, count - leftCount);
+			}
+
+			children[0] = { 0, task.Depth + 1, ComputeCentroidBounds(first, leftCount) };
+			children[1] = { 0, task.Depth + 1, ComputeCentroidBounds(first + leftCount, count - leftCount) };
+
+			const uint32_t childIndex = static_cast<uint32_t>(nodes.size());
+
+			BVHNode left = {};
+			left.Bounds = split.LeftBounds;
+			left.LeftFirst = first;
+			left.Count = leftCount;
+
+			BVHNode right = {};
+			right.Bounds = split.RightBounds;
+			right.LeftFirst = first + leftCount;
+			right.Count = count - leftCount;
+
+			nodes[task.NodeIndex].LeftFirst = childIndex;
+			nodes[task.NodeIndex].Count = 0;
+
+			nodes.push_back(left);
+			nodes.push_back(right);
+
+			children[0].NodeIndex = childIndex;
+			children[1].NodeIndex = childIndex + 1;
+
+			return true;
+		}
+
+		Bins BinRange(uint32_t first, uint32_t count, const BinMapping& mapping) const
+		{
+			Bins bins;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const PrimitiveReference& reference = m_References[i];
+
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					Bin& bin = bins.Axis[axis][mapping(reference.Centroid, axis)];
+					bin.Bounds.Grow(reference.Bounds);
+					bin.Count++;
+				}
+			}
+
+			return bins;
+		}
+
+		Bins BinParallel(uint32_t first, uint32_t count, const BinMapping& mapping)
+		{
+			std::vector<Bins> threadBins(m_ThreadPool.GetThreadCount());
+
+			m_ThreadPool.ParallelFor(count, ParallelBinThreshold / 4, [&](uint64_t begin, uint64_t end, uint32_t threadIndex)
+				{
+					threadBins[threadIndex].Merge(BinRange(first + static_cast<uint32_t>(begin), static_cast<uint32_t>(end - begin), mapping));
+				});
+
+			for (size_t i = 1; i < threadBins.size(); i++)
+			{
+				threadBins[0].Merge(threadBins[i]);
+			}
+
+			return threadBins[0];
+		}
+
+		// Sweeps over the bins of every axis and picks the plane with the lowest area weighted primitive count
+		static void FindBestSplit(const Bins& bins, Split& split)
+		{
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const Bin* axisBins = bins.Axis[axis];
+
+				float rightCost[BinCount];
+				AABB rightBounds;
+				uint32_t rightCount = 0;
+
+				for (uint32_t i = BinCount - 1; i > 0; i--)
+				{
+					rightBounds.Grow(axisBins[i].Bounds);
+					rightCount += axisBins[i].Count;
+					rightCost[i] = rightCount == 0 ? FloatMax : rightBounds.HalfArea() * static_cast<float>(rightCount);
+				}
+
+				AABB leftBounds;
+				uint32_t leftCount = 0;
+
+				for (uint32_t i = 1; i < BinCount; i++)
+				{
+					leftBounds.Grow(axisBins[i - 1].Bounds);
+					leftCount += axisBins[i - 1].Count;
+
+					if (leftCount == 0 || rightCost[i] == FloatMax)
+					{
+						continue;
+					}
+
+					const float cost = leftBounds.HalfArea() * static_cast<float>(leftCount) + rightCost[i];
+
+					if (cost < split.Cost)
+					{
+						split.Axis = axis;
+						split.Bin = i;
+						split.Cost = cost;
+					}
+				}
+			}
+
+			if (split.Cost == FloatMax)
+			{
+				return;
+			}
+
+			// Gather the bounds of both sides, so the children do not need another pass over their primitives
+			const Bin* axisBins = bins.Axis[split.Axis];
+
+			for (uint32_t i = 0; i < BinCount; i++)
+			{
+				(i < split.Bin ? split.LeftBounds : split.RightBounds).Grow(axisBins[i].Bounds);
+			}
+		}
+
+		AABB ComputeBounds(uint32_t first, uint32_t count) const
+		{
+			AABB bounds;
+
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				bounds.Grow(m_References[i].Bounds);
+			}
+
+			return bounds;
+		}
+
+		// Bounds of the centroids of a child. Cheaper to do once after the partition than to keep it per bin and axis.
+		AABB ComputeCentroidBounds(uint32_t first, uint32_t count) const
+		{
+			AABB bounds;
+
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				bounds.Grow(m_References[i].Centroid);
+			}
+
+			return bounds;
+		}
+
+		BVH& m_BVH;
+		const AABB* m_PrimitiveBounds;
+		ThreadPool& m_ThreadPool;
+
+		std::vector<PrimitiveReference> m_References;
+	};
+
+	void BVH::Build(const AABB* primitiveBounds, uint32_t count)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		m_Nodes.clear();
+		m_Indices.clear();
+		m_Statistics = {};
+
+		if (count == 0)
+		{
+			return;
+		}
+
+		BVHBuilder builder(*this, primitiveBounds, ThreadPool::Get());
+		builder.Build(count);
+
+		m_Nodes.shrink_to_fit();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		m_Statistics.BuildTime = elapsed.count();
+		m_Statistics.SAHCost = ComputeSAHCost();
+		m_Statistics.NodeCount = static_cast<uint32_t>(m_Nodes.size());
+		m_Statistics.LeafCount = static_cast<uint32_t>(std::count_if(m_Nodes.begin(), m_Nodes.end(), [](const BVHNode& node) { return node.IsLeaf(); }));
+	}
+
+	void BVH::Refit(const AABB* primitiveBounds)
+	{
+		if (m_Nodes.empty())
+		{
+			return;
+		}
+
+		// The leaves are independent of each other, so they are refitted by all threads
+		ThreadPool::Get().ParallelFor(m_Nodes.size(), 16 * 1024, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				for (uint64_t i = begin; i < end; i++)
+				{
+					BVHNode& node = m_Nodes[i];
+
+					if (!node.IsLeaf())
+					{
+						continue;
+					}
+
+					node.Bounds = AABB();
+
+					for (uint32_t j = 0; j < node.Count; j++)
+					{
+						node.Bounds.Grow(primitiveBounds[m_Indices[node.LeftFirst + j]]);
+					}
+				}
+			});
+
+		// The builder always places children after their parent, so a backwards pass sees the children of a node first
+		for (size_t i = m_Nodes.size(); i-- > 0;)
+		{
+			BVHNode& node = m_Nodes[i];
+
+			if (!node.IsLeaf())
+			{
+				node.Bounds = m_Nodes[node.LeftFirst].Bounds;
+				node.Bounds.Grow(m_Nodes[node.LeftFirst + 1].Bounds);
+			}
+		}
+	}
+
+	float BVH::ComputeSAHCost() const
+	{
+		if (m_Nodes.empty() || m_Nodes[0].Bounds.HalfArea() <= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		double cost = 0.0;
+
+		for (const BVHNode& node : m_Nodes)
+		{
+			if (node.IsLeaf())
+			{
+				cost += IntersectionCost * node.Count * node.Bounds.HalfArea();
+			}
+			else
+			{
+				cost += TraversalCost * node.Bounds.HalfArea();
+			}
+		}
+
+		return static_cast<float>(cost / m_Nodes[0].Bounds.HalfArea());
+	}
+}
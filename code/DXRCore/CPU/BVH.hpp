@@ -0,0 +1,210 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	struct BVHNode
+	{
+		AABB Bounds;
+
+		// Interior node: index of the left child, the right child follows it. Leaf: index of the first primitive.
+		uint32_t LeftFirst;
+		uint32_t Count;
+
+		bool IsLeaf() const
+		{
+			return Count > 0;
+		}
+	};
+
+	static_assert(sizeof(BVHNode) == 32, "BVH nodes should stay 32 bytes, so two of them fit in a cache line");
+
+	struct BVHStatistics
+	{
+		double BuildTime = 0.0;
+
+		// Expected cost of a random ray, relative to the cost of a single primitive test. Lower is better.
+		float SAHCost = 0.0f;
+
+		uint32_t NodeCount = 0;
+		uint32_t LeafCount = 0;
+	};
+
+	// Binary bounding volume hierarchy over an arbitrary set of primitives. The primitives themselves are not stored,
+	// the traversal functions hand primitive indices to a caller supplied intersection function.
+	class BVH
+	{
+	public:
+		// Builds the hierarchy over the given primitive bounds with a binned surface area heuristic. The top levels are
+		// split with all threads of the thread pool working on a node, after which every thread builds its own subtrees.
+		void Build(const AABB* primitiveBounds, uint32_t count);
+
+		// Recomputes the bounds of every node bottom-up from the new primitive bounds, keeping the tree as it is. Far
+		// cheaper than a build, but the tree gets worse as the primitives move away from where they were at build time.
+		// The primitive count must be the same as in the last Build.
+		void Refit(const AABB* primitiveBounds);
+
+		// Surface area heuristic cost of the current hierarchy
+		float ComputeSAHCost() const;
+
+		// Finds the closest hit. intersect(primitiveIndex, ray) tests one primitive and shortens ray.TMax on a hit.
+		template<typename Intersector>
+		void Intersect(Ray& ray, Intersector&& intersect) const;
+
+		// Returns true as soon as occluded(primitiveIndex, ray) reports a hit
+		template<typename Intersector>
+		bool Occluded(const Ray& ray, Intersector&& occluded) const;
+
+		AABB GetBounds() const
+		{
+			return m_Nodes.empty() ? AABB() : m_Nodes[0].Bounds;
+		}
+
+		const std::vector<BVHNode>& GetNodes() const
+		{
+			return m_Nodes;
+		}
+
+		const std::vector<uint32_t>& GetPrimitiveIndices() const
+		{
+			return m_Indices;
+		}
+
+		const BVHStatistics& GetStatistics() const
+		{
+			return m_Statistics;
+		}
+
+		static constexpr uint32_t MaxDepth = 64;
+
+		// Costs used by the surface area heuristic, relative to each other
+		static constexpr float TraversalCost = 1.0f;
+		static constexpr float IntersectionCost = 1.0f;
+
+	private:
+		friend class BVHBuilder;
+
+		std::vector<BVHNode> m_Nodes;
+		std::vector<uint32_t> m_Indices;
+
+		BVHStatistics m_Statistics;
+	};
+
+	template<typename Intersector>
+	inline void BVH::Intersect(Ray& ray, Intersector&& intersect) const
+	{
+		if (m_Nodes.empty())
+		{
+			return;
+		}
+
+		const RayInverse inv(ray.Direction);
+
+		uint32_t stack[MaxDepth];
+		uint32_t stackSize = 0;
+
+		const BVHNode* node = &m_Nodes[0];
+
+		if (IntersectAABB(node->Bounds, ray, inv) == FloatMax)
+		{
+			return;
+		}
+
+		while (true)
+		{
+			if (node->IsLeaf())
+			{
+				for (uint32_t i = 0; i < node->Count; i++)
+				{
+					intersect(m_Indices[node->LeftFirst + i], ray);
+				}
+
+				if (stackSize == 0)
+				{
+					return;
+				}
+
+				node = &m_Nodes[stack[--stackSize]];
+				continue;
+			}
+
+			// Visit the nearest child first, so the far child can be culled by a shorter ray
+			uint32_t nearIndex = node->LeftFirst;
+			uint32_t farIndex = node->LeftFirst + 1;
+
+			float nearT = IntersectAABB(m_Nodes[nearIndex].Bounds, ray, inv);
+			float farT = IntersectAABB(m_Nodes[farIndex].Bounds, ray, inv);
+
+			if (nearT > farT)
+			{
+				std::swap(nearT, farT);
+				std::swap(nearIndex, farIndex);
+			}
+
+			if (nearT == FloatMax)
+			{
+				if (stackSize == 0)
+				{
+					return;
+				}
+
+				node = &m_Nodes[stack[--stackSize]];
+				continue;
+			}
+
+			node = &m_Nodes[nearIndex];
+
+			if (farT != FloatMax)
+			{
+				stack[stackSize++] = farIndex;
+			}
+		}
+	}
+
+	template<typename Intersector>
+	inline bool BVH::Occluded(const Ray& ray, Intersector&& occluded) const
+	{
+		if (m_Nodes.empty())
+		{
+			return false;
+		}
+
+		const RayInverse inv(ray.Direction);
+
+		uint32_t stack[MaxDepth];
+		uint32_t stackSize = 0;
+
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node = m_Nodes[stack[--stackSize]];
+
+			if (IntersectAABB(node.Bounds, ray, inv) == FloatMax)
+			{
+				continue;
+			}
+
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = 0; i < node.Count; i++)
+				{
+					if (occluded(m_Indices[node.LeftFirst + i], ray))
+					{
+						return true;
+					}
+				}
+
+				continue;
+			}
+
+			stack[stackSize++] = node.LeftFirst + 1;
+			stack[stackSize++] = node.LeftFirst;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,357 @@
+#include "BVH8.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint32_t MaxLeafCount = 255;
+
+		// 2^(exponent - 127), built straight from the exponent bits
+		inline float StepSize(uint8_t exponent)
+		{
+			const uint32_t bits = static_cast<uint32_t>(exponent) << 23;
+
+			float step;
+			std::memcpy(&step, &bits, sizeof(float));
+
+			return step;
+		}
+
+		void InitializeNode(BVH8Node& node, const AABB& bounds)
+		{
+			node = {};
+			node.Origin = bounds.Min;
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const float extent = bounds.Max[axis] - bounds.Min[axis];
+
+				// Smallest power of two step for which 255 steps cover the node
+				int32_t exponent = extent > 0.0f ? static_cast<int32_t>(std::ceil(std::log2(extent / 255.0f))) : -126;
+				exponent = std::min(std::max(exponent, -126), 127);
+
+				while (exponent < 127 && std::ldexp(255.0f, exponent) < extent)
+				{
+					exponent++;
+				}
+
+				node.Exponent[axis] = static_cast<uint8_t>(exponent + 127);
+			}
+		}
+
+		void QuantizeChild(BVH8Node& node, uint32_t slot, const AABB& box)
+		{
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				const float origin = node.Origin[axis];
+				const float step = StepSize(node.Exponent[axis]);
+
+				int32_t min = static_cast<int32_t>(std::floor((box.Min[axis] - origin) / step));
+				int32_t max = static_cast<int32_t>(std::ceil((box.Max[axis] - origin) / step));
+
+				min = std::min(std::max(min, 0), 255);
+				max = std::min(std::max(max, 0), 255);
+
+				// Rounding of the decoded planes must never shrink the box
+				while (min > 0 && origin + static_cast<float>(min) * step > box.Min[axis])
+				{
+					min--;
+				}
+
+				while (max < 255 && origin + static_cast<float>(max) * step < box.Max[axis])
+				{
+					max++;
+				}
+
+				node.QuantizedMin[axis][slot] = static_cast<uint8_t>(min);
+				node.QuantizedMax[axis][slot] = static_cast<uint8_t>(max);
+			}
+
+			node.ChildMask |= 1 << slot;
+		}
+
+		// Any hit traversal does not need the distances, it skips the store
+		template<bool StoreDistances>
+		uint32_t IntersectChildrenScalar(const BVH8Node& node, const Ray& ray, const RayInverse& inv, float* distances)
+		{
+			uint32_t mask = 0;
+
+			for (uint32_t slot = 0; slot < 8; slot++)
+			{
+				float tNear = ray.TMin;
+				float tFar = ray.TMax;
+
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					const float scale = StepSize(node.Exponent[axis]) * inv.InvDirection[axis];
+					const float offset = (node.Origin[axis] - ray.Origin[axis]) * inv.InvDirection[axis];
+
+					const float qNear = inv.IsNegative[axis] ? node.QuantizedMax[axis][slot] : node.QuantizedMin[axis][slot];
+					const float qFar = inv.IsNegative[axis] ? node.QuantizedMin[axis][slot] : node.QuantizedMax[axis][slot];
+
+					// Same comparisons as maxps and minps, a NaN plane distance leaves the interval as it is
+					const float planeNear = qNear * scale + offset;
+					const float planeFar = qFar * scale + offset;
+
+					tNear = planeNear > tNear ? planeNear : tNear;
+					tFar = planeFar < tFar ? planeFar : tFar;
+				}
+
+				if (StoreDistances)
+				{
+					distances[slot] = tNear;
+				}
+
+				mask |= static_cast<uint32_t>(tNear <= tFar) << slot;
+			}
+
+			return mask & node.ChildMask;
+		}
+
+#if CPU_X64
+		template<bool StoreDistances>
+		CPU_TARGET_AVX2 uint32_t IntersectChildrenAVX2(const BVH8Node& node, const Ray& ray, const RayInverse& inv, float* distances)
+		{
+			__m256 tNear = _mm256_set1_ps(ray.TMin);
+			__m256 tFar = _mm256_set1_ps(ray.TMax);
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				// origin + q * step - rayOrigin, times the inverse direction, as a single multiply add per plane
+				const __m256 scale = _mm256_set1_ps(StepSize(node.Exponent[axis]) * inv.InvDirection[axis]);
+				const __m256 offset = _mm256_set1_ps((node.Origin[axis] - ray.Origin[axis]) * inv.InvDirection[axis]);
+
+				const uint8_t* nearPlane = inv.IsNegative[axis] ? node.QuantizedMax[axis] : node.QuantizedMin[axis];
+				const uint8_t* farPlane = inv.IsNegative[axis] ? node.QuantizedMin[axis] : node.QuantizedMax[axis];
+
+				const __m256 qNear = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nearPlane))));
+				const __m256 qFar = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(farPlane))));
+
+				// The plane distance goes first, so a NaN (ray in the plane of a flat box) leaves the interval as it is
+				tNear = _mm256_max_ps(_mm256_fmadd_ps(qNear, scale, offset), tNear);
+				tFar = _mm256_min_ps(_mm256_fmadd_ps(qFar, scale, offset), tFar);
+			}
+
+			if (StoreDistances)
+			{
+				_mm256_storeu_ps(distances, tNear);
+			}
+
+			return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ))) & node.ChildMask;
+		}
+
+		template<bool StoreDistances>
+		CPU_TARGET_SSE4 uint32_t IntersectChildrenSSE4(const BVH8Node& node, const Ray& ray, const RayInverse& inv, float* distances)
+		{
+			uint32_t mask = 0;
+
+			for (uint32_t half = 0; half < 2; half++)
+			{
+				__m128 tNear = _mm_set1_ps(ray.TMin);
+				__m128 tFar = _mm_set1_ps(ray.TMax);
+
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					const __m128 scale = _mm_set1_ps(StepSize(node.Exponent[axis]) * inv.InvDirection[axis]);
+					const __m128 offset = _mm_set1_ps((node.Origin[axis] - ray.Origin[axis]) * inv.InvDirection[axis]);
+
+					const uint8_t* nearPlane = (inv.IsNegative[axis] ? node.QuantizedMax[axis] : node.QuantizedMin[axis]) + half * 4;
+					const uint8_t* farPlane = (inv.IsNegative[axis] ? node.QuantizedMin[axis] : node.QuantizedMax[axis]) + half * 4;
+
+					int32_t nearBytes;
+					int32_t farBytes;
+					std::memcpy(&nearBytes, nearPlane, sizeof(int32_t));
+					std::memcpy(&farBytes, farPlane, sizeof(int32_t));
+
+					const __m128 qNear = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(nearBytes)));
+					const __m128 qFar = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(farBytes)));
+
+					tNear = _mm_max_ps(_mm_add_ps(_mm_mul_ps(qNear, scale), offset), tNear);
+					tFar = _mm_min_ps(_mm_add_ps(_mm_mul_ps(qFar, scale), offset), tFar);
+				}
+
+				if (StoreDistances)
+				{
+					_mm_storeu_ps(distances + half * 4, tNear);
+				}
+
+				mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) << (half * 4);
+			}
+
+			return mask & node.ChildMask;
+		}
+#endif
+	}
+
+	void BVH8::Build(const BVH& bvh)
+	{
+		const std::vector<BVHNode>& nodes = bvh.GetNodes();
+
+		m_Nodes.clear();
+		m_Indices = bvh.GetPrimitiveIndices();
+		m_Bounds = bvh.GetBounds();
+
+		if (nodes.empty())
+		{
+			return;
+		}
+
+		// Collapsing removes roughly three out of every four nodes
+		m_Nodes.reserve(nodes.size() / 4 + 1);
+
+		if (nodes[0].IsLeaf())
+		{
+			AddLeafNode(nodes[0].Bounds, nodes[0].LeftFirst, nodes[0].Count);
+		}
+		else
+		{
+			m_Nodes.emplace_back();
+			Collapse(bvh, 0, 0);
+		}
+
+		m_Nodes.shrink_to_fit();
+	}
+
+	void BVH8::Collapse(const BVH& bvh, uint32_t binaryIndex, uint32_t wideIndex)
+	{
+		const std::vector<BVHNode>& nodes = bvh.GetNodes();
+		const BVHNode& parent = nodes[binaryIndex];
+
+		uint32_t children[8] = { parent.LeftFirst, parent.LeftFirst + 1 };
+		uint32_t childCount = 2;
+
+		// Pull up grandchildren until all slots are used, opening the largest interior child first
+		while (childCount < 8)
+		{
+			uint32_t largest = InvalidIndex;
+			float largestArea = -1.0f;
+
+			for (uint32_t i = 0; i < childCount; i++)
+			{
+				const BVHNode& child = nodes[children[i]];
+
+				if (!child.IsLeaf() && child.Bounds.HalfArea() > largestArea)
+				{
+					largest = i;
+					largestArea = child.Bounds.HalfArea();
+				}
+			}
+
+			if (largest == InvalidIndex)
+			{
+				break;
+			}
+
+			const uint32_t opened = children[largest];
+			children[largest] = nodes[opened].LeftFirst;
+			children[childCount++] = nodes[opened].LeftFirst + 1;
+		}
+
+		InitializeNode(m_Nodes[wideIndex], parent.Bounds);
+
+		uint32_t interiorChildren[8];
+		uint32_t interiorCount = 0;
+
+		for (uint32_t slot = 0; slot < childCount; slot++)
+		{
+			const BVHNode& child = nodes[children[slot]];
+
+			QuantizeChild(m_Nodes[wideIndex], slot, child.Bounds);
+
+			if (child.IsLeaf() && child.Count <= MaxLeafCount)
+			{
+				m_Nodes[wideIndex].Child[slot] = child.LeftFirst;
+				m_Nodes[wideIndex].PrimitiveCount[slot] = static_cast<uint8_t>(child.Count);
+			}
+			else if (child.IsLeaf())
+			{
+				// Only happens when the builder hit its depth limit
+				const uint32_t leafNode = AddLeafNode(child.Bounds, child.LeftFirst, child.Count);
+				m_Nodes[wideIndex].Child[slot] = leafNode;
+			}
+			else
+			{
+				m_Nodes[wideIndex].Child[slot] = static_cast<uint32_t>(m_Nodes.size());
+				m_Nodes.emplace_back();
+
+				interiorChildren[interiorCount++] = slot;
+			}
+		}
+
+		for (uint32_t i = 0; i < interiorCount; i++)
+		{
+			const uint32_t slot = interiorChildren[i];
+			Collapse(bvh, children[slot], m_Nodes[wideIndex].Child[slot]);
+		}
+	}
+
+	uint32_t BVH8::AddLeafNode(const AABB& bounds, uint32_t first, uint32_t count)
+	{
+		// A node whose slots split a leaf that is too big for a single slot. Every slot gets the bounds of the whole leaf.
+		const uint32_t index = static_cast<uint32_t>(m_Nodes.size());
+		m_Nodes.emplace_back();
+
+		InitializeNode(m_Nodes[index], bounds);
+
+		for (uint32_t slot = 0; slot < 8 && count > 0; slot++)
+		{
+			QuantizeChild(m_Nodes[index], slot, bounds);
+
+			if (count <= MaxLeafCount || slot < 7)
+			{
+				const uint32_t slotCount = std::min(count, MaxLeafCount);
+
+				m_Nodes[index].Child[slot] = first;
+				m_Nodes[index].PrimitiveCount[slot] = static_cast<uint8_t>(slotCount);
+
+				first += slotCount;
+				count -= slotCount;
+			}
+			else
+			{
+				const uint32_t child = AddLeafNode(bounds, first, count);
+				m_Nodes[index].Child[slot] = child;
+				count = 0;
+			}
+		}
+
+		return index;
+	}
+
+	uint32_t BVH8::IntersectChildren(const BVH8Node& node, const Ray& ray, const RayInverse& inv, float distances[8])
+	{
+#if CPU_X64
+		if (GetSIMDLevel() == SIMDLevel::AVX2)
+		{
+			return IntersectChildrenAVX2<true>(node, ray, inv, distances);
+		}
+
+		if (GetSIMDLevel() == SIMDLevel::SSE4)
+		{
+			return IntersectChildrenSSE4<true>(node, ray, inv, distances);
+		}
+#endif
+
+		return IntersectChildrenScalar<true>(node, ray, inv, distances);
+	}
+
+	uint32_t BVH8::HitChildren(const BVH8Node& node, const Ray& ray, const RayInverse& inv)
+	{
+#if CPU_X64
+		if (GetSIMDLevel() == SIMDLevel::AVX2)
+		{
+			return IntersectChildrenAVX2<false>(node, ray, inv, nullptr);
+		}
+
+		if (GetSIMDLevel() == SIMDLevel::SSE4)
+		{
+			return IntersectChildrenSSE4<false>(node, ray, inv, nullptr);
+		}
+#endif
+
+		return IntersectChildrenScalar<false>(node, ray, inv, nullptr);
+	}
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "SIMD.hpp"
+
+namespace cpu
+{
+	// 8-wide node. The child boxes are stored as 8-bit offsets from the origin of the node, in steps of a power of two per
+	// axis. They are rounded outwards, so a quantized box always contains the child it was made from.
+	struct BVH8Node
+	{
+		Float3 Origin;
+
+		// Size of a quantization step per axis, as the exponent bits of a float (the step is 2^(Exponent - 127))
+		uint8_t Exponent[3];
+
+		// Bit i is set when slot i holds a child
+		uint8_t ChildMask;
+
+		// Interior child: index of the node. Leaf: index of the first primitive in the primitive index array.
+		uint32_t Child[8];
+
+		// Number of primitives of a leaf, 0 for interior children
+		uint8_t PrimitiveCount[8];
+
+		uint8_t QuantizedMin[3][8];
+		uint8_t QuantizedMax[3][8];
+	};
+
+	static_assert(sizeof(BVH8Node) == 104, "BVH8Node should stay tightly packed");
+
+	// Wide bounding volume hierarchy made by collapsing a binary BVH. A traversal step tests all 8 children of a node at
+	// once, with AVX2 when the CPU has it and SSE4 otherwise.
+	class BVH8
+	{
+	public:
+		// Collapses the binary hierarchy. The BVH8 keeps its own copy of the primitive order, so the binary BVH can be
+		// thrown away afterwards.
+		void Build(const BVH& bvh);
+
+		// Same interface as BVH::Intersect and BVH::Occluded
+		template<typename Intersector>
+		void Intersect(Ray& ray, Intersector&& intersect) const;
+
+		template<typename Intersector>
+		bool Occluded(const Ray& ray, Intersector&& occluded) const;
+
+		AABB GetBounds() const
+		{
+			return m_Bounds;
+		}
+
+		const std::vector<BVH8Node>& GetNodes() const
+		{
+			return m_Nodes;
+		}
+
+		size_t GetNodeMemory() const
+		{
+			return m_Nodes.size() * sizeof(BVH8Node);
+		}
+
+		// Worst case number of entries on the traversal stack: every level can push 7 siblings
+		static constexpr uint32_t StackSize = BVH::MaxDepth * 7 + 1;
+
+	private:
+		struct StackEntry
+		{
+			uint32_t Node;
+			float T;
+		};
+
+		void Collapse(const BVH& bvh, uint32_t binaryIndex, uint32_t wideIndex);
+		uint32_t AddLeafNode(const AABB& bounds, uint32_t first, uint32_t count);
+
+		// Tests the ray against all children of a node. Returns a bit mask of the children that are hit and writes their
+		// entry distances.
+		static uint32_t IntersectChildren(const BVH8Node& node, const Ray& ray, const RayInverse& inv, float distances[8]);
+
+		// Same test that only returns the mask, for any hit traversal
+		static uint32_t HitChildren(const BVH8Node& node, const Ray& ray, const RayInverse& inv);
+
+		std::vector<BVH8Node> m_Nodes;
+		std::vector<uint32_t> m_Indices;
+		AABB m_Bounds;
+	};
+
+	template<typename Intersector>
+	inline void BVH8::Intersect(Ray& ray, Intersector&& intersect) const
+	{
+		if (m_Nodes.empty())
+		{
+			return;
+		}
+
+		const RayInverse inv(ray.Direction);
+
+		const float rootT = IntersectAABB(m_Bounds, ray, inv);
+
+		if (rootT == FloatMax)
+		{
+			return;
+		}
+
+		StackEntry stack[StackSize];
+		uint32_t stackSize = 0;
+
+		stack[stackSize++] = { 0, rootT };
+
+		while (stackSize > 0)
+		{
+			const StackEntry entry = stack[--stackSize];
+
+			// The ray got shorter since this node was pushed
+			if (entry.T > ray.TMax)
+			{
+				continue;
+			}
+
+			const BVH8Node& node = m_Nodes[entry.Node];
+
+			float distances[8];
+			uint32_t mask = IntersectChildren(node, ray, inv, distances);
+
+			// Sort the children that were hit from near to far
+			uint32_t order[8];
+			uint32_t hitCount = 0;
+
+			while (mask != 0)
+			{
+				const uint32_t slot = FirstBit(mask);
+				mask &= mask - 1;
+
+				uint32_t i = hitCount++;
+				for (; i > 0 && distances[order[i - 1]] > distances[slot]; i--)
+				{
+					order[i] = order[i - 1];
+				}
+
+				order[i] = slot;
+			}
+
+			// Leaves are tested right away, a hit makes the ray shorter for the interior children
+			for (uint32_t i = 0; i < hitCount; i++)
+			{
+				const uint32_t slot = order[i];
+
+				if (node.PrimitiveCount[slot] == 0 || distances[slot] > ray.TMax)
+				{
+					continue;
+				}
+
+				for (uint32_t j = 0; j < node.PrimitiveCount[slot]; j++)
+				{
+					intersect(m_Indices[node.Child[slot] + j], ray);
+				}
+			}
+
+			// Push far to near, so the nearest child is popped first
+			for (uint32_t i = hitCount; i > 0; i--)
+			{
+				const uint32_t slot = order[i - 1];
+
+				if (node.PrimitiveCount[slot] == 0 && distances[slot] <= ray.TMax)
+				{
+					stack[stackSize++] = { node.Child[slot], distances[slot] };
+				}
+			}
+		}
+	}
+
+	template<typename Intersector>
+	inline bool BVH8::Occluded(const Ray& ray, Intersector&& occluded) const
+	{
+		if (m_Nodes.empty())
+		{
+			return false;
+		}
+
+		const RayInverse inv(ray.Direction);
+
+		if (IntersectAABB(m_Bounds, ray, inv) == FloatMax)
+		{
+			return false;
+		}
+
+		// Nodes are not sorted, so the stack only needs their index
+		uint32_t stack[StackSize];
+		uint32_t stackSize = 0;
+
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVH8Node& node = m_Nodes[stack[--stackSize]];
+
+			uint32_t mask = HitChildren(node, ray, inv);
+
+			// Any hit ends the search, so the order does not matter
+			while (mask != 0)
+			{
+				const uint32_t slot = FirstBit(mask);
+				mask &= mask - 1;
+
+				if (node.PrimitiveCount[slot] == 0)
+				{
+					stack[stackSize++] = node.Child[slot];
+					continue;
+				}
+
+				for (uint32_t j = 0; j < node.PrimitiveCount[slot]; j++)
+				{
+					if (occluded(m_Indices[node.Child[slot] + j], ray))
+					{
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,313 @@
+#include "Backend.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace cpu
+{
+	Backend::Backend(uint32_t width, uint32_t height)
+		: m_ThreadPool(ThreadPool::Get())
+		, m_Scheduler(m_ThreadPool)
+		, m_Accumulator(m_ThreadPool)
+		, m_Frame(width, height)
+	{
+		m_Accumulator.Resize(width, height);
+	}
+
+	void Backend::Resize(uint32_t width, uint32_t height)
+	{
+		m_Frame.Resize(width, height);
+		m_Accumulator.Resize(width, height);
+	}
+
+	void Backend::SetAccumulation(bool enabled, const AccumulationDesc& desc)
+	{
+		m_Accumulate = enabled;
+		m_Accumulator.SetDesc(desc);
+		m_Accumulator.Reset();
+	}
+
+	void Backend::Render(const FrameDesc& frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		uint64_t rayCount = 0;
+
+		if (!m_Accumulate)
+		{
+			RenderSample(frame, rayCount);
+		}
+		else
+		{
+			const uint64_t sceneVersion = frame.Scene != nullptr ? frame.Scene->Version : 0;
+
+			const bool changed = std::memcmp(&frame.InverseViewProjection, &m_AccumulatedViewProjection, sizeof(Float4x4)) != 0 ||
+				std::memcmp(&frame.CameraPosition, &m_AccumulatedCameraPosition, sizeof(Float3)) != 0 ||
+				frame.Scene != m_AccumulatedScene || sceneVersion != m_AccumulatedSceneVersion;
+
+			if (changed || m_Accumulator.GetStatistics().SampleCount == 0)
+			{
+				m_AccumulatedViewProjection = frame.InverseViewProjection;
+				m_AccumulatedCameraPosition = frame.CameraPosition;
+				m_AccumulatedScene = frame.Scene;
+				m_AccumulatedSceneVersion = sceneVersion;
+
+				m_Accumulator.Reset();
+			}
+
+			// A converged frame still holds the average, there is nothing left to render
+			if (!m_Accumulator.IsConverged())
+			{
+				FrameDesc sample = frame;
+				sample.PixelOffset = m_Accumulator.GetSampleOffset();
+				sample.SampleIndex = m_Accumulator.GetStatistics().SampleCount;
+
+				RenderSample(sample, rayCount);
+				m_Accumulator.Add(m_Frame);
+			}
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		m_Statistics.RayCount = rayCount;
+		m_Statistics.RenderTime = elapsed.count();
+	}
+
+	void Backend::RenderSample(const FrameDesc& frame, uint64_t& rayCount)
+	{
+		if (m_RenderMode == RenderMode::Wavefront && frame.Scene != nullptr)
+		{
+			RenderWavefront(frame, rayCount);
+		}
+		else
+		{
+			RenderRecursive(frame, rayCount);
+		}
+	}
+
+	void Backend::RenderRecursive(const FrameDesc& frame, uint64_t& rayCount)
+	{
+		std::atomic<uint64_t> totalRayCount{ 0 };
+
+		// Tiles that hit the reflective floor cost several times more than sky tiles, the scheduler balances that out
+		m_Scheduler.Dispatch(m_Frame.GetWidth(), m_Frame.GetHeight(), [&](const Tile& tile, uint32_t)
+			{
+				uint64_t localRayCount = 0;
+
+				for (uint32_t y = tile.Y; y < tile.Y + tile.Height; y++)
+				{
+					for (uint32_t x = tile.X; x < tile.X + tile.Width; x++)
+					{
+						Float3 color = frame.Scene != nullptr ? TraceRadiance(frame, GetPrimaryRay(frame, x, y), y * m_Frame.GetWidth() + x, 0, localRayCount) : frame.MissColor;
+						m_Frame(x, y) = { color.x, color.y, color.z, 1.0f };
+					}
+				}
+
+				totalRayCount += localRayCount;
+			});
+
+		rayCount = totalRayCount;
+	}
+
+	Ray Backend::GetPrimaryRay(const FrameDesc& frame, uint32_t x, uint32_t y) const
+	{
+		// Same as GetPrimaryRay in the shaders, apart from the offset inside the pixel
+		float screenX = (static_cast<float>(x) + frame.PixelOffset.x) / m_Frame.GetWidth();
+		float screenY = (static_cast<float>(y) + frame.PixelOffset.y) / m_Frame.GetHeight();
+		screenX = screenX * 2.0f - 1.0f;
+		screenY = -(screenY * 2.0f - 1.0f);
+
+		const auto& m = frame.InverseViewProjection.m;
+		const float wx = screenX * m[0][0] + screenY * m[1][0] + m[3][0];
+		const float wy = screenX * m[0][1] + screenY * m[1][1] + m[3][1];
+		const float wz = screenX * m[0][2] + screenY * m[1][2] + m[3][2];
+		const float ww = screenX * m[0][3] + screenY * m[1][3] + m[3][3];
+
+		const Float3 world(wx / ww, wy / ww, wz / ww);
+
+		Ray ray;
+		ray.Origin = frame.CameraPosition;
+		ray.Direction = Normalize(world - frame.CameraPosition);
+		ray.TMin = 0.01f;
+		ray.TMax = 100.0f;
+
+		return ray;
+	}
+
+	Float3 Backend::Miss(const FrameDesc& frame, const Float3& direction) const
+	{
+		if (frame.Sky != nullptr)
+		{
+			return frame.Sky->SampleEquirectangular(direction);
+		}
+
+		return frame.MissColor;
+	}
+
+	bool Backend::EndsPath(const FrameDesc& frame, const Ray& ray, const Hit* hit, uint32_t depth, Float3& radiance) const
+	{
+		if (hit == nullptr)
+		{
+			radiance = Miss(frame, ray.Direction);
+			return true;
+		}
+
+		const Scene& scene = *frame.Scene;
+		const InstanceDesc& instance = scene.TLAS.GetInstance(hit->InstanceIndex);
+
+		// ClosestMainPrimitive: procedural primitives are colored with their normal
+		if (instance.AccelerationStructure->GetType() == GeometryType::ProceduralPrimitives)
+		{
+			const Float3 normal = Normalize(scene.TLAS.GetWorldToObject(hit->InstanceIndex).TransformVectorTransposed(hit->Normal));
+			radiance = normal * 0.5f + Float3(0.5f);
+			return true;
+		}
+
+		// ClosestMain
+		if (depth + 1 >= frame.MaxRecursion || hit->InstanceIndex >= scene.Meshes.size())
+		{
+			radiance = Float3(0.0f);
+			return true;
+		}
+
+		return false;
+	}
+
+	Backend::SurfaceHit Backend::GetSurfaceHit(const FrameDesc& frame, const Ray& ray, const Hit& hit) const
+	{
+		const Scene& scene = *frame.Scene;
+		const MeshData& mesh = scene.Meshes[hit.InstanceIndex];
+
+		const Float3 objectNormal = mesh.Mesh->GetNormal(hit.PrimitiveIndex, hit.Barycentrics);
+
+		SurfaceHit surface;
+		surface.Position = ray.Origin + ray.Direction * hit.T;
+		surface.Normal = Normalize(scene.TLAS.GetWorldToObject(hit.InstanceIndex).TransformVectorTransposed(objectNormal));
+		surface.Color = Float3(mesh.Color.x, mesh.Color.y, mesh.Color.z);
+		surface.Reflectance = mesh.Reflectance;
+
+		return surface;
+	}
+
+	Float3 Backend::GetDirectLight(const FrameDesc& frame, const Float3& normal)
+	{
+		const Float3 lightDirection = -Normalize(frame.Light.Direction);
+		const float nDotL = Dot(normal, lightDirection);
+
+		return frame.Light.Color * (std::max(nDotL, 0.0f) * frame.Light.Intensity);
+	}
+
+	Ray Backend::GetShadowRay(const FrameDesc& frame, const Float3& position)
+	{
+		Ray shadowRay;
+		shadowRay.Origin = position;
+		shadowRay.Direction = -Normalize(frame.Light.Direction);
+		shadowRay.TMin = 0.01f;
+		shadowRay.TMax = 1000.0f;
+
+		return shadowRay;
+	}
+
+	bool Backend::GetSkyLight(const FrameDesc& frame, const SurfaceHit& surface, uint32_t pixel, uint32_t depth, Float3& light, Ray& shadowRay) const
+	{
+		// One stream per pixel and sample, one pair of numbers per bounce, so both render modes pick the same directions
+		Random random((static_cast<uint64_t>(pixel) << 8) | depth, frame.SampleIndex);
+		const Float2 u = { random.NextFloat(), random.NextFloat() };
+
+		float pdf;
+		const Float3 direction = frame.SkyLight->Sample(u, pdf);
+		const float nDotL = Dot(surface.Normal, direction);
+
+		if (pdf <= 0.0f || nDotL <= 0.0f)
+		{
+			return false;
+		}
+
+		// Lambertian surface, divided by the density of the direction
+		light = surface.Color * Miss(frame, direction) * (nDotL * INVPI / pdf);
+
+		shadowRay.Origin = surface.Position;
+		shadowRay.Direction = direction;
+		shadowRay.TMin = 0.01f;
+		shadowRay.TMax = 1000.0f;
+
+		return true;
+	}
+
+	Ray Backend::GetReflectionRay(const Ray& ray, const SurfaceHit& surface)
+	{
+		Ray reflectionRay;
+		reflectionRay.Origin = surface.Position;
+		reflectionRay.Direction = Reflect(ray.Direction, surface.Normal);
+		reflectionRay.TMin = 0.01f;
+		reflectionRay.TMax = 1000.0f;
+
+		return reflectionRay;
+	}
+
+	Float3 Backend::GetReflectionWeight(const Ray& ray, const SurfaceHit& surface)
+	{
+		const float cosi = Saturate(Dot(-ray.Direction, surface.Normal));
+		const Float3 f0 = surface.Color + (Float3(1.0f) - surface.Color) * std::pow(1.0f - cosi, 5.0f);
+
+		return f0 * surface.Reflectance;
+	}
+
+	Float3 Backend::TraceRadiance(const FrameDesc& frame, Ray ray, uint32_t pixel, uint32_t depth, uint64_t& rayCount) const
+	{
+		const Scene& scene = *frame.Scene;
+
+		rayCount++;
+
+		Hit hit;
+		const bool found = scene.TLAS.Intersect(ray, hit, RayFlagCullBackFacingTriangles);
+
+		Float3 pathRadiance;
+		if (EndsPath(frame, ray, found ? &hit : nullptr, depth, pathRadiance))
+		{
+			return pathRadiance;
+		}
+
+		const SurfaceHit surface = GetSurfaceHit(frame, ray, hit);
+
+		Float3 radiance = GetDirectLight(frame, surface.Normal);
+
+		float shadowValue = 1.0f;
+
+		if (frame.Shadows)
+		{
+			rayCount++;
+			shadowValue = scene.TLAS.Occluded(GetShadowRay(frame, surface.Position), frame.ShadowRayFlags) ? 0.0f : 1.0f;
+		}
+
+		Float3 reflection(0.0f);
+
+		if (surface.Reflectance > 0.001f)
+		{
+			reflection = TraceRadiance(frame, GetReflectionRay(ray, surface), pixel, depth + 1, rayCount) * GetReflectionWeight(ray, surface);
+		}
+
+		radiance = surface.Color * radiance * frame.Diffuse + reflection;
+
+		Float3 ambient = surface.Color * frame.Ambient;
+
+		if (frame.SkyLight != nullptr)
+		{
+			Ray skyRay;
+			if (!GetSkyLight(frame, surface, pixel, depth, ambient, skyRay))
+			{
+				ambient = Float3(0.0f);
+			}
+			else if (frame.Shadows)
+			{
+				rayCount++;
+				ambient = scene.TLAS.Occluded(skyRay, frame.ShadowRayFlags) ? Float3(0.0f) : ambient;
+			}
+		}
+
+		return radiance * shadowValue + ambient;
+	}
+}
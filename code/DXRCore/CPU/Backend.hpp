@@ -0,0 +1,199 @@
+#pragma once
+
+#include "Accumulator.hpp"
+#include "Image.hpp"
+#include "Scene.hpp"
+#include "SkyDistribution.hpp"
+#include "TileScheduler.hpp"
+#include "Wavefront.hpp"
+
+#include <string_view>
+
+namespace cpu
+{
+	class ThreadPool;
+
+	// Same layout as hlsl::DirectionalLight
+	struct DirectionalLight
+	{
+		Float3 Direction;
+		float Intensity;
+		Float3 Color;
+	};
+
+	// The CPU version of the data a sample binds before DispatchRays
+	struct FrameDesc
+	{
+		Float4x4 InverseViewProjection;
+		Float3 CameraPosition;
+
+		DirectionalLight Light;
+
+		const cpu::Scene* Scene = nullptr;
+
+		// Equirectangular sky dome. When it is not set, rays that miss return MissColor.
+		const Image* Sky = nullptr;
+		Float3 MissColor = Float3(1.0f, 1.0f, 0.0f);
+
+		// Alias tables of Sky. When it is set, the sky lights the meshes in place of the ambient term: every hit traces
+		// one shadow ray in a direction picked in proportion to the light of the sky.
+		const SkyDistribution* SkyLight = nullptr;
+
+		// Shading parameters that differ between the samples
+		float Diffuse = 0.65f;
+		float Ambient = 0.35f;
+		bool Shadows = true;
+		uint32_t ShadowRayFlags = RayFlagCullFrontFacingTriangles | RayFlagSkipClosestHitShader;
+		uint32_t MaxRecursion = 3;
+
+		// Position of the primary ray inside the pixel. The center, like the shaders, unless the backend accumulates.
+		Float2 PixelOffset = { 0.5f, 0.5f };
+
+		// Seeds the directions of the sky light, so every accumulated sample picks other ones
+		uint32_t SampleIndex = 0;
+	};
+
+	struct FrameStatistics
+	{
+		uint64_t RayCount = 0;
+		double RenderTime = 0.0;
+
+		double GetRaysPerSecond() const
+		{
+			return RenderTime > 0.0 ? static_cast<double>(RayCount) / RenderTime : 0.0;
+		}
+	};
+
+	enum class RenderMode
+	{
+		// Every pixel traces its own rays, recursing into reflections like the shaders do
+		Recursive,
+
+		// The pixels of a batch go through every bounce together, as stages over queues of rays: extension (closest
+		// hit), shading, shadow (occlusion) and connection. The queues are compacted between the stages, so every stage
+		// runs a tight loop over rays of a single kind.
+		Wavefront
+	};
+
+	// Headless ray tracer that runs the shading of the samples on the CPU, using every core of the machine. It renders
+	// into an image in memory, which can be written to disk after every frame.
+	class Backend
+	{
+	public:
+		Backend(uint32_t width, uint32_t height);
+
+		void Resize(uint32_t width, uint32_t height);
+
+		void Render(const FrameDesc& frame);
+
+		// With accumulation enabled, every Render adds one jittered sample per pixel to a running average, for as long
+		// as the camera and the scene stay the same. Once the image has converged, Render leaves the frame as it is.
+		void SetAccumulation(bool enabled, const AccumulationDesc& desc = {});
+
+		// Throws the accumulated samples away. Render does this itself when the camera or the scene version changes.
+		void ResetAccumulation()
+		{
+			m_Accumulator.Reset();
+		}
+
+		bool IsAccumulating() const
+		{
+			return m_Accumulate;
+		}
+
+		bool IsConverged() const
+		{
+			return m_Accumulate && m_Accumulator.IsConverged();
+		}
+
+		const AccumulationStatistics& GetAccumulationStatistics() const
+		{
+			return m_Accumulator.GetStatistics();
+		}
+
+		void SetRenderMode(RenderMode mode)
+		{
+			m_RenderMode = mode;
+		}
+
+		RenderMode GetRenderMode() const
+		{
+			return m_RenderMode;
+		}
+
+		bool WriteFrame(std::string_view path) const
+		{
+			return m_Frame.Write(path);
+		}
+
+		const Image& GetFrame() const
+		{
+			return m_Frame;
+		}
+
+		const FrameStatistics& GetStatistics() const
+		{
+			return m_Statistics;
+		}
+
+		// Per thread timings of the last frame
+		const DispatchStatistics& GetDispatchStatistics() const
+		{
+			return m_Scheduler.GetStatistics();
+		}
+
+	private:
+		// Shading inputs of a hit on a mesh
+		struct SurfaceHit
+		{
+			Float3 Position;
+			Float3 Normal;
+			Float3 Color;
+			float Reflectance;
+		};
+
+		void RenderSample(const FrameDesc& frame, uint64_t& rayCount);
+		void RenderRecursive(const FrameDesc& frame, uint64_t& rayCount);
+		void RenderWavefront(const FrameDesc& frame, uint64_t& rayCount);
+
+		Ray GetPrimaryRay(const FrameDesc& frame, uint32_t x, uint32_t y) const;
+		Float3 TraceRadiance(const FrameDesc& frame, Ray ray, uint32_t pixel, uint32_t depth, uint64_t& rayCount) const;
+		Float3 Miss(const FrameDesc& frame, const Float3& direction) const;
+
+		// Returns true with the radiance of the ray when the path ends at this hit: on a miss, a procedural primitive or
+		// at the recursion limit. hit is null on a miss.
+		bool EndsPath(const FrameDesc& frame, const Ray& ray, const Hit* hit, uint32_t depth, Float3& radiance) const;
+		SurfaceHit GetSurfaceHit(const FrameDesc& frame, const Ray& ray, const Hit& hit) const;
+
+		// Light of the directional light that reaches the surface, without the shadow
+		static Float3 GetDirectLight(const FrameDesc& frame, const Float3& normal);
+		static Ray GetShadowRay(const FrameDesc& frame, const Float3& position);
+
+		// Light of the sky from a direction picked by frame.SkyLight, without the shadow, and the shadow ray towards it.
+		// Returns false when the direction does not light the surface, so there is no need for the shadow ray.
+		bool GetSkyLight(const FrameDesc& frame, const SurfaceHit& surface, uint32_t pixel, uint32_t depth, Float3& light, Ray& shadowRay) const;
+
+		static Ray GetReflectionRay(const Ray& ray, const SurfaceHit& surface);
+
+		// Weight of the radiance of the reflection ray: Fresnel times the reflectance of the mesh
+		static Float3 GetReflectionWeight(const Ray& ray, const SurfaceHit& surface);
+
+		ThreadPool& m_ThreadPool;
+		TileScheduler m_Scheduler;
+
+		RenderMode m_RenderMode = RenderMode::Recursive;
+		WavefrontQueues m_Wavefront;
+
+		bool m_Accumulate = false;
+		Accumulator m_Accumulator;
+
+		// What the accumulated samples were rendered with
+		Float4x4 m_AccumulatedViewProjection = {};
+		Float3 m_AccumulatedCameraPosition = Float3(0.0f);
+		const Scene* m_AccumulatedScene = nullptr;
+		uint64_t m_AccumulatedSceneVersion = 0;
+
+		Image m_Frame;
+		FrameStatistics m_Statistics;
+	};
+}
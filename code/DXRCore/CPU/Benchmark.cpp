@@ -0,0 +1,70 @@
+#include "Benchmark.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdio>
+
+// The benchmarks themselves are split by area over the Benchmark*.cpp files, with the scenes they share in
+// BenchmarkScenes.cpp
+namespace cpu
+{
+	namespace
+	{
+		struct BenchmarkEntry
+		{
+			const char* Name;
+
+			// Returns false when the benchmark found a wrong result. Benchmarks that only measure always return true.
+			bool (*Run)(const BenchmarkDesc& desc);
+		};
+
+		// In the order they run and print
+		const BenchmarkEntry Benchmarks[] =
+		{
+			{ "BVH build", [](const BenchmarkDesc& desc) { BenchmarkBVHBuild(desc); return true; } },
+			{ "BVH trace", [](const BenchmarkDesc& desc) { BenchmarkBVHTrace(desc); return true; } },
+			{ "Shadow rays", [](const BenchmarkDesc& desc) { BenchmarkShadowRays(desc); return true; } },
+			{ "Instances", [](const BenchmarkDesc& desc) { BenchmarkInstances(desc); return true; } },
+			{ "Dispatch", [](const BenchmarkDesc& desc) { BenchmarkDispatch(desc); return true; } },
+			{ "Primitives", BenchmarkPrimitives },
+			{ "Refit", BenchmarkRefit },
+			{ "Wavefront", BenchmarkWavefront },
+			{ "Sky light", [](const BenchmarkDesc& desc) { BenchmarkSkyLight(desc); return true; } },
+			{ "Textures", BenchmarkTextures },
+			{ "Allocator", [](const BenchmarkDesc& desc) { BenchmarkAllocator(desc); return true; } },
+			{ "Recording", BenchmarkRecording },
+			{ "Pipeline cache", BenchmarkPipelineCache },
+			{ "Shader compilation", BenchmarkShaderCompilation },
+			{ "Shader table", BenchmarkShaderTable },
+			{ "Frame allocator", BenchmarkFrameAllocator },
+			{ "Instance packing", BenchmarkInstancePacking }
+		};
+	}
+
+	bool RunBenchmarks(const BenchmarkDesc& desc)
+	{
+		printf("Running CPU benchmarks on %u threads\n", ThreadPool::Get().GetThreadCount());
+
+		// Every benchmark runs, also after one failed, so the output lists all wrong results
+		uint32_t failedCount = 0;
+
+		for (const BenchmarkEntry& benchmark : Benchmarks)
+		{
+			if (!benchmark.Run(desc))
+			{
+				printf("%s | FAILED\n", benchmark.Name);
+				failedCount++;
+			}
+		}
+
+		if (failedCount == 0)
+		{
+			printf("All checks passed\n");
+		}
+		else
+		{
+			printf("%u benchmarks failed\n", failedCount);
+		}
+
+		return failedCount == 0;
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cpu
+{
+	struct BenchmarkDesc
+	{
+		// Size of the generated test mesh
+		uint32_t TriangleCount = 1000000;
+
+		uint32_t BuildIterations = 5;
+		uint32_t RayCount = 4 * 1024 * 1024;
+
+		// Number of cube instances in the instancing benchmark
+		uint32_t InstanceCount = 100000;
+
+		// Number of spheres in the BLAS of the procedural primitive benchmark
+		uint32_t PrimitiveCount = 1000000;
+
+		// Frames of animation in the refit benchmark, and the fraction of the instances that moves every frame
+		uint32_t RefitFrameCount = 8;
+		float RefitMovedFraction = 0.05f;
+
+		// Size of the frame in the dispatch and wavefront benchmarks
+		uint32_t DispatchWidth = 1280;
+		uint32_t DispatchHeight = 720;
+
+		// Bounces in the reflective scene of the wavefront benchmark
+		uint32_t WavefrontMaxRecursion = 6;
+
+		// Samples per pixel of the image that the sky light benchmark compares against
+		uint32_t SkyLightReferenceSampleCount = 256;
+
+		// Size of the sky in the texture benchmark, the size of our production environments
+		uint32_t TextureWidth = 8192;
+		uint32_t TextureHeight = 4096;
+
+		// Number of buffers of the scene in the memory allocator benchmark
+		uint32_t AllocatorBufferCount = 20000;
+
+		// Number of passes in the command recording benchmark
+		uint32_t RecordingPassCount = 2000;
+
+		// Number of blobs in the pipeline cache benchmark
+		uint32_t PipelineCacheEntryCount = 2000;
+
+		// Number of recursion depth permutations in the shader compilation benchmark
+		uint32_t ShaderPermutationCount = 8;
+
+		// Number of instance records in the shader table benchmark
+		uint32_t ShaderRecordCount = 100000;
+
+		// Number of constant buffers per frame in the frame allocator benchmark
+		uint32_t FrameConstantCount = 20000;
+
+		// Number of instances in the instance packing benchmark
+		uint32_t PackInstanceCount = 1000000;
+	};
+
+	// Builds a generated mesh with 16-bit and 32-bit indices, and prints the builds per second and the SAH cost
+	void BenchmarkBVHBuild(const BenchmarkDesc& desc);
+
+	// Traces coherent (camera) and incoherent (random) rays through a generated mesh with the binary and the 8-wide
+	// layout, and prints the node memory and the rays per second
+	void BenchmarkBVHTrace(const BenchmarkDesc& desc);
+
+	// Traces shadow rays towards a directional light through a generated mesh with the closest hit and the any hit
+	// query, and prints the rays per second of both
+	void BenchmarkShadowRays(const BenchmarkDesc& desc);
+
+	// Builds a top level structure over many instances of a single cube BLAS, and prints the build time, the memory of
+	// the BLAS and TLAS, and the rays per second
+	void BenchmarkInstances(const BenchmarkDesc& desc);
+
+	// Renders a frame in which some pixels cost many times more than others, once split into one block of rows per
+	// thread and once with the tile scheduler, and prints the time and the idle time of every thread
+	void BenchmarkDispatch(const BenchmarkDesc& desc);
+
+	// Intersects rays with every analytic primitive type using the scalar and the 8-wide kernel, and prints the rays per
+	// second of both and the number of rays on which they disagree. Then fills and builds a BLAS of many procedural
+	// spheres, and prints the fill and build time per million spheres and the rays per second. Returns false when the
+	// kernels disagree on more than a few grazing rays.
+	bool BenchmarkPrimitives(const BenchmarkDesc& desc);
+
+	// Deforms the generated mesh over a few frames and moves a few percent of many instances every frame. Prints the
+	// time of an update against a full build, and the SAH cost and rays per second of the refitted against the rebuilt
+	// structure. Returns false when the refitted structure hits another number of rays than the rebuilt one.
+	bool BenchmarkRefit(const BenchmarkDesc& desc);
+
+	// Renders a scene of reflective spheres on a reflective floor with the recursive and the wavefront renderer of the
+	// CPU backend, and prints the frame time and rays per second of both and the largest difference between the images.
+	// Returns false when the images are not the same.
+	bool BenchmarkWavefront(const BenchmarkDesc& desc);
+
+	// Builds the alias tables of a sky with a small sun and prints the build time and samples per second. Then lights
+	// the wavefront scene with the sky, and prints the error of a few samples per pixel with uniform and with alias
+	// table sampling.
+	void BenchmarkSkyLight(const BenchmarkDesc& desc);
+
+	// Generates the mip chain of a large HDR sky, converts it into every HDR texture format and a tone mapped copy into
+	// every LDR format, and prints the time, the memory against the uncompressed format and the error of each format.
+	// Then writes the BC6H mips to the texture cache and prints how long reading them back takes. Returns false when they
+	// do not read back the same.
+	bool BenchmarkTextures(const BenchmarkDesc& desc);
+
+	// Places the buffers of a scene of many small meshes in 64MB heaps with the TLSF allocator, once with the 64KB
+	// alignment of placed buffers and once with a small alignment, and prints the heap count and memory of both against
+	// a committed resource per buffer. Then frees and allocates buffers at random, and prints the operations per second
+	// and the fragmentation before and after defragmenting.
+	void BenchmarkAllocator(const BenchmarkDesc& desc);
+
+	// Records the passes of a frame of very uneven cost with the job recorder, once with a list per thread and once
+	// with four, and prints the time against recording them on one thread, the share of the largest list and the
+	// number of commands that did not end up in the order of the passes. Returns false when there are any.
+	bool BenchmarkRecording(const BenchmarkDesc& desc);
+
+	// Checks the pipeline keys of many similar pipelines for collisions, and prints the save and load time of a cache of
+	// root signature and shader sized blobs, the entries that did not read back the same, and what a cut off file keeps.
+	// Returns false on a collision or an entry that did not read back the same.
+	bool BenchmarkPipelineCache(const BenchmarkDesc& desc);
+
+	// Compiles permutations of a small library with DXC when it can be loaded, or with a stand-in compiler otherwise,
+	// and prints the compile time, the time on the next start with the cache, and whether an edit of an include is
+	// reloaded and a broken edit is reported. Returns false when any of that did not happen.
+	bool BenchmarkShaderCompilation(const BenchmarkDesc& desc);
+
+	// Checks the offsets of the local root arguments of a few local root signatures against the alignment rules, packs
+	// a hit group record with the mesh constants and a descriptor for every instance, and prints the packing time and
+	// size, and the records that did not read back the same. Returns false on a misaligned or a wrong record.
+	bool BenchmarkShaderTable(const BenchmarkDesc& desc);
+
+	// Allocates and fills the constant buffers of many frames with a fake GPU that keeps two frames in flight, on one
+	// thread and on the thread pool, and prints the constants per second, the chunks taken and the times the ring was
+	// full, and the constants that were misaligned or overwritten before the GPU finished their frame. Returns false when
+	// there are any.
+	bool BenchmarkFrameAllocator(const BenchmarkDesc& desc);
+
+	// Writes the instance descs of a TLAS once from separately allocated instances with a matrix each, the way the
+	// renderer did, and once from a cpu::InstanceStore with SSE4, AVX2 and the thread pool, and prints the times and
+	// the instances that do not match the matrix path. Returns false when there are any.
+	bool BenchmarkInstancePacking(const BenchmarkDesc& desc);
+
+	// Runs every benchmark above and prints the results to stdout. Returns false when any of them found a wrong result.
+	bool RunBenchmarks(const BenchmarkDesc& desc);
+}
@@ -0,0 +1,307 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "FrameAllocator.hpp"
+#include "Random.hpp"
+#include "TLSFAllocator.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+// The allocators behind the D3D12 backend: placed buffers in heaps and the constants of the frames
+namespace cpu
+{
+	void BenchmarkAllocator(const BenchmarkDesc& desc)
+	{
+		static constexpr uint64_t HeapSize = 64ull * 1024 * 1024;
+		static constexpr uint64_t PlacementAlignment = 64 * 1024;
+
+		// Buffers of a scene, log uniform between 256 bytes and 1 MB like the vertex and index buffers of many small meshes
+		Random random(18);
+		std::vector<uint64_t> sizes(desc.AllocatorBufferCount);
+
+		auto RandomSize = [&random]()
+		{
+			const uint64_t size = static_cast<uint64_t>(256.0 * std::exp2(12.0 * random.NextFloat()));
+			return (size + 255) & ~255ull;
+		};
+
+		uint64_t committedSize = 0;
+
+		for (uint64_t& size : sizes)
+		{
+			size = RandomSize();
+			committedSize += (size + PlacementAlignment - 1) & ~(PlacementAlignment - 1);
+		}
+
+		printf("Allocator | %u buffers | committed: %u allocations, %.1f MB\n", desc.AllocatorBufferCount, desc.AllocatorBufferCount, committedSize / (1024.0 * 1024.0));
+
+		// Every buffer goes into the first heap that has room, and a new heap is made when none has
+		auto Load = [&sizes](std::vector<TLSFAllocator>& heaps, std::vector<std::pair<uint32_t, uint32_t>>& allocations, uint64_t alignment)
+		{
+			for (uint64_t size : sizes)
+			{
+				TLSFAllocator::Allocation allocation;
+				uint32_t heap = 0;
+
+				for (; heap < heaps.size(); heap++)
+				{
+					allocation = heaps[heap].Allocate(size, alignment);
+
+					if (allocation.Handle != TLSFAllocator::InvalidHandle)
+					{
+						break;
+					}
+				}
+
+				if (allocation.Handle == TLSFAllocator::InvalidHandle)
+				{
+					heaps.emplace_back(HeapSize);
+					allocation = heaps.back().Allocate(size, alignment);
+				}
+
+				allocations.emplace_back(heap, allocation.Handle);
+			}
+		};
+
+		auto PrintHeaps = [](const char* name, const std::vector<TLSFAllocator>& heaps, double time, uint32_t operationCount)
+		{
+			uint64_t usedSize = 0;
+			uint64_t freeSize = 0;
+			uint64_t largestFreeSize = 0;
+			uint32_t freeRangeCount = 0;
+
+			for (const TLSFAllocator& heap : heaps)
+			{
+				const TLSFAllocator::Statistics statistics = heap.GetStatistics();
+
+				usedSize += statistics.UsedSize;
+				freeSize += statistics.FreeSize;
+				largestFreeSize = std::max(largestFreeSize, statistics.LargestFreeSize);
+				freeRangeCount += statistics.FreeRangeCount;
+			}
+
+			printf("Allocator | %s | %zu heaps, %.1f MB | %.1f MB used, %.1f MB free in %u ranges, largest %.2f MB",
+				name, heaps.size(), heaps.size() * HeapSize / (1024.0 * 1024.0), usedSize / (1024.0 * 1024.0), freeSize / (1024.0 * 1024.0), freeRangeCount,
+				largestFreeSize / (1024.0 * 1024.0));
+
+			if (operationCount > 0)
+			{
+				printf(" | %.2f M operations/s", operationCount / time / 1e6);
+			}
+
+			printf("\n");
+		};
+
+		// Buffers placed in heaps keep the 64KB alignment of committed buffers, but take one allocation per heap
+		std::vector<TLSFAllocator> placedHeaps;
+		std::vector<std::pair<uint32_t, uint32_t>> placed;
+
+		auto start = std::chrono::steady_clock::now();
+		Load(placedHeaps, placed, PlacementAlignment);
+		PrintHeaps("placed", placedHeaps, Seconds(start), desc.AllocatorBufferCount);
+
+		// Ranges of one large buffer only need the alignment of the data in them
+		std::vector<TLSFAllocator> heaps;
+		std::vector<std::pair<uint32_t, uint32_t>> allocations;
+
+		start = std::chrono::steady_clock::now();
+		Load(heaps, allocations, 256);
+		PrintHeaps("suballocated", heaps, Seconds(start), desc.AllocatorBufferCount);
+
+		// Meshes being unloaded and loaded: every operation frees a random buffer and allocates a new one, in a new heap
+		// when fragmentation leaves no room in the others
+		const uint32_t churnCount = desc.AllocatorBufferCount * 10;
+
+		start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < churnCount; i++)
+		{
+			auto& allocation = allocations[random.Next() % allocations.size()];
+			heaps[allocation.first].Free(allocation.second);
+
+			const uint64_t size = RandomSize();
+			allocation.second = heaps[allocation.first].Allocate(size, 256).Handle;
+
+			for (uint32_t heap = 0; heap < heaps.size() && allocation.second == TLSFAllocator::InvalidHandle; heap++)
+			{
+				allocation.first = heap;
+				allocation.second = heaps[heap].Allocate(size, 256).Handle;
+			}
+
+			if (allocation.second == TLSFAllocator::InvalidHandle)
+			{
+				heaps.emplace_back(HeapSize);
+				allocation.first = static_cast<uint32_t>(heaps.size() - 1);
+				allocation.second = heaps.back().Allocate(size, 256).Handle;
+			}
+		}
+
+		PrintHeaps("after churn", heaps, Seconds(start), churnCount * 2);
+
+		std::vector<TLSFAllocator::Move> moves;
+		uint64_t movedSize = 0;
+
+		start = std::chrono::steady_clock::now();
+
+		for (TLSFAllocator& heap : heaps)
+		{
+			moves.clear();
+			heap.Defragment(moves);
+
+			for (const TLSFAllocator::Move& move : moves)
+			{
+				movedSize += move.Size;
+			}
+		}
+
+		const double defragmentTime = Seconds(start);
+
+		PrintHeaps("defragmented", heaps, defragmentTime, 0);
+		printf("Allocator | defragment planned in %.2f ms, %.1f MB to copy\n", defragmentTime * 1000.0, movedSize / (1024.0 * 1024.0));
+	}
+
+	bool BenchmarkFrameAllocator(const BenchmarkDesc& desc)
+	{
+		const uint32_t frameCount = 64;
+		const uint32_t framesInFlight = 2;
+		const uint32_t constantCount = desc.FrameConstantCount;
+
+		// Small enough that the frames in flight fill it, so the allocator has to wait for the GPU
+		const uint64_t capacity = 16ull * 1024 * 1024;
+		const uint64_t gpuAddress = 0x100000000ull;
+
+		std::vector<uint8_t> memory(capacity);
+
+		// From a single float4 to a few matrices
+		Random random(24);
+		std::vector<uint32_t> sizes(constantCount);
+
+		for (uint32_t& size : sizes)
+		{
+			size = (16 + random.Next() % 497) & ~3u;
+		}
+
+		struct Result
+		{
+			double Time = 0.0;
+			uint64_t ChunkCount = 0;
+			uint64_t WaitCount = 0;
+			uint32_t FailedCount = 0;
+			uint32_t MisalignedCount = 0;
+			uint32_t OverwrittenCount = 0;
+			bool OversizedRejected = false;
+		};
+
+		auto Run = [&](bool parallel)
+		{
+			Result result;
+
+			// The offset of every constant buffer of every frame, which the fake GPU reads back once it finishes a frame
+			std::vector<std::vector<uint64_t>> frames(frameCount, std::vector<uint64_t>(constantCount));
+			uint64_t completedFence = 0;
+
+			// Frame i has fence i + 1. Called by the allocator under its lock when the ring is full, and by the frame loop.
+			auto Complete = [&](uint64_t fence)
+			{
+				for (; completedFence < fence; completedFence++)
+				{
+					const std::vector<uint64_t>& offsets = frames[completedFence];
+
+					for (uint32_t i = 0; i < constantCount; i++)
+					{
+						if (offsets[i] == RingAllocator::InvalidOffset)
+						{
+							result.FailedCount++;
+							continue;
+						}
+
+						result.MisalignedCount += offsets[i] % FrameAllocator::Alignment != 0 || offsets[i] + sizes[i] > capacity;
+
+						const uint32_t value = static_cast<uint32_t>(completedFence) * constantCount + i;
+						const uint32_t* words = reinterpret_cast<const uint32_t*>(memory.data() + offsets[i]);
+						bool overwritten = false;
+
+						for (uint32_t word = 0; word < sizes[i] / 4; word++)
+						{
+							overwritten |= words[word] != value;
+						}
+
+						result.OverwrittenCount += overwritten;
+					}
+				}
+
+				return completedFence;
+			};
+
+			FrameAllocator allocator(memory.data(), gpuAddress, capacity, ThreadPool::Get().GetThreadCount(), 64 * 1024, Complete);
+
+			for (uint32_t frame = 0; frame < frameCount; frame++)
+			{
+				std::vector<uint64_t>& offsets = frames[frame];
+
+				auto Allocate = [&](uint32_t begin, uint32_t end, uint32_t threadIndex)
+				{
+					for (uint32_t i = begin; i < end; i++)
+					{
+						const FrameAllocator::Allocation allocation = allocator.Allocate(sizes[i], threadIndex);
+
+						if (allocation.CPUAddress == nullptr)
+						{
+							offsets[i] = RingAllocator::InvalidOffset;
+							continue;
+						}
+
+						// Every word of the constants tells the frame and the constant it belongs to
+						const uint32_t value = frame * constantCount + i;
+						uint32_t* words = reinterpret_cast<uint32_t*>(allocation.CPUAddress);
+						std::fill(words, words + sizes[i] / 4, value);
+
+						offsets[i] = allocation.GPUAddress - gpuAddress;
+					}
+				};
+
+				auto start = std::chrono::steady_clock::now();
+
+				if (parallel)
+				{
+					ThreadPool::Get().ParallelFor(constantCount, 256, Allocate);
+				}
+				else
+				{
+					Allocate(0, constantCount, 0);
+				}
+
+				result.Time += Seconds(start);
+
+				const uint64_t fence = frame + 1;
+				allocator.EndFrame(fence, Complete(fence > framesInFlight ? fence - framesInFlight : 0));
+			}
+
+			Complete(frameCount);
+
+			result.ChunkCount = allocator.GetChunkCount();
+			result.WaitCount = allocator.GetWaitCount();
+
+			// A single constant buffer larger than the ring fails instead of waiting forever
+			result.OversizedRejected = allocator.Allocate(capacity + FrameAllocator::Alignment).GPUAddress == 0;
+
+			return result;
+		};
+
+		const Result single = Run(false);
+		const Result parallel = Run(true);
+		const double constants = static_cast<double>(frameCount) * constantCount;
+
+		printf("Frame allocator | %u frames of %u constants | 1 thread %.1f M constants/s, %llu chunks, %llu waits | %u threads %.1f M constants/s, %llu chunks, %llu waits | %u failed, %u misaligned, %u overwritten | oversized constants %s\n",
+			frameCount, constantCount, constants / single.Time / 1e6, static_cast<unsigned long long>(single.ChunkCount), static_cast<unsigned long long>(single.WaitCount),
+			ThreadPool::Get().GetThreadCount(), constants / parallel.Time / 1e6, static_cast<unsigned long long>(parallel.ChunkCount), static_cast<unsigned long long>(parallel.WaitCount),
+			single.FailedCount + parallel.FailedCount, single.MisalignedCount + parallel.MisalignedCount, single.OverwrittenCount + parallel.OverwrittenCount,
+			single.OversizedRejected && parallel.OversizedRejected ? "rejected" : "accepted");
+
+		return single.FailedCount + parallel.FailedCount + single.MisalignedCount + parallel.MisalignedCount + single.OverwrittenCount + parallel.OverwrittenCount == 0 &&
+			single.OversizedRejected && parallel.OversizedRejected;
+	}
+}
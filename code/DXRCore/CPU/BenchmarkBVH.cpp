@@ -0,0 +1,498 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "PrimitiveKernels.hpp"
+#include "Random.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+
+// BVH builds and traversal of a single BLAS, with triangles and with procedural primitives
+namespace cpu
+{
+	namespace
+	{
+		// Signed distance from a point to the surface of a primitive, in double precision, to check the hits of the
+		// kernels against
+		double GetPrimitiveDistance(const primitives::Primitive& primitive, double x, double y, double z)
+		{
+			const Float4& p = primitive.Parameters;
+
+			x -= primitive.Position.x;
+			y -= primitive.Position.y;
+			z -= primitive.Position.z;
+
+			switch (primitive.Type)
+			{
+			case primitives::PRIMITIVE_TORUS:
+			{
+				const double ring = std::sqrt(x * x + y * y) - p.x;
+				return std::sqrt(ring * ring + z * z) - p.y;
+			}
+			case primitives::PRIMITIVE_BOX:
+			{
+				const double qx = std::abs(x) - p.x;
+				const double qy = std::abs(y) - p.y;
+				const double qz = std::abs(z) - p.z;
+
+				const double ox = std::max(qx, 0.0);
+				const double oy = std::max(qy, 0.0);
+				const double oz = std::max(qz, 0.0);
+
+				return std::sqrt(ox * ox + oy * oy + oz * oz) + std::min(std::max({ qx, qy, qz }), 0.0);
+			}
+			case primitives::PRIMITIVE_CYLINDER:
+			{
+				const double side = std::sqrt(x * x + y * y) - p.x;
+				const double cap = std::abs(z) - p.y;
+
+				return std::hypot(std::max(side, 0.0), std::max(cap, 0.0)) + std::min(std::max(side, cap), 0.0);
+			}
+			case primitives::PRIMITIVE_CAPSULE:
+			{
+				const double segment = z - std::clamp(z, -static_cast<double>(p.y), static_cast<double>(p.y));
+				return std::sqrt(x * x + y * y + segment * segment) - p.x;
+			}
+			default:
+				return std::sqrt(x * x + y * y + z * z) - p.x;
+			}
+		}
+
+		double GetHitDistance(const primitives::Primitive& primitive, const RayPacket8& packet, uint32_t lane, float t)
+		{
+			return std::abs(GetPrimitiveDistance(primitive,
+				packet.OriginX[lane] + static_cast<double>(t) * packet.DirectionX[lane],
+				packet.OriginY[lane] + static_cast<double>(t) * packet.DirectionY[lane],
+				packet.OriginZ[lane] + static_cast<double>(t) * packet.DirectionZ[lane]));
+		}
+
+		// How deep the ray reaches below the surface around a hit at t, sampled in steps of a thousandth of the size of
+		// the primitive. Negative when the ray stays outside.
+		double GetPenetration(const primitives::Primitive& primitive, const RayPacket8& packet, uint32_t lane, float t)
+		{
+			Float3 boundsMin;
+			Float3 boundsMax;
+			primitives::GetPrimitiveBounds(primitive, boundsMin, boundsMax);
+
+			const Float3 extent = boundsMax - boundsMin;
+			const double size = std::max({ extent.x, extent.y, extent.z });
+
+			double deepest = FloatMax;
+
+			for (int i = -1000; i <= 1000; i++)
+			{
+				const double sampleT = t + size * i * 1.0e-3;
+
+				deepest = std::min(deepest, GetPrimitiveDistance(primitive,
+					packet.OriginX[lane] + sampleT * packet.DirectionX[lane],
+					packet.OriginY[lane] + sampleT * packet.DirectionY[lane],
+					packet.OriginZ[lane] + sampleT * packet.DirectionZ[lane]));
+			}
+
+			return -deepest;
+		}
+	}
+
+	void BenchmarkBVHBuild(const BenchmarkDesc& desc)
+	{
+		for (uint32_t indexSize : { sizeof(uint16_t), sizeof(uint32_t) })
+		{
+			TriangleMesh mesh;
+			CreateMesh(mesh, desc.TriangleCount, indexSize);
+
+			BottomLevelAS blas;
+
+			// Warm up, so the first build does not pay for page faults
+			blas.Build(mesh);
+
+			auto start = std::chrono::steady_clock::now();
+
+			for (uint32_t i = 0; i < desc.BuildIterations; i++)
+			{
+				blas.Build(mesh);
+			}
+
+			const double time = Seconds(start) / desc.BuildIterations;
+			const BVHStatistics& statistics = blas.GetStatistics();
+
+			printf("BVH build | %u-bit indices | %u triangles | %.2f builds/s (%.2f ms) | SAH cost %.2f | %u nodes, %u leaves\n",
+				indexSize * 8, mesh.GetTriangleCount(), 1.0 / time, time * 1000.0, statistics.SAHCost, statistics.NodeCount, statistics.LeafCount);
+		}
+	}
+
+	void BenchmarkBVHTrace(const BenchmarkDesc& desc)
+	{
+		TriangleMesh mesh;
+		CreateMesh(mesh, desc.TriangleCount, sizeof(uint32_t));
+
+		const uint32_t resolution = static_cast<uint32_t>(std::sqrt(static_cast<double>(desc.RayCount)));
+
+		// A pinhole camera looking at the mesh, neighboring rays take nearly the same path through the tree
+		auto CoherentRay = [resolution](uint32_t i)
+			{
+				const float x = ((i % resolution) + 0.5f) / resolution * 2.0f - 1.0f;
+				const float z = ((i / resolution) + 0.5f) / resolution * 2.0f - 1.0f;
+
+				Ray ray;
+				ray.Origin = Float3(0.0f, -3.0f, 0.0f);
+				ray.Direction = Normalize(Float3(x * 0.5f, 1.0f, z * 0.5f));
+				ray.TMin = 0.0f;
+				ray.TMax = FloatMax;
+
+				return ray;
+			};
+
+		// Rays that start near the surface and leave in a random direction, like the reflection and shadow rays of the samples
+		auto IncoherentRay = [](uint32_t i)
+			{
+				Random random(i);
+
+				auto RandomDirection = [&random]()
+					{
+						const float z = random.NextFloat() * 2.0f - 1.0f;
+						const float phi = random.NextFloat() * 2.0f * PI;
+						const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+
+						return Float3(r * std::cos(phi), r * std::sin(phi), z);
+					};
+
+				Ray ray;
+				ray.Origin = RandomDirection() * (0.8f + 0.4f * random.NextFloat());
+				ray.Direction = RandomDirection();
+				ray.TMin = 0.0f;
+				ray.TMax = FloatMax;
+
+				return ray;
+			};
+
+		struct Configuration
+		{
+			const char* Name;
+			BVHLayout Layout;
+			SIMDLevel Level;
+		};
+
+		const Configuration configurations[] = {
+			{ "binary     ", BVHLayout::Binary, SIMDLevel::Scalar },
+			{ "BVH8 scalar", BVHLayout::Wide, SIMDLevel::Scalar },
+			{ "BVH8 SSE4  ", BVHLayout::Wide, SIMDLevel::SSE4 },
+			{ "BVH8 AVX2  ", BVHLayout::Wide, SIMDLevel::AVX2 },
+		};
+
+		const SIMDLevel previousLevel = GetSIMDLevel();
+
+		for (const Configuration& configuration : configurations)
+		{
+			if (configuration.Level > GetSupportedSIMDLevel())
+			{
+				printf("BVH trace | %s | skipped, not supported by this CPU\n", configuration.Name);
+				continue;
+			}
+
+			SetSIMDLevel(configuration.Level);
+
+			BottomLevelAS blas;
+			blas.SetLayout(configuration.Layout);
+			blas.Build(mesh);
+
+			uint32_t coherentHits = 0;
+			uint32_t incoherentHits = 0;
+
+			const double coherent = TraceRays(blas, resolution * resolution, CoherentRay, coherentHits);
+			const double incoherent = TraceRays(blas, desc.RayCount, IncoherentRay, incoherentHits);
+
+			printf("BVH trace | %s | %.2f MB of nodes | coherent %.2f MRays/s (%.1f%% hit) | incoherent %.2f MRays/s (%.1f%% hit)\n",
+				configuration.Name, blas.GetNodeMemory() / (1024.0 * 1024.0),
+				coherent * 1.0e-6, 100.0 * coherentHits / (resolution * resolution),
+				incoherent * 1.0e-6, 100.0 * incoherentHits / desc.RayCount);
+		}
+
+		SetSIMDLevel(previousLevel);
+	}
+
+	void BenchmarkShadowRays(const BenchmarkDesc& desc)
+	{
+		TriangleMesh mesh;
+		CreateMesh(mesh, desc.TriangleCount, sizeof(uint32_t));
+
+		// Rays from points around the surface towards a directional light. The bumps shadow each other.
+		auto ShadowRay = [](uint32_t i)
+			{
+				Random random(i);
+
+				const float z = random.NextFloat() * 2.0f - 1.0f;
+				const float phi = random.NextFloat() * 2.0f * PI;
+				const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+
+				Ray ray;
+				ray.Origin = Float3(r * std::cos(phi), r * std::sin(phi), z) * (0.9f + 0.2f * random.NextFloat());
+				ray.Direction = Normalize(Float3(0.3f, -0.6f, 0.75f));
+				ray.TMin = 1.0e-3f;
+				ray.TMax = FloatMax;
+
+				return ray;
+			};
+
+		const SIMDLevel previousLevel = GetSIMDLevel();
+
+		for (SIMDLevel level : { SIMDLevel::Scalar, SIMDLevel::SSE4, SIMDLevel::AVX2 })
+		{
+			const char* name = level == SIMDLevel::AVX2 ? "BVH8 AVX2" : level == SIMDLevel::SSE4 ? "BVH8 SSE4" : "BVH8 scalar";
+
+			if (level > GetSupportedSIMDLevel())
+			{
+				printf("Shadow rays | %s | skipped, not supported by this CPU\n", name);
+				continue;
+			}
+
+			SetSIMDLevel(level);
+
+			BottomLevelAS blas;
+			blas.Build(mesh);
+
+			uint32_t closestHits = 0;
+			uint32_t anyHits = 0;
+
+			const double closest = TraceRays(blas, desc.RayCount, ShadowRay, closestHits);
+			const double any = TraceRays(blas, desc.RayCount, ShadowRay, anyHits, true);
+
+			printf("Shadow rays | %s | closest hit %.2f MRays/s | any hit %.2f MRays/s (%.2fx) | %.1f%% occluded\n",
+				name, closest * 1.0e-6, any * 1.0e-6, any / closest, 100.0 * anyHits / desc.RayCount);
+		}
+
+		SetSIMDLevel(previousLevel);
+	}
+
+	bool BenchmarkPrimitives(const BenchmarkDesc& desc)
+	{
+		const primitives::Primitive kernels[] = {
+			{ primitives::PRIMITIVE_SPHERE, Float3(0.0f), { 1.0f, 0.0f, 0.0f, 0.0f } },
+			{ primitives::PRIMITIVE_TORUS, Float3(0.0f), { 0.8f, 0.25f, 0.0f, 0.0f } },
+			{ primitives::PRIMITIVE_BOX, Float3(0.0f), { 0.8f, 0.6f, 0.4f, 0.0f } },
+			{ primitives::PRIMITIVE_CYLINDER, Float3(0.0f), { 0.6f, 0.8f, 0.0f, 0.0f } },
+			{ primitives::PRIMITIVE_CAPSULE, Float3(0.0f), { 0.5f, 0.5f, 0.0f, 0.0f } }
+		};
+
+		const char* names[] = { "sphere  ", "torus   ", "box     ", "cylinder", "capsule " };
+
+		// Rays from random points around the primitive towards random points close to it, so roughly half of them hit.
+		// The packets are reused until RayCount rays have been tested, which keeps the benchmark out of main memory.
+		constexpr uint32_t PacketCount = 8192;
+		const uint32_t rounds = std::max(desc.RayCount / (PacketCount * 8), 1u);
+		const uint64_t rayCount = static_cast<uint64_t>(rounds) * PacketCount * 8;
+
+		std::vector<RayPacket8> packets(PacketCount);
+		Random random(0x9e3779b9);
+
+		for (RayPacket8& packet : packets)
+		{
+			for (uint32_t lane = 0; lane < 8; lane++)
+			{
+				const Float3 origin = Float3(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * 8.0f;
+				const Float3 target = Float3(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * 2.5f;
+				const Float3 direction = Normalize(target - origin);
+
+				packet.OriginX[lane] = origin.x;
+				packet.OriginY[lane] = origin.y;
+				packet.OriginZ[lane] = origin.z;
+				packet.DirectionX[lane] = direction.x;
+				packet.DirectionY[lane] = direction.y;
+				packet.DirectionZ[lane] = direction.z;
+				packet.TMin[lane] = 0.0f;
+				packet.TMax[lane] = FloatMax;
+			}
+		}
+
+		const SIMDLevel previousLevel = GetSIMDLevel();
+		const bool hasAVX2 = GetSupportedSIMDLevel() >= SIMDLevel::AVX2;
+
+		// On t, and on the distance of a hit to the surface, for primitives of about unit size
+		constexpr float Tolerance = 1.0e-2f;
+
+		std::vector<float> scalarT(static_cast<size_t>(PacketCount) * 8);
+		std::vector<float> wideT(static_cast<size_t>(PacketCount) * 8);
+		std::vector<uint8_t> scalarMasks(PacketCount);
+		std::vector<uint8_t> wideMasks(PacketCount);
+
+		bool passed = true;
+
+		for (uint32_t kernel = 0; kernel < std::size(kernels); kernel++)
+		{
+			const primitives::Primitive& primitive = kernels[kernel];
+
+			// Single threaded, this measures the kernels and not the thread pool
+			auto start = std::chrono::steady_clock::now();
+
+			for (uint32_t round = 0; round < rounds; round++)
+			{
+				for (uint32_t i = 0; i < PacketCount; i++)
+				{
+					const RayPacket8& packet = packets[i];
+					uint8_t mask = 0;
+
+					for (uint32_t lane = 0; lane < 8; lane++)
+					{
+						const Float3 origin(packet.OriginX[lane], packet.OriginY[lane], packet.OriginZ[lane]);
+						const Float3 direction(packet.DirectionX[lane], packet.DirectionY[lane], packet.DirectionZ[lane]);
+
+						if (primitives::IntersectPrimitive(primitive, origin, direction, packet.TMin[lane], packet.TMax[lane], scalarT[i * 8 + lane]))
+						{
+							mask |= 1 << lane;
+						}
+					}
+
+					scalarMasks[i] = mask;
+				}
+			}
+
+			const double scalarTime = Seconds(start);
+
+			// Every hit has to be on the surface. The closed form of the torus cancels away about three digits in single
+			// precision, the kernels polish its root so the hit stays within the tolerance.
+			uint32_t hits = 0;
+			double largestError = 0.0;
+
+			for (uint32_t i = 0; i < PacketCount; i++)
+			{
+				for (uint32_t lane = 0; lane < 8; lane++)
+				{
+					if ((scalarMasks[i] >> lane & 1) != 0)
+					{
+						largestError = std::max(largestError, GetHitDistance(primitive, packets[i], lane, scalarT[i * 8 + lane]));
+						hits++;
+					}
+				}
+			}
+
+			if (!hasAVX2)
+			{
+				printf("Primitives | %s | scalar %.2f MRays/s | 8-wide skipped, AVX2 not supported by this CPU | %.1f%% hit | largest distance to the surface %.1e\n",
+					names[kernel], rayCount / scalarTime * 1.0e-6, 100.0 * hits / (PacketCount * 8), largestError);
+
+				passed &= largestError <= Tolerance;
+				continue;
+			}
+
+			SetSIMDLevel(SIMDLevel::AVX2);
+			start = std::chrono::steady_clock::now();
+
+			for (uint32_t round = 0; round < rounds; round++)
+			{
+				for (uint32_t i = 0; i < PacketCount; i++)
+				{
+					wideMasks[i] = static_cast<uint8_t>(IntersectPrimitive8(primitive, packets[i], 0xff, &wideT[i * 8]));
+				}
+			}
+
+			const double wideTime = Seconds(start);
+
+			// The kernels have to agree on t within the tolerance. A ray that grazes the surface has a double root, which
+			// the kernels may decide differently, but only when the ray reaches less than the tolerance into the
+			// primitive.
+			uint32_t mismatches = 0;
+			uint32_t grazingRays = 0;
+
+			for (uint32_t i = 0; i < PacketCount; i++)
+			{
+				for (uint32_t lane = 0; lane < 8; lane++)
+				{
+					const bool scalarHit = (scalarMasks[i] >> lane & 1) != 0;
+					const bool wideHit = (wideMasks[i] >> lane & 1) != 0;
+
+					const float wide = wideT[i * 8 + lane];
+
+					if (wideHit)
+					{
+						largestError = std::max(largestError, GetHitDistance(primitive, packets[i], lane, wide));
+					}
+
+					if (scalarHit && wideHit)
+					{
+						mismatches += std::abs(scalarT[i * 8 + lane] - wide) > Tolerance;
+					}
+					else if (scalarHit != wideHit)
+					{
+						const float t = scalarHit ? scalarT[i * 8 + lane] : wide;
+
+						if (GetPenetration(primitive, packets[i], lane, t) < Tolerance)
+						{
+							grazingRays++;
+						}
+						else
+						{
+							mismatches++;
+						}
+					}
+				}
+			}
+
+			printf("Primitives | %s | scalar %.2f MRays/s | 8-wide %.2f MRays/s (%.2fx) | %.1f%% hit | %u mismatches, %u grazing rays | largest distance to the surface %.1e\n",
+				names[kernel], rayCount / scalarTime * 1.0e-6, rayCount / wideTime * 1.0e-6, scalarTime / wideTime,
+				100.0 * hits / (PacketCount * 8), mismatches, grazingRays, largestError);
+
+			passed &= mismatches == 0 && largestError <= Tolerance;
+		}
+
+		SetSIMDLevel(previousLevel);
+
+		// Small spheres scattered through a cube, generated by all threads and traced from the outside through the BLAS
+		ProceduralGeometry geometry;
+		const float extent = std::cbrt(static_cast<float>(desc.PrimitiveCount)) * 0.5f;
+
+		auto start = std::chrono::steady_clock::now();
+
+		geometry.Resize(desc.PrimitiveCount);
+		ThreadPool::Get().ParallelFor(desc.PrimitiveCount, 16384, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				for (uint64_t i = begin; i < end; i++)
+				{
+					Random sphereRandom(static_cast<uint32_t>(i));
+
+					primitives::Primitive sphere = {};
+					sphere.Type = primitives::PRIMITIVE_SPHERE;
+					sphere.Position = Float3(sphereRandom.NextFloat(), sphereRandom.NextFloat(), sphereRandom.NextFloat()) * (2.0f * extent) - Float3(extent);
+					sphere.Parameters.x = 0.1f + 0.15f * sphereRandom.NextFloat();
+
+					Float3 boundsMin;
+					Float3 boundsMax;
+					primitives::GetPrimitiveBounds(sphere, boundsMin, boundsMax);
+
+					geometry.SetPrimitive(i, { boundsMin, boundsMax }, sphere);
+				}
+			});
+
+		const double fillTime = Seconds(start);
+
+		BottomLevelAS blas;
+
+		start = std::chrono::steady_clock::now();
+		blas.Build(geometry);
+		const double buildTime = Seconds(start);
+
+		auto SphereRay = [extent](uint32_t i)
+			{
+				Random rayRandom(i);
+
+				Ray ray;
+				ray.Origin = Float3(rayRandom.NextFloat() - 0.5f, rayRandom.NextFloat() - 0.5f, -1.0f) * (2.0f * extent);
+				ray.Direction = Normalize(Float3(rayRandom.NextFloat() - 0.5f, rayRandom.NextFloat() - 0.5f, 4.0f));
+				ray.TMin = 0.0f;
+				ray.TMax = FloatMax;
+
+				return ray;
+			};
+
+		uint32_t hitCount = 0;
+		const double raysPerSecond = TraceRays(blas, desc.RayCount, SphereRay, hitCount);
+
+		const double millions = desc.PrimitiveCount * 1.0e-6;
+		printf("Primitives | %u spheres | fill %.2f ms (%.2f ms per million) | BLAS build %.2f ms (%.2f ms per million) | %.2f MRays/s (%.1f%% hit)\n",
+			desc.PrimitiveCount, fillTime * 1000.0, fillTime * 1000.0 / millions, buildTime * 1000.0, buildTime * 1000.0 / millions,
+			raysPerSecond * 1.0e-6, 100.0 * hitCount / desc.RayCount);
+
+		return passed;
+	}
+}
@@ -0,0 +1,453 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "PipelineCache.hpp"
+#include "Random.hpp"
+#include "ShaderCompiler.hpp"
+#include "ShaderTable.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+// Creating the pipelines of the D3D12 backend: the pipeline cache, compiling shaders and the shader tables
+namespace cpu
+{
+	bool BenchmarkPipelineCache(const BenchmarkDesc& desc)
+	{
+		// Keys of pipelines that differ in one name or value, the way the hit groups of a scene do. Two lists of names
+		// that only differ in where one name ends and the next starts have to get different keys as well.
+		std::vector<uint64_t> keys;
+		keys.reserve(desc.PipelineCacheEntryCount * 2);
+
+		for (uint32_t i = 0; i < desc.PipelineCacheEntryCount; i++)
+		{
+			const std::wstring name = L"HitGroup" + std::to_wstring(i);
+
+			PipelineKey key;
+			key.Add(name);
+			key.Add(std::wstring_view(L"Closest"));
+			key.AddValue(i % 64);
+			keys.push_back(key.Get());
+
+			PipelineKey moved;
+			moved.Add(name + L"C");
+			moved.Add(std::wstring_view(L"losest"));
+			moved.AddValue(i % 64);
+			keys.push_back(moved.Get());
+		}
+
+		std::vector<uint64_t> sortedKeys = keys;
+		std::sort(sortedKeys.begin(), sortedKeys.end());
+		const uint64_t collisionCount = sortedKeys.size() - (std::unique(sortedKeys.begin(), sortedKeys.end()) - sortedKeys.begin());
+
+		// Blobs between 256 bytes and 64 KB, the range of root signatures and compiled shader libraries
+		Random random(21);
+
+		std::vector<std::vector<uint8_t>> blobs(desc.PipelineCacheEntryCount);
+		uint64_t totalSize = 0;
+
+		const std::string path = (std::filesystem::temp_directory_path() / "DXRBenchmarkPipelineCache.bin").string();
+		PipelineCache cache(path);
+
+		for (uint32_t i = 0; i < desc.PipelineCacheEntryCount; i++)
+		{
+			blobs[i].resize(static_cast<size_t>(256.0 * std::exp2(8.0 * random.NextFloat())));
+
+			for (uint8_t& byte : blobs[i])
+			{
+				byte = static_cast<uint8_t>(random.Next());
+			}
+
+			totalSize += blobs[i].size();
+			cache.Store(keys[i * 2], blobs[i].data(), blobs[i].size());
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		const bool saved = cache.Save();
+		const double saveTime = Seconds(start);
+
+		auto CountMismatches = [&](const PipelineCache& loaded)
+		{
+			uint32_t mismatchCount = 0;
+
+			for (uint32_t i = 0; i < desc.PipelineCacheEntryCount; i++)
+			{
+				const std::vector<uint8_t>* blob = loaded.Find(keys[i * 2]);
+				mismatchCount += blob != nullptr && *blob != blobs[i];
+			}
+
+			return mismatchCount;
+		};
+
+		PipelineCache loaded(path);
+
+		start = std::chrono::steady_clock::now();
+		const bool load = loaded.Load();
+		const double loadTime = Seconds(start);
+
+		const uint32_t mismatchCount = CountMismatches(loaded) + desc.PipelineCacheEntryCount - loaded.GetEntryCount();
+
+		// A file cut off in the middle of an entry keeps the entries before it and drops the rest
+		std::error_code error;
+		std::filesystem::resize_file(path, std::filesystem::file_size(path, error) / 2, error);
+
+		PipelineCache truncated(path);
+		truncated.Load();
+
+		const uint32_t truncatedMismatchCount = CountMismatches(truncated);
+
+		std::filesystem::remove(path, error);
+
+		if (!saved || !load)
+		{
+			printf("Pipeline cache | failed to write or read %s\n", path.c_str());
+			return false;
+		}
+
+		printf("Pipeline cache | %llu key collisions in %zu keys | %u entries, %.2f MB saved in %.2f ms, loaded in %.2f ms | %u missing or wrong entries | %u of %u entries kept of a file cut in half, %u wrong\n",
+			static_cast<unsigned long long>(collisionCount), keys.size(), desc.PipelineCacheEntryCount, totalSize / (1024.0 * 1024.0), saveTime * 1000.0,
+			loadTime * 1000.0, mismatchCount, truncated.GetEntryCount(), desc.PipelineCacheEntryCount, truncatedMismatchCount);
+
+		return collisionCount == 0 && mismatchCount == 0 && truncatedMismatchCount == 0;
+	}
+
+	bool BenchmarkShaderCompilation(const BenchmarkDesc& desc)
+	{
+		// A library that includes a file next to it, which includes one from an include directory
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "DXRBenchmarkShaders";
+		const std::string cachePath = (directory / "ShaderCache.bin").string();
+
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+		std::filesystem::create_directories(directory / "Include", error);
+
+		auto WriteFile = [](const std::filesystem::path& path, const char* text)
+		{
+			std::FILE* file = std::fopen(path.string().c_str(), "wb");
+
+			if (file != nullptr)
+			{
+				std::fputs(text, file);
+				std::fclose(file);
+			}
+
+			// File times can be as coarse as seconds, so every write moves the time on by one
+			static auto time = std::filesystem::file_time_type::clock::now();
+			time += std::chrono::seconds(1);
+
+			std::error_code error;
+			std::filesystem::last_write_time(path, time, error);
+		};
+
+		WriteFile(directory / "Library.hlsl",
+			"#include \"Shared.hpp\"\n"
+			"RWTexture2D<float4> Output : register(u0);\n"
+			"[shader(\"raygeneration\")]\n"
+			"void RayGenMain()\n"
+			"{\n"
+			"    float4 color = 0;\n"
+			"    for (uint i = 0; i < RECURSION_DEPTH; i++) { color += COLOR * SCALE * i; }\n"
+			"    Output[DispatchRaysIndex().xy] = color;\n"
+			"}\n");
+		WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#define COLOR float4(1, 0, 0, 1)\n");
+		WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 1.0f\n");
+
+		// Without DXC, a stand-in that fails on '#error' and returns a hash of the source and arguments checks the
+		// queue, the cache and the reloads all the same
+		ShaderCompiler compiler;
+		const bool hasCompiler = compiler.Initialize();
+
+		ShaderCompileService::CompileFunction compile = [&compiler](const ShaderCompileDesc& shader, std::vector<uint8_t>& code, std::string& errors)
+		{
+			return compiler.Compile(shader, code, errors);
+		};
+
+		if (!hasCompiler)
+		{
+			compile = [](const ShaderCompileDesc& shader, std::vector<uint8_t>& code, std::string& errors)
+			{
+				std::string text;
+				uint64_t hash = 0;
+				std::vector<std::string> files;
+
+				if (!HashShaderSource(shader.SourcePath, shader.IncludeDirectories, hash, files))
+				{
+					errors = "Failed to read " + shader.SourcePath;
+					return false;
+				}
+
+				for (const std::string& file : files)
+				{
+					std::FILE* source = std::fopen(file.c_str(), "rb");
+					char buffer[256];
+
+					while (source != nullptr && std::fgets(buffer, sizeof(buffer), source) != nullptr)
+					{
+						text += buffer;
+					}
+
+					if (source != nullptr)
+					{
+						std::fclose(source);
+					}
+				}
+
+				if (text.find("#error") != text.npos)
+				{
+					errors = shader.SourcePath + ": error: #error";
+					return false;
+				}
+
+				const uint64_t key = GetShaderKey(shader, hash, 0);
+				code.assign(reinterpret_cast<const uint8_t*>(&key), reinterpret_cast<const uint8_t*>(&key) + sizeof(key));
+
+				return true;
+			};
+		}
+
+		auto Permutation = [&directory](uint32_t depth)
+		{
+			ShaderCompileDesc shader;
+			shader.SourcePath = (directory / "Library.hlsl").string();
+			shader.Defines.push_back({ "RECURSION_DEPTH", std::to_string(depth) });
+			shader.IncludeDirectories.push_back((directory / "Include").string());
+
+			return shader;
+		};
+
+		const uint32_t permutationCount = desc.ShaderPermutationCount;
+		const uint32_t threadCount = std::max(ThreadPool::Get().GetThreadCount() / 2, 1u);
+
+		// Takes the result of every permutation, and counts the ones that compiled and the codes that are unique
+		auto TakeResults = [permutationCount](ShaderCompileService& service, std::vector<std::vector<uint8_t>>& codes, uint32_t& failedCount)
+		{
+			codes.assign(permutationCount, {});
+			failedCount = 0;
+
+			for (ShaderCompileService::Handle handle = 0; handle < permutationCount; handle++)
+			{
+				std::string errors;
+				failedCount += !service.TakeResult(handle, codes[handle], errors) || codes[handle].empty();
+			}
+
+			std::vector<std::vector<uint8_t>> unique = codes;
+			std::sort(unique.begin(), unique.end());
+
+			return static_cast<uint32_t>(std::unique(unique.begin(), unique.end()) - unique.begin());
+		};
+
+		std::vector<std::vector<uint8_t>> codes;
+		std::vector<std::vector<uint8_t>> cachedCodes;
+		uint32_t failedCount = 0;
+
+		auto start = std::chrono::steady_clock::now();
+
+		uint32_t uniqueCount = 0;
+		{
+			ShaderCompileService service(compile, compiler.GetVersion(), cachePath, threadCount);
+
+			for (uint32_t i = 0; i < permutationCount; i++)
+			{
+				service.Add(Permutation(i + 1));
+			}
+
+			service.Wait();
+			uniqueCount = TakeResults(service, codes, failedCount);
+		}
+
+		const double compileTime = Seconds(start);
+
+		// The next start finds every permutation in the cache
+		ShaderCompileService service(compile, compiler.GetVersion(), cachePath, threadCount);
+
+		start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < permutationCount; i++)
+		{
+			service.Add(Permutation(i + 1));
+		}
+
+		service.Wait();
+
+		const double cachedTime = Seconds(start);
+		const uint32_t cacheMissCount = service.GetCompileCount();
+
+		uint32_t cachedFailedCount = 0;
+		TakeResults(service, cachedCodes, cachedFailedCount);
+
+		const bool cachedSame = cachedCodes == codes;
+
+		// An edit of the include in the include directory compiles every permutation again
+		WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 2.0f\n");
+
+		start = std::chrono::steady_clock::now();
+		const uint32_t reloadCount = service.Reload();
+		service.Wait();
+		const double reloadTime = Seconds(start);
+
+		std::vector<std::vector<uint8_t>> reloadedCodes;
+		uint32_t reloadFailedCount = 0;
+		TakeResults(service, reloadedCodes, reloadFailedCount);
+
+		uint32_t changedCount = 0;
+
+		for (uint32_t i = 0; i < permutationCount; i++)
+		{
+			changedCount += !reloadedCodes[i].empty() && reloadedCodes[i] != codes[i];
+		}
+
+		// A broken edit reports errors instead of code, and nothing is reloaded while no file changes
+		WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#error broken edit\n");
+
+		service.Reload();
+		service.Wait();
+
+		std::vector<std::vector<uint8_t>> brokenCodes;
+		uint32_t brokenCount = 0;
+		TakeResults(service, brokenCodes, brokenCount);
+
+		const uint32_t idleReloadCount = service.Reload();
+
+		std::filesystem::remove_all(directory, error);
+
+		printf("Shader compilation | %s | %u permutations on %u threads, %u unique, %u failed, in %.2f ms | %.2f ms from the cache with %u compiles, %s | include edit reloads %u in %.2f ms, %u changed | broken edit fails %u of %u | %u reloads without an edit\n",
+			hasCompiler ? "DXC" : "no DXC, stand-in compiler", permutationCount, threadCount, uniqueCount, failedCount, compileTime * 1000.0,
+			cachedTime * 1000.0, cacheMissCount, cachedSame && cachedFailedCount == 0 ? "same code" : "different code", reloadCount, reloadTime * 1000.0,
+			changedCount, brokenCount, permutationCount, idleReloadCount);
+
+		// Whether an edit changes the code is up to the compiler, so changedCount is only printed
+		return failedCount == 0 && cacheMissCount == 0 && cachedSame && cachedFailedCount == 0 && reloadCount == permutationCount &&
+			reloadFailedCount == 0 && brokenCount == permutationCount && idleReloadCount == 0;
+	}
+
+	bool BenchmarkShaderTable(const BenchmarkDesc& desc)
+	{
+		// Local root signatures of a few shapes: constants only, descriptors after an odd number of constants, and
+		// everything mixed. Root descriptors go at 8 bytes, constants at 4, and records one multiple of 32 bytes apart.
+		std::vector<ShaderRecordLayout> layouts(4);
+		layouts[0].AddConstants(8);
+
+		layouts[1].AddConstants(1);
+		layouts[1].AddDescriptor();
+
+		layouts[2].AddDescriptor();
+		layouts[2].AddConstants(3);
+		layouts[2].AddDescriptor();
+		layouts[2].AddConstants(1);
+
+		layouts[3].AddConstants(8);
+		layouts[3].AddDescriptor();
+
+		uint32_t badLayoutCount = 0;
+
+		for (const ShaderRecordLayout& layout : layouts)
+		{
+			bool bad = layout.GetStride() % ShaderRecordAlignment != 0 || layout.GetStride() < layout.GetRecordSize() || layout.GetStride() > MaxShaderRecordSize;
+			uint32_t end = ShaderIdentifierSize;
+
+			for (uint32_t i = 0; i < layout.GetArgumentCount(); i++)
+			{
+				const uint32_t alignment = layout.IsDescriptor(i) ? 8 : 4;
+
+				bad |= layout.GetArgumentOffset(i) < end || layout.GetArgumentOffset(i) % alignment != 0;
+				end = layout.GetArgumentOffset(i) + layout.GetArgumentSize(i);
+			}
+
+			badLayoutCount += bad || end != layout.GetRecordSize();
+		}
+
+		// The 8 constants of the mesh start right after the identifier and the descriptor after them, 72 bytes padded
+		// to a stride of 96
+		const ShaderRecordLayout& layout = layouts[3];
+		badLayoutCount += layout.GetArgumentOffset(0) != 32 || layout.GetArgumentOffset(1) != 64 || layout.GetStride() != 96;
+		badLayoutCount += layouts[1].GetArgumentOffset(1) != 40 || layouts[1].GetStride() != 64;
+
+		struct MeshConstants
+		{
+			float Color[4];
+			float Reflectance;
+
+			uint32_t IndexIdx;
+			uint32_t NormalIdx;
+			uint32_t UV0Idx;
+		};
+
+		const uint32_t recordCount = desc.ShaderRecordCount;
+
+		uint8_t identifiers[2][ShaderIdentifierSize];
+
+		for (uint32_t i = 0; i < ShaderIdentifierSize; i++)
+		{
+			identifiers[0][i] = static_cast<uint8_t>(i);
+			identifiers[1][i] = static_cast<uint8_t>(255 - i);
+		}
+
+		Random random(23);
+		std::vector<MeshConstants> meshes(recordCount);
+
+		for (MeshConstants& mesh : meshes)
+		{
+			mesh = { { random.NextFloat(), random.NextFloat(), random.NextFloat(), 1.0f }, random.NextFloat(), random.Next(), random.Next(), random.Next() };
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		ShaderTable table(layout, recordCount);
+
+		for (uint32_t i = 0; i < recordCount; i++)
+		{
+			table.SetIdentifier(i, identifiers[i % 2]);
+			table.SetConstants(i, 0, meshes[i]);
+			table.SetDescriptor(i, 1, 0x10000ull * i);
+		}
+
+		const double packTime = Seconds(start);
+
+		uint32_t wrongCount = 0;
+
+		for (uint32_t i = 0; i < recordCount; i++)
+		{
+			const uint8_t* record = table.GetRecord(i);
+			const uint64_t address = 0x10000ull * i;
+
+			bool wrong = memcmp(record, identifiers[i % 2], ShaderIdentifierSize) != 0;
+			wrong |= memcmp(record + layout.GetArgumentOffset(0), &meshes[i], sizeof(MeshConstants)) != 0;
+			wrong |= memcmp(record + layout.GetArgumentOffset(1), &address, sizeof(address)) != 0;
+
+			// The padding up to the next record stays zero
+			for (uint32_t byte = layout.GetRecordSize(); byte < layout.GetStride(); byte++)
+			{
+				wrong |= record[byte] != 0;
+			}
+
+			wrongCount += wrong;
+		}
+
+		// Writes past the end of the constants, of the wrong kind of argument, and to arguments or records that do not
+		// exist are dropped
+		ShaderTable guarded(layouts[0], 2);
+		const uint32_t values[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+		guarded.SetConstants(0, 0, values, 16, 4);
+		guarded.SetConstants(2, 0, values, 8);
+		guarded.SetDescriptor(1, 0, ~0ull);
+		guarded.SetDescriptor(0, 1, ~0ull);
+
+		uint32_t overrunCount = 0;
+
+		for (uint32_t byte = 0; byte < guarded.GetSize(); byte++)
+		{
+			const bool written = byte >= ShaderIdentifierSize + 16 && byte < ShaderIdentifierSize + 32;
+			overrunCount += guarded.GetData()[byte] != (written && byte % 4 == 0 ? 1 : 0);
+		}
+
+		printf("Shader table | %u of %zu layouts misaligned | %u records of %u bytes, %.2f MB packed in %.2f ms (%.1f M records/s) | %u wrong records | %u bytes written out of bounds\n",
+			badLayoutCount, layouts.size(), recordCount, table.GetStride(), table.GetSize() / (1024.0 * 1024.0), packTime * 1000.0,
+			recordCount / packTime / 1e6, wrongCount, overrunCount);
+
+		return badLayoutCount == 0 && wrongCount == 0 && overrunCount == 0;
+	}
+}
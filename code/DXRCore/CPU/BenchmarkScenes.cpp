@@ -0,0 +1,232 @@
+#include "BenchmarkScenes.hpp"
+#include "Random.hpp"
+#include "SkyDistribution.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+
+namespace cpu
+{
+	// A bumpy sphere with roughly the requested number of triangles. The bumps give the builder a less regular
+	// distribution than a plain sphere.
+	void CreateMesh(TriangleMesh& mesh, uint32_t triangleCount, uint32_t indexSize)
+	{
+		// rows * columns * 2 triangles, with twice as many columns as rows
+		uint32_t rows = std::max(static_cast<uint32_t>(std::sqrt(triangleCount / 4.0)), 2u);
+
+		// 16-bit indices can only address 65536 vertices
+		if (indexSize == sizeof(uint16_t))
+		{
+			rows = std::min(rows, 180u);
+		}
+
+		const uint32_t columns = rows * 2;
+
+		std::vector<Float3> positions;
+		positions.reserve(static_cast<size_t>(rows + 1) * (columns + 1));
+
+		for (uint32_t y = 0; y <= rows; y++)
+		{
+			const float theta = PI * y / rows;
+
+			for (uint32_t x = 0; x <= columns; x++)
+			{
+				const float phi = 2.0f * PI * x / columns;
+				const float radius = 1.0f + 0.1f * std::sin(theta * 7.0f) * std::sin(phi * 5.0f) + 0.02f * std::sin(theta * 61.0f + phi * 37.0f);
+
+				positions.emplace_back(radius * std::sin(theta) * std::cos(phi), radius * std::sin(theta) * std::sin(phi), radius * std::cos(theta));
+			}
+		}
+
+		std::vector<uint32_t> indices;
+		indices.reserve(static_cast<size_t>(rows) * columns * 6);
+
+		for (uint32_t y = 0; y < rows; y++)
+		{
+			for (uint32_t x = 0; x < columns; x++)
+			{
+				const uint32_t i0 = y * (columns + 1) + x;
+				const uint32_t i1 = i0 + 1;
+				const uint32_t i2 = i0 + columns + 1;
+				const uint32_t i3 = i2 + 1;
+
+				indices.insert(indices.end(), { i0, i2, i1, i1, i2, i3 });
+			}
+		}
+
+		mesh.SetPositions(positions.size(), positions.data());
+
+		if (indexSize == sizeof(uint16_t))
+		{
+			std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+			mesh.SetIndices(shortIndices.size(), shortIndices.data(), sizeof(uint16_t));
+		}
+		else
+		{
+			mesh.SetIndices(indices.size(), indices.data(), sizeof(uint32_t));
+		}
+	}
+
+	// The cube of the samples
+	void CreateCube(TriangleMesh& mesh)
+	{
+		const Float3 positions[] = {
+			{ -0.5f, -0.5f, -0.5f }, { +0.5f, -0.5f, -0.5f }, { -0.5f, +0.5f, -0.5f }, { +0.5f, +0.5f, -0.5f },
+			{ -0.5f, -0.5f, +0.5f }, { +0.5f, -0.5f, +0.5f }, { -0.5f, +0.5f, +0.5f }, { +0.5f, +0.5f, +0.5f }
+		};
+
+		const uint16_t indices[] = {
+			0, 2, 1, 1, 2, 3,
+			4, 5, 6, 5, 7, 6,
+			0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7,
+			0, 4, 2, 2, 4, 6,
+			1, 3, 5, 3, 7, 5
+		};
+
+		mesh.SetPositions(std::size(positions), positions);
+		mesh.SetIndices(std::size(indices), indices, sizeof(uint16_t));
+	}
+
+	// Randomly rotated instances of blas on a grid in the xy plane. Returns the size of a side of the grid.
+	uint32_t CreateInstanceGrid(const BottomLevelAS& blas, uint32_t instanceCount, std::vector<InstanceDesc>& instances)
+	{
+		const uint32_t gridSize = std::max(static_cast<uint32_t>(std::sqrt(static_cast<double>(instanceCount))), 1u);
+		instances.resize(static_cast<size_t>(gridSize) * gridSize);
+
+		for (uint32_t i = 0; i < instances.size(); i++)
+		{
+			Random random(i);
+
+			const float angle = random.NextFloat() * 2.0f * PI;
+			const float scale = 0.3f + 0.4f * random.NextFloat();
+			const float c = std::cos(angle) * scale;
+			const float s = std::sin(angle) * scale;
+
+			InstanceDesc& instance = instances[i];
+			instance = {};
+			instance.Transform = { { { c, -s, 0.0f, static_cast<float>(i % gridSize) }, { s, c, 0.0f, static_cast<float>(i / gridSize) }, { 0.0f, 0.0f, scale, random.NextFloat() } } };
+			instance.InstanceMask = 1;
+			instance.AccelerationStructure = &blas;
+		}
+
+		return gridSize;
+	}
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Traces rayCount rays made by generateRay on all threads and returns the rays per second. Occlusion rays use the
+	// any hit query instead of the closest hit query.
+	double TraceRays(const BottomLevelAS& blas, uint32_t rayCount, const std::function<Ray(uint32_t)>& generateRay, uint32_t& hitCount, bool occlusion)
+	{
+		std::atomic<uint32_t> hits{ 0 };
+
+		auto start = std::chrono::steady_clock::now();
+
+		ThreadPool::Get().ParallelFor(rayCount, 4096, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				uint32_t localHits = 0;
+
+				for (uint64_t i = begin; i < end; i++)
+				{
+					Ray ray = generateRay(static_cast<uint32_t>(i));
+					Hit hit;
+
+					if (occlusion ? blas.Occluded(ray, RayFlagNone) : blas.Intersect(ray, hit, RayFlagNone))
+					{
+						localHits++;
+					}
+				}
+
+				hits += localHits;
+			});
+
+		const double time = Seconds(start);
+		hitCount = hits;
+
+		return rayCount / time;
+	}
+
+	void CreateReflectiveScene(ReflectiveScene& scene)
+	{
+		CreateCube(scene.Cube);
+		CreateMesh(scene.Sphere, 20000, sizeof(uint32_t));
+
+		scene.CubeBLAS.Build(scene.Cube);
+		scene.SphereBLAS.Build(scene.Sphere);
+
+		std::vector<InstanceDesc> instances;
+
+		InstanceDesc floor = {};
+		floor.Transform = { { { 24.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 24.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.2f, -0.1f } } };
+		floor.InstanceMask = 1;
+		floor.AccelerationStructure = &scene.CubeBLAS;
+
+		instances.push_back(floor);
+		scene.Scene.Meshes.push_back({ { 0.6f, 0.6f, 0.6f, 1.0f }, 0.8f, &scene.Cube });
+
+		for (uint32_t i = 0; i < 25; i++)
+		{
+			Random random(i);
+
+			InstanceDesc instance = {};
+			instance.Transform = { { { 1.0f, 0.0f, 0.0f, (i % 5) * 2.5f - 5.0f }, { 0.0f, 1.0f, 0.0f, (i / 5) * 2.5f - 5.0f }, { 0.0f, 0.0f, 1.0f, 1.1f } } };
+			instance.InstanceMask = 1;
+			instance.AccelerationStructure = &scene.SphereBLAS;
+
+			instances.push_back(instance);
+			scene.Scene.Meshes.push_back({ { random.NextFloat(), random.NextFloat(), random.NextFloat(), 1.0f }, 0.5f + 0.5f * random.NextFloat(), &scene.Sphere });
+		}
+
+		scene.Scene.TLAS.Build(instances.data(), static_cast<uint32_t>(instances.size()));
+	}
+
+	// A dim sky with a small, bright sun, which is what makes uniform sampling of the sky so noisy
+	void CreateSky(Image& sky, uint32_t width, uint32_t height)
+	{
+		sky.Resize(width, height);
+
+		const Float3 sun = Normalize(Float3(0.4f, -0.6f, 0.7f));
+
+		ThreadPool::Get().ParallelFor(height, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				for (uint32_t y = static_cast<uint32_t>(begin); y < end; y++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						const Float3 direction = sky::GetSkyDirection((x + 0.5f) / width, (y + 0.5f) / height);
+						const Float3 color = Dot(direction, sun) > 0.9995f ? Float3(2000.0f, 1800.0f, 1500.0f) : Float3(0.3f, 0.45f, 0.7f) * (0.5f + 0.5f * std::max(direction.z, 0.0f));
+
+						sky(x, y) = { color.x, color.y, color.z, 1.0f };
+					}
+				}
+			});
+	}
+
+	// Camera looking down at the spheres. GetPrimaryRay divides by w, which is 1 here, so the rows are the right
+	// and up vector of the image plane and the point the camera looks at.
+	void SetReflectiveSceneFrame(const ReflectiveScene& scene, uint32_t width, uint32_t height, FrameDesc& frame)
+	{
+		const Float3 position(0.0f, -14.0f, 7.0f);
+		const Float3 forward = Normalize(Float3(0.0f, 0.0f, 0.5f) - position);
+		const Float3 right = Normalize(Cross(forward, Float3(0.0f, 0.0f, 1.0f)));
+		const Float3 up = Cross(right, forward);
+		const float aspect = static_cast<float>(width) / height;
+		const float tanHalfFov = 0.5f;
+
+		frame.Scene = &scene.Scene;
+		frame.CameraPosition = position;
+		frame.Light = { Float3(-0.3f, 0.5f, -1.0f), 1.0f, Float3(1.0f) };
+		frame.InverseViewProjection = { { { right.x * tanHalfFov * aspect, right.y * tanHalfFov * aspect, right.z * tanHalfFov * aspect, 0.0f },
+			{ up.x * tanHalfFov, up.y * tanHalfFov, up.z * tanHalfFov, 0.0f },
+			{ 0.0f, 0.0f, 0.0f, 0.0f },
+			{ position.x + forward.x, position.y + forward.y, position.z + forward.z, 1.0f } } };
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Backend.hpp"
+#include "BottomLevelAS.hpp"
+#include "Geometry.hpp"
+#include "Image.hpp"
+#include "Scene.hpp"
+#include "TopLevelAS.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// The generated scenes and the helpers that the benchmarks share, see Benchmark.hpp
+namespace cpu
+{
+	// A bumpy sphere with roughly the requested number of triangles. The bumps give the builder a less regular
+	// distribution than a plain sphere.
+	void CreateMesh(TriangleMesh& mesh, uint32_t triangleCount, uint32_t indexSize);
+
+	// The cube of the samples
+	void CreateCube(TriangleMesh& mesh);
+
+	// Randomly rotated instances of blas on a grid in the xy plane. Returns the size of a side of the grid.
+	uint32_t CreateInstanceGrid(const BottomLevelAS& blas, uint32_t instanceCount, std::vector<InstanceDesc>& instances);
+
+	double Seconds(std::chrono::steady_clock::time_point start);
+
+	// Traces rayCount rays made by generateRay on all threads and returns the rays per second. Occlusion rays use the
+	// any hit query instead of the closest hit query.
+	double TraceRays(const BottomLevelAS& blas, uint32_t rayCount, const std::function<Ray(uint32_t)>& generateRay, uint32_t& hitCount, bool occlusion = false);
+
+	// A mirror-like floor under a grid of reflective spheres, so most paths bounce several times
+	struct ReflectiveScene
+	{
+		TriangleMesh Cube;
+		TriangleMesh Sphere;
+
+		BottomLevelAS CubeBLAS;
+		BottomLevelAS SphereBLAS;
+
+		cpu::Scene Scene;
+	};
+
+	void CreateReflectiveScene(ReflectiveScene& scene);
+
+	// A dim sky with a small, bright sun, which is what makes uniform sampling of the sky so noisy
+	void CreateSky(Image& sky, uint32_t width, uint32_t height);
+
+	// Camera looking down at the spheres. GetPrimaryRay divides by w, which is 1 here, so the rows are the right
+	// and up vector of the image plane and the point the camera looks at.
+	void SetReflectiveSceneFrame(const ReflectiveScene& scene, uint32_t width, uint32_t height, FrameDesc& frame);
+}
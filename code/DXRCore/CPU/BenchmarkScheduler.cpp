@@ -0,0 +1,321 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "JobRecorder.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+// Splitting the work of a frame over the threads: tiles, the wavefront renderer and recording the passes
+namespace cpu
+{
+	namespace
+	{
+		// Camera ray through a pixel, with the mesh in the lower part of the image. Pixels that hit the mesh trace
+		// extra rays into random directions, so they cost several times more than pixels that see nothing, like the
+		// reflective floor of the samples against the sky.
+		uint32_t ShadePixel(const BottomLevelAS& blas, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+		{
+			constexpr uint32_t SecondaryRayCount = 8;
+
+			Ray ray;
+			ray.Origin = Float3(0.0f, -3.0f, 1.2f);
+			ray.Direction = Normalize(Float3((x + 0.5f) / width - 0.5f, 1.0f, 0.5f - (y + 0.5f) / height));
+			ray.TMin = 0.0f;
+			ray.TMax = FloatMax;
+
+			Hit hit;
+			if (!blas.Intersect(ray, hit, RayFlagNone))
+			{
+				return 1;
+			}
+
+			const Float3 position = ray.Origin + ray.Direction * ray.TMax;
+			Random random(static_cast<uint64_t>(y) * width + x);
+
+			for (uint32_t i = 0; i < SecondaryRayCount; i++)
+			{
+				const float z = random.NextFloat() * 2.0f - 1.0f;
+				const float phi = random.NextFloat() * 2.0f * PI;
+				const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+
+				Ray secondary;
+				secondary.Origin = position;
+				secondary.Direction = Float3(r * std::cos(phi), r * std::sin(phi), z);
+				secondary.TMin = 1.0e-3f;
+				secondary.TMax = FloatMax;
+
+				Hit secondaryHit;
+				blas.Intersect(secondary, secondaryHit, RayFlagNone);
+			}
+
+			return 1 + SecondaryRayCount;
+		}
+
+		void PrintDispatch(const char* name, const DispatchStatistics& statistics, uint64_t rayCount)
+		{
+			double totalIdle = 0.0;
+			double maxIdle = 0.0;
+
+			for (const DispatchThreadStatistics& thread : statistics.Threads)
+			{
+				totalIdle += thread.IdleTime;
+				maxIdle = std::max(maxIdle, thread.IdleTime);
+			}
+
+			const double averageIdle = totalIdle / statistics.Threads.size();
+
+			printf("Dispatch | %s | %.2f ms | %.2f MRays/s | idle per thread: average %.2f ms (%.1f%%), max %.2f ms (%.1f%%)\n",
+				name, statistics.Time * 1000.0, rayCount / statistics.Time * 1.0e-6,
+				averageIdle * 1000.0, 100.0 * averageIdle / statistics.Time, maxIdle * 1000.0, 100.0 * maxIdle / statistics.Time);
+		}
+	}
+
+	void BenchmarkDispatch(const BenchmarkDesc& desc)
+	{
+		TriangleMesh mesh;
+		CreateMesh(mesh, desc.TriangleCount, sizeof(uint32_t));
+
+		BottomLevelAS blas;
+		blas.Build(mesh);
+
+		ThreadPool& threadPool = ThreadPool::Get();
+		const uint32_t threadCount = threadPool.GetThreadCount();
+		const uint32_t width = desc.DispatchWidth;
+		const uint32_t height = desc.DispatchHeight;
+
+		std::atomic<uint64_t> rayCount{ 0 };
+
+		// One block of rows per thread, the way a uniform grid is split up
+		DispatchStatistics rows;
+		rows.Threads.resize(threadCount);
+
+		auto start = std::chrono::steady_clock::now();
+
+		threadPool.ParallelFor(threadCount, 1, [&](uint64_t block, uint64_t, uint32_t threadIndex)
+			{
+				const auto blockStart = std::chrono::steady_clock::now();
+				uint64_t localRayCount = 0;
+
+				for (uint32_t y = static_cast<uint32_t>(height * block / threadCount); y < height * (block + 1) / threadCount; y++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						localRayCount += ShadePixel(blas, x, y, width, height);
+					}
+				}
+
+				rows.Threads[threadIndex].BusyTime += Seconds(blockStart);
+				rayCount += localRayCount;
+			});
+
+		rows.Time = Seconds(start);
+
+		for (DispatchThreadStatistics& thread : rows.Threads)
+		{
+			thread.IdleTime = rows.Time - thread.BusyTime;
+		}
+
+		PrintDispatch("row blocks", rows, rayCount);
+
+		TileScheduler scheduler(threadPool);
+		rayCount = 0;
+
+		scheduler.Dispatch(width, height, [&](const Tile& tile, uint32_t)
+			{
+				uint64_t localRayCount = 0;
+
+				for (uint32_t y = tile.Y; y < tile.Y + tile.Height; y++)
+				{
+					for (uint32_t x = tile.X; x < tile.X + tile.Width; x++)
+					{
+						localRayCount += ShadePixel(blas, x, y, width, height);
+					}
+				}
+
+				rayCount += localRayCount;
+			});
+
+		const DispatchStatistics& tiles = scheduler.GetStatistics();
+		PrintDispatch("tiles      ", tiles, rayCount);
+
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			const DispatchThreadStatistics& thread = tiles.Threads[i];
+			printf("Dispatch | thread %3u | %5u tiles, %3u steals | busy %.2f ms | idle %.2f ms\n",
+				i, thread.TileCount, thread.StealCount, thread.BusyTime * 1000.0, thread.IdleTime * 1000.0);
+		}
+	}
+
+	bool BenchmarkWavefront(const BenchmarkDesc& desc)
+	{
+		ReflectiveScene scene;
+		CreateReflectiveScene(scene);
+
+		FrameDesc frame;
+		SetReflectiveSceneFrame(scene, desc.DispatchWidth, desc.DispatchHeight, frame);
+		frame.MaxRecursion = desc.WavefrontMaxRecursion;
+
+		Backend backend(desc.DispatchWidth, desc.DispatchHeight);
+
+		const RenderMode modes[] = { RenderMode::Recursive, RenderMode::Wavefront };
+		const char* names[] = { "recursive", "wavefront" };
+
+		std::vector<Float4> images[2];
+
+		for (uint32_t mode = 0; mode < 2; mode++)
+		{
+			backend.SetRenderMode(modes[mode]);
+
+			// The fastest of a few frames, the first one also warms up the queues
+			FrameStatistics best;
+
+			for (uint32_t i = 0; i < 3; i++)
+			{
+				backend.Render(frame);
+
+				if (i == 0 || backend.GetStatistics().RenderTime < best.RenderTime)
+				{
+					best = backend.GetStatistics();
+				}
+			}
+
+			const Image& image = backend.GetFrame();
+			images[mode].assign(image.GetData(), image.GetData() + static_cast<size_t>(image.GetWidth()) * image.GetHeight());
+
+			printf("Wavefront | %s | %.2f ms | %llu rays | %.2f MRays/s\n",
+				names[mode], best.RenderTime * 1000.0, static_cast<unsigned long long>(best.RayCount), best.GetRaysPerSecond() * 1.0e-6);
+		}
+
+		float maxDifference = 0.0f;
+
+		for (size_t i = 0; i < images[0].size(); i++)
+		{
+			maxDifference = std::max({ maxDifference, std::fabs(images[0][i].x - images[1][i].x), std::fabs(images[0][i].y - images[1][i].y), std::fabs(images[0][i].z - images[1][i].z) });
+		}
+
+		printf("Wavefront | largest pixel difference %g\n", maxDifference);
+
+		// Both renderers trace the same rays, only the order of the additions differs
+		return maxDifference < 1.0e-4f;
+	}
+
+	bool BenchmarkRecording(const BenchmarkDesc& desc)
+	{
+		// A pass writes its commands into the list of its chunk. A command is a hash of the pass and its index, which
+		// stands in for the CPU work of validating and encoding it.
+		Random random(20);
+
+		std::vector<uint32_t> commandCounts(desc.RecordingPassCount);
+		uint64_t totalCommandCount = 0;
+		bool passed = true;
+
+		for (uint32_t& count : commandCounts)
+		{
+			// Most passes are small, a few record many times more than the others
+			count = random.NextFloat() < 0.05f ? 20000 + random.Next() % 20000 : 200 + random.Next() % 2000;
+			totalCommandCount += count;
+		}
+
+		auto Command = [](uint32_t pass, uint32_t index)
+		{
+			uint32_t hash = pass * 0x9E3779B9u ^ index;
+
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				hash = (hash ^ (hash >> 15)) * 0x2C1B3C6Du;
+			}
+
+			return hash;
+		};
+
+		// Reference order of the commands, as one thread would record them
+		std::vector<uint32_t> reference;
+		reference.reserve(totalCommandCount);
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (uint32_t pass = 0; pass < desc.RecordingPassCount; pass++)
+		{
+			for (uint32_t i = 0; i < commandCounts[pass]; i++)
+			{
+				reference.push_back(Command(pass, i));
+			}
+		}
+
+		const double singleTime = Seconds(start);
+
+		ThreadPool& threadPool = ThreadPool::Get();
+		JobRecorder recorder(threadPool);
+
+		std::vector<std::vector<uint32_t>> lists(threadPool.GetThreadCount());
+
+		for (uint32_t maxChunkCount : { threadPool.GetThreadCount(), threadPool.GetThreadCount() * 4 })
+		{
+			if (lists.size() < maxChunkCount)
+			{
+				lists.resize(maxChunkCount);
+			}
+
+			for (uint32_t pass = 0; pass < desc.RecordingPassCount; pass++)
+			{
+				recorder.Add([&lists, &commandCounts, &Command, pass](uint32_t chunk, uint32_t)
+				{
+					for (uint32_t i = 0; i < commandCounts[pass]; i++)
+					{
+						lists[chunk].push_back(Command(pass, i));
+					}
+				}, static_cast<float>(commandCounts[pass]));
+			}
+
+			start = std::chrono::steady_clock::now();
+
+			const uint32_t chunkCount = recorder.Record(maxChunkCount, [&lists](uint32_t chunk, uint32_t)
+			{
+				lists[chunk].clear();
+			});
+
+			const double time = Seconds(start);
+
+			// Submitting the lists in chunk order has to give the commands in the order of the passes
+			uint64_t position = 0;
+			uint64_t misplacedCount = 0;
+			uint64_t largestChunk = 0;
+
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				for (uint32_t command : lists[chunk])
+				{
+					misplacedCount += position >= reference.size() || reference[position] != command;
+					position++;
+				}
+
+				largestChunk = std::max<uint64_t>(largestChunk, lists[chunk].size());
+			}
+
+			misplacedCount += reference.size() - std::min<uint64_t>(position, reference.size());
+
+			// On one thread the chunks are recorded one after the other, which only measures the overhead of the recorder
+			if (threadPool.GetThreadCount() > 1)
+			{
+				printf("Recording | %u passes, %.2f M commands in %u lists | %.2f ms, %.2f ms on one thread (%.1fx) | largest list %.1f%% | %llu misplaced commands\n",
+					desc.RecordingPassCount, totalCommandCount / 1e6, chunkCount, time * 1000.0, singleTime * 1000.0, singleTime / time,
+					100.0 * largestChunk / totalCommandCount, static_cast<unsigned long long>(misplacedCount));
+			}
+			else
+			{
+				printf("Recording | %u passes, %.2f M commands in %u lists | %.2f ms, %.2f ms without the recorder | speedup skipped, only one thread | largest list %.1f%% | %llu misplaced commands\n",
+					desc.RecordingPassCount, totalCommandCount / 1e6, chunkCount, time * 1000.0, singleTime * 1000.0,
+					100.0 * largestChunk / totalCommandCount, static_cast<unsigned long long>(misplacedCount));
+			}
+
+			passed &= misplacedCount == 0;
+		}
+
+		return passed;
+	}
+}
@@ -0,0 +1,110 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "Random.hpp"
+#include "SkyDistribution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Importance sampling of the sky
+namespace cpu
+{
+	void BenchmarkSkyLight(const BenchmarkDesc& desc)
+	{
+		Image sky;
+		CreateSky(sky, 2048, 1024);
+
+		// The same tables over an evenly lit sky pick every direction of the sphere with the same chance
+		Image flatSky(sky.GetWidth(), sky.GetHeight());
+		flatSky.Clear({ 1.0f, 1.0f, 1.0f, 1.0f });
+
+		SkyDistribution importance;
+		SkyDistribution uniform;
+
+		auto start = std::chrono::steady_clock::now();
+		importance.Build(sky);
+		const double buildTime = Seconds(start);
+
+		uniform.Build(flatSky);
+
+		constexpr uint32_t SampleCount = 1 << 22;
+		Random random(7);
+
+		// Averages to the solid angle of the sphere when the densities are right
+		double inversePdfSum = 0.0;
+
+		start = std::chrono::steady_clock::now();
+
+		for (uint32_t i = 0; i < SampleCount; i++)
+		{
+			float pdf;
+			importance.Sample({ random.NextFloat(), random.NextFloat() }, pdf);
+			inversePdfSum += 1.0 / pdf;
+		}
+
+		const double sampleTime = Seconds(start);
+
+		printf("SkyLight | %ux%u sky | table build %.2f ms | %.1f M samples/s on one thread | average 1/pdf %.3f (4 pi is %.3f)\n",
+			sky.GetWidth(), sky.GetHeight(), buildTime * 1000.0, SampleCount / sampleTime * 1.0e-6, inversePdfSum / SampleCount, 4.0 * PI);
+
+		// Error of a few samples per pixel against many, rendered at a quarter of the resolution. The error is measured
+		// on the colors clamped to [0, 1], like they end up in a PPM, so the sun itself does not drown out the rest.
+		ReflectiveScene scene;
+		CreateReflectiveScene(scene);
+
+		const uint32_t width = std::max(desc.DispatchWidth / 4, 1u);
+		const uint32_t height = std::max(desc.DispatchHeight / 4, 1u);
+
+		FrameDesc frame;
+		SetReflectiveSceneFrame(scene, width, height, frame);
+		frame.Sky = &sky;
+		frame.MaxRecursion = 2;
+
+		Backend backend(width, height);
+
+		auto Render = [&](const SkyDistribution& distribution, uint32_t sampleCount)
+			{
+				AccumulationDesc accumulation;
+				accumulation.VarianceTarget = 0.0f;
+				accumulation.MaxSampleCount = sampleCount;
+
+				frame.SkyLight = &distribution;
+				backend.SetAccumulation(true, accumulation);
+
+				while (!backend.IsConverged())
+				{
+					backend.Render(frame);
+				}
+
+				const Image& image = backend.GetFrame();
+				return std::vector<Float4>(image.GetData(), image.GetData() + static_cast<size_t>(width) * height);
+			};
+
+		const std::vector<Float4> reference = Render(importance, desc.SkyLightReferenceSampleCount);
+
+		for (uint32_t sampleCount : { 1u, 4u, 16u })
+		{
+			const char* names[] = { "uniform", "alias table" };
+			const SkyDistribution* distributions[] = { &uniform, &importance };
+
+			for (uint32_t i = 0; i < 2; i++)
+			{
+				const std::vector<Float4> image = Render(*distributions[i], sampleCount);
+
+				double squaredError = 0.0;
+
+				for (size_t pixel = 0; pixel < image.size(); pixel++)
+				{
+					const float dx = Saturate(image[pixel].x) - Saturate(reference[pixel].x);
+					const float dy = Saturate(image[pixel].y) - Saturate(reference[pixel].y);
+					const float dz = Saturate(image[pixel].z) - Saturate(reference[pixel].z);
+
+					squaredError += dx * dx + dy * dy + dz * dz;
+				}
+
+				printf("SkyLight | %s | %u spp | RMSE %.4f against %u spp\n", names[i], sampleCount, std::sqrt(squaredError / (3.0 * image.size())), desc.SkyLightReferenceSampleCount);
+			}
+		}
+	}
+}
@@ -0,0 +1,401 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "InstanceStore.hpp"
+#include "Random.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Top level structures: many instances, refitting, and writing the instance descs
+namespace cpu
+{
+	void BenchmarkInstances(const BenchmarkDesc& desc)
+	{
+		TriangleMesh cube;
+		CreateCube(cube);
+
+		BottomLevelAS blas;
+		blas.Build(cube);
+
+		std::vector<InstanceDesc> instances;
+		const uint32_t gridSize = CreateInstanceGrid(blas, desc.InstanceCount, instances);
+
+		TopLevelAS tlas;
+
+		auto start = std::chrono::steady_clock::now();
+		tlas.Build(instances.data(), static_cast<uint32_t>(instances.size()));
+		const double buildTime = Seconds(start);
+
+		const uint32_t resolution = static_cast<uint32_t>(std::sqrt(static_cast<double>(desc.RayCount)));
+		std::atomic<uint32_t> hits{ 0 };
+
+		// Looking down at the grid from above, at an angle
+		start = std::chrono::steady_clock::now();
+
+		ThreadPool::Get().ParallelFor(static_cast<uint64_t>(resolution) * resolution, 4096, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				uint32_t localHits = 0;
+
+				for (uint64_t i = begin; i < end; i++)
+				{
+					const float u = static_cast<float>(i % resolution) / resolution;
+					const float v = static_cast<float>(i / resolution) / resolution;
+
+					Ray ray;
+					ray.Origin = Float3(u * gridSize, v * gridSize - 2.0f, 5.0f);
+					ray.Direction = Normalize(Float3(0.0f, 0.4f, -1.0f));
+					ray.TMin = 0.0f;
+					ray.TMax = FloatMax;
+
+					Hit hit;
+					if (tlas.Intersect(ray, hit, RayFlagCullBackFacingTriangles))
+					{
+						localHits++;
+					}
+				}
+
+				hits += localHits;
+			});
+
+		const double traceTime = Seconds(start);
+		const uint32_t rayCount = resolution * resolution;
+
+		printf("Instances | %zu instances of one BLAS | TLAS build %.2f ms | BLAS %.2f KB, TLAS %.2f MB | %.2f MRays/s (%.1f%% hit)\n",
+			instances.size(), buildTime * 1000.0, blas.GetNodeMemory() / 1024.0, tlas.GetMemory() / (1024.0 * 1024.0),
+			rayCount / traceTime * 1.0e-6, 100.0 * hits / rayCount);
+	}
+
+	bool BenchmarkRefit(const BenchmarkDesc& desc)
+	{
+		TriangleMesh mesh;
+		CreateMesh(mesh, desc.TriangleCount, sizeof(uint32_t));
+
+		const std::vector<Float3> restPositions = mesh.GetPositions();
+		std::vector<Float3> positions(restPositions.size());
+
+		// One structure is refitted every frame, the other one is built from scratch as the reference
+		BottomLevelAS refitted;
+		refitted.SetAllowUpdate(true);
+		refitted.Build(mesh);
+
+		BottomLevelAS rebuilt;
+		bool passed = true;
+
+		const uint32_t resolution = static_cast<uint32_t>(std::sqrt(static_cast<double>(desc.RayCount)));
+
+		auto CameraRay = [resolution](uint32_t i)
+			{
+				const float x = ((i % resolution) + 0.5f) / resolution * 2.0f - 1.0f;
+				const float z = ((i / resolution) + 0.5f) / resolution * 2.0f - 1.0f;
+
+				Ray ray;
+				ray.Origin = Float3(0.0f, -3.0f, 0.0f);
+				ray.Direction = Normalize(Float3(x * 0.5f, 1.0f, z * 0.5f));
+				ray.TMin = 0.0f;
+				ray.TMax = FloatMax;
+
+				return ray;
+			};
+
+		// A wave runs over the mesh while it twists further every frame, so the refitted tree slowly gets worse
+		for (uint32_t frame = 1; frame <= desc.RefitFrameCount; frame++)
+		{
+			ThreadPool::Get().ParallelFor(positions.size(), 16 * 1024, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint64_t i = begin; i < end; i++)
+					{
+						const Float3& p = restPositions[i];
+						const float angle = 0.15f * frame * p.z;
+						const float c = std::cos(angle);
+						const float s = std::sin(angle);
+						const float scale = 1.0f + 0.05f * std::sin(6.0f * p.z + 0.5f * frame);
+
+						positions[i] = Float3((c * p.x - s * p.y) * scale, (s * p.x + c * p.y) * scale, p.z);
+					}
+				});
+
+			mesh.SetPositions(positions.size(), positions.data());
+
+			auto start = std::chrono::steady_clock::now();
+			const bool rebuiltByUpdate = refitted.Update();
+			const double updateTime = Seconds(start);
+
+			start = std::chrono::steady_clock::now();
+			rebuilt.Build(mesh);
+			const double buildTime = Seconds(start);
+
+			uint32_t refittedHits = 0;
+			uint32_t rebuiltHits = 0;
+			const double refittedRays = TraceRays(refitted, desc.RayCount, CameraRay, refittedHits);
+			const double rebuiltRays = TraceRays(rebuilt, desc.RayCount, CameraRay, rebuiltHits);
+
+			printf("Refit | frame %u | update %.2f ms (%s) | build %.2f ms | SAH %.2f vs %.2f | %.2f vs %.2f MRays/s | %u vs %u hits\n",
+				frame, updateTime * 1000.0, rebuiltByUpdate ? "rebuilt" : "refitted", buildTime * 1000.0, refitted.GetSAHCost(), rebuilt.GetSAHCost(),
+				refittedRays * 1.0e-6, rebuiltRays * 1.0e-6, refittedHits, rebuiltHits);
+
+			passed &= refittedHits == rebuiltHits;
+		}
+
+		// Instances of which a few percent move every frame
+		TriangleMesh cube;
+		CreateCube(cube);
+
+		BottomLevelAS cubeBLAS;
+		cubeBLAS.Build(cube);
+
+		std::vector<InstanceDesc> instances;
+		CreateInstanceGrid(cubeBLAS, desc.InstanceCount, instances);
+
+		TopLevelAS tlas;
+		tlas.SetAllowUpdate(true);
+		tlas.Build(instances.data(), static_cast<uint32_t>(instances.size()));
+
+		TopLevelAS reference;
+
+		double updateTime = 0.0;
+		double buildTime = 0.0;
+		uint32_t rebuildCount = 0;
+
+		const uint32_t movedCount = std::max(static_cast<uint32_t>(instances.size() * desc.RefitMovedFraction), 1u);
+
+		for (uint32_t frame = 1; frame <= desc.RefitFrameCount; frame++)
+		{
+			Random random(frame);
+
+			for (uint32_t i = 0; i < movedCount; i++)
+			{
+				InstanceDesc& instance = instances[random.Next() % instances.size()];
+				instance.Transform.m[2][3] += random.NextFloat() - 0.5f;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			rebuildCount += tlas.Update(instances.data(), static_cast<uint32_t>(instances.size())) ? 1 : 0;
+			updateTime += Seconds(start);
+
+			start = std::chrono::steady_clock::now();
+			reference.Build(instances.data(), static_cast<uint32_t>(instances.size()));
+			buildTime += Seconds(start);
+		}
+
+		printf("Refit | %zu instances, %u moved per frame | update %.2f ms (%u of %u rebuilt) | build %.2f ms\n",
+			instances.size(), movedCount, updateTime * 1000.0 / desc.RefitFrameCount, rebuildCount, desc.RefitFrameCount, buildTime * 1000.0 / desc.RefitFrameCount);
+
+		return passed;
+	}
+
+	bool BenchmarkInstancePacking(const BenchmarkDesc& desc)
+	{
+		const uint32_t instanceCount = desc.PackInstanceCount;
+
+		// An instance of the renderer, allocated on its own and turned into a matrix for every build
+		struct Instance
+		{
+			Float3 Translation;
+			Float4 Rotation;
+			Float3 Scale;
+			Float4 Color;
+			float Reflectance;
+			uint64_t AccelerationStructure;
+			uint32_t HitGroupIndex;
+		};
+
+		Random random(25);
+		std::vector<std::unique_ptr<Instance>> instances(instanceCount);
+		InstanceStore store;
+		store.Reserve(instanceCount);
+
+		for (uint32_t i = 0; i < instanceCount; i++)
+		{
+			Float4 rotation = { random.NextFloat() * 2.0f - 1.0f, random.NextFloat() * 2.0f - 1.0f, random.NextFloat() * 2.0f - 1.0f, random.NextFloat() * 2.0f - 1.0f };
+			const float length = std::sqrt(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z + rotation.w * rotation.w);
+			rotation = { rotation.x / length, rotation.y / length, rotation.z / length, rotation.w / length };
+
+			Instance& instance = *(instances[i] = std::make_unique<Instance>());
+			instance.Translation = { random.NextFloat() * 200.0f - 100.0f, random.NextFloat() * 200.0f - 100.0f, random.NextFloat() * 200.0f - 100.0f };
+			instance.Rotation = rotation;
+			instance.Scale = { 0.5f + random.NextFloat() * 1.5f, 0.5f + random.NextFloat() * 1.5f, 0.5f + random.NextFloat() * 1.5f };
+			instance.Color = { random.NextFloat(), random.NextFloat(), random.NextFloat(), 1.0f };
+			instance.Reflectance = random.NextFloat();
+			instance.AccelerationStructure = 0x100000000ull + 0x10000ull * (random.Next() % 64);
+			instance.HitGroupIndex = i;
+
+			const uint32_t index = store.Add(instance.AccelerationStructure, 0, instance.HitGroupIndex);
+			store.SetTranslation(index, instance.Translation);
+			store.SetRotation(index, instance.Rotation);
+			store.SetScale(index, instance.Scale);
+			store.SetColor(index, instance.Color);
+			store.SetReflectance(index, instance.Reflectance);
+		}
+
+		// Upload heaps start at 64 KB, the output starts on a cache line like they do
+		struct alignas(64) CacheLine
+		{
+			uint8_t Bytes[64];
+		};
+
+		std::vector<CacheLine> mapped(instanceCount);
+		PackedInstanceDesc* reference = reinterpret_cast<PackedInstanceDesc*>(mapped.data());
+
+		// The matrix path: translation * rotation * scale in the row-vector convention, transposed into a vector of
+		// descs that is copied into the upload buffer
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<PackedInstanceDesc> descs;
+		descs.reserve(instanceCount);
+
+		for (const std::unique_ptr<Instance>& instance : instances)
+		{
+			const Float4& q = instance->Rotation;
+			const float rotation[4][4] = {
+				{ 1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + q.z * q.w), 2.0f * (q.x * q.z - q.y * q.w), 0.0f },
+				{ 2.0f * (q.x * q.y - q.z * q.w), 1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z + q.x * q.w), 0.0f },
+				{ 2.0f * (q.x * q.z + q.y * q.w), 2.0f * (q.y * q.z - q.x * q.w), 1.0f - 2.0f * (q.x * q.x + q.y * q.y), 0.0f },
+				{ 0.0f, 0.0f, 0.0f, 1.0f }
+			};
+			const float translation[4][4] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { instance->Translation.x, instance->Translation.y, instance->Translation.z, 1.0f } };
+			const float scale[4][4] = { { instance->Scale.x, 0.0f, 0.0f, 0.0f }, { 0.0f, instance->Scale.y, 0.0f, 0.0f }, { 0.0f, 0.0f, instance->Scale.z, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+			float translationRotation[4][4];
+			float matrix[4][4];
+
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				for (uint32_t column = 0; column < 4; column++)
+				{
+					translationRotation[row][column] = translation[row][0] * rotation[0][column] + translation[row][1] * rotation[1][column] + translation[row][2] * rotation[2][column] + translation[row][3] * rotation[3][column];
+				}
+			}
+
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				for (uint32_t column = 0; column < 4; column++)
+				{
+					matrix[row][column] = translationRotation[row][0] * scale[0][column] + translationRotation[row][1] * scale[1][column] + translationRotation[row][2] * scale[2][column] + translationRotation[row][3] * scale[3][column];
+				}
+			}
+
+			PackedInstanceDesc instanceDesc = {};
+			instanceDesc.InstanceMask = 1;
+			instanceDesc.InstanceContributionToHitGroupIndex = instance->HitGroupIndex;
+			instanceDesc.AccelerationStructure = instance->AccelerationStructure;
+
+			for (uint32_t row = 0; row < 3; row++)
+			{
+				for (uint32_t column = 0; column < 4; column++)
+				{
+					instanceDesc.Transform.m[row][column] = matrix[column][row];
+				}
+			}
+
+			descs.push_back(instanceDesc);
+		}
+
+		memcpy(reference, descs.data(), sizeof(PackedInstanceDesc) * instanceCount);
+
+		const double matrixTime = Seconds(start);
+
+		// Instances that are not within a rounding error of the matrix path, or differ from it in anything but the
+		// transform
+		auto CountWrong = [&](const PackedInstanceDesc* packed, uint32_t begin, uint32_t end, float& maxError)
+		{
+			uint32_t wrongCount = 0;
+
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const PackedInstanceDesc& a = packed[i];
+				const PackedInstanceDesc& b = reference[i];
+
+				bool wrong = a.InstanceID != b.InstanceID || a.InstanceMask != b.InstanceMask || a.Flags != b.Flags;
+				wrong |= a.InstanceContributionToHitGroupIndex != b.InstanceContributionToHitGroupIndex || a.AccelerationStructure != b.AccelerationStructure;
+
+				for (uint32_t row = 0; row < 3; row++)
+				{
+					for (uint32_t column = 0; column < 4; column++)
+					{
+						const float error = std::abs(a.Transform.m[row][column] - b.Transform.m[row][column]) / std::max(1.0f, std::abs(b.Transform.m[row][column]));
+						maxError = std::max(maxError, error);
+						wrong |= !(error < 1e-4f);
+					}
+				}
+
+				wrongCount += wrong;
+			}
+
+			return wrongCount;
+		};
+
+		struct Configuration
+		{
+			const char* Name;
+			SIMDLevel Level;
+			bool Parallel;
+		};
+
+		const Configuration configurations[] = {
+			{ "scalar, 1 thread", SIMDLevel::Scalar, false },
+			{ "SSE4, 1 thread ", SIMDLevel::SSE4, false },
+			{ "AVX2, 1 thread ", SIMDLevel::AVX2, false },
+			{ "AVX2, all threads", SIMDLevel::AVX2, true },
+		};
+
+		const SIMDLevel previousLevel = GetSIMDLevel();
+		std::vector<CacheLine> output(instanceCount);
+		PackedInstanceDesc* packed = reinterpret_cast<PackedInstanceDesc*>(output.data());
+
+		printf("Instance packing | %u instances | matrix per instance %.2f ms\n", instanceCount, matrixTime * 1000.0);
+
+		bool passed = true;
+
+		for (const Configuration& configuration : configurations)
+		{
+			if (configuration.Level > GetSupportedSIMDLevel())
+			{
+				printf("Instance packing | %s | skipped, not supported by this CPU\n", configuration.Name);
+				continue;
+			}
+
+			SetSIMDLevel(configuration.Level);
+			memset(output.data(), 0, sizeof(CacheLine) * output.size());
+
+			start = std::chrono::steady_clock::now();
+
+			if (configuration.Parallel)
+			{
+				store.Pack(packed);
+			}
+			else
+			{
+				store.Pack(packed, 0, instanceCount);
+			}
+
+			const double time = Seconds(start);
+
+			float maxError = 0.0f;
+			uint32_t wrongCount = CountWrong(packed, 0, instanceCount, maxError);
+
+			// A range that does not start on a multiple of the vector width into memory that is not aligned for
+			// streaming stores, which takes the unaligned stores and the scalar tail
+			const uint32_t end = std::min(instanceCount, 1003u);
+			std::vector<uint8_t> unaligned(sizeof(PackedInstanceDesc) * end + 8);
+			PackedInstanceDesc* shifted = reinterpret_cast<PackedInstanceDesc*>(unaligned.data() + 8);
+
+			store.Pack(shifted, 3, end);
+			wrongCount += CountWrong(shifted, 3, end, maxError);
+
+			printf("Instance packing | %s | %.2f ms (%.1fx) | %.1f GB/s written | %u instances wrong, largest relative error %.2g\n",
+				configuration.Name, time * 1000.0, matrixTime / time, sizeof(PackedInstanceDesc) * static_cast<double>(instanceCount) / time / 1e9, wrongCount, maxError);
+
+			passed &= wrongCount == 0;
+		}
+
+		SetSIMDLevel(previousLevel);
+
+		return passed;
+	}
+}
@@ -0,0 +1,208 @@
+#include "Benchmark.hpp"
+#include "BenchmarkScenes.hpp"
+#include "BlockCompression.hpp"
+#include "TextureCache.hpp"
+#include "TextureFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+// Mips, texture formats and block compression, and the texture cache
+namespace cpu
+{
+	bool BenchmarkTextures(const BenchmarkDesc& desc)
+	{
+		Image sky;
+		CreateSky(sky, desc.TextureWidth, desc.TextureHeight);
+
+		const uint32_t mipCount = GetMipCount(sky.GetWidth(), sky.GetHeight());
+		std::vector<Image> mips(mipCount);
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (uint32_t level = 1; level < mipCount; level++)
+		{
+			GenerateMip(level == 1 ? sky : mips[level - 1], mips[level]);
+		}
+
+		const double mipTime = Seconds(start);
+		const uint64_t pixelCount = static_cast<uint64_t>(sky.GetWidth()) * sky.GetHeight();
+
+		printf("Textures | %ux%u | %u mips in %.2f ms\n", sky.GetWidth(), sky.GetHeight(), mipCount, mipTime * 1000.0);
+
+		// The sky tone mapped into [0, 1] with a pattern on top, standing in for an LDR texture
+		std::vector<Image> ldrMips(mipCount);
+		ldrMips[0].Resize(sky.GetWidth(), sky.GetHeight());
+
+		for (uint32_t y = 0; y < sky.GetHeight(); y++)
+		{
+			for (uint32_t x = 0; x < sky.GetWidth(); x++)
+			{
+				const Float4& color = sky(x, y);
+				const float pattern = 0.75f + 0.25f * std::sin(x * 0.3f) * std::cos(y * 0.2f);
+
+				ldrMips[0](x, y) = { color.x / (1.0f + color.x) * pattern, color.y / (1.0f + color.y) * pattern, color.z / (1.0f + color.z), pattern };
+			}
+		}
+
+		for (uint32_t level = 1; level < mipCount; level++)
+		{
+			GenerateMip(ldrMips[level - 1], ldrMips[level]);
+		}
+
+		// Converts all levels, and prints the memory against the uncompressed format and the error of the full size level
+		auto convert = [&](const Image& image, const std::vector<Image>& levels, TextureFormat format, const char* name, TextureFormat baseFormat, const char* baseName)
+		{
+			std::vector<std::vector<uint8_t>> encoded(mipCount);
+			uint64_t memory = 0;
+			uint64_t baseMemory = 0;
+
+			auto convertStart = std::chrono::steady_clock::now();
+
+			for (uint32_t level = 0; level < mipCount; level++)
+			{
+				const Image& source = level == 0 ? image : levels[level];
+				const uint64_t rowPitch = GetRowPitch(format, source.GetWidth());
+
+				encoded[level].resize(rowPitch * GetRowCount(format, source.GetHeight()));
+				ConvertPixels(source, format, encoded[level].data(), rowPitch);
+
+				memory += encoded[level].size();
+				baseMemory += GetRowPitch(baseFormat, source.GetWidth()) * source.GetHeight();
+			}
+
+			const double convertTime = Seconds(convertStart);
+			const uint64_t rowPitch = GetRowPitch(format, image.GetWidth());
+
+			// Largest and average error of every 16th pixel, relative to the brightest channel of the pixel
+			float error = 0.0f;
+			double errorSum = 0.0;
+
+			for (uint64_t pixel = 0; pixel < pixelCount; pixel += 16)
+			{
+				const uint32_t x = static_cast<uint32_t>(pixel % image.GetWidth());
+				const uint32_t y = static_cast<uint32_t>(pixel / image.GetWidth());
+				const Float4& original = image(x, y);
+				Float3 decoded;
+
+				if (IsBlockCompressed(format))
+				{
+					Float4 texels[16];
+					DecodeBlock(format, encoded[0].data() + (y / 4) * rowPitch + (x / 4) * GetBytesPerBlock(format), texels);
+
+					const Float4& texel = texels[(y % 4) * 4 + x % 4];
+					decoded = Float3(texel.x, texel.y, texel.z);
+				}
+				else
+				{
+					const uint8_t* pixelData = encoded[0].data() + y * rowPitch + x * GetBytesPerPixel(format);
+
+					if (format == TextureFormat::RGBA32F)
+					{
+						std::memcpy(&decoded, pixelData, sizeof(decoded));
+					}
+					else if (format == TextureFormat::RGBA16F)
+					{
+						uint16_t half[4];
+						std::memcpy(half, pixelData, sizeof(half));
+						decoded = Float3(HalfToFloat(half[0]), HalfToFloat(half[1]), HalfToFloat(half[2]));
+					}
+					else if (format == TextureFormat::RGBA8)
+					{
+						decoded = Float3(pixelData[0] / 255.0f, pixelData[1] / 255.0f, pixelData[2] / 255.0f);
+					}
+					else
+					{
+						uint32_t packed;
+						std::memcpy(&packed, pixelData, sizeof(packed));
+						decoded = format == TextureFormat::RGB9E5 ? UnpackRGB9E5(packed) : UnpackR11G11B10(packed);
+					}
+				}
+
+				const float brightest = std::max({ original.x, original.y, original.z, 1e-6f });
+				const float pixelError = std::max({ std::fabs(decoded.x - original.x), std::fabs(decoded.y - original.y), std::fabs(decoded.z - original.z) }) / brightest;
+
+				error = std::max(error, pixelError);
+				errorSum += pixelError;
+			}
+
+			printf("Textures | %s | %.1f MB with mips, %.1fx smaller than %s | converted in %.2f ms | relative error %.5f largest, %.5f average\n",
+				name, memory / (1024.0 * 1024.0), static_cast<double>(baseMemory) / memory, baseName, convertTime * 1000.0, error, errorSum / ((pixelCount + 15) / 16));
+
+			return encoded;
+		};
+
+		const TextureFormat formats[] = { TextureFormat::RGBA32F, TextureFormat::RGBA16F, TextureFormat::R11G11B10F, TextureFormat::RGB9E5, TextureFormat::BC6H };
+		const char* names[] = { "RGBA32F", "RGBA16F", "R11G11B10F", "RGB9E5", "BC6H" };
+
+		std::vector<std::vector<uint8_t>> encodedBC6H;
+
+		for (uint32_t i = 0; i < std::size(formats); i++)
+		{
+			encodedBC6H = convert(sky, mips, formats[i], names[i], TextureFormat::RGBA32F, "RGBA32F");
+		}
+
+		const TextureFormat ldrFormats[] = { TextureFormat::RGBA8, TextureFormat::BC7, TextureFormat::BC1 };
+		const char* ldrNames[] = { "RGBA8", "BC7", "BC1" };
+
+		for (uint32_t i = 0; i < std::size(ldrFormats); i++)
+		{
+			convert(ldrMips[0], ldrMips, ldrFormats[i], ldrNames[i], TextureFormat::RGBA8, "RGBA8");
+		}
+
+		// Reading the BC6H mips back from the cache, which is what every load after the first does instead of encoding
+		TextureCache cache((std::filesystem::temp_directory_path() / "DXRBenchmarkTextureCache").string());
+
+		TextureCacheHeader header;
+		header.Key = TextureCache::GetKey(HashMemory(sky.GetData(), pixelCount * sizeof(Float4)), TextureFormat::BC6H, mipCount);
+		header.Format = TextureFormat::BC6H;
+		header.Width = sky.GetWidth();
+		header.Height = sky.GetHeight();
+		header.MipCount = mipCount;
+
+		start = std::chrono::steady_clock::now();
+		const bool written = cache.Write(header, encodedBC6H);
+		const double writeTime = Seconds(start);
+
+		std::vector<uint8_t> loaded(encodedBC6H[0].size());
+		bool read = written;
+
+		start = std::chrono::steady_clock::now();
+
+		if (read && cache.Open(header.Key))
+		{
+			for (uint32_t level = 0; level < mipCount && read; level++)
+			{
+				const uint32_t width = std::max(header.Width >> level, 1u);
+				const uint32_t height = std::max(header.Height >> level, 1u);
+				const uint64_t rowPitch = GetRowPitch(header.Format, width);
+
+				read = cache.ReadRows(loaded.data(), rowPitch, rowPitch, GetRowCount(header.Format, height)) &&
+					(level > 0 || std::memcmp(loaded.data(), encodedBC6H[0].data(), loaded.size()) == 0);
+			}
+		}
+		else
+		{
+			read = false;
+		}
+
+		const double readTime = Seconds(start);
+
+		if (read)
+		{
+			printf("Textures | cache | BC6H with mips written in %.2f ms, read back in %.2f ms\n", writeTime * 1000.0, readTime * 1000.0);
+		}
+		else
+		{
+			printf("Textures | cache | failed to write or read %s\n", cache.GetDirectory().c_str());
+		}
+
+		cache.Remove(header.Key);
+
+		return read;
+	}
+}
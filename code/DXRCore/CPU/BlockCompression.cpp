@@ -0,0 +1,764 @@
+#include "BlockCompression.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint32_t TexelCount = 16;
+
+		// Weights of the palette entries of the 4-bit index modes of BC6H and BC7, out of 64
+		constexpr int32_t Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// Weights of the BC1 palette entries in four color mode. Entry 2 is 2/3 of the first endpoint.
+		constexpr float WeightsBC1[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		constexpr uint32_t BC7Mode6 = 1u << 6;
+		constexpr uint32_t BC6HMode11 = 0x03;
+
+		// Writes fields of a 128-bit block, least significant bit first
+		class BitWriter
+		{
+		public:
+			explicit BitWriter(uint8_t* block)
+				: m_Block(block)
+			{
+				std::memset(block, 0, 16);
+			}
+
+			void Write(uint32_t value, uint32_t bitCount)
+			{
+				for (uint32_t i = 0; i < bitCount; i++, m_Position++)
+				{
+					m_Block[m_Position >> 3] |= static_cast<uint8_t>(((value >> i) & 1u) << (m_Position & 7));
+				}
+			}
+
+		private:
+			uint8_t* m_Block;
+			uint32_t m_Position = 0;
+		};
+
+		class BitReader
+		{
+		public:
+			explicit BitReader(const uint8_t* block)
+				: m_Block(block)
+			{
+			}
+
+			uint32_t Read(uint32_t bitCount)
+			{
+				uint32_t value = 0;
+
+				for (uint32_t i = 0; i < bitCount; i++, m_Position++)
+				{
+					value |= ((m_Block[m_Position >> 3] >> (m_Position & 7)) & 1u) << i;
+				}
+
+				return value;
+			}
+
+		private:
+			const uint8_t* m_Block;
+			uint32_t m_Position = 0;
+		};
+
+		// Endpoints of the line through the points along their principal axis, which is found with a few steps of power
+		// iteration on the covariance. The endpoints are the outermost projections of the points onto the line.
+		void FitLine(const Vector4* points, Vector4& endpoint0, Vector4& endpoint1)
+		{
+			Vector4 mean = Zero4();
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				mean = Add4(mean, points[i]);
+			}
+
+			mean = Mul4(mean, Splat4(1.0f / TexelCount));
+
+			float covariance[4][4] = {};
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				float offset[4];
+				Store4(offset, Sub4(points[i], mean));
+
+				for (uint32_t row = 0; row < 4; row++)
+				{
+					const Vector4 product = Mul4(Splat4(offset[row]), Load4(offset));
+					Store4(covariance[row], Add4(Load4(covariance[row]), product));
+				}
+			}
+
+			// Starting from the row of the largest variance avoids starting perpendicular to the axis
+			uint32_t largest = 0;
+
+			for (uint32_t row = 1; row < 4; row++)
+			{
+				largest = covariance[row][row] > covariance[largest][largest] ? row : largest;
+			}
+
+			Vector4 axis = Load4(covariance[largest]);
+
+			for (uint32_t iteration = 0; iteration < 8; iteration++)
+			{
+				float direction[4];
+				Store4(direction, axis);
+
+				Vector4 next = Zero4();
+
+				for (uint32_t row = 0; row < 4; row++)
+				{
+					next = Add4(next, Mul4(Splat4(direction[row]), Load4(covariance[row])));
+				}
+
+				const float length = std::sqrt(HorizontalSum4(Mul4(next, next)));
+
+				if (!(length > 1e-12f))
+				{
+					endpoint0 = mean;
+					endpoint1 = mean;
+					return;
+				}
+
+				axis = Mul4(next, Splat4(1.0f / length));
+			}
+
+			float minimum = std::numeric_limits<float>::max();
+			float maximum = -std::numeric_limits<float>::max();
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				const float t = HorizontalSum4(Mul4(Sub4(points[i], mean), axis));
+				minimum = std::min(minimum, t);
+				maximum = std::max(maximum, t);
+			}
+
+			endpoint0 = Add4(mean, Mul4(axis, Splat4(minimum)));
+			endpoint1 = Add4(mean, Mul4(axis, Splat4(maximum)));
+		}
+
+		// Least squares endpoints for fixed indices, where weights[i] is how much of the second endpoint point i gets.
+		// Solves the 2x2 normal equations, which are the same for every channel. False when all weights are the same.
+		bool RefineLine(const Vector4* points, const float* weights, Vector4& endpoint0, Vector4& endpoint1)
+		{
+			float a = 0.0f;
+			float b = 0.0f;
+			float c = 0.0f;
+			Vector4 right0 = Zero4();
+			Vector4 right1 = Zero4();
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				const float w = weights[i];
+
+				a += (1.0f - w) * (1.0f - w);
+				b += (1.0f - w) * w;
+				c += w * w;
+				right0 = Add4(right0, Mul4(points[i], Splat4(1.0f - w)));
+				right1 = Add4(right1, Mul4(points[i], Splat4(w)));
+			}
+
+			const float determinant = a * c - b * b;
+
+			if (std::fabs(determinant) < 1e-6f)
+			{
+				return false;
+			}
+
+			const float inverse = 1.0f / determinant;
+
+			endpoint0 = Mul4(Sub4(Mul4(right0, Splat4(c)), Mul4(right1, Splat4(b))), Splat4(inverse));
+			endpoint1 = Mul4(Sub4(Mul4(right1, Splat4(a)), Mul4(right0, Splat4(b))), Splat4(inverse));
+
+			return true;
+		}
+
+		// Nearest palette entry of every point. Returns the summed squared error.
+		float FindIndices(const Vector4* points, const Vector4* palette, uint32_t paletteSize, uint8_t* indices)
+		{
+			float error = 0.0f;
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				float best = std::numeric_limits<float>::max();
+
+				for (uint32_t entry = 0; entry < paletteSize; entry++)
+				{
+					const Vector4 offset = Sub4(points[i], palette[entry]);
+					const float distance = HorizontalSum4(Mul4(offset, offset));
+
+					if (distance < best)
+					{
+						best = distance;
+						indices[i] = static_cast<uint8_t>(entry);
+					}
+				}
+
+				error += best;
+			}
+
+			return error;
+		}
+
+		int32_t Clamp(int32_t value, int32_t minimum, int32_t maximum)
+		{
+			return std::min(std::max(value, minimum), maximum);
+		}
+
+		// BC1 endpoints are 5:6:5 colors, the points are in [0, 1]
+		uint16_t QuantizeRGB565(Vector4 color)
+		{
+			float channels[4];
+			Store4(channels, color);
+
+			const int32_t r = Clamp(static_cast<int32_t>(std::lround(channels[0] * 31.0f)), 0, 31);
+			const int32_t g = Clamp(static_cast<int32_t>(std::lround(channels[1] * 63.0f)), 0, 63);
+			const int32_t b = Clamp(static_cast<int32_t>(std::lround(channels[2] * 31.0f)), 0, 31);
+
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		Vector4 UnpackRGB565(uint16_t color)
+		{
+			const uint32_t r = (color >> 11) & 31;
+			const uint32_t g = (color >> 5) & 63;
+			const uint32_t b = color & 31;
+
+			return Set4(((r << 3) | (r >> 2)) / 255.0f, ((g << 2) | (g >> 4)) / 255.0f, ((b << 3) | (b >> 2)) / 255.0f, 0.0f);
+		}
+
+		// BC7 mode 6 endpoints have 7 bits per channel and one p-bit shared by the channels, together 8 bits. The
+		// points are in [0, 255].
+		void QuantizeBC7Endpoint(Vector4 endpoint, uint32_t* color, uint32_t& pBit)
+		{
+			float channels[4];
+			Store4(channels, Min4(Max4(endpoint, Zero4()), Splat4(255.0f)));
+
+			float bestError = std::numeric_limits<float>::max();
+
+			for (uint32_t p = 0; p < 2; p++)
+			{
+				uint32_t candidate[4];
+				float error = 0.0f;
+
+				for (uint32_t channel = 0; channel < 4; channel++)
+				{
+					candidate[channel] = static_cast<uint32_t>(Clamp(static_cast<int32_t>(std::lround((channels[channel] - p) * 0.5f)), 0, 127));
+
+					const float value = static_cast<float>((candidate[channel] << 1) | p);
+					error += (value - channels[channel]) * (value - channels[channel]);
+				}
+
+				if (error < bestError)
+				{
+					bestError = error;
+					pBit = p;
+					std::memcpy(color, candidate, sizeof(candidate));
+				}
+			}
+		}
+
+		// The value the decoder gives a 10-bit BC6H endpoint before interpolation, and the half it turns an interpolated
+		// value into. The points are the bits of halfs, so the palette is spaced roughly logarithmically.
+		int32_t UnquantizeBC6H(int32_t value)
+		{
+			if (value == 0)
+			{
+				return 0;
+			}
+
+			if (value == 1023)
+			{
+				return 0xFFFF;
+			}
+
+			return ((value << 16) + 0x8000) >> 10;
+		}
+
+		int32_t FinishBC6H(int32_t value)
+		{
+			return (value * 31) >> 6;
+		}
+
+		int32_t InterpolateBC6H(int32_t endpoint0, int32_t endpoint1, uint32_t index)
+		{
+			return FinishBC6H((UnquantizeBC6H(endpoint0) * (64 - Weights4[index]) + UnquantizeBC6H(endpoint1) * Weights4[index] + 32) >> 6);
+		}
+
+		// The 10-bit endpoint that decodes closest to the half, from the neighbours of the linear estimate
+		int32_t QuantizeBC6H(float half)
+		{
+			const int32_t estimate = static_cast<int32_t>(half * (1023.0f / 0x7BFF) + 0.5f);
+
+			int32_t best = 0;
+			float bestError = std::numeric_limits<float>::max();
+
+			for (int32_t candidate = std::max(estimate - 1, 0); candidate <= std::min(estimate + 1, 1023); candidate++)
+			{
+				const float error = std::fabs(static_cast<float>(FinishBC6H(UnquantizeBC6H(candidate))) - half);
+
+				if (error < bestError)
+				{
+					bestError = error;
+					best = candidate;
+				}
+			}
+
+			return best;
+		}
+
+		// The first index of a block has one bit less, so its top bit must be 0. Swapping the endpoints mirrors the
+		// indices when it is not.
+		template<typename Endpoint>
+		void FixAnchorIndex(uint8_t* indices, Endpoint& endpoint0, Endpoint& endpoint1)
+		{
+			if (indices[0] < 8)
+			{
+				return;
+			}
+
+			std::swap(endpoint0, endpoint1);
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				indices[i] = static_cast<uint8_t>(15 - indices[i]);
+			}
+		}
+
+		void WriteIndices4(BitWriter& writer, const uint8_t* indices)
+		{
+			writer.Write(indices[0], 3);
+
+			for (uint32_t i = 1; i < TexelCount; i++)
+			{
+				writer.Write(indices[i], 4);
+			}
+		}
+
+		void ReadIndices4(BitReader& reader, uint8_t* indices)
+		{
+			indices[0] = static_cast<uint8_t>(reader.Read(3));
+
+			for (uint32_t i = 1; i < TexelCount; i++)
+			{
+				indices[i] = static_cast<uint8_t>(reader.Read(4));
+			}
+		}
+	}
+
+	void EncodeBC1(const Float4* texels, uint8_t* block)
+	{
+		Vector4 points[TexelCount];
+
+		for (uint32_t i = 0; i < TexelCount; i++)
+		{
+			points[i] = Min4(Max4(Set4(texels[i].x, texels[i].y, texels[i].z, 0.0f), Zero4()), Splat4(1.0f));
+		}
+
+		Vector4 endpoint0;
+		Vector4 endpoint1;
+		FitLine(points, endpoint0, endpoint1);
+
+		float bestError = std::numeric_limits<float>::max();
+		uint16_t bestColors[2] = {};
+		uint8_t bestIndices[TexelCount] = {};
+
+		for (uint32_t iteration = 0; iteration < 2; iteration++)
+		{
+			uint16_t color0 = QuantizeRGB565(endpoint0);
+			uint16_t color1 = QuantizeRGB565(endpoint1);
+
+			// Four color mode needs the first endpoint to be the larger one
+			if (color0 < color1)
+			{
+				std::swap(color0, color1);
+			}
+
+			const Vector4 first = UnpackRGB565(color0);
+			const Vector4 second = UnpackRGB565(color1);
+			const Vector4 third = Splat4(1.0f / 3.0f);
+
+			const Vector4 palette[4] =
+			{
+				first,
+				second,
+				Add4(first, Mul4(Sub4(second, first), third)),
+				Sub4(second, Mul4(Sub4(second, first), third))
+			};
+
+			// Equal endpoints select three color mode, in which index 0 still is the first endpoint
+			uint8_t indices[TexelCount];
+			const float error = FindIndices(points, palette, color0 == color1 ? 1 : 4, indices);
+
+			if (error < bestError)
+			{
+				bestError = error;
+				bestColors[0] = color0;
+				bestColors[1] = color1;
+				std::memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			float weights[TexelCount];
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				weights[i] = WeightsBC1[indices[i]];
+			}
+
+			if (color0 == color1 || !RefineLine(points, weights, endpoint0, endpoint1))
+			{
+				break;
+			}
+		}
+
+		uint32_t indexBits = 0;
+
+		for (uint32_t i = 0; i < TexelCount; i++)
+		{
+			indexBits |= static_cast<uint32_t>(bestIndices[i]) << (i * 2);
+		}
+
+		std::memcpy(block, bestColors, sizeof(bestColors));
+		std::memcpy(block + 4, &indexBits, sizeof(indexBits));
+	}
+
+	void EncodeBC6H(const Float4* texels, uint8_t* block)
+	{
+		Vector4 points[TexelCount];
+
+		for (uint32_t i = 0; i < TexelCount; i++)
+		{
+			// Unsigned, and capped at the largest finite half
+			const uint16_t r = std::min<uint16_t>(FloatToHalf(std::max(texels[i].x, 0.0f)), 0x7BFF);
+			const uint16_t g = std::min<uint16_t>(FloatToHalf(std::max(texels[i].y, 0.0f)), 0x7BFF);
+			const uint16_t b = std::min<uint16_t>(FloatToHalf(std::max(texels[i].z, 0.0f)), 0x7BFF);
+
+			points[i] = Set4(r, g, b, 0.0f);
+		}
+
+		Vector4 endpoint0;
+		Vector4 endpoint1;
+		FitLine(points, endpoint0, endpoint1);
+
+		float bestError = std::numeric_limits<float>::max();
+		int32_t bestEndpoints[2][3] = {};
+		uint8_t bestIndices[TexelCount] = {};
+
+		for (uint32_t iteration = 0; iteration < 2; iteration++)
+		{
+			float first[4];
+			float second[4];
+			Store4(first, endpoint0);
+			Store4(second, endpoint1);
+
+			int32_t endpoints[2][3];
+
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				endpoints[0][channel] = QuantizeBC6H(first[channel]);
+				endpoints[1][channel] = QuantizeBC6H(second[channel]);
+			}
+
+			Vector4 palette[16];
+
+			for (uint32_t index = 0; index < 16; index++)
+			{
+				palette[index] = Set4(
+					static_cast<float>(InterpolateBC6H(endpoints[0][0], endpoints[1][0], index)),
+					static_cast<float>(InterpolateBC6H(endpoints[0][1], endpoints[1][1], index)),
+					static_cast<float>(InterpolateBC6H(endpoints[0][2], endpoints[1][2], index)),
+					0.0f);
+			}
+
+			uint8_t indices[TexelCount];
+			const float error = FindIndices(points, palette, 16, indices);
+
+			if (error < bestError)
+			{
+				bestError = error;
+				std::memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+				std::memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			float weights[TexelCount];
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				weights[i] = Weights4[indices[i]] / 64.0f;
+			}
+
+			if (!RefineLine(points, weights, endpoint0, endpoint1))
+			{
+				break;
+			}
+		}
+
+		FixAnchorIndex(bestIndices, bestEndpoints[0], bestEndpoints[1]);
+
+		BitWriter writer(block);
+		writer.Write(BC6HMode11, 5);
+
+		for (uint32_t endpoint = 0; endpoint < 2; endpoint++)
+		{
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				writer.Write(static_cast<uint32_t>(bestEndpoints[endpoint][channel]), 10);
+			}
+		}
+
+		WriteIndices4(writer, bestIndices);
+	}
+
+	void EncodeBC7(const Float4* texels, uint8_t* block)
+	{
+		Vector4 points[TexelCount];
+
+		for (uint32_t i = 0; i < TexelCount; i++)
+		{
+			const Vector4 texel = Load4(&texels[i].x);
+			points[i] = Mul4(Min4(Max4(texel, Zero4()), Splat4(1.0f)), Splat4(255.0f));
+		}
+
+		Vector4 endpoint0;
+		Vector4 endpoint1;
+		FitLine(points, endpoint0, endpoint1);
+
+		struct Endpoint
+		{
+			uint32_t Color[4];
+			uint32_t PBit;
+		};
+
+		float bestError = std::numeric_limits<float>::max();
+		Endpoint bestEndpoints[2] = {};
+		uint8_t bestIndices[TexelCount] = {};
+
+		for (uint32_t iteration = 0; iteration < 2; iteration++)
+		{
+			Endpoint endpoints[2];
+			QuantizeBC7Endpoint(endpoint0, endpoints[0].Color, endpoints[0].PBit);
+			QuantizeBC7Endpoint(endpoint1, endpoints[1].Color, endpoints[1].PBit);
+
+			int32_t values[2][4];
+
+			for (uint32_t endpoint = 0; endpoint < 2; endpoint++)
+			{
+				for (uint32_t channel = 0; channel < 4; channel++)
+				{
+					values[endpoint][channel] = static_cast<int32_t>((endpoints[endpoint].Color[channel] << 1) | endpoints[endpoint].PBit);
+				}
+			}
+
+			Vector4 palette[16];
+
+			for (uint32_t index = 0; index < 16; index++)
+			{
+				float entry[4];
+
+				for (uint32_t channel = 0; channel < 4; channel++)
+				{
+					entry[channel] = static_cast<float>((values[0][channel] * (64 - Weights4[index]) + values[1][channel] * Weights4[index] + 32) >> 6);
+				}
+
+				palette[index] = Load4(entry);
+			}
+
+			uint8_t indices[TexelCount];
+			const float error = FindIndices(points, palette, 16, indices);
+
+			if (error < bestError)
+			{
+				bestError = error;
+				bestEndpoints[0] = endpoints[0];
+				bestEndpoints[1] = endpoints[1];
+				std::memcpy(bestIndices, indices, sizeof(indices));
+			}
+
+			float weights[TexelCount];
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				weights[i] = Weights4[indices[i]] / 64.0f;
+			}
+
+			if (!RefineLine(points, weights, endpoint0, endpoint1))
+			{
+				break;
+			}
+		}
+
+		FixAnchorIndex(bestIndices, bestEndpoints[0], bestEndpoints[1]);
+
+		BitWriter writer(block);
+		writer.Write(BC7Mode6, 7);
+
+		for (uint32_t channel = 0; channel < 4; channel++)
+		{
+			writer.Write(bestEndpoints[0].Color[channel], 7);
+			writer.Write(bestEndpoints[1].Color[channel], 7);
+		}
+
+		writer.Write(bestEndpoints[0].PBit, 1);
+		writer.Write(bestEndpoints[1].PBit, 1);
+
+		WriteIndices4(writer, bestIndices);
+	}
+
+	void DecodeBlock(TextureFormat format, const uint8_t* block, Float4* texels)
+	{
+		std::memset(texels, 0, sizeof(Float4) * TexelCount);
+
+		if (format == TextureFormat::BC1)
+		{
+			uint16_t colors[2];
+			uint32_t indexBits;
+			std::memcpy(colors, block, sizeof(colors));
+			std::memcpy(&indexBits, block + 4, sizeof(indexBits));
+
+			float palette[4][4];
+			Store4(palette[0], UnpackRGB565(colors[0]));
+			Store4(palette[1], UnpackRGB565(colors[1]));
+
+			for (uint32_t channel = 0; channel < 3; channel++)
+			{
+				if (colors[0] > colors[1])
+				{
+					palette[2][channel] = (2.0f * palette[0][channel] + palette[1][channel]) / 3.0f;
+					palette[3][channel] = (palette[0][channel] + 2.0f * palette[1][channel]) / 3.0f;
+				}
+				else
+				{
+					palette[2][channel] = (palette[0][channel] + palette[1][channel]) * 0.5f;
+					palette[3][channel] = 0.0f;
+				}
+			}
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				const uint32_t index = (indexBits >> (i * 2)) & 3;
+				const bool transparent = colors[0] <= colors[1] && index == 3;
+
+				texels[i] = { palette[index][0], palette[index][1], palette[index][2], transparent ? 0.0f : 1.0f };
+			}
+		}
+		else if (format == TextureFormat::BC6H)
+		{
+			BitReader reader(block);
+
+			if (reader.Read(5) != BC6HMode11)
+			{
+				return;
+			}
+
+			int32_t endpoints[2][3];
+
+			for (uint32_t endpoint = 0; endpoint < 2; endpoint++)
+			{
+				for (uint32_t channel = 0; channel < 3; channel++)
+				{
+					endpoints[endpoint][channel] = static_cast<int32_t>(reader.Read(10));
+				}
+			}
+
+			uint8_t indices[TexelCount];
+			ReadIndices4(reader, indices);
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				texels[i] =
+				{
+					HalfToFloat(static_cast<uint16_t>(InterpolateBC6H(endpoints[0][0], endpoints[1][0], indices[i]))),
+					HalfToFloat(static_cast<uint16_t>(InterpolateBC6H(endpoints[0][1], endpoints[1][1], indices[i]))),
+					HalfToFloat(static_cast<uint16_t>(InterpolateBC6H(endpoints[0][2], endpoints[1][2], indices[i]))),
+					1.0f
+				};
+			}
+		}
+		else if (format == TextureFormat::BC7)
+		{
+			BitReader reader(block);
+
+			if (reader.Read(7) != BC7Mode6)
+			{
+				return;
+			}
+
+			uint32_t colors[2][4];
+
+			for (uint32_t channel = 0; channel < 4; channel++)
+			{
+				colors[0][channel] = reader.Read(7);
+				colors[1][channel] = reader.Read(7);
+			}
+
+			const uint32_t pBits[2] = { reader.Read(1), reader.Read(1) };
+
+			uint8_t indices[TexelCount];
+			ReadIndices4(reader, indices);
+
+			for (uint32_t i = 0; i < TexelCount; i++)
+			{
+				float texel[4];
+
+				for (uint32_t channel = 0; channel < 4; channel++)
+				{
+					const int32_t value0 = static_cast<int32_t>((colors[0][channel] << 1) | pBits[0]);
+					const int32_t value1 = static_cast<int32_t>((colors[1][channel] << 1) | pBits[1]);
+
+					texel[channel] = ((value0 * (64 - Weights4[indices[i]]) + value1 * Weights4[indices[i]] + 32) >> 6) / 255.0f;
+				}
+
+				texels[i] = { texel[0], texel[1], texel[2], texel[3] };
+			}
+		}
+	}
+
+	void CompressImage(const Image& image, TextureFormat format, void* destination, uint64_t rowPitch)
+	{
+		const uint32_t width = image.GetWidth();
+		const uint32_t height = image.GetHeight();
+		const uint32_t blockCountX = (width + 3) / 4;
+		const uint32_t blockBytes = GetBytesPerBlock(format);
+
+		ThreadPool::Get().ParallelFor((height + 3) / 4, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				Float4 texels[TexelCount];
+
+				for (uint32_t blockY = static_cast<uint32_t>(begin); blockY < end; blockY++)
+				{
+					uint8_t* row = static_cast<uint8_t*>(destination) + blockY * rowPitch;
+
+					for (uint32_t blockX = 0; blockX < blockCountX; blockX++)
+					{
+						for (uint32_t i = 0; i < TexelCount; i++)
+						{
+							texels[i] = image(std::min(blockX * 4 + i % 4, width - 1), std::min(blockY * 4 + i / 4, height - 1));
+						}
+
+						uint8_t* block = row + blockX * blockBytes;
+
+						switch (format)
+						{
+						case TextureFormat::BC1:
+							EncodeBC1(texels, block);
+							break;
+						case TextureFormat::BC6H:
+							EncodeBC6H(texels, block);
+							break;
+						default:
+							EncodeBC7(texels, block);
+							break;
+						}
+					}
+				}
+			});
+	}
+}
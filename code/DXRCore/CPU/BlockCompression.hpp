@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Image.hpp"
+#include "TextureFormat.hpp"
+
+#include <cstdint>
+
+namespace cpu
+{
+	// Encoders for the 4x4 blocks of BC1, BC6H and BC7. Every encoder uses one subset: it fits a line through the
+	// texels along their principal axis, picks the nearest palette entry per texel and refines the endpoints with a
+	// least squares fit of those indices. BC7 always uses mode 6 (RGBA, 4-bit indices) and BC6H mode 11 (10-bit
+	// endpoints, unsigned). The texels are in row-major order.
+	void EncodeBC1(const Float4* texels, uint8_t* block);
+	void EncodeBC6H(const Float4* texels, uint8_t* block);
+	void EncodeBC7(const Float4* texels, uint8_t* block);
+
+	// Decodes a block of one of the encoders above. BC7 and BC6H blocks in other modes decode to 0.
+	void DecodeBlock(TextureFormat format, const uint8_t* block, Float4* texels);
+
+	// Encodes every block of the image, one row of blocks per thread. Rows of blocks are rowPitch bytes apart. Blocks
+	// over the edge of the image repeat its last row and column.
+	void CompressImage(const Image& image, TextureFormat format, void* destination, uint64_t rowPitch);
+}
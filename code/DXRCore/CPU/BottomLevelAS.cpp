@@ -0,0 +1,218 @@
+#include "BottomLevelAS.hpp"
+#include "ThreadPool.hpp"
+
+namespace cpu
+{
+	namespace
+	{
+		// Reads the index buffer in its own format, so 16-bit meshes are not widened first
+		template<typename IndexType>
+		void ComputeTriangleBounds(const Float3* positions, const IndexType* indices, uint32_t triangleCount, AABB* bounds)
+		{
+			ThreadPool::Get().ParallelFor(triangleCount, 16 * 1024, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint64_t i = begin; i < end; i++)
+					{
+						const IndexType* triangle = indices + i * 3;
+
+						AABB box;
+						box.Grow(positions[triangle[0]]);
+						box.Grow(positions[triangle[1]]);
+						box.Grow(positions[triangle[2]]);
+
+						bounds[i] = box;
+					}
+				});
+		}
+	}
+
+	void BottomLevelAS::Build(const TriangleMesh& mesh)
+	{
+		m_Type = GeometryType::Triangles;
+		m_Triangles = &mesh;
+		m_Procedural = nullptr;
+
+		std::vector<AABB> bounds;
+		ComputePrimitiveBounds(bounds);
+
+		BuildHierarchy(bounds.data(), static_cast<uint32_t>(bounds.size()));
+	}
+
+	void BottomLevelAS::Build(const ProceduralGeometry& geometry)
+	{
+		m_Type = GeometryType::ProceduralPrimitives;
+		m_Triangles = nullptr;
+		m_Procedural = &geometry;
+
+		const auto& boxes = geometry.GetBoxes();
+		BuildHierarchy(boxes.data(), static_cast<uint32_t>(boxes.size()));
+	}
+
+	bool BottomLevelAS::Update()
+	{
+		std::vector<AABB> triangleBounds;
+		const AABB* bounds = nullptr;
+		uint32_t count = 0;
+
+		if (m_Type == GeometryType::Triangles)
+		{
+			ComputePrimitiveBounds(triangleBounds);
+			bounds = triangleBounds.data();
+			count = static_cast<uint32_t>(triangleBounds.size());
+		}
+		else
+		{
+			bounds = m_Procedural->GetBoxes().data();
+			count = static_cast<uint32_t>(m_Procedural->GetBoxes().size());
+		}
+
+		if (!m_AllowUpdate || m_BVH.GetPrimitiveIndices().size() != count)
+		{
+			BuildHierarchy(bounds, count);
+			return true;
+		}
+
+		m_BVH.Refit(bounds);
+
+		const float cost = m_BVH.ComputeSAHCost();
+
+		if (cost > m_Statistics.SAHCost * m_RebuildThreshold)
+		{
+			BuildHierarchy(bounds, count);
+			return true;
+		}
+
+		m_Bounds = m_BVH.GetBounds();
+		m_SAHCost = cost;
+
+		if (m_Layout == BVHLayout::Wide)
+		{
+			m_BVH8.Build(m_BVH);
+		}
+
+		return false;
+	}
+
+	void BottomLevelAS::ComputePrimitiveBounds(std::vector<AABB>& bounds) const
+	{
+		const uint32_t triangleCount = m_Triangles->GetTriangleCount();
+		bounds.resize(triangleCount);
+
+		if (m_Triangles->GetIndexSize() == sizeof(uint16_t))
+		{
+			ComputeTriangleBounds(m_Triangles->GetPositions().data(), static_cast<const uint16_t*>(m_Triangles->GetIndexData()), triangleCount, bounds.data());
+		}
+		else
+		{
+			ComputeTriangleBounds(m_Triangles->GetPositions().data(), static_cast<const uint32_t*>(m_Triangles->GetIndexData()), triangleCount, bounds.data());
+		}
+	}
+
+	void BottomLevelAS::BuildHierarchy(const AABB* primitiveBounds, uint32_t count)
+	{
+		m_BVH.Build(primitiveBounds, count);
+		m_Bounds = m_BVH.GetBounds();
+		m_Statistics = m_BVH.GetStatistics();
+		m_SAHCost = m_Statistics.SAHCost;
+
+		if (m_Layout == BVHLayout::Wide)
+		{
+			m_BVH8.Build(m_BVH);
+
+			if (!m_AllowUpdate)
+			{
+				m_BVH = BVH();
+			}
+		}
+		else
+		{
+			m_BVH8 = BVH8();
+		}
+	}
+
+	template<typename Intersector>
+	void BottomLevelAS::Traverse(Ray& ray, Intersector&& intersect) const
+	{
+		if (m_Layout == BVHLayout::Wide)
+		{
+			m_BVH8.Intersect(ray, intersect);
+		}
+		else
+		{
+			m_BVH.Intersect(ray, intersect);
+		}
+	}
+
+	template<typename Intersector>
+	bool BottomLevelAS::TraverseOcclusion(const Ray& ray, Intersector&& occluded) const
+	{
+		if (m_Layout == BVHLayout::Wide)
+		{
+			return m_BVH8.Occluded(ray, occluded);
+		}
+
+		return m_BVH.Occluded(ray, occluded);
+	}
+
+	bool BottomLevelAS::Intersect(Ray& ray, Hit& hit, uint32_t flags) const
+	{
+		bool found = false;
+
+		if (m_Type == GeometryType::Triangles)
+		{
+			Traverse(ray, [&](uint32_t primitive, Ray& r)
+				{
+					Float3 v0, v1, v2;
+					m_Triangles->GetTriangle(primitive, v0, v1, v2);
+
+					float t, u, v;
+					if (IntersectTriangle(r, v0, v1, v2, flags, t, u, v))
+					{
+						r.TMax = t;
+						hit.T = t;
+						hit.Barycentrics = { u, v };
+						hit.PrimitiveIndex = primitive;
+						found = true;
+					}
+				});
+		}
+		else
+		{
+			Traverse(ray, [&](uint32_t primitive, Ray& r)
+				{
+					float t;
+					Float3 normal;
+					if (m_Procedural->Intersect(primitive, r, t, normal))
+					{
+						r.TMax = t;
+						hit.T = t;
+						hit.Barycentrics = { 0.0f, 0.0f };
+						hit.PrimitiveIndex = primitive;
+						hit.Normal = normal;
+						found = true;
+					}
+				});
+		}
+
+		return found;
+	}
+
+	bool BottomLevelAS::Occluded(const Ray& ray, uint32_t flags) const
+	{
+		if (m_Type == GeometryType::Triangles)
+		{
+			return TraverseOcclusion(ray, [&](uint32_t primitive, const Ray& r)
+				{
+					Float3 v0, v1, v2;
+					m_Triangles->GetTriangle(primitive, v0, v1, v2);
+
+					return OccludesTriangle(r, v0, v1, v2, flags);
+				});
+		}
+
+		return TraverseOcclusion(ray, [&](uint32_t primitive, const Ray& r)
+			{
+				return m_Procedural->Occluded(primitive, r);
+			});
+	}
+}
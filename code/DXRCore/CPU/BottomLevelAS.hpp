@@ -0,0 +1,134 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "BVH8.hpp"
+#include "Geometry.hpp"
+
+namespace cpu
+{
+	enum class GeometryType
+	{
+		Triangles,
+		ProceduralPrimitives
+	};
+
+	enum class BVHLayout
+	{
+		// Binary nodes with full precision bounds
+		Binary,
+
+		// The binary BVH collapsed into 8-wide nodes with quantized bounds. Less memory and faster traversal.
+		Wide
+	};
+
+	// CPU counterpart of a bottom level acceleration structure. It references the geometry it was built from, so the
+	// geometry needs to stay alive as long as the acceleration structure is used.
+	class BottomLevelAS
+	{
+	public:
+		// Picks the node layout of the next Build
+		void SetLayout(BVHLayout layout)
+		{
+			m_Layout = layout;
+		}
+
+		// Keeps the binary hierarchy after the next Build, so Update can refit it. With the wide layout this costs the
+		// memory of the binary nodes on top of the wide ones.
+		void SetAllowUpdate(bool allowUpdate)
+		{
+			m_AllowUpdate = allowUpdate;
+		}
+
+		// Update rebuilds once the SAH cost of the refitted hierarchy is more than this many times the cost after the
+		// last build
+		void SetRebuildThreshold(float threshold)
+		{
+			m_RebuildThreshold = threshold;
+		}
+
+		void Build(const TriangleMesh& mesh);
+		void Build(const ProceduralGeometry& geometry);
+
+		// Brings the hierarchy up to date with the moved vertices or boxes of the geometry it was built from, which
+		// needs to have the same number of primitives. Refits when the structure was built with updates allowed, and
+		// rebuilds when it was not or when the refit went over the rebuild threshold. Returns true when it rebuilt.
+		bool Update();
+
+		// Object space closest hit query. Shortens ray.TMax and fills in the hit when something closer is found.
+		bool Intersect(Ray& ray, Hit& hit, uint32_t flags) const;
+
+		// Object space any hit query
+		bool Occluded(const Ray& ray, uint32_t flags) const;
+
+		AABB GetBounds() const
+		{
+			return m_Bounds;
+		}
+
+		BVHLayout GetLayout() const
+		{
+			return m_Layout;
+		}
+
+		GeometryType GetType() const
+		{
+			return m_Type;
+		}
+
+		const TriangleMesh* GetTriangleMesh() const
+		{
+			return m_Triangles;
+		}
+
+		const ProceduralGeometry* GetProceduralGeometry() const
+		{
+			return m_Procedural;
+		}
+
+		// Statistics of the binary build, which the wide layout is collapsed from
+		const BVHStatistics& GetStatistics() const
+		{
+			return m_Statistics;
+		}
+
+		// SAH cost after the last Build or Update
+		float GetSAHCost() const
+		{
+			return m_SAHCost;
+		}
+
+		size_t GetNodeMemory() const
+		{
+			return m_Layout == BVHLayout::Wide ? m_BVH8.GetNodeMemory() : m_BVH.GetNodes().size() * sizeof(BVHNode);
+		}
+
+	private:
+		void ComputePrimitiveBounds(std::vector<AABB>& bounds) const;
+		void BuildHierarchy(const AABB* primitiveBounds, uint32_t count);
+
+		template<typename Intersector>
+		void Traverse(Ray& ray, Intersector&& intersect) const;
+
+		template<typename Intersector>
+		bool TraverseOcclusion(const Ray& ray, Intersector&& occluded) const;
+
+		BVHLayout m_Layout = BVHLayout::Wide;
+
+		bool m_AllowUpdate = false;
+		float m_RebuildThreshold = 1.5f;
+
+		// Only one of the two holds nodes, depending on the layout. The binary nodes are kept as well when updates are
+		// allowed, the wide nodes are collapsed from them again after every refit.
+		BVH m_BVH;
+		BVH8 m_BVH8;
+
+		AABB m_Bounds;
+		BVHStatistics m_Statistics;
+		float m_SAHCost = 0.0f;
+
+		GeometryType m_Type = GeometryType::Triangles;
+
+		const TriangleMesh* m_Triangles = nullptr;
+		const ProceduralGeometry* m_Procedural = nullptr;
+	};
+}
@@ -0,0 +1,149 @@
+#include "DescriptorAllocator.hpp"
+
+#include <cstddef>
+#include <iterator>
+
+namespace cpu
+{
+	DescriptorAllocator::DescriptorAllocator(uint32_t capacity)
+	{
+		Reset(capacity);
+	}
+
+	void DescriptorAllocator::Reset(uint32_t capacity)
+	{
+		m_FreeByOffset.clear();
+		m_FreeBySize.clear();
+		m_FrameFrees.clear();
+		m_PendingFrees.clear();
+
+		m_Capacity = 0;
+		m_FreeCount = 0;
+
+		Grow(capacity);
+	}
+
+	uint32_t DescriptorAllocator::Allocate(uint32_t count)
+	{
+		auto best = m_FreeBySize.lower_bound({ count, 0 });
+
+		if (count == 0 || best == m_FreeBySize.end())
+		{
+			return InvalidIndex;
+		}
+
+		const uint32_t index = best->second;
+		const uint32_t size = best->first;
+
+		RemoveFreeRange(m_FreeByOffset.find(index));
+
+		// The rest of the range stays free
+		if (size > count)
+		{
+			AddFreeRange(index + count, size - count);
+		}
+
+		return index;
+	}
+
+	void DescriptorAllocator::Free(uint32_t index, uint32_t count)
+	{
+		if (index == InvalidIndex || count == 0)
+		{
+			return;
+		}
+
+		m_FrameFrees.push_back({ index, count, 0 });
+	}
+
+	void DescriptorAllocator::EndFrame(uint64_t fence)
+	{
+		for (PendingFree& pending : m_FrameFrees)
+		{
+			pending.Fence = fence;
+			m_PendingFrees.push_back(pending);
+		}
+
+		m_FrameFrees.clear();
+	}
+
+	void DescriptorAllocator::Reclaim(uint64_t completedFence)
+	{
+		size_t kept = 0;
+
+		for (const PendingFree& pending : m_PendingFrees)
+		{
+			if (pending.Fence <= completedFence)
+			{
+				AddFreeRange(pending.Index, pending.Count);
+			}
+			else
+			{
+				m_PendingFrees[kept++] = pending;
+			}
+		}
+
+		m_PendingFrees.resize(kept);
+	}
+
+	void DescriptorAllocator::Grow(uint32_t capacity)
+	{
+		if (capacity <= m_Capacity)
+		{
+			return;
+		}
+
+		const uint32_t start = m_Capacity;
+		m_Capacity = capacity;
+
+		AddFreeRange(start, capacity - start);
+	}
+
+	uint32_t DescriptorAllocator::GetUsedEnd() const
+	{
+		if (m_FreeByOffset.empty())
+		{
+			return m_Capacity;
+		}
+
+		const auto& [index, count] = *m_FreeByOffset.rbegin();
+
+		return index + count == m_Capacity ? index : m_Capacity;
+	}
+
+	void DescriptorAllocator::AddFreeRange(uint32_t index, uint32_t count)
+	{
+		// Merge with the free range after it
+		auto next = m_FreeByOffset.lower_bound(index);
+
+		if (next != m_FreeByOffset.end() && next->first == index + count)
+		{
+			count += next->second;
+			RemoveFreeRange(next++);
+		}
+
+		// And with the one before it
+		if (next != m_FreeByOffset.begin())
+		{
+			auto previous = std::prev(next);
+
+			if (previous->first + previous->second == index)
+			{
+				index = previous->first;
+				count += previous->second;
+				RemoveFreeRange(previous);
+			}
+		}
+
+		m_FreeByOffset.emplace(index, count);
+		m_FreeBySize.emplace(count, index);
+		m_FreeCount += count;
+	}
+
+	void DescriptorAllocator::RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range)
+	{
+		m_FreeCount -= range->second;
+		m_FreeBySize.erase({ range->second, range->first });
+		m_FreeByOffset.erase(range);
+	}
+}
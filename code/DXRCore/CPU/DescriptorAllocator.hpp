@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace cpu
+{
+	// Hands out ranges of indices in a descriptor heap. Free ranges are kept sorted by offset, so neighbours merge when
+	// they are freed, and by size, so an allocation takes the smallest range it fits in. A freed range is only reused
+	// once the frame that freed it has completed on the GPU, as the frames in flight can still read its descriptors.
+	class DescriptorAllocator
+	{
+	public:
+		static constexpr uint32_t InvalidIndex = ~0u;
+
+		DescriptorAllocator() = default;
+		explicit DescriptorAllocator(uint32_t capacity);
+
+		// Forgets every allocation
+		void Reset(uint32_t capacity);
+
+		// First index of count contiguous indices, or InvalidIndex when no free range is large enough. The caller can
+		// Grow and try again.
+		uint32_t Allocate(uint32_t count = 1);
+
+		// Frees the range at the end of the current frame
+		void Free(uint32_t index, uint32_t count = 1);
+
+		// Closes the current frame. Its frees are reused once Reclaim is called with a completed fence of at least the
+		// fence. Fences must increase from frame to frame.
+		void EndFrame(uint64_t fence);
+
+		// Makes the frees of the frames of which the fence has completed available again
+		void Reclaim(uint64_t completedFence);
+
+		// Adds the indices from the current capacity up to the new one
+		void Grow(uint32_t capacity);
+
+		uint32_t GetCapacity() const
+		{
+			return m_Capacity;
+		}
+
+		// Indices that are allocated, including the ones that wait for their frame to complete
+		uint32_t GetAllocatedCount() const
+		{
+			return m_Capacity - m_FreeCount;
+		}
+
+		// One past the highest allocated index, the part of the heap that holds descriptors
+		uint32_t GetUsedEnd() const;
+
+	private:
+		struct PendingFree
+		{
+			uint32_t Index;
+			uint32_t Count;
+			uint64_t Fence;
+		};
+
+		void AddFreeRange(uint32_t index, uint32_t count);
+		void RemoveFreeRange(std::map<uint32_t, uint32_t>::iterator range);
+
+		// Offset to size, and size with offset
+		std::map<uint32_t, uint32_t> m_FreeByOffset;
+		std::set<std::pair<uint32_t, uint32_t>> m_FreeBySize;
+
+		// Frees of the current frame have no fence yet
+		std::vector<PendingFree> m_FrameFrees;
+		std::vector<PendingFree> m_PendingFrees;
+
+		uint32_t m_Capacity = 0;
+		uint32_t m_FreeCount = 0;
+	};
+}
@@ -0,0 +1,55 @@
+#include "FrameAllocator.hpp"
+
+#include <algorithm>
+
+namespace cpu
+{
+	FrameAllocator::FrameAllocator(uint8_t* cpuAddress, uint64_t gpuAddress, uint64_t capacity, uint32_t threadCount, uint64_t chunkSize, WaitFunction wait)
+		: m_CPUAddress(cpuAddress)
+		, m_GPUAddress(gpuAddress)
+		, m_ChunkSize((std::max(chunkSize, Alignment) + Alignment - 1) & ~(Alignment - 1))
+		, m_Wait(std::move(wait))
+		, m_Chunks(std::max(threadCount, 1u))
+		, m_Ring(capacity)
+	{
+	}
+
+	FrameAllocator::Allocation FrameAllocator::AllocateChunk(uint64_t size, uint32_t threadIndex)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		// Constants larger than a chunk get a chunk of their own size
+		const uint64_t chunkSize = std::max(m_ChunkSize, size);
+		uint64_t offset = m_Ring.Allocate(chunkSize, Alignment);
+
+		// The oldest frame in flight frees the most memory. Without one, the open frame fills the ring by itself.
+		while (offset == RingAllocator::InvalidOffset && m_Ring.GetOldestFence() != 0)
+		{
+			m_WaitCount++;
+			m_Ring.Release(m_Wait(m_Ring.GetOldestFence()));
+
+			offset = m_Ring.Allocate(chunkSize, Alignment);
+		}
+
+		if (offset == RingAllocator::InvalidOffset)
+		{
+			return {};
+		}
+
+		m_ChunkCount++;
+		m_Chunks[threadIndex] = { offset + size, offset + chunkSize };
+
+		return { m_CPUAddress + offset, m_GPUAddress + offset };
+	}
+
+	void FrameAllocator::EndFrame(uint64_t fence, uint64_t completedFence)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		// What is left of the chunks goes with the frame, the next frame starts with new ones
+		m_Ring.CloseBatch(fence);
+		m_Ring.Release(completedFence);
+
+		std::fill(m_Chunks.begin(), m_Chunks.end(), Chunk());
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "RingAllocator.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace cpu
+{
+	// Hands out the constant buffers of a frame from a ring of persistently mapped memory. Every thread bumps a pointer
+	// through a chunk of its own, so an allocation is an add and a compare, and only taking the next chunk from the ring
+	// locks. The chunks of a frame are reused once the fence of the frame has completed. When the ring is full the
+	// allocator waits for the oldest frame.
+	class FrameAllocator
+	{
+	public:
+		// Constant buffer views start at multiples of 256 bytes
+		static constexpr uint64_t Alignment = 256;
+
+		// Blocks until the fence has completed, and returns the last completed fence
+		using WaitFunction = std::function<uint64_t(uint64_t fence)>;
+
+		struct Allocation
+		{
+			uint8_t* CPUAddress = nullptr;
+
+			// 0 when the allocation failed
+			uint64_t GPUAddress = 0;
+		};
+
+		// The memory stays owned by the caller. Every thread of the thread count gets a chunk of its own.
+		FrameAllocator(uint8_t* cpuAddress, uint64_t gpuAddress, uint64_t capacity, uint32_t threadCount, uint64_t chunkSize, WaitFunction wait);
+
+		FrameAllocator(const FrameAllocator&) = delete;
+		FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+		// Size bytes that are valid until the end of the frame. Fails when the frame fills the ring by itself. Every
+		// thread passes its own index, a thread index of cpu::ThreadPool on the threads of the pool.
+		Allocation Allocate(uint64_t size, uint32_t threadIndex = 0)
+		{
+			Chunk& chunk = m_Chunks[threadIndex];
+			const uint64_t alignedSize = (size + Alignment - 1) & ~(Alignment - 1);
+
+			if (alignedSize > chunk.End - chunk.Offset)
+			{
+				return AllocateChunk(alignedSize, threadIndex);
+			}
+
+			const uint64_t offset = chunk.Offset;
+			chunk.Offset += alignedSize;
+
+			return { m_CPUAddress + offset, m_GPUAddress + offset };
+		}
+
+		// Uninitialized space for a struct of Shared.hpp, with its GPU address
+		template<typename T>
+		T* Allocate(uint64_t& gpuAddress, uint32_t threadIndex = 0)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Constants are copied to the GPU as they are");
+
+			const Allocation allocation = Allocate(sizeof(T), threadIndex);
+			gpuAddress = allocation.GPUAddress;
+
+			return reinterpret_cast<T*>(allocation.CPUAddress);
+		}
+
+		// Copies the struct into the frame and returns its GPU address, or 0 when the allocation failed. Structs only,
+		// so a size in bytes goes to the overload above.
+		template<typename T, typename = std::enable_if_t<std::is_class_v<T>>>
+		uint64_t Allocate(const T& value, uint32_t threadIndex = 0)
+		{
+			uint64_t gpuAddress = 0;
+
+			if (T* constants = Allocate<T>(gpuAddress, threadIndex))
+			{
+				memcpy(constants, &value, sizeof(T));
+			}
+
+			return gpuAddress;
+		}
+
+		// Ends the frame, which owns everything allocated since the last call until its fence has completed, and frees
+		// the frames of which the fence has. Fences start at 1 and increase from frame to frame. Not to be called while
+		// other threads allocate.
+		void EndFrame(uint64_t fence, uint64_t completedFence);
+
+		// Bytes of the ring in use by the frames in flight and the open frame
+		uint64_t GetUsedSize() const
+		{
+			return m_Ring.GetUsedSize();
+		}
+
+		// Times a thread took a new chunk, and times the ring was full and the allocator had to wait for the GPU
+		uint64_t GetChunkCount() const
+		{
+			return m_ChunkCount;
+		}
+
+		uint64_t GetWaitCount() const
+		{
+			return m_WaitCount;
+		}
+
+	private:
+		Allocation AllocateChunk(uint64_t size, uint32_t threadIndex);
+
+		// On a cache line of its own, so the threads do not share the line they write to
+		struct alignas(64) Chunk
+		{
+			uint64_t Offset = 0;
+			uint64_t End = 0;
+		};
+
+		uint8_t* m_CPUAddress;
+		uint64_t m_GPUAddress;
+		uint64_t m_ChunkSize;
+
+		WaitFunction m_Wait;
+
+		std::vector<Chunk> m_Chunks;
+
+		std::mutex m_Mutex;
+		RingAllocator m_Ring;
+
+		uint64_t m_ChunkCount = 0;
+		uint64_t m_WaitCount = 0;
+	};
+}
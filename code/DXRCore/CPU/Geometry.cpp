@@ -0,0 +1,22 @@
+#include "Geometry.hpp"
+
+namespace cpu
+{
+	bool ProceduralGeometry::Intersect(uint32_t primitive, const Ray& ray, float& t, Float3& normal) const
+	{
+		if (!primitives::IntersectPrimitive(m_Primitives[primitive], ray.Origin, ray.Direction, ray.TMin, ray.TMax, t))
+		{
+			return false;
+		}
+
+		normal = primitives::GetPrimitiveNormal(m_Primitives[primitive], ray.Origin + ray.Direction * t);
+
+		return true;
+	}
+
+	bool ProceduralGeometry::Occluded(uint32_t primitive, const Ray& ray) const
+	{
+		float t;
+		return primitives::IntersectPrimitive(m_Primitives[primitive], ray.Origin, ray.Direction, ray.TMin, ray.TMax, t);
+	}
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Math.hpp"
+#include "../Shaders/Primitives.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	// CPU copy of the vertex and index data given to Mesh. Indices are kept in their original 16-bit or 32-bit format.
+	class TriangleMesh
+	{
+	public:
+		void SetPositions(uint64_t numPositions, const Float3* data)
+		{
+			m_Positions.assign(data, data + numPositions);
+		}
+
+		void SetNormals(uint64_t numNormals, const Float3* data)
+		{
+			m_Normals.assign(data, data + numNormals);
+		}
+
+		void SetIndices(uint64_t numIndices, const void* data, uint32_t indexSize)
+		{
+			const auto* bytes = static_cast<const uint8_t*>(data);
+
+			m_Indices.assign(bytes, bytes + numIndices * indexSize);
+			m_IndexSize = indexSize;
+		}
+
+		uint32_t GetTriangleCount() const
+		{
+			return m_IndexSize == 0 ? 0 : static_cast<uint32_t>(m_Indices.size() / (m_IndexSize * 3));
+		}
+
+		void GetTriangleIndices(uint32_t triangle, uint32_t indices[3]) const
+		{
+			if (m_IndexSize == sizeof(uint16_t))
+			{
+				const auto* data = reinterpret_cast<const uint16_t*>(m_Indices.data()) + triangle * 3;
+				indices[0] = data[0];
+				indices[1] = data[1];
+				indices[2] = data[2];
+			}
+			else
+			{
+				const auto* data = reinterpret_cast<const uint32_t*>(m_Indices.data()) + triangle * 3;
+				indices[0] = data[0];
+				indices[1] = data[1];
+				indices[2] = data[2];
+			}
+		}
+
+		void GetTriangle(uint32_t triangle, Float3& v0, Float3& v1, Float3& v2) const
+		{
+			uint32_t indices[3];
+			GetTriangleIndices(triangle, indices);
+
+			v0 = m_Positions[indices[0]];
+			v1 = m_Positions[indices[1]];
+			v2 = m_Positions[indices[2]];
+		}
+
+		// Interpolated vertex normal, or the geometric normal when the mesh has no normals
+		Float3 GetNormal(uint32_t triangle, const Float2& barycentrics) const
+		{
+			uint32_t indices[3];
+			GetTriangleIndices(triangle, indices);
+
+			if (m_Normals.empty())
+			{
+				const Float3& v0 = m_Positions[indices[0]];
+				return Normalize(Cross(m_Positions[indices[1]] - v0, m_Positions[indices[2]] - v0));
+			}
+
+			const float w = 1.0f - barycentrics.x - barycentrics.y;
+			return Normalize(m_Normals[indices[0]] * w + m_Normals[indices[1]] * barycentrics.x + m_Normals[indices[2]] * barycentrics.y);
+		}
+
+		const std::vector<Float3>& GetPositions() const
+		{
+			return m_Positions;
+		}
+
+		const std::vector<Float3>& GetNormals() const
+		{
+			return m_Normals;
+		}
+
+		const void* GetIndexData() const
+		{
+			return m_Indices.data();
+		}
+
+		uint32_t GetIndexSize() const
+		{
+			return m_IndexSize;
+		}
+
+	private:
+		std::vector<Float3> m_Positions;
+		std::vector<Float3> m_Normals;
+
+		std::vector<uint8_t> m_Indices;
+		uint32_t m_IndexSize = 0;
+	};
+
+	// CPU copy of the entries of a ProceduralPrimitive: the AABB that goes into the BVH and the analytic primitive inside
+	// it. The layout of AABB matches D3D12_RAYTRACING_AABB.
+	class ProceduralGeometry
+	{
+	public:
+		void AddPrimitive(const AABB& box, const primitives::Primitive& primitive)
+		{
+			m_Boxes.push_back(box);
+			m_Primitives.push_back(primitive);
+		}
+
+		// Resize followed by SetPrimitive fills large sets from several threads, every thread writing its own range
+		void Resize(uint64_t count)
+		{
+			m_Boxes.resize(count);
+			m_Primitives.resize(count);
+		}
+
+		void SetPrimitive(uint64_t index, const AABB& box, const primitives::Primitive& primitive)
+		{
+			m_Boxes[index] = box;
+			m_Primitives[index] = primitive;
+		}
+
+		const std::vector<AABB>& GetBoxes() const
+		{
+			return m_Boxes;
+		}
+
+		const std::vector<primitives::Primitive>& GetPrimitives() const
+		{
+			return m_Primitives;
+		}
+
+		// Intersection "shader" for the CPU path, the same code as IntersectionMain in the intersection sample
+		bool Intersect(uint32_t primitive, const Ray& ray, float& t, Float3& normal) const;
+
+		// Same test without the normal, for shadow rays
+		bool Occluded(uint32_t primitive, const Ray& ray) const;
+
+	private:
+		std::vector<AABB> m_Boxes;
+		std::vector<primitives::Primitive> m_Primitives;
+	};
+}
@@ -0,0 +1,143 @@
+#include "Image.hpp"
+
+#include <cstdio>
+#include <string>
+
+namespace cpu
+{
+	Image::Image(uint32_t width, uint32_t height)
+	{
+		Resize(width, height);
+	}
+
+	void Image::Resize(uint32_t width, uint32_t height)
+	{
+		m_Width = width;
+		m_Height = height;
+		m_Pixels.assign(static_cast<size_t>(width) * height, Float4{ 0.0f, 0.0f, 0.0f, 1.0f });
+	}
+
+	void Image::Clear(const Float4& color)
+	{
+		std::fill(m_Pixels.begin(), m_Pixels.end(), color);
+	}
+
+	void Image::SetPixels(const uint8_t* rgba)
+	{
+		for (size_t i = 0; i < m_Pixels.size(); i++)
+		{
+			m_Pixels[i] = { rgba[i * 4 + 0] / 255.0f, rgba[i * 4 + 1] / 255.0f, rgba[i * 4 + 2] / 255.0f, rgba[i * 4 + 3] / 255.0f };
+		}
+	}
+
+	void Image::SetPixels(const float* rgba)
+	{
+		for (size_t i = 0; i < m_Pixels.size(); i++)
+		{
+			m_Pixels[i] = { rgba[i * 4 + 0], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3] };
+		}
+	}
+
+	Float3 Image::Sample(float u, float v) const
+	{
+		if (m_Pixels.empty())
+		{
+			return Float3(0.0f);
+		}
+
+		const float x = u * m_Width - 0.5f;
+		const float y = v * m_Height - 0.5f;
+
+		const float fx = std::floor(x);
+		const float fy = std::floor(y);
+		const float tx = x - fx;
+		const float ty = y - fy;
+
+		auto Fetch = [this](int64_t px, int64_t py)
+			{
+				px %= static_cast<int64_t>(m_Width);
+				px = px < 0 ? px + m_Width : px;
+				py = std::clamp<int64_t>(py, 0, static_cast<int64_t>(m_Height) - 1);
+
+				const Float4& p = m_Pixels[static_cast<size_t>(py) * m_Width + static_cast<size_t>(px)];
+				return Float3(p.x, p.y, p.z);
+			};
+
+		const int64_t ix = static_cast<int64_t>(fx);
+		const int64_t iy = static_cast<int64_t>(fy);
+
+		const Float3 top = Fetch(ix, iy) * (1.0f - tx) + Fetch(ix + 1, iy) * tx;
+		const Float3 bottom = Fetch(ix, iy + 1) * (1.0f - tx) + Fetch(ix + 1, iy + 1) * tx;
+
+		return top * (1.0f - ty) + bottom * ty;
+	}
+
+	Float3 Image::SampleEquirectangular(const Float3& direction) const
+	{
+		const float phi = std::atan2(direction.y, direction.x) + PI;
+		const float theta = std::acos(std::clamp(-direction.z, -1.0f, 1.0f));
+
+		const float u = phi / (2.0f * PI);
+		const float v = 1.0f - (theta / PI);
+
+		return Sample(u, v);
+	}
+
+	bool Image::Write(std::string_view path) const
+	{
+		const std::string file(path);
+		const bool isFloat = path.size() > 4 && path.substr(path.size() - 4) == ".pfm";
+
+		FILE* stream = std::fopen(file.c_str(), "wb");
+
+		if (stream == nullptr)
+		{
+			return false;
+		}
+
+		if (isFloat)
+		{
+			// PFM stores the rows bottom to top. A negative scale marks the data as little endian.
+			std::fprintf(stream, "PF\n%u %u\n-1.0\n", m_Width, m_Height);
+
+			std::vector<float> row(static_cast<size_t>(m_Width) * 3);
+
+			for (uint32_t y = m_Height; y-- > 0;)
+			{
+				for (uint32_t x = 0; x < m_Width; x++)
+				{
+					const Float4& p = (*this)(x, y);
+					row[x * 3 + 0] = p.x;
+					row[x * 3 + 1] = p.y;
+					row[x * 3 + 2] = p.z;
+				}
+
+				std::fwrite(row.data(), sizeof(float), row.size(), stream);
+			}
+		}
+		else
+		{
+			std::fprintf(stream, "P6\n%u %u\n255\n", m_Width, m_Height);
+
+			std::vector<uint8_t> row(static_cast<size_t>(m_Width) * 3);
+
+			for (uint32_t y = 0; y < m_Height; y++)
+			{
+				for (uint32_t x = 0; x < m_Width; x++)
+				{
+					// Same conversion as writing to the R8G8B8A8_UNORM render target
+					const Float4& p = (*this)(x, y);
+					row[x * 3 + 0] = static_cast<uint8_t>(Saturate(p.x) * 255.0f + 0.5f);
+					row[x * 3 + 1] = static_cast<uint8_t>(Saturate(p.y) * 255.0f + 0.5f);
+					row[x * 3 + 2] = static_cast<uint8_t>(Saturate(p.z) * 255.0f + 0.5f);
+				}
+
+				std::fwrite(row.data(), 1, row.size(), stream);
+			}
+		}
+
+		std::fclose(stream);
+
+		return true;
+	}
+}
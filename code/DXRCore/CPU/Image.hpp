@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace cpu
+{
+	// RGBA32F image. Used as the render target of the CPU backend and as the CPU copy of textures (e.g. the sky dome).
+	class Image
+	{
+	public:
+		Image() = default;
+		Image(uint32_t width, uint32_t height);
+
+		void Resize(uint32_t width, uint32_t height);
+		void Clear(const Float4& color);
+
+		// Copies 8-bit or 32-bit float RGBA pixels, as returned by stbi_load/stbi_loadf with 4 channels
+		void SetPixels(const uint8_t* rgba);
+		void SetPixels(const float* rgba);
+
+		Float4& operator()(uint32_t x, uint32_t y)
+		{
+			return m_Pixels[static_cast<size_t>(y) * m_Width + x];
+		}
+
+		const Float4& operator()(uint32_t x, uint32_t y) const
+		{
+			return m_Pixels[static_cast<size_t>(y) * m_Width + x];
+		}
+
+		// Bilinear lookup with wrapping in u and clamping in v
+		Float3 Sample(float u, float v) const;
+
+		// Lookup in an equirectangular map, using the same mapping as MissMain in the samples
+		Float3 SampleEquirectangular(const Float3& direction) const;
+
+		// Writes the image as a binary PPM (8-bit, clamped) or PFM (32-bit float), picked by the extension of the path
+		bool Write(std::string_view path) const;
+
+		uint32_t GetWidth() const
+		{
+			return m_Width;
+		}
+
+		uint32_t GetHeight() const
+		{
+			return m_Height;
+		}
+
+		const Float4* GetData() const
+		{
+			return m_Pixels.data();
+		}
+
+		Float4* GetData()
+		{
+			return m_Pixels.data();
+		}
+
+	private:
+		std::vector<Float4> m_Pixels;
+
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+	};
+}
@@ -0,0 +1,435 @@
+#include "InstanceStore.hpp"
+
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstring>
+#include <initializer_list>
+
+namespace cpu
+{
+	namespace
+	{
+		// Pointers to the components of the instances, so the kernels can be free functions with their own target
+		struct Components
+		{
+			const float* Translation[3];
+			const float* Rotation[4];
+			const float* Scale[3];
+
+			const uint8_t* Mask;
+			const uint32_t* InstanceID;
+			const uint32_t* HitGroupIndex;
+			const uint64_t* AccelerationStructure;
+		};
+
+		// Row j of the transform is scale j times row j of the rotation, and the translation rotated and scaled. The
+		// SIMD kernels do the same operations in the same order, so the paths only differ where a compiler fuses a
+		// multiply and an add.
+		Transform3x4 BuildTransform(const float t[3], const float q[4], const float s[3])
+		{
+			const float xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+			const float xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+			const float xw = q[0] * q[3], yw = q[1] * q[3], zw = q[2] * q[3];
+
+			const float r[3][3] = {
+				{ 1.0f - 2.0f * (yy + zz), 2.0f * (xy - zw), 2.0f * (xz + yw) },
+				{ 2.0f * (xy + zw), 1.0f - 2.0f * (xx + zz), 2.0f * (yz - xw) },
+				{ 2.0f * (xz - yw), 2.0f * (yz + xw), 1.0f - 2.0f * (xx + yy) }
+			};
+
+			Transform3x4 transform;
+
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				transform.m[j][0] = s[j] * r[j][0];
+				transform.m[j][1] = s[j] * r[j][1];
+				transform.m[j][2] = s[j] * r[j][2];
+				transform.m[j][3] = s[j] * ((r[j][0] * t[0] + r[j][1] * t[1]) + r[j][2] * t[2]);
+			}
+
+			return transform;
+		}
+
+		void PackScalar(const Components& c, PackedInstanceDesc* descs, uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const float t[3] = { c.Translation[0][i], c.Translation[1][i], c.Translation[2][i] };
+				const float q[4] = { c.Rotation[0][i], c.Rotation[1][i], c.Rotation[2][i], c.Rotation[3][i] };
+				const float s[3] = { c.Scale[0][i], c.Scale[1][i], c.Scale[2][i] };
+
+				PackedInstanceDesc desc;
+				desc.Transform = BuildTransform(t, q, s);
+				desc.InstanceID = c.InstanceID[i];
+				desc.InstanceMask = c.Mask[i];
+				desc.InstanceContributionToHitGroupIndex = c.HitGroupIndex[i];
+				desc.Flags = 0;
+				desc.AccelerationStructure = c.AccelerationStructure[i];
+
+				descs[i] = desc;
+			}
+		}
+
+#if CPU_X64
+		CPU_TARGET_AVX2 inline void Transpose8(__m256 r[8])
+		{
+			const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+			const __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+			const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+			const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+			const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+			const __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+			const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+			const __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+			const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+			const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+			const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+			const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+			const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+			r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+			r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+			r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+			r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+			r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+			r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+			r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+			r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+		}
+
+		// One row of the transforms of 8 instances
+		CPU_TARGET_AVX2 inline void TransformRow8(__m256 r0, __m256 r1, __m256 r2, __m256 s, const __m256 t[3], __m256* row)
+		{
+			row[0] = _mm256_mul_ps(s, r0);
+			row[1] = _mm256_mul_ps(s, r1);
+			row[2] = _mm256_mul_ps(s, r2);
+			row[3] = _mm256_mul_ps(s, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r0, t[0]), _mm256_mul_ps(r1, t[1])), _mm256_mul_ps(r2, t[2])));
+		}
+
+		// Packs 8 instances at the time and returns where it stopped, the rest is left to PackScalar. Streaming stores
+		// need descs at a multiple of 32 bytes.
+		template<bool Stream>
+		CPU_TARGET_AVX2 uint32_t PackAVX2(const Components& c, PackedInstanceDesc* descs, uint32_t begin, uint32_t end)
+		{
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 two = _mm256_set1_ps(2.0f);
+			const __m256i lower24 = _mm256_set1_epi32(0xFFFFFF);
+
+			uint32_t i = begin;
+
+			for (; i + 8 <= end; i += 8)
+			{
+				const __m256 t[3] = { _mm256_loadu_ps(c.Translation[0] + i), _mm256_loadu_ps(c.Translation[1] + i), _mm256_loadu_ps(c.Translation[2] + i) };
+
+				const __m256 x = _mm256_loadu_ps(c.Rotation[0] + i);
+				const __m256 y = _mm256_loadu_ps(c.Rotation[1] + i);
+				const __m256 z = _mm256_loadu_ps(c.Rotation[2] + i);
+				const __m256 w = _mm256_loadu_ps(c.Rotation[3] + i);
+
+				const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+				const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+				const __m256 xw = _mm256_mul_ps(x, w), yw = _mm256_mul_ps(y, w), zw = _mm256_mul_ps(z, w);
+
+				// Words 0 to 7 of the descs are the first two rows of the transforms, words 8 to 15 the last row, the
+				// instance ID and mask, the hit group index and flags, and the address of the BLAS
+				__m256 low[8];
+				__m256 high[8];
+
+				TransformRow8(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), _mm256_mul_ps(two, _mm256_sub_ps(xy, zw)), _mm256_mul_ps(two, _mm256_add_ps(xz, yw)),
+					_mm256_loadu_ps(c.Scale[0] + i), t, low);
+				TransformRow8(_mm256_mul_ps(two, _mm256_add_ps(xy, zw)), _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), _mm256_mul_ps(two, _mm256_sub_ps(yz, xw)),
+					_mm256_loadu_ps(c.Scale[1] + i), t, low + 4);
+				TransformRow8(_mm256_mul_ps(two, _mm256_sub_ps(xz, yw)), _mm256_mul_ps(two, _mm256_add_ps(yz, xw)), _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))),
+					_mm256_loadu_ps(c.Scale[2] + i), t, high);
+
+				const __m256i mask = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(c.Mask + i)));
+				const __m256i instanceID = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.InstanceID + i)), lower24);
+				const __m256i hitGroupIndex = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(c.HitGroupIndex + i)), lower24);
+
+				high[4] = _mm256_castsi256_ps(_mm256_or_si256(instanceID, _mm256_slli_epi32(mask, 24)));
+				high[5] = _mm256_castsi256_ps(hitGroupIndex);
+
+				// The 64 bit addresses split into their low and high halves
+				const __m256 a = _mm256_loadu_ps(reinterpret_cast<const float*>(c.AccelerationStructure + i));
+				const __m256 b = _mm256_loadu_ps(reinterpret_cast<const float*>(c.AccelerationStructure + i + 4));
+				high[6] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+				high[7] = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+				Transpose8(low);
+				Transpose8(high);
+
+				float* out = reinterpret_cast<float*>(descs + i);
+
+				for (uint32_t k = 0; k < 8; k++)
+				{
+					if constexpr (Stream)
+					{
+						_mm256_stream_ps(out + k * 16, low[k]);
+						_mm256_stream_ps(out + k * 16 + 8, high[k]);
+					}
+					else
+					{
+						_mm256_storeu_ps(out + k * 16, low[k]);
+						_mm256_storeu_ps(out + k * 16 + 8, high[k]);
+					}
+				}
+			}
+
+			if constexpr (Stream)
+			{
+				_mm_sfence();
+			}
+
+			return i;
+		}
+
+		// One row of the transforms of 4 instances
+		CPU_TARGET_SSE4 inline void TransformRow4(__m128 r0, __m128 r1, __m128 r2, __m128 s, const __m128 t[3], __m128* row)
+		{
+			row[0] = _mm_mul_ps(s, r0);
+			row[1] = _mm_mul_ps(s, r1);
+			row[2] = _mm_mul_ps(s, r2);
+			row[3] = _mm_mul_ps(s, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, t[0]), _mm_mul_ps(r1, t[1])), _mm_mul_ps(r2, t[2])));
+		}
+
+		// Same as PackAVX2 with 4 instances at the time, streaming stores need descs at a multiple of 16 bytes
+		template<bool Stream>
+		CPU_TARGET_SSE4 uint32_t PackSSE4(const Components& c, PackedInstanceDesc* descs, uint32_t begin, uint32_t end)
+		{
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 two = _mm_set1_ps(2.0f);
+			const __m128i lower24 = _mm_set1_epi32(0xFFFFFF);
+
+			uint32_t i = begin;
+
+			for (; i + 4 <= end; i += 4)
+			{
+				const __m128 t[3] = { _mm_loadu_ps(c.Translation[0] + i), _mm_loadu_ps(c.Translation[1] + i), _mm_loadu_ps(c.Translation[2] + i) };
+
+				const __m128 x = _mm_loadu_ps(c.Rotation[0] + i);
+				const __m128 y = _mm_loadu_ps(c.Rotation[1] + i);
+				const __m128 z = _mm_loadu_ps(c.Rotation[2] + i);
+				const __m128 w = _mm_loadu_ps(c.Rotation[3] + i);
+
+				const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+				const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+				const __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+				// Four groups of four words of the descs, the last one the instance ID and mask, the hit group index and
+				// flags, and the address of the BLAS
+				__m128 words[16];
+
+				TransformRow4(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_sub_ps(xy, zw)), _mm_mul_ps(two, _mm_add_ps(xz, yw)),
+					_mm_loadu_ps(c.Scale[0] + i), t, words);
+				TransformRow4(_mm_mul_ps(two, _mm_add_ps(xy, zw)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_sub_ps(yz, xw)),
+					_mm_loadu_ps(c.Scale[1] + i), t, words + 4);
+				TransformRow4(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), _mm_mul_ps(two, _mm_add_ps(yz, xw)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))),
+					_mm_loadu_ps(c.Scale[2] + i), t, words + 8);
+
+				int32_t maskBytes;
+				memcpy(&maskBytes, c.Mask + i, sizeof(maskBytes));
+
+				const __m128i mask = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(maskBytes));
+				const __m128i instanceID = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.InstanceID + i)), lower24);
+				const __m128i hitGroupIndex = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(c.HitGroupIndex + i)), lower24);
+
+				words[12] = _mm_castsi128_ps(_mm_or_si128(instanceID, _mm_slli_epi32(mask, 24)));
+				words[13] = _mm_castsi128_ps(hitGroupIndex);
+
+				const __m128 a = _mm_loadu_ps(reinterpret_cast<const float*>(c.AccelerationStructure + i));
+				const __m128 b = _mm_loadu_ps(reinterpret_cast<const float*>(c.AccelerationStructure + i + 2));
+				words[14] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				words[15] = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+				for (uint32_t group = 0; group < 16; group += 4)
+				{
+					_MM_TRANSPOSE4_PS(words[group], words[group + 1], words[group + 2], words[group + 3]);
+				}
+
+				float* out = reinterpret_cast<float*>(descs + i);
+
+				for (uint32_t k = 0; k < 4; k++)
+				{
+					for (uint32_t group = 0; group < 4; group++)
+					{
+						if constexpr (Stream)
+						{
+							_mm_stream_ps(out + k * 16 + group * 4, words[group * 4 + k]);
+						}
+						else
+						{
+							_mm_storeu_ps(out + k * 16 + group * 4, words[group * 4 + k]);
+						}
+					}
+				}
+			}
+
+			if constexpr (Stream)
+			{
+				_mm_sfence();
+			}
+
+			return i;
+		}
+#endif
+	}
+
+	uint32_t InstanceStore::Add(uint64_t accelerationStructure, uint32_t instanceID, uint32_t hitGroupIndex)
+	{
+		m_TranslationX.push_back(0.0f);
+		m_TranslationY.push_back(0.0f);
+		m_TranslationZ.push_back(0.0f);
+
+		m_RotationX.push_back(0.0f);
+		m_RotationY.push_back(0.0f);
+		m_RotationZ.push_back(0.0f);
+		m_RotationW.push_back(1.0f);
+
+		m_ScaleX.push_back(1.0f);
+		m_ScaleY.push_back(1.0f);
+		m_ScaleZ.push_back(1.0f);
+
+		m_ColorR.push_back(1.0f);
+		m_ColorG.push_back(1.0f);
+		m_ColorB.push_back(1.0f);
+		m_ColorA.push_back(1.0f);
+		m_Reflectance.push_back(0.0f);
+
+		m_Mask.push_back(1);
+		m_InstanceID.push_back(instanceID);
+		m_HitGroupIndex.push_back(hitGroupIndex);
+		m_AccelerationStructure.push_back(accelerationStructure);
+
+		return GetCount() - 1;
+	}
+
+	void InstanceStore::Reserve(uint32_t count)
+	{
+		for (std::vector<float>* component : { &m_TranslationX, &m_TranslationY, &m_TranslationZ, &m_RotationX, &m_RotationY, &m_RotationZ, &m_RotationW,
+			&m_ScaleX, &m_ScaleY, &m_ScaleZ, &m_ColorR, &m_ColorG, &m_ColorB, &m_ColorA, &m_Reflectance })
+		{
+			component->reserve(count);
+		}
+
+		m_Mask.reserve(count);
+		m_InstanceID.reserve(count);
+		m_HitGroupIndex.reserve(count);
+		m_AccelerationStructure.reserve(count);
+	}
+
+	void InstanceStore::Clear()
+	{
+		for (std::vector<float>* component : { &m_TranslationX, &m_TranslationY, &m_TranslationZ, &m_RotationX, &m_RotationY, &m_RotationZ, &m_RotationW,
+			&m_ScaleX, &m_ScaleY, &m_ScaleZ, &m_ColorR, &m_ColorG, &m_ColorB, &m_ColorA, &m_Reflectance })
+		{
+			component->clear();
+		}
+
+		m_Mask.clear();
+		m_InstanceID.clear();
+		m_HitGroupIndex.clear();
+		m_AccelerationStructure.clear();
+	}
+
+	void InstanceStore::SetTranslation(uint32_t index, const Float3& translation)
+	{
+		m_TranslationX[index] = translation.x;
+		m_TranslationY[index] = translation.y;
+		m_TranslationZ[index] = translation.z;
+	}
+
+	void InstanceStore::SetRotation(uint32_t index, const Float4& rotation)
+	{
+		m_RotationX[index] = rotation.x;
+		m_RotationY[index] = rotation.y;
+		m_RotationZ[index] = rotation.z;
+		m_RotationW[index] = rotation.w;
+	}
+
+	void InstanceStore::SetScale(uint32_t index, const Float3& scale)
+	{
+		m_ScaleX[index] = scale.x;
+		m_ScaleY[index] = scale.y;
+		m_ScaleZ[index] = scale.z;
+	}
+
+	void InstanceStore::SetColor(uint32_t index, const Float4& color)
+	{
+		m_ColorR[index] = color.x;
+		m_ColorG[index] = color.y;
+		m_ColorB[index] = color.z;
+		m_ColorA[index] = color.w;
+	}
+
+	void InstanceStore::SetReflectance(uint32_t index, float reflectance)
+	{
+		m_Reflectance[index] = reflectance;
+	}
+
+	void InstanceStore::SetMask(uint32_t index, uint8_t mask)
+	{
+		m_Mask[index] = mask;
+	}
+
+	void InstanceStore::SetInstanceID(uint32_t index, uint32_t instanceID)
+	{
+		m_InstanceID[index] = instanceID;
+	}
+
+	void InstanceStore::SetHitGroupIndex(uint32_t index, uint32_t hitGroupIndex)
+	{
+		m_HitGroupIndex[index] = hitGroupIndex;
+	}
+
+	void InstanceStore::SetAccelerationStructure(uint32_t index, uint64_t accelerationStructure)
+	{
+		m_AccelerationStructure[index] = accelerationStructure;
+	}
+
+	Transform3x4 InstanceStore::GetTransform(uint32_t index) const
+	{
+		const float t[3] = { m_TranslationX[index], m_TranslationY[index], m_TranslationZ[index] };
+		const float q[4] = { m_RotationX[index], m_RotationY[index], m_RotationZ[index], m_RotationW[index] };
+		const float s[3] = { m_ScaleX[index], m_ScaleY[index], m_ScaleZ[index] };
+
+		return BuildTransform(t, q, s);
+	}
+
+	void InstanceStore::Pack(PackedInstanceDesc* descs, uint32_t begin, uint32_t end) const
+	{
+		const Components components = {
+			{ m_TranslationX.data(), m_TranslationY.data(), m_TranslationZ.data() },
+			{ m_RotationX.data(), m_RotationY.data(), m_RotationZ.data(), m_RotationW.data() },
+			{ m_ScaleX.data(), m_ScaleY.data(), m_ScaleZ.data() },
+			m_Mask.data(), m_InstanceID.data(), m_HitGroupIndex.data(), m_AccelerationStructure.data()
+		};
+
+#if CPU_X64
+		const uintptr_t address = reinterpret_cast<uintptr_t>(descs);
+
+		if (GetSIMDLevel() == SIMDLevel::AVX2)
+		{
+			begin = address % 32 == 0 ? PackAVX2<true>(components, descs, begin, end) : PackAVX2<false>(components, descs, begin, end);
+		}
+		else if (GetSIMDLevel() == SIMDLevel::SSE4)
+		{
+			begin = address % 16 == 0 ? PackSSE4<true>(components, descs, begin, end) : PackSSE4<false>(components, descs, begin, end);
+		}
+#endif
+
+		PackScalar(components, descs, begin, end);
+	}
+
+	void InstanceStore::Pack(PackedInstanceDesc* descs) const
+	{
+		ThreadPool::Get().ParallelFor(GetCount(), PackGrainSize, [this, descs](uint64_t begin, uint64_t end, uint32_t)
+		{
+			Pack(descs, static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+		});
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace cpu
+{
+	// Same bytes as D3D12_RAYTRACING_INSTANCE_DESC, so instances can be packed straight into an upload buffer
+	struct PackedInstanceDesc
+	{
+		Transform3x4 Transform;
+		uint32_t InstanceID : 24;
+		uint32_t InstanceMask : 8;
+		uint32_t InstanceContributionToHitGroupIndex : 24;
+		uint32_t Flags : 8;
+		uint64_t AccelerationStructure;
+	};
+
+	static_assert(sizeof(PackedInstanceDesc) == 64, "An instance desc is 64 bytes");
+
+	// The instances of a TLAS as a structure of arrays, every component in an array of its own. Packing loads the
+	// components of 8 instances (4 with SSE4) at the time, builds their transforms side by side and transposes them into
+	// instance descs, without a matrix per instance.
+	class InstanceStore
+	{
+	public:
+		// Instances of a chunk of the thread pool when packing
+		static constexpr uint32_t PackGrainSize = 4096;
+
+		// Adds an instance with the identity transform, white, not reflective and with mask 1, and returns its index
+		uint32_t Add(uint64_t accelerationStructure, uint32_t instanceID = 0, uint32_t hitGroupIndex = 0);
+
+		void Reserve(uint32_t count);
+		void Clear();
+
+		uint32_t GetCount() const
+		{
+			return static_cast<uint32_t>(m_AccelerationStructure.size());
+		}
+
+		void SetTranslation(uint32_t index, const Float3& translation);
+
+		// A quaternion, used as it is like XMMatrixRotationQuaternion does
+		void SetRotation(uint32_t index, const Float4& rotation);
+		void SetScale(uint32_t index, const Float3& scale);
+
+		void SetColor(uint32_t index, const Float4& color);
+		void SetReflectance(uint32_t index, float reflectance);
+		void SetMask(uint32_t index, uint8_t mask);
+
+		void SetInstanceID(uint32_t index, uint32_t instanceID);
+		void SetHitGroupIndex(uint32_t index, uint32_t hitGroupIndex);
+		void SetAccelerationStructure(uint32_t index, uint64_t accelerationStructure);
+
+		Float4 GetColor(uint32_t index) const
+		{
+			return { m_ColorR[index], m_ColorG[index], m_ColorB[index], m_ColorA[index] };
+		}
+
+		float GetReflectance(uint32_t index) const
+		{
+			return m_Reflectance[index];
+		}
+
+		uint32_t GetInstanceID(uint32_t index) const
+		{
+			return m_InstanceID[index];
+		}
+
+		uint64_t GetAccelerationStructure(uint32_t index) const
+		{
+			return m_AccelerationStructure[index];
+		}
+
+		// The transform the instance desc gets. Same as the transpose of translation * rotation * scale of the
+		// instances of the renderer, in the row-vector convention of DirectXMath.
+		Transform3x4 GetTransform(uint32_t index) const;
+
+		// Writes the instances of [begin, end) to descs[begin, end) on the calling thread, with the instructions of
+		// GetSIMDLevel(). Full cache lines are written in order, which suits the write-combined memory of upload heaps.
+		void Pack(PackedInstanceDesc* descs, uint32_t begin, uint32_t end) const;
+
+		// Writes every instance to descs, split over the threads of cpu::ThreadPool
+		void Pack(PackedInstanceDesc* descs) const;
+
+	private:
+		std::vector<float> m_TranslationX;
+		std::vector<float> m_TranslationY;
+		std::vector<float> m_TranslationZ;
+
+		std::vector<float> m_RotationX;
+		std::vector<float> m_RotationY;
+		std::vector<float> m_RotationZ;
+		std::vector<float> m_RotationW;
+
+		std::vector<float> m_ScaleX;
+		std::vector<float> m_ScaleY;
+		std::vector<float> m_ScaleZ;
+
+		std::vector<float> m_ColorR;
+		std::vector<float> m_ColorG;
+		std::vector<float> m_ColorB;
+		std::vector<float> m_ColorA;
+		std::vector<float> m_Reflectance;
+
+		std::vector<uint8_t> m_Mask;
+		std::vector<uint32_t> m_InstanceID;
+		std::vector<uint32_t> m_HitGroupIndex;
+		std::vector<uint64_t> m_AccelerationStructure;
+	};
+}
@@ -0,0 +1,98 @@
+#include "JobRecorder.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace cpu
+{
+	void PartitionJobs(const std::vector<float>& costs, uint32_t maxChunkCount, std::vector<RecordingChunk>& chunks)
+	{
+		chunks.clear();
+
+		const uint32_t jobCount = static_cast<uint32_t>(costs.size());
+		const uint32_t chunkCount = std::min(std::max(maxChunkCount, 1u), jobCount);
+
+		if (chunkCount == 0)
+		{
+			return;
+		}
+
+		double totalCost = 0.0;
+
+		for (float cost : costs)
+		{
+			totalCost += std::max(cost, 0.0f);
+		}
+
+		// A chunk ends once the cost so far reaches its share of the total, but leaves at least one job for every chunk
+		// after it
+		RecordingChunk chunk;
+		double cost = 0.0;
+
+		for (uint32_t job = 0; job < jobCount; job++)
+		{
+			cost += std::max(costs[job], 0.0f);
+			chunk.JobCount++;
+
+			const uint32_t chunksLeft = chunkCount - static_cast<uint32_t>(chunks.size()) - 1;
+			const uint32_t jobsLeft = jobCount - job - 1;
+			const double share = totalCost * (chunks.size() + 1) / chunkCount;
+
+			if (chunksLeft > 0 && (cost >= share || jobsLeft == chunksLeft))
+			{
+				chunks.push_back(chunk);
+
+				chunk.FirstJob = job + 1;
+				chunk.JobCount = 0;
+			}
+		}
+
+		chunks.push_back(chunk);
+	}
+
+	JobRecorder::JobRecorder(ThreadPool& threadPool)
+		: m_ThreadPool(threadPool)
+	{
+	}
+
+	void JobRecorder::Add(Job job, float cost)
+	{
+		m_Jobs.push_back(std::move(job));
+		m_Costs.push_back(cost);
+	}
+
+	uint32_t JobRecorder::Record(uint32_t maxChunkCount, const Job& beginChunk)
+	{
+		PartitionJobs(m_Costs, maxChunkCount, m_Chunks);
+
+		auto RecordChunks = [this, &beginChunk](uint64_t begin, uint64_t end, uint32_t threadIndex)
+		{
+			for (uint64_t i = begin; i < end; i++)
+			{
+				const uint32_t chunk = static_cast<uint32_t>(i);
+
+				beginChunk(chunk, threadIndex);
+
+				for (uint32_t job = 0; job < m_Chunks[chunk].JobCount; job++)
+				{
+					m_Jobs[m_Chunks[chunk].FirstJob + job](chunk, threadIndex);
+				}
+			}
+		};
+
+		// A single chunk is recorded on the calling thread, which saves waking up the pool
+		if (m_Chunks.size() == 1)
+		{
+			RecordChunks(0, 1, 0);
+		}
+		else if (m_Chunks.size() > 1)
+		{
+			m_ThreadPool.ParallelFor(m_Chunks.size(), 1, RecordChunks);
+		}
+
+		m_Jobs.clear();
+		m_Costs.clear();
+
+		return static_cast<uint32_t>(m_Chunks.size());
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+#include <functional>
+#include <vector>
+
+namespace cpu
+{
+	class ThreadPool;
+
+	// Jobs of a chunk are recorded in order by one thread, into the list of the chunk
+	struct RecordingChunk
+	{
+		uint32_t FirstJob = 0;
+		uint32_t JobCount = 0;
+	};
+
+	// Splits jobs into at most maxChunkCount contiguous chunks of about the same total cost. Every chunk has at least one
+	// job, and the chunks cover the jobs in order.
+	void PartitionJobs(const std::vector<float>& costs, uint32_t maxChunkCount, std::vector<RecordingChunk>& chunks);
+
+	// Records jobs, such as the passes of a frame, on the threads of a pool without changing their order. The jobs are
+	// split into contiguous chunks of about the same cost and every chunk is recorded by one thread into a list of its
+	// own, so submitting the lists in chunk order submits the jobs in the order they were added. Few large chunks keep
+	// the number of lists, and the cost of submitting them, low.
+	class JobRecorder
+	{
+	public:
+		// Records a job into the list of the chunk. The thread index is below ThreadPool::GetThreadCount(), so it can
+		// index per thread data such as the constants of a thread. A thread can record several chunks one after the
+		// other, so data that stays in use by the list until it is submitted, like a command allocator, goes per chunk.
+		using Job = std::function<void(uint32_t chunk, uint32_t threadIndex)>;
+
+		explicit JobRecorder(ThreadPool& threadPool);
+
+		// Adds a job that is recorded after the ones added before it. The cost is only compared between jobs.
+		void Add(Job job, float cost = 1.0f);
+
+		// Records the jobs added since the last call in at most maxChunkCount chunks, and blocks until all are recorded.
+		// beginChunk is called on the thread of a chunk before its jobs, to get the list of the chunk ready. Returns the
+		// number of chunks.
+		uint32_t Record(uint32_t maxChunkCount, const Job& beginChunk);
+
+		uint32_t GetJobCount() const
+		{
+			return static_cast<uint32_t>(m_Jobs.size());
+		}
+
+		// Chunks of the last Record
+		const std::vector<RecordingChunk>& GetChunks() const
+		{
+			return m_Chunks;
+		}
+
+	private:
+		ThreadPool& m_ThreadPool;
+
+		std::vector<Job> m_Jobs;
+		std::vector<float> m_Costs;
+		std::vector<RecordingChunk> m_Chunks;
+	};
+}
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+
+// Small, portable math library for the CPU backend. The D3D12 path uses DirectXMath, but the CPU path needs to build
+// on machines without the Windows SDK, so it uses these plain structs instead. The layouts match the XMFLOAT types.
+
+namespace cpu
+{
+	constexpr float PI = 3.14159265f;
+	constexpr float INVPI = 0.31830988618379067153777f;
+	constexpr float INV2PI = 0.15915494309189533576888f;
+	constexpr float FloatMax = std::numeric_limits<float>::max();
+
+	struct Float2
+	{
+		float x;
+		float y;
+	};
+
+	struct Float3
+	{
+		Float3() = default;
+		constexpr Float3(float v) : x(v), y(v), z(v) {}
+		constexpr Float3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+		float operator[](uint32_t axis) const
+		{
+			return (&x)[axis];
+		}
+
+		float& operator[](uint32_t axis)
+		{
+			return (&x)[axis];
+		}
+
+		float x;
+		float y;
+		float z;
+	};
+
+	struct Float4
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+	};
+
+	// Row-major, row-vector convention. This is the same memory layout as DirectX::XMFLOAT4X4.
+	struct Float4x4
+	{
+		float m[4][4];
+	};
+
+	inline Float3 operator+(const Float3& a, const Float3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Float3 operator-(const Float3& a, const Float3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Float3 operator*(const Float3& a, const Float3& b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+	inline Float3 operator/(const Float3& a, const Float3& b) { return { a.x / b.x, a.y / b.y, a.z / b.z }; }
+	inline Float3 operator*(const Float3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	inline Float3 operator*(float s, const Float3& a) { return { a.x * s, a.y * s, a.z * s }; }
+	inline Float3 operator/(const Float3& a, float s) { return a * (1.0f / s); }
+	inline Float3 operator-(const Float3& a) { return { -a.x, -a.y, -a.z }; }
+
+	inline Float3& operator+=(Float3& a, const Float3& b) { a = a + b; return a; }
+	inline Float3& operator-=(Float3& a, const Float3& b) { a = a - b; return a; }
+	inline Float3& operator*=(Float3& a, const Float3& b) { a = a * b; return a; }
+	inline Float3& operator*=(Float3& a, float s) { a = a * s; return a; }
+
+	inline float Dot(const Float3& a, const Float3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline Float3 Cross(const Float3& a, const Float3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	inline float Length(const Float3& a)
+	{
+		return std::sqrt(Dot(a, a));
+	}
+
+	inline Float3 Normalize(const Float3& a)
+	{
+		return a * (1.0f / Length(a));
+	}
+
+	inline Float3 Min(const Float3& a, const Float3& b)
+	{
+		return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) };
+	}
+
+	inline Float3 Max(const Float3& a, const Float3& b)
+	{
+		return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) };
+	}
+
+	inline Float3 Reflect(const Float3& i, const Float3& n)
+	{
+		return i - n * (2.0f * Dot(i, n));
+	}
+
+	inline float Saturate(float v)
+	{
+		return std::min(std::max(v, 0.0f), 1.0f);
+	}
+
+	inline uint32_t MaxAxis(const Float3& a)
+	{
+		return a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+	}
+
+	struct AABB
+	{
+		Float3 Min = Float3(FloatMax);
+		Float3 Max = Float3(-FloatMax);
+
+		void Grow(const Float3& p)
+		{
+			Min = cpu::Min(Min, p);
+			Max = cpu::Max(Max, p);
+		}
+
+		void Grow(const AABB& box)
+		{
+			Min = cpu::Min(Min, box.Min);
+			Max = cpu::Max(Max, box.Max);
+		}
+
+		Float3 Extent() const
+		{
+			return Max - Min;
+		}
+
+		Float3 Center() const
+		{
+			return (Min + Max) * 0.5f;
+		}
+
+		bool IsValid() const
+		{
+			return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z;
+		}
+
+		// Half of the surface area. The factor 2 cancels out in every SAH ratio, so it is left out.
+		float HalfArea() const
+		{
+			if (!IsValid())
+			{
+				return 0.0f;
+			}
+
+			Float3 e = Extent();
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	// 3x4 affine transform, laid out like D3D12_RAYTRACING_INSTANCE_DESC::Transform (world = M * float4(p, 1)).
+	struct Transform3x4
+	{
+		float m[3][4];
+
+		static Transform3x4 Identity()
+		{
+			return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } } };
+		}
+
+		Float3 TransformPoint(const Float3& p) const
+		{
+			return {
+				m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+				m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+				m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]
+			};
+		}
+
+		Float3 TransformVector(const Float3& v) const
+		{
+			return {
+				m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+				m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+				m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z
+			};
+		}
+
+		// Transforms a direction with the transpose of the 3x3 part. Used on the inverse transform to bring object space
+		// normals into world space.
+		Float3 TransformVectorTransposed(const Float3& v) const
+		{
+			return {
+				m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+				m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+				m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z
+			};
+		}
+
+		AABB TransformBounds(const AABB& box) const
+		{
+			AABB result;
+
+			if (!box.IsValid())
+			{
+				return result;
+			}
+
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				Float3 corner((i & 1) ? box.Max.x : box.Min.x, (i & 2) ? box.Max.y : box.Min.y, (i & 4) ? box.Max.z : box.Min.z);
+				result.Grow(TransformPoint(corner));
+			}
+
+			return result;
+		}
+
+		Transform3x4 Inverse() const
+		{
+			const float a = m[0][0], b = m[0][1], c = m[0][2];
+			const float d = m[1][0], e = m[1][1], f = m[1][2];
+			const float g = m[2][0], h = m[2][1], i = m[2][2];
+
+			const float A = e * i - f * h;
+			const float B = f * g - d * i;
+			const float C = d * h - e * g;
+
+			const float det = a * A + b * B + c * C;
+			const float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+			Transform3x4 r;
+			r.m[0][0] = A * invDet;
+			r.m[1][0] = B * invDet;
+			r.m[2][0] = C * invDet;
+			r.m[0][1] = (c * h - b * i) * invDet;
+			r.m[1][1] = (a * i - c * g) * invDet;
+			r.m[2][1] = (b * g - a * h) * invDet;
+			r.m[0][2] = (b * f - c * e) * invDet;
+			r.m[1][2] = (c * d - a * f) * invDet;
+			r.m[2][2] = (a * e - b * d) * invDet;
+
+			const Float3 t(m[0][3], m[1][3], m[2][3]);
+			r.m[0][3] = -(r.m[0][0] * t.x + r.m[0][1] * t.y + r.m[0][2] * t.z);
+			r.m[1][3] = -(r.m[1][0] * t.x + r.m[1][1] * t.y + r.m[1][2] * t.z);
+			r.m[2][3] = -(r.m[2][0] * t.x + r.m[2][1] * t.y + r.m[2][2] * t.z);
+
+			return r;
+		}
+	};
+
+	// Mirrors the ray flags of HLSL's TraceRay, so the CPU path can be driven with the same values as the shaders.
+	enum RayFlags : uint32_t
+	{
+		RayFlagNone = 0x00,
+		RayFlagForceOpaque = 0x01,
+		RayFlagForceNonOpaque = 0x02,
+		RayFlagAcceptFirstHitAndEndSearch = 0x04,
+		RayFlagSkipClosestHitShader = 0x08,
+		RayFlagCullBackFacingTriangles = 0x10,
+		RayFlagCullFrontFacingTriangles = 0x20,
+		RayFlagCullOpaque = 0x40,
+		RayFlagCullNonOpaque = 0x80,
+	};
+
+	// Same members as HLSL's RayDesc
+	struct Ray
+	{
+		Float3 Origin;
+		float TMin;
+		Float3 Direction;
+		float TMax;
+	};
+
+	constexpr uint32_t InvalidIndex = static_cast<uint32_t>(-1);
+
+	struct Hit
+	{
+		float T = FloatMax;
+		Float2 Barycentrics = { 0.0f, 0.0f };
+
+		uint32_t PrimitiveIndex = InvalidIndex;
+		uint32_t InstanceIndex = InvalidIndex;
+		uint32_t InstanceID = 0;
+
+		// Record in the hit group table that the GPU would run for this hit
+		uint32_t HitGroupIndex = 0;
+
+		// Object space normal, only written by procedural primitives (the triangle normal is fetched during shading)
+		Float3 Normal = Float3(0.0f);
+
+		bool IsValid() const
+		{
+			return InstanceIndex != InvalidIndex;
+		}
+	};
+
+	// Precomputed data that every box test during a traversal needs
+	struct RayInverse
+	{
+		explicit RayInverse(const Float3& direction)
+		{
+			// A zero component gets a large finite inverse instead of infinity. The quantized planes of the BVH8 are
+			// computed as q * scale + offset, where an infinite inverse gives 0 * inf = NaN and switches the slab off.
+			InvDirection = Float3(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+			IsNegative[0] = InvDirection.x < 0.0f;
+			IsNegative[1] = InvDirection.y < 0.0f;
+			IsNegative[2] = InvDirection.z < 0.0f;
+		}
+
+		Float3 InvDirection;
+		uint32_t IsNegative[3];
+
+	private:
+		static float SafeInverse(float x)
+		{
+			constexpr float large = 1.0e18f;
+			return std::abs(x) > 1.0f / large ? 1.0f / x : std::copysign(large, x);
+		}
+	};
+
+	// Slab test. Returns the entry distance, or FloatMax when the box is missed.
+	inline float IntersectAABB(const AABB& box, const Ray& ray, const RayInverse& inv)
+	{
+		const float tx1 = (box.Min.x - ray.Origin.x) * inv.InvDirection.x;
+		const float tx2 = (box.Max.x - ray.Origin.x) * inv.InvDirection.x;
+		float tmin = std::min(tx1, tx2);
+		float tmax = std::max(tx1, tx2);
+
+		const float ty1 = (box.Min.y - ray.Origin.y) * inv.InvDirection.y;
+		const float ty2 = (box.Max.y - ray.Origin.y) * inv.InvDirection.y;
+		tmin = std::max(tmin, std::min(ty1, ty2));
+		tmax = std::min(tmax, std::max(ty1, ty2));
+
+		const float tz1 = (box.Min.z - ray.Origin.z) * inv.InvDirection.z;
+		const float tz2 = (box.Max.z - ray.Origin.z) * inv.InvDirection.z;
+		tmin = std::max(tmin, std::min(tz1, tz2));
+		tmax = std::min(tmax, std::max(tz1, tz2));
+
+		if (tmax >= tmin && tmax >= ray.TMin && tmin < ray.TMax)
+		{
+			return std::max(tmin, ray.TMin);
+		}
+
+		return FloatMax;
+	}
+
+	// Moller-Trumbore. Front faces follow the D3D12 convention: clockwise as seen from the ray origin.
+	// On a hit, u and v are the weights of v1 and v2, the same as BuiltInTriangleIntersectionAttributes::barycentrics.
+	inline bool IntersectTriangle(const Ray& ray, const Float3& v0, const Float3& v1, const Float3& v2, uint32_t flags, float& t, float& u, float& v)
+	{
+		const Float3 e1 = v1 - v0;
+		const Float3 e2 = v2 - v0;
+		const Float3 p = Cross(ray.Direction, e2);
+		const float det = Dot(e1, p);
+
+		// det > 0 means that the geometric normal cross(e1, e2) points towards the ray origin, which is a front face
+		if ((flags & RayFlagCullBackFacingTriangles) && det <= 0.0f)
+		{
+			return false;
+		}
+
+		if ((flags & RayFlagCullFrontFacingTriangles) && det >= 0.0f)
+		{
+			return false;
+		}
+
+		if (std::fabs(det) < 1e-12f)
+		{
+			return false;
+		}
+
+		const float invDet = 1.0f / det;
+		const Float3 s = ray.Origin - v0;
+
+		u = Dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+
+		const Float3 q = Cross(s, e1);
+
+		v = Dot(ray.Direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+
+		t = Dot(e2, q) * invDet;
+
+		return t >= ray.TMin && t < ray.TMax;
+	}
+
+	// Any hit version of IntersectTriangle for shadow rays. Nothing is divided by the determinant: u, v and t are
+	// compared scaled by it, and the barycentrics are never computed.
+	inline bool OccludesTriangle(const Ray& ray, const Float3& v0, const Float3& v1, const Float3& v2, uint32_t flags)
+	{
+		const Float3 e1 = v1 - v0;
+		const Float3 e2 = v2 - v0;
+		const Float3 p = Cross(ray.Direction, e2);
+		const float det = Dot(e1, p);
+
+		if ((flags & RayFlagCullBackFacingTriangles) && det <= 0.0f)
+		{
+			return false;
+		}
+
+		if ((flags & RayFlagCullFrontFacingTriangles) && det >= 0.0f)
+		{
+			return false;
+		}
+
+		const float absDet = std::fabs(det);
+
+		if (absDet < 1e-12f)
+		{
+			return false;
+		}
+
+		// Flipping the signs for back faces keeps all comparisons against a positive determinant
+		const float sign = std::copysign(1.0f, det);
+		const Float3 s = ray.Origin - v0;
+
+		const float u = Dot(s, p) * sign;
+		if (u < 0.0f || u > absDet)
+		{
+			return false;
+		}
+
+		const Float3 q = Cross(s, e1);
+
+		const float v = Dot(ray.Direction, q) * sign;
+		if (v < 0.0f || u + v > absDet)
+		{
+			return false;
+		}
+
+		const float t = Dot(e2, q) * sign;
+
+		return t >= ray.TMin * absDet && t < ray.TMax * absDet;
+	}
+}
@@ -0,0 +1,187 @@
+#include "PipelineCache.hpp"
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint32_t CacheMagic = 0x50525844; // 'DXRP'
+
+		struct FileHeader
+		{
+			uint32_t Magic = 0;
+			uint32_t Version = 0;
+			uint64_t EntryCount = 0;
+		};
+
+		struct EntryHeader
+		{
+			uint64_t Key = 0;
+			uint64_t Size = 0;
+			uint64_t Checksum = 0;
+		};
+
+		// Covers the key and the size too, so a damaged entry header cannot pass off a blob as that of another pipeline
+		uint64_t GetChecksum(const EntryHeader& entry, const std::vector<uint8_t>& data)
+		{
+			const uint64_t seed = HashMemory(&entry, offsetof(EntryHeader, Checksum));
+
+			return HashMemory(data.data(), data.size(), seed);
+		}
+	}
+
+	void PipelineKey::Add(const void* data, size_t size)
+	{
+		m_Hash = HashMemory(data, size, m_Hash);
+	}
+
+	PipelineCache::PipelineCache(std::string path)
+		: m_Path(std::move(path))
+	{
+	}
+
+	bool PipelineCache::Load()
+	{
+		std::FILE* file = std::fopen(m_Path.c_str(), "rb");
+
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		std::fseek(file, 0, SEEK_END);
+		const uint64_t fileSize = static_cast<uint64_t>(std::ftell(file));
+		std::fseek(file, 0, SEEK_SET);
+
+		FileHeader header;
+		const bool valid = std::fread(&header, sizeof(header), 1, file) == 1 && header.Magic == CacheMagic && header.Version == Version;
+
+		uint64_t offset = sizeof(header);
+
+		for (uint64_t i = 0; valid && i < header.EntryCount; i++)
+		{
+			EntryHeader entry;
+
+			// A blob that does not fit in the rest of the file means the file was cut off
+			if (std::fread(&entry, sizeof(entry), 1, file) != 1 || entry.Size > fileSize - offset - sizeof(entry))
+			{
+				break;
+			}
+
+			std::vector<uint8_t> data(entry.Size);
+
+			if ((entry.Size > 0 && std::fread(data.data(), entry.Size, 1, file) != 1) || GetChecksum(entry, data) != entry.Checksum)
+			{
+				break;
+			}
+
+			offset += sizeof(entry) + entry.Size;
+			m_Entries.insert_or_assign(entry.Key, std::move(data));
+		}
+
+		std::fclose(file);
+
+		return valid;
+	}
+
+	bool PipelineCache::Save()
+	{
+		if (!m_Dirty)
+		{
+			return true;
+		}
+
+		std::error_code error;
+		const std::filesystem::path directory = std::filesystem::path(m_Path).parent_path();
+
+		if (!directory.empty())
+		{
+			std::filesystem::create_directories(directory, error);
+		}
+
+		const std::string temporaryPath = m_Path + ".tmp";
+
+		std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		FileHeader header;
+		header.Magic = CacheMagic;
+		header.Version = Version;
+		header.EntryCount = m_Entries.size();
+
+		bool success = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+		// Sorted by key, so the same entries always give the same file
+		std::vector<uint64_t> keys;
+		keys.reserve(m_Entries.size());
+
+		for (const auto& [key, data] : m_Entries)
+		{
+			keys.push_back(key);
+		}
+
+		std::sort(keys.begin(), keys.end());
+
+		for (uint64_t key : keys)
+		{
+			const std::vector<uint8_t>& data = m_Entries[key];
+
+			EntryHeader entry;
+			entry.Key = key;
+			entry.Size = data.size();
+			entry.Checksum = GetChecksum(entry, data);
+
+			success = success && std::fwrite(&entry, sizeof(entry), 1, file) == 1;
+			success = success && (data.empty() || std::fwrite(data.data(), data.size(), 1, file) == 1);
+		}
+
+		success = std::fclose(file) == 0 && success;
+
+		if (success)
+		{
+			std::filesystem::rename(temporaryPath, m_Path, error);
+			success = !error;
+		}
+
+		if (!success)
+		{
+			std::filesystem::remove(temporaryPath, error);
+		}
+
+		m_Dirty = !success;
+
+		return success;
+	}
+
+	const std::vector<uint8_t>* PipelineCache::Find(uint64_t key) const
+	{
+		auto entry = m_Entries.find(key);
+
+		return entry != m_Entries.end() ? &entry->second : nullptr;
+	}
+
+	void PipelineCache::Store(uint64_t key, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+		m_Entries.insert_or_assign(key, std::vector<uint8_t>(bytes, bytes + size));
+		m_Dirty = true;
+	}
+
+	void PipelineCache::Remove(uint64_t key)
+	{
+		if (m_Entries.erase(key) > 0)
+		{
+			m_Dirty = true;
+		}
+	}
+}
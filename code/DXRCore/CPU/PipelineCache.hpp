@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace cpu
+{
+	// Builds the key of a pipeline from everything that changes what gets created. Values are hashed in the order they
+	// are added, together with their size, so two different lists of values do not end up with the same key by just
+	// moving bytes from one value to the next.
+	class PipelineKey
+	{
+	public:
+		void Add(const void* data, size_t size);
+
+		void Add(std::wstring_view text)
+		{
+			Add(text.data(), text.size() * sizeof(wchar_t));
+		}
+
+		// Only for values without padding, as the padding bytes would be hashed as well
+		template<typename T>
+		void AddValue(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be hashed");
+			Add(&value, sizeof(value));
+		}
+
+		uint64_t Get() const
+		{
+			return m_Hash;
+		}
+
+	private:
+		uint64_t m_Hash = 0;
+	};
+
+	// Blobs of pipelines, such as serialized root signatures and compiled shaders, in one file on disk. Every blob is
+	// stored with a checksum, so a broken entry is dropped on load instead of being handed to the driver. The file is
+	// only rewritten when an entry was added.
+	class PipelineCache
+	{
+	public:
+		// Bumped whenever the layout of the file or of a blob changes
+		static constexpr uint32_t Version = 2;
+
+		explicit PipelineCache(std::string path);
+
+		// Adds the entries of the file to the stored ones, replacing those with the same key. Fails when there is no file
+		// or it is of another version, and drops the entries from the first broken one on.
+		bool Load();
+
+		// Writes all entries through a temporary file when one was added since the last load or save
+		bool Save();
+
+		// Returns nullptr when there is no entry for the key
+		const std::vector<uint8_t>* Find(uint64_t key) const;
+
+		void Store(uint64_t key, const void* data, size_t size);
+
+		void Remove(uint64_t key);
+
+		uint32_t GetEntryCount() const
+		{
+			return static_cast<uint32_t>(m_Entries.size());
+		}
+
+		bool IsDirty() const
+		{
+			return m_Dirty;
+		}
+
+		const std::string& GetPath() const
+		{
+			return m_Path;
+		}
+
+	private:
+		std::string m_Path;
+
+		std::unordered_map<uint64_t, std::vector<uint8_t>> m_Entries;
+		bool m_Dirty = false;
+	};
+}
@@ -0,0 +1,455 @@
+#include "PrimitiveKernels.hpp"
+#include "SIMD.hpp"
+
+#include <limits>
+
+namespace cpu
+{
+#if CPU_X64
+	namespace
+	{
+		// Eight lanes of a 3D vector
+		struct Vector8
+		{
+			__m256 x;
+			__m256 y;
+			__m256 z;
+		};
+
+		CPU_TARGET_AVX2 inline __m256 Dot8(const Vector8& a, const Vector8& b)
+		{
+			return _mm256_fmadd_ps(a.x, b.x, _mm256_fmadd_ps(a.y, b.y, _mm256_mul_ps(a.z, b.z)));
+		}
+
+		CPU_TARGET_AVX2 inline __m256 Abs8(__m256 v)
+		{
+			return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+		}
+
+		// Lanes of a where the mask is set, b elsewhere
+		CPU_TARGET_AVX2 inline __m256 Select8(__m256 mask, __m256 a, __m256 b)
+		{
+			return _mm256_blendv_ps(b, a, mask);
+		}
+
+		// sqrt(max(v, 0)), for lanes that are masked out afterwards anyway
+		CPU_TARGET_AVX2 inline __m256 SafeSqrt8(__m256 v)
+		{
+			return _mm256_sqrt_ps(_mm256_max_ps(v, _mm256_setzero_ps()));
+		}
+
+		// Cube root of v >= 0. A guess from dividing the exponent by 3, refined with three Newton steps.
+		CPU_TARGET_AVX2 inline __m256 Cbrt8(__m256 v)
+		{
+			const __m256i bits = _mm256_castps_si256(v);
+			const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+
+			__m256i guessBits = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(bits), third));
+			guessBits = _mm256_add_epi32(guessBits, _mm256_set1_epi32(709921077));
+
+			__m256 y = _mm256_castsi256_ps(guessBits);
+
+			for (int i = 0; i < 3; i++)
+			{
+				// y = (2y + v / y^2) / 3
+				y = _mm256_mul_ps(_mm256_fmadd_ps(_mm256_set1_ps(2.0f), y, _mm256_div_ps(v, _mm256_mul_ps(y, y))), third);
+			}
+
+			return Select8(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_setzero_ps(), y);
+		}
+
+		// acos for v in [-1, 1], Abramowitz and Stegun 4.4.46 (error below 2e-8)
+		CPU_TARGET_AVX2 inline __m256 Acos8(__m256 v)
+		{
+			const __m256 a = Abs8(v);
+
+			__m256 p = _mm256_set1_ps(-0.0012624911f);
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(0.0066700901f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(-0.0170881256f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(0.0308918810f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(-0.0501743046f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(0.0889789874f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(-0.2145988016f));
+			p = _mm256_fmadd_ps(p, a, _mm256_set1_ps(1.5707963050f));
+
+			const __m256 r = _mm256_mul_ps(SafeSqrt8(_mm256_sub_ps(_mm256_set1_ps(1.0f), a)), p);
+
+			return Select8(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_sub_ps(_mm256_set1_ps(cpu::PI), r), r);
+		}
+
+		// cos for v in [0, pi / 3], which is all the torus needs. Taylor series up to v^10.
+		CPU_TARGET_AVX2 inline __m256 CosSmall8(__m256 v)
+		{
+			const __m256 v2 = _mm256_mul_ps(v, v);
+
+			__m256 p = _mm256_set1_ps(-1.0f / 3628800.0f);
+			p = _mm256_fmadd_ps(p, v2, _mm256_set1_ps(1.0f / 40320.0f));
+			p = _mm256_fmadd_ps(p, v2, _mm256_set1_ps(-1.0f / 720.0f));
+			p = _mm256_fmadd_ps(p, v2, _mm256_set1_ps(1.0f / 24.0f));
+			p = _mm256_fmadd_ps(p, v2, _mm256_set1_ps(-0.5f));
+
+			return _mm256_fmadd_ps(p, v2, _mm256_set1_ps(1.0f));
+		}
+
+		// Keeps the closest candidate in [tMin, t) for the lanes in valid
+		CPU_TARGET_AVX2 inline void AddCandidate8(__m256 candidate, __m256 valid, __m256 tMin, __m256& t)
+		{
+			const __m256 closer = _mm256_and_ps(_mm256_cmp_ps(candidate, tMin, _CMP_GE_OQ), _mm256_cmp_ps(candidate, t, _CMP_LT_OQ));
+			t = Select8(_mm256_and_ps(valid, closer), candidate, t);
+		}
+
+		CPU_TARGET_AVX2 __m256 IntersectSphere8(const Vector8& ro, const Vector8& rd, const primitives::Primitive& primitive, __m256 tMin, __m256 tMax)
+		{
+			const __m256 radius = _mm256_set1_ps(primitive.Parameters.x);
+
+			const __m256 a = Dot8(rd, rd);
+			const __m256 h = _mm256_sub_ps(_mm256_setzero_ps(), Dot8(rd, ro));
+			const __m256 c = _mm256_fnmadd_ps(radius, radius, Dot8(ro, ro));
+			const __m256 discriminant = _mm256_fnmadd_ps(a, c, _mm256_mul_ps(h, h));
+
+			const __m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+			const __m256 s = SafeSqrt8(discriminant);
+
+			__m256 t = tMax;
+			AddCandidate8(_mm256_div_ps(_mm256_sub_ps(h, s), a), valid, tMin, t);
+			AddCandidate8(_mm256_div_ps(_mm256_add_ps(h, s), a), valid, tMin, t);
+
+			return t;
+		}
+
+		CPU_TARGET_AVX2 __m256 IntersectBox8(const Vector8& ro, const Vector8& rd, const primitives::Primitive& primitive, __m256 tMin, __m256 tMax)
+		{
+			const __m256 one = _mm256_set1_ps(1.0f);
+
+			const __m256* origin = &ro.x;
+			const __m256* direction = &rd.x;
+			const float* halfSize = &primitive.Parameters.x;
+
+			__m256 tNear = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+			__m256 tFar = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const __m256 invD = _mm256_div_ps(one, direction[axis]);
+				const __m256 h = _mm256_set1_ps(halfSize[axis]);
+
+				const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), h), origin[axis]), invD);
+				const __m256 t2 = _mm256_mul_ps(_mm256_sub_ps(h, origin[axis]), invD);
+
+				tNear = _mm256_max_ps(tNear, _mm256_min_ps(t1, t2));
+				tFar = _mm256_min_ps(tFar, _mm256_max_ps(t1, t2));
+			}
+
+			const __m256 valid = _mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ);
+
+			__m256 t = tMax;
+			AddCandidate8(tNear, valid, tMin, t);
+			AddCandidate8(tFar, valid, tMin, t);
+
+			return t;
+		}
+
+		// The side of a cylinder along z, for the hits with |z| <= halfHeight. Shared by cylinders and capsules.
+		CPU_TARGET_AVX2 void IntersectTube8(const Vector8& ro, const Vector8& rd, __m256 radius, __m256 halfHeight, __m256 tMin, __m256& t)
+		{
+			const __m256 a = _mm256_fmadd_ps(rd.x, rd.x, _mm256_mul_ps(rd.y, rd.y));
+			const __m256 b = _mm256_fmadd_ps(ro.x, rd.x, _mm256_mul_ps(ro.y, rd.y));
+			const __m256 c = _mm256_fnmadd_ps(radius, radius, _mm256_fmadd_ps(ro.x, ro.x, _mm256_mul_ps(ro.y, ro.y)));
+			const __m256 discriminant = _mm256_fnmadd_ps(a, c, _mm256_mul_ps(b, b));
+
+			const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ));
+			const __m256 s = SafeSqrt8(discriminant);
+			const __m256 minusB = _mm256_sub_ps(_mm256_setzero_ps(), b);
+
+			const __m256 t1 = _mm256_div_ps(_mm256_sub_ps(minusB, s), a);
+			const __m256 t2 = _mm256_div_ps(_mm256_add_ps(minusB, s), a);
+
+			const __m256 inside1 = _mm256_cmp_ps(Abs8(_mm256_fmadd_ps(rd.z, t1, ro.z)), halfHeight, _CMP_LE_OQ);
+			const __m256 inside2 = _mm256_cmp_ps(Abs8(_mm256_fmadd_ps(rd.z, t2, ro.z)), halfHeight, _CMP_LE_OQ);
+
+			AddCandidate8(t1, _mm256_and_ps(valid, inside1), tMin, t);
+			AddCandidate8(t2, _mm256_and_ps(valid, inside2), tMin, t);
+		}
+
+		CPU_TARGET_AVX2 __m256 IntersectCylinder8(const Vector8& ro, const Vector8& rd, const primitives::Primitive& primitive, __m256 tMin, __m256 tMax)
+		{
+			const __m256 radius = _mm256_set1_ps(primitive.Parameters.x);
+			const __m256 halfHeight = _mm256_set1_ps(primitive.Parameters.y);
+
+			__m256 t = tMax;
+			IntersectTube8(ro, rd, radius, halfHeight, tMin, t);
+
+			// Caps. A direction parallel to the caps gives infinite t values, which fail the radius test.
+			const __m256 radius2 = _mm256_mul_ps(radius, radius);
+			const __m256 nonZero = _mm256_cmp_ps(rd.z, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+
+			for (float side : { 1.0f, -1.0f })
+			{
+				const __m256 capT = _mm256_div_ps(_mm256_fmsub_ps(_mm256_set1_ps(side), halfHeight, ro.z), rd.z);
+
+				const __m256 x = _mm256_fmadd_ps(rd.x, capT, ro.x);
+				const __m256 y = _mm256_fmadd_ps(rd.y, capT, ro.y);
+				const __m256 inside = _mm256_cmp_ps(_mm256_fmadd_ps(x, x, _mm256_mul_ps(y, y)), radius2, _CMP_LE_OQ);
+
+				AddCandidate8(capT, _mm256_and_ps(nonZero, inside), tMin, t);
+			}
+
+			return t;
+		}
+
+		CPU_TARGET_AVX2 __m256 IntersectCapsule8(const Vector8& ro, const Vector8& rd, const primitives::Primitive& primitive, __m256 tMin, __m256 tMax)
+		{
+			const __m256 radius = _mm256_set1_ps(primitive.Parameters.x);
+			const __m256 halfLength = _mm256_set1_ps(primitive.Parameters.y);
+
+			__m256 t = tMax;
+			IntersectTube8(ro, rd, radius, halfLength, tMin, t);
+
+			const __m256 a = Dot8(rd, rd);
+
+			for (float side : { 1.0f, -1.0f })
+			{
+				const __m256 sideV = _mm256_set1_ps(side);
+				const Vector8 oc = { ro.x, ro.y, _mm256_fnmadd_ps(sideV, halfLength, ro.z) };
+
+				const __m256 h = Dot8(rd, oc);
+				const __m256 c = _mm256_fnmadd_ps(radius, radius, Dot8(oc, oc));
+				const __m256 discriminant = _mm256_fnmadd_ps(a, c, _mm256_mul_ps(h, h));
+
+				const __m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+				const __m256 s = SafeSqrt8(discriminant);
+				const __m256 minusH = _mm256_sub_ps(_mm256_setzero_ps(), h);
+
+				const __m256 t1 = _mm256_div_ps(_mm256_sub_ps(minusH, s), a);
+				const __m256 t2 = _mm256_div_ps(_mm256_add_ps(minusH, s), a);
+
+				// Only the outer half of each sphere belongs to the capsule
+				const __m256 outer1 = _mm256_cmp_ps(_mm256_mul_ps(_mm256_fmadd_ps(rd.z, t1, oc.z), sideV), _mm256_setzero_ps(), _CMP_GE_OQ);
+				const __m256 outer2 = _mm256_cmp_ps(_mm256_mul_ps(_mm256_fmadd_ps(rd.z, t2, oc.z), sideV), _mm256_setzero_ps(), _CMP_GE_OQ);
+
+				AddCandidate8(t1, _mm256_and_ps(valid, outer1), tMin, t);
+				AddCandidate8(t2, _mm256_and_ps(valid, outer2), tMin, t);
+			}
+
+			return t;
+		}
+
+		// primitives::RefineTorusRoot
+		CPU_TARGET_AVX2 __m256 RefineTorusRoot8(const Vector8& ro, const Vector8& rd, __m256 Ra2, __m256 ra2, __m256 t)
+		{
+			const __m256 maxStep = _mm256_sqrt_ps(ra2);
+
+			for (int i = 0; i < 4; i++)
+			{
+				const Vector8 p = { _mm256_fmadd_ps(rd.x, t, ro.x), _mm256_fmadd_ps(rd.y, t, ro.y), _mm256_fmadd_ps(rd.z, t, ro.z) };
+				const __m256 g = _mm256_add_ps(_mm256_sub_ps(Dot8(p, p), ra2), Ra2);
+
+				const __m256 fourRa2 = _mm256_mul_ps(_mm256_set1_ps(4.0f), Ra2);
+				const __m256 f = _mm256_fnmadd_ps(fourRa2, _mm256_fmadd_ps(p.x, p.x, _mm256_mul_ps(p.y, p.y)), _mm256_mul_ps(g, g));
+				const __m256 df = _mm256_fmsub_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f), g), Dot8(p, rd),
+					_mm256_mul_ps(_mm256_add_ps(fourRa2, fourRa2), _mm256_fmadd_ps(p.x, rd.x, _mm256_mul_ps(p.y, rd.y))));
+
+				const __m256 step = _mm256_div_ps(f, df);
+				t = Select8(_mm256_cmp_ps(Abs8(step), maxStep, _CMP_LT_OQ), _mm256_sub_ps(t, step), t);
+			}
+
+			return t;
+		}
+
+		// primitives::IntersectTorus with every branch turned into a select
+		CPU_TARGET_AVX2 __m256 IntersectTorus8(const Vector8& ro, Vector8 rd, const primitives::Primitive& primitive, __m256 tMin, __m256 tMax)
+		{
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 two = _mm256_set1_ps(2.0f);
+			const __m256 three = _mm256_set1_ps(3.0f);
+
+			const __m256 scale = _mm256_sqrt_ps(Dot8(rd, rd));
+			const __m256 invScale = _mm256_div_ps(one, scale);
+			rd = { _mm256_mul_ps(rd.x, invScale), _mm256_mul_ps(rd.y, invScale), _mm256_mul_ps(rd.z, invScale) };
+
+			const __m256 tMinScaled = _mm256_mul_ps(tMin, scale);
+			const __m256 tMaxScaled = _mm256_mul_ps(tMax, scale);
+
+			const float ringRadius = primitive.Parameters.x;
+			const float tubeRadius = primitive.Parameters.y;
+			const __m256 Ra2 = _mm256_set1_ps(ringRadius * ringRadius);
+			const __m256 ra2 = _mm256_set1_ps(tubeRadius * tubeRadius);
+			const __m256 outer2 = _mm256_set1_ps((ringRadius + tubeRadius) * (ringRadius + tubeRadius));
+
+			const __m256 m = Dot8(ro, ro);
+			const __m256 n = Dot8(ro, rd);
+
+			// Bounding sphere
+			__m256 valid = _mm256_cmp_ps(_mm256_add_ps(_mm256_fmsub_ps(n, n, m), outer2), zero, _CMP_GE_OQ);
+
+			const __m256 k = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(m, ra2), Ra2), _mm256_set1_ps(0.5f));
+			__m256 k3 = n;
+			__m256 k2 = _mm256_add_ps(_mm256_fmadd_ps(n, n, _mm256_mul_ps(Ra2, _mm256_mul_ps(rd.z, rd.z))), k);
+			__m256 k1 = _mm256_fmadd_ps(k, n, _mm256_mul_ps(Ra2, _mm256_mul_ps(ro.z, rd.z)));
+			__m256 k0 = _mm256_fnmadd_ps(Ra2, ra2, _mm256_fmadd_ps(k, k, _mm256_mul_ps(Ra2, _mm256_mul_ps(ro.z, ro.z))));
+
+			// Solve for 1 / t in the lanes where c1 is close to zero
+			const __m256 c1Test = _mm256_fmadd_ps(k3, _mm256_fmsub_ps(k3, k3, k2), k1);
+			const __m256 flip = _mm256_cmp_ps(Abs8(c1Test), _mm256_set1_ps(0.01f), _CMP_LT_OQ);
+
+			{
+				const __m256 invK0 = _mm256_div_ps(one, k0);
+				const __m256 flippedK1 = _mm256_mul_ps(k3, invK0);
+				const __m256 flippedK2 = _mm256_mul_ps(k2, invK0);
+				const __m256 flippedK3 = _mm256_mul_ps(k1, invK0);
+
+				k0 = Select8(flip, invK0, k0);
+				k1 = Select8(flip, flippedK1, k1);
+				k2 = Select8(flip, flippedK2, k2);
+				k3 = Select8(flip, flippedK3, k3);
+			}
+
+			const __m256 k3k3 = _mm256_mul_ps(k3, k3);
+
+			__m256 c2 = _mm256_fnmadd_ps(three, k3k3, _mm256_mul_ps(two, k2));
+			__m256 c1 = _mm256_fmadd_ps(k3, _mm256_sub_ps(k3k3, k2), k1);
+			__m256 c0 = _mm256_fmadd_ps(k3, _mm256_fmsub_ps(k3, _mm256_fmadd_ps(_mm256_set1_ps(-3.0f), k3k3, _mm256_mul_ps(_mm256_set1_ps(4.0f), k2)), _mm256_mul_ps(_mm256_set1_ps(8.0f), k1)), _mm256_mul_ps(_mm256_set1_ps(4.0f), k0));
+
+			c2 = _mm256_div_ps(c2, three);
+			c1 = _mm256_mul_ps(c1, two);
+			c0 = _mm256_div_ps(c0, three);
+
+			const __m256 Q = _mm256_fmadd_ps(c2, c2, c0);
+			const __m256 R = _mm256_sub_ps(_mm256_fmsub_ps(_mm256_mul_ps(three, c0), c2, _mm256_mul_ps(c2, _mm256_mul_ps(c2, c2))), _mm256_mul_ps(c1, c1));
+
+			const __m256 h = _mm256_fmsub_ps(R, R, _mm256_mul_ps(Q, _mm256_mul_ps(Q, Q)));
+			const __m256 fourRoots = _mm256_cmp_ps(h, zero, _CMP_LT_OQ);
+
+			// Four real roots
+			const __m256 sQ = SafeSqrt8(Q);
+			const __m256 cosine = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(R, _mm256_mul_ps(sQ, Q)), _mm256_set1_ps(-1.0f)), one);
+			const __m256 zFour = _mm256_mul_ps(_mm256_mul_ps(two, sQ), CosSmall8(_mm256_div_ps(Acos8(cosine), three)));
+
+			// Two real roots
+			const __m256 cubeRoot = Cbrt8(_mm256_add_ps(SafeSqrt8(h), Abs8(R)));
+			const __m256 signR = _mm256_or_ps(_mm256_and_ps(R, _mm256_set1_ps(-0.0f)), one);
+			const __m256 zTwo = _mm256_mul_ps(signR, Abs8(_mm256_add_ps(cubeRoot, _mm256_div_ps(Q, cubeRoot))));
+
+			const __m256 z = _mm256_sub_ps(c2, Select8(fourRoots, zFour, zTwo));
+
+			__m256 d1 = _mm256_fnmadd_ps(three, c2, z);
+			__m256 d2 = _mm256_fnmadd_ps(three, c0, _mm256_mul_ps(z, z));
+
+			const __m256 small = _mm256_cmp_ps(Abs8(d1), _mm256_set1_ps(1.0e-4f), _CMP_LT_OQ);
+
+			valid = _mm256_and_ps(valid, Select8(small, _mm256_cmp_ps(d2, zero, _CMP_GE_OQ), _mm256_cmp_ps(d1, zero, _CMP_GE_OQ)));
+
+			{
+				const __m256 largeD1 = SafeSqrt8(_mm256_mul_ps(d1, _mm256_set1_ps(0.5f)));
+				const __m256 largeD2 = _mm256_div_ps(c1, largeD1);
+
+				d2 = Select8(small, SafeSqrt8(d2), largeD2);
+				d1 = Select8(small, d1, largeD1);
+			}
+
+			__m256 t = tMaxScaled;
+
+			const __m256 d1d1 = _mm256_mul_ps(d1, d1);
+			const __m256 minusK3 = _mm256_sub_ps(zero, k3);
+
+			for (int pair = 0; pair < 2; pair++)
+			{
+				// -d1 -+ sqrt(d1^2 - z + d2) for the first pair, d1 -+ sqrt(d1^2 - z - d2) for the second
+				const __m256 signedD1 = pair == 0 ? _mm256_sub_ps(zero, d1) : d1;
+				const __m256 h2 = pair == 0 ? _mm256_add_ps(_mm256_sub_ps(d1d1, z), d2) : _mm256_sub_ps(_mm256_sub_ps(d1d1, z), d2);
+
+				const __m256 pairValid = _mm256_and_ps(valid, _mm256_cmp_ps(h2, zero, _CMP_GT_OQ));
+				const __m256 s = SafeSqrt8(h2);
+
+				__m256 t1 = _mm256_add_ps(_mm256_sub_ps(signedD1, s), minusK3);
+				__m256 t2 = _mm256_add_ps(_mm256_add_ps(signedD1, s), minusK3);
+
+				t1 = Select8(flip, _mm256_div_ps(two, t1), t1);
+				t2 = Select8(flip, _mm256_div_ps(two, t2), t2);
+
+				AddCandidate8(t1, pairValid, tMinScaled, t);
+				AddCandidate8(t2, pairValid, tMinScaled, t);
+			}
+
+			// Lanes without a hit keep tMax, as do the lanes whose root was refined out of the range
+			__m256 hit = _mm256_cmp_ps(t, tMaxScaled, _CMP_LT_OQ);
+			t = RefineTorusRoot8(ro, rd, Ra2, ra2, t);
+			hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(t, tMinScaled, _CMP_GE_OQ), _mm256_cmp_ps(t, tMaxScaled, _CMP_LT_OQ)));
+
+			return Select8(hit, _mm256_mul_ps(t, invScale), tMax);
+		}
+
+		CPU_TARGET_AVX2 uint32_t IntersectPrimitiveAVX2(const primitives::Primitive& primitive, const RayPacket8& rays, uint32_t activeMask, float t[8])
+		{
+			const Vector8 ro = {
+				_mm256_sub_ps(_mm256_load_ps(rays.OriginX), _mm256_set1_ps(primitive.Position.x)),
+				_mm256_sub_ps(_mm256_load_ps(rays.OriginY), _mm256_set1_ps(primitive.Position.y)),
+				_mm256_sub_ps(_mm256_load_ps(rays.OriginZ), _mm256_set1_ps(primitive.Position.z))
+			};
+
+			const Vector8 rd = { _mm256_load_ps(rays.DirectionX), _mm256_load_ps(rays.DirectionY), _mm256_load_ps(rays.DirectionZ) };
+
+			const __m256 tMin = _mm256_load_ps(rays.TMin);
+			const __m256 tMax = _mm256_load_ps(rays.TMax);
+
+			__m256 result;
+
+			switch (primitive.Type)
+			{
+			case primitives::PRIMITIVE_SPHERE:
+				result = IntersectSphere8(ro, rd, primitive, tMin, tMax);
+				break;
+			case primitives::PRIMITIVE_TORUS:
+				result = IntersectTorus8(ro, rd, primitive, tMin, tMax);
+				break;
+			case primitives::PRIMITIVE_BOX:
+				result = IntersectBox8(ro, rd, primitive, tMin, tMax);
+				break;
+			case primitives::PRIMITIVE_CYLINDER:
+				result = IntersectCylinder8(ro, rd, primitive, tMin, tMax);
+				break;
+			case primitives::PRIMITIVE_CAPSULE:
+				result = IntersectCapsule8(ro, rd, primitive, tMin, tMax);
+				break;
+			default:
+				return 0;
+			}
+
+			_mm256_storeu_ps(t, result);
+
+			return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(result, tMax, _CMP_LT_OQ))) & activeMask;
+		}
+	}
+#endif
+
+	uint32_t IntersectPrimitive8(const primitives::Primitive& primitive, const RayPacket8& rays, uint32_t activeMask, float t[8])
+	{
+#if CPU_X64
+		if (GetSIMDLevel() == SIMDLevel::AVX2)
+		{
+			return IntersectPrimitiveAVX2(primitive, rays, activeMask, t);
+		}
+#endif
+
+		uint32_t hitMask = 0;
+
+		for (uint32_t lane = 0; lane < 8; lane++)
+		{
+			if ((activeMask & (1u << lane)) == 0)
+			{
+				continue;
+			}
+
+			const Float3 origin(rays.OriginX[lane], rays.OriginY[lane], rays.OriginZ[lane]);
+			const Float3 direction(rays.DirectionX[lane], rays.DirectionY[lane], rays.DirectionZ[lane]);
+
+			if (primitives::IntersectPrimitive(primitive, origin, direction, rays.TMin[lane], rays.TMax[lane], t[lane]))
+			{
+				hitMask |= 1u << lane;
+			}
+		}
+
+		return hitMask;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../Shaders/Primitives.hpp"
+
+namespace cpu
+{
+	// Eight rays in structure of arrays layout, one ray per lane
+	struct alignas(32) RayPacket8
+	{
+		float OriginX[8];
+		float OriginY[8];
+		float OriginZ[8];
+
+		float DirectionX[8];
+		float DirectionY[8];
+		float DirectionZ[8];
+
+		float TMin[8];
+		float TMax[8];
+	};
+
+	// Tests the eight rays of a packet against one primitive. Only the lanes in activeMask are tested. Returns the mask
+	// of the lanes that hit and writes their closest t. The normal is left to primitives::GetPrimitiveNormal, which
+	// only the closest hit needs.
+	//
+	// Runs all lanes at once with AVX2. Without AVX2 every lane goes through the scalar kernel of the shared header.
+	uint32_t IntersectPrimitive8(const primitives::Primitive& primitive, const RayPacket8& rays, uint32_t activeMask, float t[8]);
+}
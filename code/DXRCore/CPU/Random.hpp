@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cpu
+{
+	// Small PCG random number generator. Cheap to create per pixel or per ray, which keeps parallel loops deterministic.
+	class Random
+	{
+	public:
+		explicit Random(uint64_t seed, uint64_t sequence = 0)
+			: m_Increment((sequence << 1u) | 1u)
+		{
+			Next();
+			m_State += seed;
+			Next();
+		}
+
+		uint32_t Next()
+		{
+			const uint64_t state = m_State;
+			m_State = state * 6364136223846793005ull + m_Increment;
+
+			const uint32_t xorShifted = static_cast<uint32_t>(((state >> 18u) ^ state) >> 27u);
+			const uint32_t rotation = static_cast<uint32_t>(state >> 59u);
+
+			return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+		}
+
+		// Uniform float in [0, 1)
+		float NextFloat()
+		{
+			return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+		}
+
+	private:
+		uint64_t m_State = 0;
+		uint64_t m_Increment;
+	};
+}
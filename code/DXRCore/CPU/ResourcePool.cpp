@@ -0,0 +1,143 @@
+#include "ResourcePool.hpp"
+
+#include <cstddef>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint64_t SizeMask = (1ull << 48) - 1;
+	}
+
+	uint64_t ResourcePool::GetSizeClass(uint64_t size)
+	{
+		if (size <= MinSize)
+		{
+			return MinSize;
+		}
+
+		uint32_t log2 = 0;
+
+		while ((size >> (log2 + 1)) != 0)
+		{
+			log2++;
+		}
+
+		const uint64_t step = 1ull << (log2 - 2);
+
+		return (size + step - 1) & ~(step - 1);
+	}
+
+	uint32_t ResourcePool::Acquire(uint32_t kind, uint64_t size, uint64_t completedFence)
+	{
+		const uint64_t key = GetKey(kind, size);
+		auto it = m_Free.find(key);
+
+		if (it == m_Free.end() || it->second.empty() || it->second.front().Fence > completedFence)
+		{
+			return InvalidSlot;
+		}
+
+		const uint32_t slot = it->second.front().Slot;
+		it->second.pop_front();
+
+		RemoveSlot(key, slot);
+
+		return slot;
+	}
+
+	uint32_t ResourcePool::Release(uint32_t kind, uint64_t size, uint64_t fence)
+	{
+		const uint64_t key = GetKey(kind, size);
+		const uint32_t slot = AddSlot(key);
+
+		m_Free[key].push_back({ slot, fence });
+
+		return slot;
+	}
+
+	uint32_t ResourcePool::ReleaseAfterSubmit(uint32_t kind, uint64_t size, uint64_t owner)
+	{
+		const uint64_t key = GetKey(kind, size);
+		const uint32_t slot = AddSlot(key);
+
+		m_Pending.push_back({ key, slot, owner });
+
+		return slot;
+	}
+
+	void ResourcePool::Submit(uint64_t owner, uint64_t fence)
+	{
+		size_t kept = 0;
+
+		for (const PendingEntry& entry : m_Pending)
+		{
+			if (entry.Owner == owner)
+			{
+				m_Free[entry.Key].push_back({ entry.Slot, fence });
+			}
+			else
+			{
+				m_Pending[kept++] = entry;
+			}
+		}
+
+		m_Pending.resize(kept);
+	}
+
+	void ResourcePool::Trim(uint64_t completedFence, uint64_t maxFreeSize, std::vector<uint32_t>& evicted)
+	{
+		while (m_FreeSize > maxFreeSize)
+		{
+			// The oldest resource is at the front of one of the lists
+			std::deque<Entry>* oldest = nullptr;
+			uint64_t oldestKey = 0;
+
+			for (auto& [key, entries] : m_Free)
+			{
+				if (!entries.empty() && entries.front().Fence <= completedFence && (oldest == nullptr || entries.front().Fence < oldest->front().Fence))
+				{
+					oldest = &entries;
+					oldestKey = key;
+				}
+			}
+
+			if (oldest == nullptr)
+			{
+				break;
+			}
+
+			const uint32_t slot = oldest->front().Slot;
+			oldest->pop_front();
+
+			RemoveSlot(oldestKey, slot);
+			evicted.push_back(slot);
+		}
+	}
+
+	uint64_t ResourcePool::GetKey(uint32_t kind, uint64_t size)
+	{
+		return (static_cast<uint64_t>(kind) << 48) | GetSizeClass(size);
+	}
+
+	uint32_t ResourcePool::AddSlot(uint64_t key)
+	{
+		m_FreeSize += key & SizeMask;
+
+		if (!m_UnusedSlots.empty())
+		{
+			const uint32_t slot = m_UnusedSlots.back();
+			m_UnusedSlots.pop_back();
+
+			return slot;
+		}
+
+		return m_SlotCount++;
+	}
+
+	void ResourcePool::RemoveSlot(uint64_t key, uint32_t slot)
+	{
+		m_FreeSize -= key & SizeMask;
+		m_UnusedSlots.push_back(slot);
+	}
+}
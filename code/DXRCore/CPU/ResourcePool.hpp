@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace cpu
+{
+	// Bookkeeping of GPU resources that get reused instead of created for every build, like the scratch buffers of
+	// acceleration structures. Resources are grouped by a kind that the caller picks and by a size class, in which the
+	// size is rounded up to a quarter of its power of two, so at most a fifth of a resource goes unused. A released
+	// resource is only handed out again once the fence of the work that used it has completed. The pool only deals in
+	// slots, the caller keeps the resources in an array indexed by them.
+	class ResourcePool
+	{
+	public:
+		static constexpr uint32_t InvalidSlot = ~0u;
+		static constexpr uint64_t MinSize = 64 * 1024;
+
+		// Size that resources for size bytes are created with
+		static uint64_t GetSizeClass(uint64_t size);
+
+		// Takes a released resource of the kind and the size class of size out of the pool, of which the fence has
+		// completed. InvalidSlot when there is none, in which case the caller creates one of GetSizeClass(size) bytes.
+		uint32_t Acquire(uint32_t kind, uint64_t size, uint64_t completedFence);
+
+		// Adds a resource of size bytes that can be reused once the fence completes, and returns the slot to store it
+		// in. Fences must not decrease from call to call.
+		uint32_t Release(uint32_t kind, uint64_t size, uint64_t fence);
+
+		// Adds a resource that recorded work uses which was not submitted yet. It waits for the fence that Submit gives
+		// to the owner, such as the command list that the work was recorded into.
+		uint32_t ReleaseAfterSubmit(uint32_t kind, uint64_t size, uint64_t owner);
+		void Submit(uint64_t owner, uint64_t fence);
+
+		// Takes released resources of which the fence has completed out of the pool, oldest first, until at most
+		// maxFreeSize bytes are left. Their slots are appended to evicted, for the caller to destroy the resources.
+		void Trim(uint64_t completedFence, uint64_t maxFreeSize, std::vector<uint32_t>& evicted);
+
+		// Bytes of the released resources, including the ones that wait for a submit
+		uint64_t GetFreeSize() const
+		{
+			return m_FreeSize;
+		}
+
+		uint32_t GetFreeCount() const
+		{
+			return m_SlotCount - static_cast<uint32_t>(m_UnusedSlots.size());
+		}
+
+	private:
+		struct Entry
+		{
+			uint32_t Slot;
+			uint64_t Fence;
+		};
+
+		struct PendingEntry
+		{
+			uint64_t Key;
+			uint32_t Slot;
+			uint64_t Owner;
+		};
+
+		// Kind in the top 16 bits, size class in the rest
+		static uint64_t GetKey(uint32_t kind, uint64_t size);
+
+		uint32_t AddSlot(uint64_t key);
+		void RemoveSlot(uint64_t key, uint32_t slot);
+
+		// Released resources per key, in the order of their fences
+		std::unordered_map<uint64_t, std::deque<Entry>> m_Free;
+		std::vector<PendingEntry> m_Pending;
+
+		std::vector<uint32_t> m_UnusedSlots;
+		uint32_t m_SlotCount = 0;
+		uint64_t m_FreeSize = 0;
+	};
+}
@@ -0,0 +1,66 @@
+#include "RingAllocator.hpp"
+
+namespace cpu
+{
+	RingAllocator::RingAllocator(uint64_t capacity)
+	{
+		Reset(capacity);
+	}
+
+	void RingAllocator::Reset(uint64_t capacity)
+	{
+		m_Batches.clear();
+		m_Capacity = capacity;
+		m_Head = 0;
+		m_Tail = 0;
+		m_OpenBatchStart = 0;
+	}
+
+	uint64_t RingAllocator::Allocate(uint64_t size, uint64_t alignment)
+	{
+		if (size == 0 || size > m_Capacity)
+		{
+			return InvalidOffset;
+		}
+
+		const uint64_t offset = m_Head % m_Capacity;
+		uint64_t start = (offset + alignment - 1) & ~(alignment - 1);
+
+		// Skip the end of the ring when the allocation does not fit before it, the capacity is offset 0 of the next lap
+		if (start + size > m_Capacity)
+		{
+			start = m_Capacity;
+		}
+
+		const uint64_t begin = m_Head + (start - offset);
+		const uint64_t end = begin + size;
+
+		if (end - m_Tail > m_Capacity)
+		{
+			return InvalidOffset;
+		}
+
+		m_Head = end;
+
+		return begin % m_Capacity;
+	}
+
+	void RingAllocator::CloseBatch(uint64_t fence)
+	{
+		if (HasOpenAllocations())
+		{
+			m_Batches.push_back({ fence, m_Head });
+		}
+
+		m_OpenBatchStart = m_Head;
+	}
+
+	void RingAllocator::Release(uint64_t completedFence)
+	{
+		while (!m_Batches.empty() && m_Batches.front().Fence <= completedFence)
+		{
+			m_Tail = m_Batches.front().End;
+			m_Batches.pop_front();
+		}
+	}
+}
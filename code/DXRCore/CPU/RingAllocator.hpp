@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+namespace cpu
+{
+	// Suballocates a fixed size ring, such as a staging buffer that the GPU copies from. Allocations belong to the open
+	// batch until CloseBatch tags them with a fence value, and their memory is reused once Release is called with a
+	// completed value of at least that fence. An allocation never wraps around: when it does not fit before the end of
+	// the ring it starts at offset 0, and the end is skipped.
+	class RingAllocator
+	{
+	public:
+		static constexpr uint64_t InvalidOffset = ~0ull;
+
+		RingAllocator() = default;
+		explicit RingAllocator(uint64_t capacity);
+
+		// Forgets every allocation
+		void Reset(uint64_t capacity);
+
+		// Offset of size bytes aligned to alignment, which must be a power of two. InvalidOffset when the ring has no
+		// room until older batches are released, or when the size is larger than the ring.
+		uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+
+		// Closes the open batch. Its allocations are released by the first Release with a completed fence of at least
+		// the fence. Fences must increase from batch to batch.
+		void CloseBatch(uint64_t fence);
+
+		// Frees the closed batches of which the fence has completed
+		void Release(uint64_t completedFence);
+
+		// Fence of the oldest closed batch that was not released, or 0 when there is none
+		uint64_t GetOldestFence() const
+		{
+			return m_Batches.empty() ? 0 : m_Batches.front().Fence;
+		}
+
+		bool HasOpenAllocations() const
+		{
+			return m_Head != m_OpenBatchStart;
+		}
+
+		uint64_t GetCapacity() const
+		{
+			return m_Capacity;
+		}
+
+		// Bytes in use, including the skipped ends of the ring
+		uint64_t GetUsedSize() const
+		{
+			return m_Head - m_Tail;
+		}
+
+	private:
+		struct Batch
+		{
+			uint64_t Fence;
+			uint64_t End;
+		};
+
+		std::deque<Batch> m_Batches;
+
+		uint64_t m_Capacity = 0;
+
+		// Positions that only grow, the offset in the ring is the position modulo the capacity
+		uint64_t m_Head = 0;
+		uint64_t m_Tail = 0;
+		uint64_t m_OpenBatchStart = 0;
+	};
+}
@@ -0,0 +1,62 @@
+#include "SIMD.hpp"
+
+#include <algorithm>
+
+namespace cpu
+{
+	namespace
+	{
+#if CPU_X64
+		bool DetectAVX2()
+		{
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+
+			if (info[0] < 7)
+			{
+				return false;
+			}
+
+			// FMA, and the OS saving the AVX registers on context switches
+			__cpuid(info, 1);
+
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+			if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6)
+			{
+				return false;
+			}
+
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+		}
+#endif
+
+		SIMDLevel g_SIMDLevel = GetSupportedSIMDLevel();
+	}
+
+	SIMDLevel GetSupportedSIMDLevel()
+	{
+#if CPU_X64
+		static const SIMDLevel level = DetectAVX2() ? SIMDLevel::AVX2 : SIMDLevel::SSE4;
+		return level;
+#else
+		return SIMDLevel::Scalar;
+#endif
+	}
+
+	SIMDLevel GetSIMDLevel()
+	{
+		return g_SIMDLevel;
+	}
+
+	void SetSIMDLevel(SIMDLevel level)
+	{
+		g_SIMDLevel = std::min(level, GetSupportedSIMDLevel());
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+
+// The SSE4 and AVX2 code paths are only built for x64, everywhere else the CPU backend runs the scalar ones
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_X64 1
+#include <immintrin.h>
+#else
+#define CPU_X64 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Functions that use instructions above the baseline of the build are tagged with these. MSVC allows any intrinsic in
+// any function, GCC and Clang need to be told per function.
+#if CPU_X64
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CPU_TARGET_SSE4
+#define CPU_TARGET_AVX2
+#else
+#define CPU_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace cpu
+{
+	// Instruction sets the SIMD code paths are written for. SSE4 is the minimum the CPU backend runs on with x64, other
+	// architectures only have the scalar paths.
+	enum class SIMDLevel : uint8_t
+	{
+		Scalar,
+		SSE4,
+		AVX2
+	};
+
+	// The best level this machine supports, detected once with cpuid
+	SIMDLevel GetSupportedSIMDLevel();
+
+	// The level the SIMD code paths currently use. Defaults to the supported level, and can be lowered to compare paths.
+	SIMDLevel GetSIMDLevel();
+	void SetSIMDLevel(SIMDLevel level);
+
+	// Index of the lowest set bit. The mask must not be 0.
+	inline uint32_t FirstBit(uint32_t mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	inline uint32_t FirstBit(uint64_t mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+	}
+
+	// Index of the highest set bit. The mask must not be 0.
+	inline uint32_t LastBit(uint64_t mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, mask);
+		return static_cast<uint32_t>(index);
+#else
+		return 63 - static_cast<uint32_t>(__builtin_clzll(mask));
+#endif
+	}
+
+	// Four floats in an SSE register, which x64 always has, for code that does not need a path per level. Scalar
+	// everywhere else.
+#if CPU_X64
+	using Vector4 = __m128;
+
+	inline Vector4 Zero4() { return _mm_setzero_ps(); }
+	inline Vector4 Splat4(float v) { return _mm_set1_ps(v); }
+	inline Vector4 Set4(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+	inline Vector4 Load4(const float* v) { return _mm_loadu_ps(v); }
+	inline void Store4(float* v, Vector4 a) { _mm_storeu_ps(v, a); }
+
+	inline Vector4 Add4(Vector4 a, Vector4 b) { return _mm_add_ps(a, b); }
+	inline Vector4 Sub4(Vector4 a, Vector4 b) { return _mm_sub_ps(a, b); }
+	inline Vector4 Mul4(Vector4 a, Vector4 b) { return _mm_mul_ps(a, b); }
+	inline Vector4 Min4(Vector4 a, Vector4 b) { return _mm_min_ps(a, b); }
+	inline Vector4 Max4(Vector4 a, Vector4 b) { return _mm_max_ps(a, b); }
+
+	inline float HorizontalSum4(Vector4 a)
+	{
+		const __m128 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+		return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+	}
+#else
+	struct Vector4
+	{
+		float v[4];
+	};
+
+	inline Vector4 Zero4() { return { { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+	inline Vector4 Splat4(float v) { return { { v, v, v, v } }; }
+	inline Vector4 Set4(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+	inline Vector4 Load4(const float* v) { return { { v[0], v[1], v[2], v[3] } }; }
+	inline void Store4(float* v, Vector4 a) { v[0] = a.v[0]; v[1] = a.v[1]; v[2] = a.v[2]; v[3] = a.v[3]; }
+
+	inline Vector4 Add4(Vector4 a, Vector4 b) { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+	inline Vector4 Sub4(Vector4 a, Vector4 b) { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+	inline Vector4 Mul4(Vector4 a, Vector4 b) { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+
+	// Same operand order as minps and maxps, which return the second operand when either is NaN
+	inline Vector4 Min4(Vector4 a, Vector4 b)
+	{
+		return { { a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1], a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3] } };
+	}
+
+	inline Vector4 Max4(Vector4 a, Vector4 b)
+	{
+		return { { a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1], a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3] } };
+	}
+
+	// Same order of additions as the SSE version
+	inline float HorizontalSum4(Vector4 a)
+	{
+		return (a.v[0] + a.v[2]) + (a.v[1] + a.v[3]);
+	}
+#endif
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "TopLevelAS.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	// CPU counterpart of hlsl::Mesh. Indexed with the instance index, like the hit group records of the instances.
+	struct MeshData
+	{
+		Float4 Color;
+		float Reflectance;
+
+		const TriangleMesh* Mesh;
+	};
+
+	// Everything the CPU backend needs to shade a frame: the acceleration structure and the per instance data
+	struct Scene
+	{
+		TopLevelAS TLAS;
+		std::vector<MeshData> Meshes;
+
+		// Incremented whenever an instance or its geometry changes, so accumulated frames of the old scene get thrown away
+		uint64_t Version = 0;
+	};
+}
@@ -0,0 +1,602 @@
+#include "ShaderCompiler.hpp"
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+// The compiler is only declared when its header is there. On Linux dxcapi.h includes the WinAdapter.h of the DXC
+// release, which provides the Windows types it uses. DXR_NO_DXC leaves it out, DXR_DXC_LIBRARY is where CMake found
+// the library.
+#if defined(DXR_NO_DXC)
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#include <dxcapi.h>
+#define DXC_AVAILABLE 1
+#elif defined(__has_include)
+#if __has_include(<WinAdapter.h>) && __has_include(<dxcapi.h>)
+#include <dxcapi.h>
+#include <dlfcn.h>
+#define DXC_AVAILABLE 1
+#endif
+#endif
+
+#ifndef DXC_AVAILABLE
+#define DXC_AVAILABLE 0
+#endif
+
+#ifndef DXR_DXC_LIBRARY
+#define DXR_DXC_LIBRARY ""
+#endif
+
+namespace cpu
+{
+	namespace
+	{
+		bool ReadFile(const std::filesystem::path& path, std::string& text)
+		{
+			std::ifstream file(path, std::ios::binary);
+
+			if (!file)
+			{
+				return false;
+			}
+
+			text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			return true;
+		}
+
+		// Returns the name between the quotes of a '#include "name"' line, or an empty string for any other line
+		std::string GetInclude(const std::string& line)
+		{
+			size_t position = line.find_first_not_of(" \t");
+
+			if (position == line.npos || line[position] != '#')
+			{
+				return {};
+			}
+
+			position = line.find_first_not_of(" \t", position + 1);
+
+			if (position == line.npos || line.compare(position, 7, "include") != 0)
+			{
+				return {};
+			}
+
+			const size_t begin = line.find('"', position + 7);
+			const size_t end = begin == line.npos ? line.npos : line.find('"', begin + 1);
+
+			return end == line.npos ? std::string() : line.substr(begin + 1, end - begin - 1);
+		}
+
+		bool HashFile(const std::filesystem::path& path, const std::vector<std::string>& includeDirectories, PipelineKey& key, std::vector<std::string>& files)
+		{
+			const std::string name = path.lexically_normal().string();
+
+			// Every file is hashed once, which also stops include cycles of files without an include guard
+			if (std::find(files.begin(), files.end(), name) != files.end())
+			{
+				return true;
+			}
+
+			std::string text;
+
+			if (!ReadFile(path, text))
+			{
+				return false;
+			}
+
+			files.push_back(name);
+
+			key.Add(name.data(), name.size());
+			key.Add(text.data(), text.size());
+
+			std::istringstream lines(text);
+			std::string line;
+
+			while (std::getline(lines, line))
+			{
+				const std::string include = GetInclude(line);
+
+				if (include.empty())
+				{
+					continue;
+				}
+
+				std::filesystem::path includePath = path.parent_path() / include;
+
+				for (size_t i = 0; i < includeDirectories.size() && !std::filesystem::exists(includePath); i++)
+				{
+					includePath = std::filesystem::path(includeDirectories[i]) / include;
+				}
+
+				if (!HashFile(includePath, includeDirectories, key, files))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		std::wstring Widen(const std::string& text)
+		{
+			return std::filesystem::path(text).wstring();
+		}
+
+#if DXC_AVAILABLE
+		// Releases the interface at the end of the scope, without needing the COM helpers of either platform
+		template<typename T>
+		struct DxcObject
+		{
+			~DxcObject()
+			{
+				if (Pointer != nullptr)
+				{
+					Pointer->Release();
+				}
+			}
+
+			T* operator->() const
+			{
+				return Pointer;
+			}
+
+			void** Out()
+			{
+				return reinterpret_cast<void**>(&Pointer);
+			}
+
+			T* Pointer = nullptr;
+		};
+#endif
+	}
+
+	bool HashShaderSource(const std::string& path, const std::vector<std::string>& includeDirectories, uint64_t& hash, std::vector<std::string>& files)
+	{
+		PipelineKey key;
+		files.clear();
+
+		if (!HashFile(path, includeDirectories, key, files))
+		{
+			return false;
+		}
+
+		hash = key.Get();
+		return true;
+	}
+
+	uint64_t GetShaderKey(const ShaderCompileDesc& desc, uint64_t sourceHash, uint64_t compilerVersion)
+	{
+		PipelineKey key;
+		key.AddValue(sourceHash);
+		key.AddValue(compilerVersion);
+
+		// The arguments hold everything of the description but the path, which the source hash already has
+		for (const std::wstring& argument : GetShaderArguments(desc))
+		{
+			key.Add(argument);
+		}
+
+		return key.Get();
+	}
+
+	std::vector<std::wstring> GetShaderArguments(const ShaderCompileDesc& desc)
+	{
+		std::vector<std::wstring> arguments = { L"-T", Widen(desc.Target) };
+
+		if (!desc.EntryPoint.empty())
+		{
+			arguments.insert(arguments.end(), { L"-E", Widen(desc.EntryPoint) });
+		}
+
+		for (const ShaderDefine& define : desc.Defines)
+		{
+			arguments.insert(arguments.end(), { L"-D", Widen(define.Value.empty() ? define.Name : define.Name + "=" + define.Value) });
+		}
+
+		for (const std::string& directory : desc.IncludeDirectories)
+		{
+			arguments.insert(arguments.end(), { L"-I", Widen(directory) });
+		}
+
+		if (desc.Debug)
+		{
+			arguments.insert(arguments.end(), { L"-Od", L"-Zi", L"-Qembed_debug" });
+		}
+		else
+		{
+			arguments.insert(arguments.end(), { L"-O3", L"-Qstrip_debug", L"-Qstrip_reflect" });
+		}
+
+		return arguments;
+	}
+
+	ShaderCompiler::~ShaderCompiler()
+	{
+#if DXC_AVAILABLE && defined(_WIN32)
+		if (m_Library != nullptr)
+		{
+			FreeLibrary(static_cast<HMODULE>(m_Library));
+		}
+#elif DXC_AVAILABLE
+		if (m_Library != nullptr)
+		{
+			dlclose(m_Library);
+		}
+#endif
+	}
+
+	bool ShaderCompiler::Initialize([[maybe_unused]] const std::string& libraryPath)
+	{
+#if DXC_AVAILABLE
+#if defined(_WIN32)
+		m_Library = LoadLibraryA(libraryPath.empty() ? "dxcompiler.dll" : libraryPath.c_str());
+
+		// The library of the build is the fallback when the default name is not on the search path
+		if (m_Library == nullptr && libraryPath.empty() && DXR_DXC_LIBRARY[0] != '\0')
+		{
+			m_Library = LoadLibraryA(DXR_DXC_LIBRARY);
+		}
+
+		m_CreateInstance = m_Library != nullptr ? reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(m_Library), "DxcCreateInstance")) : nullptr;
+#else
+		m_Library = dlopen(libraryPath.empty() ? "libdxcompiler.so" : libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+		// The library of the build is the fallback when the default name is not on the search path
+		if (m_Library == nullptr && libraryPath.empty() && DXR_DXC_LIBRARY[0] != '\0')
+		{
+			m_Library = dlopen(DXR_DXC_LIBRARY, RTLD_NOW | RTLD_LOCAL);
+		}
+
+		m_CreateInstance = m_Library != nullptr ? dlsym(m_Library, "DxcCreateInstance") : nullptr;
+#endif
+
+		if (m_CreateInstance == nullptr)
+		{
+			return false;
+		}
+
+		const DxcCreateInstanceProc createInstance = reinterpret_cast<DxcCreateInstanceProc>(m_CreateInstance);
+
+		DxcObject<IDxcCompiler3> compiler;
+		DxcObject<IDxcVersionInfo> versionInfo;
+
+		if (SUCCEEDED(createInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler3), compiler.Out())) &&
+			SUCCEEDED(compiler->QueryInterface(__uuidof(IDxcVersionInfo), versionInfo.Out())))
+		{
+			UINT32 major = 0;
+			UINT32 minor = 0;
+			versionInfo->GetVersion(&major, &minor);
+
+			m_Version = (static_cast<uint64_t>(major) << 32) | minor;
+		}
+
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool ShaderCompiler::Compile([[maybe_unused]] const ShaderCompileDesc& desc, std::vector<uint8_t>& code, std::string& errors) const
+	{
+		code.clear();
+		errors.clear();
+
+#if DXC_AVAILABLE
+		if (m_CreateInstance == nullptr)
+		{
+			errors = "The shader compiler is not loaded";
+			return false;
+		}
+
+		const DxcCreateInstanceProc createInstance = reinterpret_cast<DxcCreateInstanceProc>(m_CreateInstance);
+
+		// The objects are not shared between threads, so every compile creates its own
+		DxcObject<IDxcUtils> utils;
+		DxcObject<IDxcCompiler3> compiler;
+		DxcObject<IDxcIncludeHandler> includeHandler;
+		DxcObject<IDxcBlobEncoding> source;
+
+		const std::wstring path = Widen(desc.SourcePath);
+
+		if (FAILED(createInstance(CLSID_DxcUtils, __uuidof(IDxcUtils), utils.Out())) ||
+			FAILED(createInstance(CLSID_DxcCompiler, __uuidof(IDxcCompiler3), compiler.Out())) ||
+			FAILED(utils->CreateDefaultIncludeHandler(&includeHandler.Pointer)))
+		{
+			errors = "Failed to create the shader compiler";
+			return false;
+		}
+
+		if (FAILED(utils->LoadFile(path.c_str(), nullptr, &source.Pointer)))
+		{
+			errors = "Failed to read " + desc.SourcePath;
+			return false;
+		}
+
+		// The path comes first, so the errors name the file and includes are found next to it
+		std::vector<std::wstring> arguments = GetShaderArguments(desc);
+		arguments.insert(arguments.begin(), path);
+
+		std::vector<LPCWSTR> argumentPointers;
+
+		for (const std::wstring& argument : arguments)
+		{
+			argumentPointers.push_back(argument.c_str());
+		}
+
+		DxcBuffer buffer = {};
+		buffer.Ptr = source->GetBufferPointer();
+		buffer.Size = source->GetBufferSize();
+		buffer.Encoding = DXC_CP_ACP;
+
+		DxcObject<IDxcResult> result;
+
+		if (FAILED(compiler->Compile(&buffer, argumentPointers.data(), static_cast<UINT32>(argumentPointers.size()), includeHandler.Pointer, __uuidof(IDxcResult), result.Out())))
+		{
+			errors = "Failed to run the shader compiler";
+			return false;
+		}
+
+		DxcObject<IDxcBlobUtf8> errorBlob;
+
+		if (SUCCEEDED(result->GetOutput(DXC_OUT_ERRORS, __uuidof(IDxcBlobUtf8), errorBlob.Out(), nullptr)) && errorBlob.Pointer != nullptr)
+		{
+			errors.assign(errorBlob->GetStringPointer(), errorBlob->GetStringLength());
+		}
+
+		HRESULT status = E_FAIL;
+		result->GetStatus(&status);
+
+		DxcObject<IDxcBlob> object;
+
+		if (FAILED(status) || FAILED(result->GetOutput(DXC_OUT_OBJECT, __uuidof(IDxcBlob), object.Out(), nullptr)) || object.Pointer == nullptr)
+		{
+			return false;
+		}
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(object->GetBufferPointer());
+		code.assign(bytes, bytes + object->GetBufferSize());
+
+		return true;
+#else
+		errors = "This build has no shader compiler";
+		return false;
+#endif
+	}
+
+	ShaderCompileService::ShaderCompileService(CompileFunction compile, uint64_t compilerVersion, std::string cachePath, uint32_t threadCount)
+		: m_Compile(std::move(compile))
+		, m_CompilerVersion(compilerVersion)
+		, m_Cache(std::move(cachePath))
+	{
+		m_Cache.Load();
+
+		for (uint32_t i = 0; i < std::max(threadCount, 1u); i++)
+		{
+			m_Workers.emplace_back(&ShaderCompileService::WorkerMain, this);
+		}
+	}
+
+	ShaderCompileService::~ShaderCompileService()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Exit = true;
+		}
+
+		m_WakeCondition.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+
+		// The code compiled since the queue last ran empty
+		if (m_Cache.IsDirty())
+		{
+			m_Cache.Save();
+		}
+	}
+
+	ShaderCompileService::Handle ShaderCompileService::Add(ShaderCompileDesc desc)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		const Handle handle = static_cast<Handle>(m_Permutations.size());
+
+		Permutation& permutation = m_Permutations.emplace_back();
+		permutation.Desc = std::move(desc);
+		permutation.Queued = true;
+
+		m_Queue.push_back(handle);
+		m_WakeCondition.notify_one();
+
+		return handle;
+	}
+
+	uint32_t ShaderCompileService::Reload()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		uint32_t queuedCount = 0;
+
+		for (Handle handle = 0; handle < m_Permutations.size(); handle++)
+		{
+			Permutation& permutation = m_Permutations[handle];
+
+			if (permutation.Queued)
+			{
+				continue;
+			}
+
+			bool changed = false;
+
+			for (size_t i = 0; i < permutation.Files.size() && !changed; i++)
+			{
+				std::error_code error;
+				changed = std::filesystem::last_write_time(permutation.Files[i], error) != permutation.WriteTimes[i];
+			}
+
+			if (changed)
+			{
+				permutation.Queued = true;
+				m_Queue.push_back(handle);
+				queuedCount++;
+			}
+		}
+
+		if (queuedCount > 0)
+		{
+			m_WakeCondition.notify_all();
+		}
+
+		return queuedCount;
+	}
+
+	bool ShaderCompileService::TakeResult(Handle handle, std::vector<uint8_t>& code, std::string& errors)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		Permutation& permutation = m_Permutations[handle];
+
+		if (!permutation.HasResult)
+		{
+			return false;
+		}
+
+		code = permutation.Code;
+		errors = permutation.Errors;
+		permutation.HasResult = false;
+
+		return true;
+	}
+
+	void ShaderCompileService::Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this]() { return m_Queue.empty() && m_ActiveCount == 0; });
+	}
+
+	uint32_t ShaderCompileService::GetCompileCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_CompileCount;
+	}
+
+	void ShaderCompileService::WorkerMain()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		while (true)
+		{
+			m_WakeCondition.wait(lock, [this]() { return m_Exit || !m_Queue.empty(); });
+
+			if (m_Exit)
+			{
+				return;
+			}
+
+			const Handle handle = m_Queue.front();
+			m_Queue.pop_front();
+			m_ActiveCount++;
+
+			lock.unlock();
+			Compile(handle);
+			lock.lock();
+
+			m_ActiveCount--;
+
+			if (m_Queue.empty() && m_ActiveCount == 0)
+			{
+				// Once for all the permutations of an Add or a Reload, rather than a write of the whole file per compile
+				if (m_Cache.IsDirty())
+				{
+					m_Cache.Save();
+				}
+
+				m_DoneCondition.notify_all();
+			}
+		}
+	}
+
+	void ShaderCompileService::Compile(Handle handle)
+	{
+		ShaderCompileDesc desc;
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			desc = m_Permutations[handle].Desc;
+		}
+
+		// The write times are taken before the files are hashed, so a file written during the compile is compiled again
+		// on the next reload. The first pass only finds the files.
+		uint64_t sourceHash = 0;
+		std::vector<std::string> files;
+		HashShaderSource(desc.SourcePath, desc.IncludeDirectories, sourceHash, files);
+
+		std::vector<std::filesystem::file_time_type> writeTimes(files.size());
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::error_code error;
+			writeTimes[i] = std::filesystem::last_write_time(files[i], error);
+		}
+
+		if (!HashShaderSource(desc.SourcePath, desc.IncludeDirectories, sourceHash, files))
+		{
+			// A missing file is reported by the compiler, and never cached as the key would not cover it
+			sourceHash = 0;
+		}
+
+		const uint64_t key = GetShaderKey(desc, sourceHash, m_CompilerVersion);
+
+		std::vector<uint8_t> code;
+		std::string errors;
+		bool cached = false;
+
+		if (sourceHash != 0)
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+
+			if (const std::vector<uint8_t>* entry = m_Cache.Find(key))
+			{
+				code = *entry;
+				cached = true;
+			}
+		}
+
+		if (!cached && !m_Compile(desc, code, errors))
+		{
+			code.clear();
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		if (!cached)
+		{
+			m_CompileCount++;
+
+			if (!code.empty() && sourceHash != 0)
+			{
+				m_Cache.Store(key, code.data(), code.size());
+			}
+		}
+
+		Permutation& permutation = m_Permutations[handle];
+		permutation.Files = std::move(files);
+		permutation.WriteTimes = std::move(writeTimes);
+		permutation.Code = std::move(code);
+		permutation.Errors = std::move(errors);
+		permutation.Queued = false;
+		permutation.HasResult = true;
+	}
+}
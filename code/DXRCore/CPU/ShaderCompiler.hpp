@@ -0,0 +1,166 @@
+#pragma once
+
+#include "PipelineCache.hpp"
+
+#include <cstdint>
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cpu
+{
+	struct ShaderDefine
+	{
+		std::string Name;
+		std::string Value;
+	};
+
+	// One permutation of a shader. Two descriptions with the same values compile the same source to the same code.
+	struct ShaderCompileDesc
+	{
+		std::string SourcePath;
+
+		// Empty for a library, which exports all of its shaders
+		std::string EntryPoint;
+		std::string Target = "lib_6_6";
+
+		std::vector<ShaderDefine> Defines;
+
+		// Searched after the directory of the file that includes another
+		std::vector<std::string> IncludeDirectories;
+
+		// Skips the optimizations and embeds the debug information
+		bool Debug = false;
+	};
+
+	// Hashes the source file and every file it includes with '#include "..."', and returns the paths of all of them.
+	// Includes are looked up next to the file that includes them and then in the include directories, the way the
+	// compiler does. Includes inside inactive preprocessor branches are hashed as well, which at worst compiles a
+	// permutation once more than needed. Fails when a file can not be read.
+	bool HashShaderSource(const std::string& path, const std::vector<std::string>& includeDirectories, uint64_t& hash, std::vector<std::string>& files);
+
+	// Key of the compiled code in the cache, from the hash of the source files, everything in the description and the
+	// version of the compiler
+	uint64_t GetShaderKey(const ShaderCompileDesc& desc, uint64_t sourceHash, uint64_t compilerVersion);
+
+	// Command line of the DirectX shader compiler for the description, without the source file
+	std::vector<std::wstring> GetShaderArguments(const ShaderCompileDesc& desc);
+
+	// The DirectX shader compiler, loaded at runtime: dxcompiler.dll on Windows and libdxcompiler.so on Linux, so
+	// shaders can be compiled and checked on machines without a GPU. Builds without dxcapi.h (on Linux it needs the
+	// WinAdapter.h of the DXC release on the include path) have no compiler, and Initialize fails.
+	class ShaderCompiler
+	{
+	public:
+		ShaderCompiler() = default;
+		~ShaderCompiler();
+
+		ShaderCompiler(const ShaderCompiler&) = delete;
+		ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+		// Loads the compiler from the path, or by its default name from the search path of the system when it is empty,
+		// and else from where CMake found it
+		bool Initialize(const std::string& libraryPath = {});
+
+		bool IsAvailable() const
+		{
+			return m_CreateInstance != nullptr;
+		}
+
+		// Major version in the upper and minor version in the lower 32 bits, 0 when it is not known
+		uint64_t GetVersion() const
+		{
+			return m_Version;
+		}
+
+		// Can be called from several threads at once. The errors hold the warnings as well when it succeeds.
+		bool Compile(const ShaderCompileDesc& desc, std::vector<uint8_t>& code, std::string& errors) const;
+
+	private:
+		void* m_Library = nullptr;
+		void* m_CreateInstance = nullptr;
+
+		uint64_t m_Version = 0;
+	};
+
+	// Compiles shader permutations on background threads and keeps the newest code of each. Code that was compiled
+	// before, by any run with the same source files, defines and compiler, comes from the cache instead. Reload
+	// compiles the permutations again of which a source file changed, so a shader can be edited while the application
+	// runs.
+	class ShaderCompileService
+	{
+	public:
+		using Handle = uint32_t;
+
+		// Compiles a permutation into code. Returns false with the errors when the source does not compile.
+		using CompileFunction = std::function<bool(const ShaderCompileDesc& desc, std::vector<uint8_t>& code, std::string& errors)>;
+
+		// The version of the compiler is part of the key of the cached code. The cache is written whenever the queue
+		// runs empty, so it holds all the code once Wait returns, and when the service is destroyed.
+		ShaderCompileService(CompileFunction compile, uint64_t compilerVersion, std::string cachePath, uint32_t threadCount = 1);
+		~ShaderCompileService();
+
+		ShaderCompileService(const ShaderCompileService&) = delete;
+		ShaderCompileService& operator=(const ShaderCompileService&) = delete;
+
+		// Adds a permutation and queues its compilation
+		Handle Add(ShaderCompileDesc desc);
+
+		// Queues the permutations of which a source file was written since they were last compiled, and returns how
+		// many. Cheap enough to be called a few times a second.
+		uint32_t Reload();
+
+		// Returns true once for every new result of the permutation. The code is empty when the compile failed, in
+		// which case the errors say why and the code of the last result is still the one to use.
+		bool TakeResult(Handle handle, std::vector<uint8_t>& code, std::string& errors);
+
+		// Blocks until every queued permutation is compiled
+		void Wait();
+
+		// Compiles done since the start, not counting the code that came from the cache
+		uint32_t GetCompileCount() const;
+
+	private:
+		struct Permutation
+		{
+			ShaderCompileDesc Desc;
+
+			// Source files of the last compile, with the time they were written
+			std::vector<std::string> Files;
+			std::vector<std::filesystem::file_time_type> WriteTimes;
+
+			std::vector<uint8_t> Code;
+			std::string Errors;
+
+			bool Queued = false;
+			bool HasResult = false;
+		};
+
+		void WorkerMain();
+		void Compile(Handle handle);
+
+		CompileFunction m_Compile;
+		uint64_t m_CompilerVersion;
+
+		PipelineCache m_Cache;
+
+		std::vector<std::thread> m_Workers;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_WakeCondition;
+		std::condition_variable m_DoneCondition;
+
+		std::deque<Permutation> m_Permutations;
+		std::deque<Handle> m_Queue;
+		uint32_t m_ActiveCount = 0;
+		uint32_t m_CompileCount = 0;
+
+		bool m_Exit = false;
+	};
+}
@@ -0,0 +1,73 @@
+#include "ShaderTable.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cpu
+{
+	uint32_t ShaderRecordLayout::AddConstants(uint32_t count)
+	{
+		return Add(count * 4, 4, false);
+	}
+
+	uint32_t ShaderRecordLayout::AddDescriptor()
+	{
+		return Add(8, 8, true);
+	}
+
+	uint32_t ShaderRecordLayout::Add(uint32_t size, uint32_t alignment, bool descriptor)
+	{
+		const uint32_t offset = AlignShaderRecord(m_Size, alignment);
+
+		m_Arguments.push_back({ offset, size, descriptor });
+		m_Size = offset + size;
+
+		return static_cast<uint32_t>(m_Arguments.size() - 1);
+	}
+
+	ShaderTable::ShaderTable(const ShaderRecordLayout& layout, uint32_t recordCount)
+		: m_Layout(layout)
+		, m_RecordCount(recordCount)
+		, m_Data(static_cast<size_t>(recordCount) * layout.GetStride(), 0)
+	{
+	}
+
+	void ShaderTable::SetIdentifier(uint32_t record, const void* identifier)
+	{
+		if (record < m_RecordCount)
+		{
+			memcpy(m_Data.data() + static_cast<size_t>(record) * GetStride(), identifier, ShaderIdentifierSize);
+		}
+	}
+
+	void ShaderTable::SetConstants(uint32_t record, uint32_t argument, const void* values, uint32_t count, uint32_t offset)
+	{
+		// Values past the end of the constants are dropped instead of overwriting the next argument
+		if (uint8_t* data = GetArgument(record, argument, false))
+		{
+			const uint32_t size = m_Layout.GetArgumentSize(argument);
+			const uint32_t begin = std::min(offset * 4, size);
+			const uint32_t end = std::min(begin + count * 4, size);
+
+			memcpy(data + begin, values, end - begin);
+		}
+	}
+
+	void ShaderTable::SetDescriptor(uint32_t record, uint32_t argument, uint64_t address)
+	{
+		if (uint8_t* data = GetArgument(record, argument, true))
+		{
+			memcpy(data, &address, sizeof(address));
+		}
+	}
+
+	uint8_t* ShaderTable::GetArgument(uint32_t record, uint32_t argument, bool descriptor)
+	{
+		if (record >= m_RecordCount || argument >= m_Layout.GetArgumentCount() || m_Layout.IsDescriptor(argument) != descriptor)
+		{
+			return nullptr;
+		}
+
+		return m_Data.data() + static_cast<size_t>(record) * GetStride() + m_Layout.GetArgumentOffset(argument);
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace cpu
+{
+	// The rules of D3D12 for shader tables, without the headers of D3D12 so the packing can be checked anywhere
+	constexpr uint32_t ShaderIdentifierSize = 32;
+	constexpr uint32_t ShaderRecordAlignment = 32;
+	constexpr uint32_t ShaderTableAlignment = 64;
+	constexpr uint32_t MaxShaderRecordSize = 4096;
+
+	constexpr uint32_t AlignShaderRecord(uint32_t size, uint32_t alignment)
+	{
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Where the local root arguments go in a shader record. The arguments follow the shader identifier in the order of
+	// the parameters of the local root signature: 32 bit constants are packed at 4 bytes, and root descriptors and
+	// descriptor tables take a GPU address or handle of 8 bytes at an 8 byte offset.
+	class ShaderRecordLayout
+	{
+	public:
+		// Both return the index of the argument
+		uint32_t AddConstants(uint32_t count);
+		uint32_t AddDescriptor();
+
+		uint32_t GetArgumentCount() const
+		{
+			return static_cast<uint32_t>(m_Arguments.size());
+		}
+
+		uint32_t GetArgumentOffset(uint32_t argument) const
+		{
+			return m_Arguments[argument].Offset;
+		}
+
+		uint32_t GetArgumentSize(uint32_t argument) const
+		{
+			return m_Arguments[argument].Size;
+		}
+
+		bool IsDescriptor(uint32_t argument) const
+		{
+			return m_Arguments[argument].Descriptor;
+		}
+
+		// Identifier and arguments, without the padding up to the next record
+		uint32_t GetRecordSize() const
+		{
+			return m_Size;
+		}
+
+		// Distance between two records of a table
+		uint32_t GetStride() const
+		{
+			return AlignShaderRecord(m_Size, ShaderRecordAlignment);
+		}
+
+	private:
+		uint32_t Add(uint32_t size, uint32_t alignment, bool descriptor);
+
+		struct Argument
+		{
+			uint32_t Offset;
+			uint32_t Size;
+			bool Descriptor;
+		};
+
+		std::vector<Argument> m_Arguments;
+		uint32_t m_Size = ShaderIdentifierSize;
+	};
+
+	// The bytes of a shader table, records of the same layout one stride apart. Records start out zeroed, so an
+	// argument that is never set reads as 0.
+	class ShaderTable
+	{
+	public:
+		ShaderTable() = default;
+		ShaderTable(const ShaderRecordLayout& layout, uint32_t recordCount);
+
+		void SetIdentifier(uint32_t record, const void* identifier);
+
+		// Writes count 32 bit values into the constants of the argument, starting at the value at offset
+		void SetConstants(uint32_t record, uint32_t argument, const void* values, uint32_t count, uint32_t offset = 0);
+
+		// Whole structs, such as the ones the shaders declare their local constant buffers with
+		template<typename T>
+		void SetConstants(uint32_t record, uint32_t argument, const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T> && sizeof(T) % 4 == 0, "Constants are written in 32 bit values");
+			SetConstants(record, argument, &value, sizeof(T) / 4);
+		}
+
+		// A GPU virtual address for a root descriptor, or a GPU descriptor handle for a descriptor table
+		void SetDescriptor(uint32_t record, uint32_t argument, uint64_t address);
+
+		const ShaderRecordLayout& GetLayout() const
+		{
+			return m_Layout;
+		}
+
+		uint32_t GetRecordCount() const
+		{
+			return m_RecordCount;
+		}
+
+		uint32_t GetStride() const
+		{
+			return m_Layout.GetStride();
+		}
+
+		// The size of the buffer to copy the table into, which has to start at a multiple of ShaderTableAlignment
+		uint64_t GetSize() const
+		{
+			return m_Data.size();
+		}
+
+		const uint8_t* GetData() const
+		{
+			return m_Data.data();
+		}
+
+		const uint8_t* GetRecord(uint32_t record) const
+		{
+			return m_Data.data() + static_cast<size_t>(record) * GetStride();
+		}
+
+	private:
+		uint8_t* GetArgument(uint32_t record, uint32_t argument, bool descriptor);
+
+		ShaderRecordLayout m_Layout;
+		uint32_t m_RecordCount = 0;
+
+		std::vector<uint8_t> m_Data;
+	};
+}
@@ -0,0 +1,120 @@
+#include "SkyDistribution.hpp"
+#include "ThreadPool.hpp"
+
+namespace cpu
+{
+	namespace
+	{
+		// Vose's alias method. Entries with less than the average weight get topped up by an entry with more, until
+		// every entry holds exactly the average. The work lists are passed in, so a thread can reuse them for every row.
+		void BuildAliasTable(const float* weights, uint32_t count, sky::AliasEntry* entries, std::vector<uint32_t>& small, std::vector<uint32_t>& large, std::vector<float>& scaled)
+		{
+			double sum = 0.0;
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				sum += weights[i];
+			}
+
+			// Nothing to importance sample, so every entry is as likely
+			if (sum <= 0.0)
+			{
+				for (uint32_t i = 0; i < count; i++)
+				{
+					entries[i] = { 1.0f, i, 1.0f / count };
+				}
+
+				return;
+			}
+
+			small.clear();
+			large.clear();
+			scaled.resize(count);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				entries[i].Pdf = static_cast<float>(weights[i] / sum);
+				scaled[i] = static_cast<float>(weights[i] * count / sum);
+
+				(scaled[i] < 1.0f ? small : large).push_back(i);
+			}
+
+			while (!small.empty() && !large.empty())
+			{
+				const uint32_t less = small.back();
+				small.pop_back();
+
+				const uint32_t more = large.back();
+
+				entries[less].Probability = scaled[less];
+				entries[less].Alias = more;
+
+				// Same as scaled[more] - (1 - scaled[less]), but with less cancellation
+				scaled[more] = (scaled[more] + scaled[less]) - 1.0f;
+
+				if (scaled[more] < 1.0f)
+				{
+					large.pop_back();
+					small.push_back(more);
+				}
+			}
+
+			// What is left holds the average, up to rounding
+			for (uint32_t i : small)
+			{
+				entries[i].Probability = 1.0f;
+				entries[i].Alias = i;
+			}
+
+			for (uint32_t i : large)
+			{
+				entries[i].Probability = 1.0f;
+				entries[i].Alias = i;
+			}
+		}
+	}
+
+	void SkyDistribution::Build(const Image& sky)
+	{
+		m_Width = sky.GetWidth();
+		m_Height = sky.GetHeight();
+
+		m_Entries.resize(static_cast<size_t>(m_Height) + static_cast<size_t>(m_Width) * m_Height);
+
+		std::vector<float> rowWeights(m_Height);
+
+		ThreadPool::Get().ParallelFor(m_Height, 8, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				std::vector<float> weights(m_Width);
+				std::vector<uint32_t> small;
+				std::vector<uint32_t> large;
+				std::vector<float> scaled;
+
+				for (uint32_t row = static_cast<uint32_t>(begin); row < end; row++)
+				{
+					// The texels of a row all cover the same solid angle, so it only matters for the marginal table
+					const float sinTheta = std::sin((row + 0.5f) / m_Height * PI);
+
+					double rowWeight = 0.0;
+
+					for (uint32_t column = 0; column < m_Width; column++)
+					{
+						const Float4& texel = sky(column, row);
+						weights[column] = std::max(0.2126f * texel.x + 0.7152f * texel.y + 0.0722f * texel.z, 0.0f);
+
+						rowWeight += weights[column];
+					}
+
+					rowWeights[row] = static_cast<float>(rowWeight * sinTheta);
+
+					BuildAliasTable(weights.data(), m_Width, &m_Entries[m_Height + static_cast<size_t>(row) * m_Width], small, large, scaled);
+				}
+			});
+
+		std::vector<uint32_t> small;
+		std::vector<uint32_t> large;
+		std::vector<float> scaled;
+
+		BuildAliasTable(rowWeights.data(), m_Height, m_Entries.data(), small, large, scaled);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include "../Shaders/SkySampling.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	// Alias tables over the texels of an equirectangular sky, weighted by their luminance and the solid angle they
+	// cover. The entries have the layout of Shaders/SkySampling.hpp, so the same table can be uploaded for the shaders.
+	class SkyDistribution
+	{
+	public:
+		SkyDistribution() = default;
+
+		// Builds the tables from the sky, one row per thread
+		void Build(const Image& sky);
+
+		// Direction towards the sky and its density over solid angle
+		Float3 Sample(const Float2& random, float& pdf) const
+		{
+			return sky::SampleSky(m_Entries.data(), m_Width, m_Height, random, pdf);
+		}
+
+		float GetPdf(const Float3& direction) const
+		{
+			return sky::GetSkyPdf(m_Entries.data(), m_Width, m_Height, direction);
+		}
+
+		bool IsEmpty() const
+		{
+			return m_Entries.empty();
+		}
+
+		const std::vector<sky::AliasEntry>& GetEntries() const
+		{
+			return m_Entries;
+		}
+
+		uint32_t GetWidth() const
+		{
+			return m_Width;
+		}
+
+		uint32_t GetHeight() const
+		{
+			return m_Height;
+		}
+
+	private:
+		std::vector<sky::AliasEntry> m_Entries;
+
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+	};
+}
@@ -0,0 +1,411 @@
+#include "TLSFAllocator.hpp"
+
+#include "SIMD.hpp"
+
+#include <algorithm>
+
+namespace cpu
+{
+	namespace
+	{
+		uint64_t AlignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) & ~(alignment - 1);
+		}
+	}
+
+	TLSFAllocator::TLSFAllocator(uint64_t size)
+	{
+		Reset(size);
+	}
+
+	void TLSFAllocator::Reset(uint64_t size)
+	{
+		m_Blocks.clear();
+		m_UnusedBlocks.clear();
+
+		std::fill(&m_Heads[0][0], &m_Heads[0][0] + FirstLevelCount * SecondLevelCount, InvalidHandle);
+		m_FirstLevelBitmap = 0;
+		std::fill(std::begin(m_SecondLevelBitmaps), std::end(m_SecondLevelBitmaps), 0u);
+
+		m_Size = size;
+		m_UsedSize = 0;
+		m_AllocationCount = 0;
+		m_First = InvalidHandle;
+
+		if (size > 0)
+		{
+			m_First = CreateBlock();
+			m_Blocks[m_First].Size = size;
+
+			InsertFree(m_First);
+		}
+	}
+
+	TLSFAllocator::Allocation TLSFAllocator::Allocate(uint64_t size, uint64_t alignment)
+	{
+		Allocation allocation;
+
+		if (size == 0 || size > m_Size)
+		{
+			return allocation;
+		}
+
+		uint32_t block = FindFreeBlock(size);
+
+		// Most ranges already start at an aligned offset, so padding for the alignment is only searched for when the
+		// range that was found does not fit with it
+		if (block != InvalidHandle && AlignUp(m_Blocks[block].Offset, alignment) + size > m_Blocks[block].Offset + m_Blocks[block].Size)
+		{
+			block = alignment > 1 ? FindFreeBlock(size + alignment - 1) : InvalidHandle;
+		}
+
+		if (block == InvalidHandle)
+		{
+			return allocation;
+		}
+
+		RemoveFree(block);
+
+		// The padding in front stays free. The block before it is in use, otherwise they would have been merged.
+		const uint64_t padding = AlignUp(m_Blocks[block].Offset, alignment) - m_Blocks[block].Offset;
+
+		if (padding > 0)
+		{
+			const uint32_t aligned = Split(block, padding);
+			InsertFree(block);
+			block = aligned;
+		}
+
+		if (m_Blocks[block].Size > size)
+		{
+			InsertFree(Split(block, size));
+		}
+
+		m_Blocks[block].Alignment = alignment;
+
+		m_UsedSize += size;
+		m_AllocationCount++;
+
+		allocation.Offset = m_Blocks[block].Offset;
+		allocation.Handle = block;
+
+		return allocation;
+	}
+
+	void TLSFAllocator::Free(uint32_t handle)
+	{
+		if (handle == InvalidHandle)
+		{
+			return;
+		}
+
+		m_UsedSize -= m_Blocks[handle].Size;
+		m_AllocationCount--;
+
+		uint32_t block = handle;
+
+		const uint32_t next = m_Blocks[block].Next;
+
+		if (next != InvalidHandle && m_Blocks[next].IsFree)
+		{
+			RemoveFree(next);
+			Merge(block, next);
+		}
+
+		const uint32_t previous = m_Blocks[block].Previous;
+
+		if (previous != InvalidHandle && m_Blocks[previous].IsFree)
+		{
+			RemoveFree(previous);
+			Merge(previous, block);
+			block = previous;
+		}
+
+		InsertFree(block);
+	}
+
+	void TLSFAllocator::Defragment(std::vector<Move>& moves)
+	{
+		std::vector<uint32_t> used;
+		used.reserve(m_AllocationCount);
+
+		for (uint32_t block = m_First; block != InvalidHandle;)
+		{
+			const uint32_t next = m_Blocks[block].Next;
+
+			if (m_Blocks[block].IsFree)
+			{
+				RemoveFree(block);
+				DestroyBlock(block);
+			}
+			else
+			{
+				used.push_back(block);
+			}
+
+			block = next;
+		}
+
+		// The allocations are laid out again in the same order, with free blocks only where alignment needs padding
+		uint64_t cursor = 0;
+		uint32_t previous = InvalidHandle;
+		m_First = InvalidHandle;
+
+		auto Append = [&](uint32_t block)
+		{
+			m_Blocks[block].Previous = previous;
+			m_Blocks[block].Next = InvalidHandle;
+
+			if (previous != InvalidHandle)
+			{
+				m_Blocks[previous].Next = block;
+			}
+			else
+			{
+				m_First = block;
+			}
+
+			previous = block;
+		};
+
+		auto AppendFree = [&](uint64_t offset, uint64_t size)
+		{
+			const uint32_t block = CreateBlock();
+			m_Blocks[block].Offset = offset;
+			m_Blocks[block].Size = size;
+
+			Append(block);
+			InsertFree(block);
+		};
+
+		for (uint32_t block : used)
+		{
+			const uint64_t offset = AlignUp(cursor, m_Blocks[block].Alignment);
+
+			if (offset > cursor)
+			{
+				AppendFree(cursor, offset - cursor);
+			}
+
+			if (offset != m_Blocks[block].Offset)
+			{
+				moves.push_back({ block, m_Blocks[block].Offset, offset, m_Blocks[block].Size });
+				m_Blocks[block].Offset = offset;
+			}
+
+			Append(block);
+			cursor = offset + m_Blocks[block].Size;
+		}
+
+		if (cursor < m_Size)
+		{
+			AppendFree(cursor, m_Size - cursor);
+		}
+	}
+
+	TLSFAllocator::Statistics TLSFAllocator::GetStatistics() const
+	{
+		Statistics statistics;
+		statistics.UsedSize = m_UsedSize;
+		statistics.AllocationCount = m_AllocationCount;
+
+		for (uint32_t block = m_First; block != InvalidHandle; block = m_Blocks[block].Next)
+		{
+			if (m_Blocks[block].IsFree)
+			{
+				statistics.FreeSize += m_Blocks[block].Size;
+				statistics.LargestFreeSize = std::max(statistics.LargestFreeSize, m_Blocks[block].Size);
+				statistics.FreeRangeCount++;
+			}
+		}
+
+		return statistics;
+	}
+
+	void TLSFAllocator::GetBin(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+	{
+		if (size < SecondLevelCount)
+		{
+			firstLevel = 0;
+			secondLevel = static_cast<uint32_t>(size);
+			return;
+		}
+
+		const uint32_t log2 = LastBit(size);
+
+		firstLevel = log2 - SecondLevelBits + 1;
+		secondLevel = static_cast<uint32_t>(size >> (log2 - SecondLevelBits)) - SecondLevelCount;
+	}
+
+	void TLSFAllocator::GetSearchBin(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+	{
+		if (size >= SecondLevelCount)
+		{
+			size += (1ull << (LastBit(size) - SecondLevelBits)) - 1;
+		}
+
+		GetBin(size, firstLevel, secondLevel);
+	}
+
+	uint32_t TLSFAllocator::FindFreeBlock(uint64_t size) const
+	{
+		uint32_t firstLevel;
+		uint32_t secondLevel;
+		GetSearchBin(size, firstLevel, secondLevel);
+
+		if (firstLevel < FirstLevelCount)
+		{
+			uint32_t secondLevelMap = m_SecondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+
+			if (secondLevelMap == 0)
+			{
+				const uint64_t firstLevelMap = firstLevel + 1 < 64 ? m_FirstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+
+				if (firstLevelMap != 0)
+				{
+					firstLevel = FirstBit(firstLevelMap);
+					secondLevelMap = m_SecondLevelBitmaps[firstLevel];
+				}
+			}
+
+			if (secondLevelMap != 0)
+			{
+				return m_Heads[firstLevel][FirstBit(secondLevelMap)];
+			}
+		}
+
+		// The bins above are full of ranges that are certain to fit. The bin of the size itself can still hold one that
+		// fits, which only matters when the allocator is nearly full.
+		GetBin(size, firstLevel, secondLevel);
+
+		for (uint32_t block = m_Heads[firstLevel][secondLevel]; block != InvalidHandle; block = m_Blocks[block].NextFree)
+		{
+			if (m_Blocks[block].Size >= size)
+			{
+				return block;
+			}
+		}
+
+		return InvalidHandle;
+	}
+
+	void TLSFAllocator::InsertFree(uint32_t block)
+	{
+		uint32_t firstLevel;
+		uint32_t secondLevel;
+		GetBin(m_Blocks[block].Size, firstLevel, secondLevel);
+
+		uint32_t& head = m_Heads[firstLevel][secondLevel];
+
+		m_Blocks[block].IsFree = true;
+		m_Blocks[block].PreviousFree = InvalidHandle;
+		m_Blocks[block].NextFree = head;
+
+		if (head != InvalidHandle)
+		{
+			m_Blocks[head].PreviousFree = block;
+		}
+
+		head = block;
+
+		m_FirstLevelBitmap |= 1ull << firstLevel;
+		m_SecondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+	}
+
+	void TLSFAllocator::RemoveFree(uint32_t block)
+	{
+		uint32_t firstLevel;
+		uint32_t secondLevel;
+		GetBin(m_Blocks[block].Size, firstLevel, secondLevel);
+
+		Block& entry = m_Blocks[block];
+
+		if (entry.PreviousFree != InvalidHandle)
+		{
+			m_Blocks[entry.PreviousFree].NextFree = entry.NextFree;
+		}
+		else
+		{
+			m_Heads[firstLevel][secondLevel] = entry.NextFree;
+		}
+
+		if (entry.NextFree != InvalidHandle)
+		{
+			m_Blocks[entry.NextFree].PreviousFree = entry.PreviousFree;
+		}
+
+		if (m_Heads[firstLevel][secondLevel] == InvalidHandle)
+		{
+			m_SecondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+
+			if (m_SecondLevelBitmaps[firstLevel] == 0)
+			{
+				m_FirstLevelBitmap &= ~(1ull << firstLevel);
+			}
+		}
+
+		entry.IsFree = false;
+		entry.PreviousFree = InvalidHandle;
+		entry.NextFree = InvalidHandle;
+	}
+
+	uint32_t TLSFAllocator::Split(uint32_t block, uint64_t size)
+	{
+		const uint32_t rest = CreateBlock();
+
+		Block& entry = m_Blocks[block];
+		Block& restEntry = m_Blocks[rest];
+
+		restEntry.Offset = entry.Offset + size;
+		restEntry.Size = entry.Size - size;
+		restEntry.Previous = block;
+		restEntry.Next = entry.Next;
+
+		if (entry.Next != InvalidHandle)
+		{
+			m_Blocks[entry.Next].Previous = rest;
+		}
+
+		entry.Next = rest;
+		entry.Size = size;
+
+		return rest;
+	}
+
+	void TLSFAllocator::Merge(uint32_t block, uint32_t next)
+	{
+		Block& entry = m_Blocks[block];
+		const Block& nextEntry = m_Blocks[next];
+
+		entry.Size += nextEntry.Size;
+		entry.Next = nextEntry.Next;
+
+		if (nextEntry.Next != InvalidHandle)
+		{
+			m_Blocks[nextEntry.Next].Previous = block;
+		}
+
+		DestroyBlock(next);
+	}
+
+	uint32_t TLSFAllocator::CreateBlock()
+	{
+		if (!m_UnusedBlocks.empty())
+		{
+			const uint32_t block = m_UnusedBlocks.back();
+			m_UnusedBlocks.pop_back();
+
+			m_Blocks[block] = Block();
+			return block;
+		}
+
+		m_Blocks.emplace_back();
+		return static_cast<uint32_t>(m_Blocks.size() - 1);
+	}
+
+	void TLSFAllocator::DestroyBlock(uint32_t block)
+	{
+		m_UnusedBlocks.push_back(block);
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace cpu
+{
+	// Two level segregated fit allocator of ranges in a block of memory, such as a D3D12 heap that resources are placed
+	// in. Free ranges are binned by the power of two of their size and by 16 steps within it, and a bitmap per level
+	// finds a bin with a range that fits in constant time. Ranges merge with free neighbours when they are freed.
+	// Only the offsets are managed, the memory itself is never touched.
+	class TLSFAllocator
+	{
+	public:
+		static constexpr uint32_t InvalidHandle = ~0u;
+
+		struct Allocation
+		{
+			uint64_t Offset = 0;
+			uint32_t Handle = InvalidHandle;
+		};
+
+		// A range that Defragment moved, to be copied from the old to the new offset in the order of the list
+		struct Move
+		{
+			uint32_t Handle;
+			uint64_t SourceOffset;
+			uint64_t DestinationOffset;
+			uint64_t Size;
+		};
+
+		struct Statistics
+		{
+			uint64_t UsedSize = 0;
+			uint64_t FreeSize = 0;
+			uint64_t LargestFreeSize = 0;
+			uint32_t AllocationCount = 0;
+			uint32_t FreeRangeCount = 0;
+		};
+
+		TLSFAllocator() = default;
+		explicit TLSFAllocator(uint64_t size);
+
+		// Forgets every allocation
+		void Reset(uint64_t size);
+
+		// Range of size bytes at an offset that is a multiple of alignment, which must be a power of two. The handle is
+		// InvalidHandle when there is no free range that fits.
+		Allocation Allocate(uint64_t size, uint64_t alignment = 1);
+		void Free(uint32_t handle);
+
+		uint64_t GetOffset(uint32_t handle) const
+		{
+			return m_Blocks[handle].Offset;
+		}
+
+		uint64_t GetAllocationSize(uint32_t handle) const
+		{
+			return m_Blocks[handle].Size;
+		}
+
+		// Slides every allocation down to the lowest offset its alignment allows, which leaves one free range at the
+		// end. The handles stay the same. Every range moves to a lower offset, and copying them in the order of the
+		// list never overwrites a range that still has to be copied. A range can overlap its old one.
+		void Defragment(std::vector<Move>& moves);
+
+		Statistics GetStatistics() const;
+
+		uint64_t GetSize() const
+		{
+			return m_Size;
+		}
+
+		bool IsEmpty() const
+		{
+			return m_UsedSize == 0;
+		}
+
+	private:
+		static constexpr uint32_t SecondLevelBits = 4;
+		static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+		static constexpr uint32_t FirstLevelCount = 65 - SecondLevelBits;
+
+		struct Block
+		{
+			uint64_t Offset = 0;
+			uint64_t Size = 0;
+
+			// Neighbours in memory
+			uint32_t Previous = InvalidHandle;
+			uint32_t Next = InvalidHandle;
+
+			// Neighbours in the bin of a free block
+			uint32_t PreviousFree = InvalidHandle;
+			uint32_t NextFree = InvalidHandle;
+
+			uint64_t Alignment = 1;
+			bool IsFree = false;
+		};
+
+		// Bin that a free range of the size goes in
+		static void GetBin(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+		// Smallest bin of which every range has at least the size
+		static void GetSearchBin(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+		uint32_t FindFreeBlock(uint64_t size) const;
+
+		void InsertFree(uint32_t block);
+		void RemoveFree(uint32_t block);
+
+		// Splits the first size bytes off the block into a new block, which follows it in memory
+		uint32_t Split(uint32_t block, uint64_t size);
+		void Merge(uint32_t block, uint32_t next);
+
+		uint32_t CreateBlock();
+		void DestroyBlock(uint32_t block);
+
+		std::vector<Block> m_Blocks;
+		std::vector<uint32_t> m_UnusedBlocks;
+
+		uint32_t m_Heads[FirstLevelCount][SecondLevelCount];
+		uint64_t m_FirstLevelBitmap = 0;
+		uint32_t m_SecondLevelBitmaps[FirstLevelCount] = {};
+
+		uint64_t m_Size = 0;
+		uint64_t m_UsedSize = 0;
+		uint32_t m_AllocationCount = 0;
+
+		// Block at offset 0, the start of the list of blocks in memory order
+		uint32_t m_First = InvalidHandle;
+	};
+}
@@ -0,0 +1,193 @@
+#include "TextureCache.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <filesystem>
+
+namespace cpu
+{
+	namespace
+	{
+		constexpr uint32_t CacheMagic = 0x54525844; // 'DXRT'
+
+		uint64_t Mix(uint64_t value)
+		{
+			value ^= value >> 33;
+			value *= 0xFF51AFD7ED558CCDull;
+			value ^= value >> 33;
+			value *= 0xC4CEB9FE1A85EC53ull;
+			value ^= value >> 33;
+
+			return value;
+		}
+
+		uint64_t GetEntrySize(const TextureCacheHeader& header)
+		{
+			uint64_t size = sizeof(TextureCacheHeader);
+
+			for (uint32_t level = 0; level < header.MipCount; level++)
+			{
+				const uint32_t width = std::max(header.Width >> level, 1u);
+				const uint32_t height = std::max(header.Height >> level, 1u);
+
+				size += GetRowPitch(header.Format, width) * GetRowCount(header.Format, height);
+			}
+
+			return size;
+		}
+	}
+
+	uint64_t HashMemory(const void* data, size_t size, uint64_t seed)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = Mix(seed ^ size);
+
+		size_t offset = 0;
+
+		for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+		{
+			uint64_t word;
+			std::memcpy(&word, bytes + offset, sizeof(word));
+
+			hash = (hash ^ word) * 0x100000001B3ull;
+			hash ^= hash >> 29;
+		}
+
+		uint64_t tail = 0;
+		std::memcpy(&tail, bytes + offset, size - offset);
+
+		return Mix(hash ^ tail);
+	}
+
+	TextureCache::TextureCache(std::string directory)
+		: m_Directory(std::move(directory))
+	{
+	}
+
+	TextureCache::~TextureCache()
+	{
+		if (m_File != nullptr)
+		{
+			std::fclose(m_File);
+		}
+	}
+
+	uint64_t TextureCache::GetKey(uint64_t sourceHash, TextureFormat format, uint32_t mipCount)
+	{
+		const uint64_t settings = (static_cast<uint64_t>(Version) << 40) | (static_cast<uint64_t>(format) << 32) | mipCount;
+
+		return Mix(sourceHash ^ Mix(settings));
+	}
+
+	bool TextureCache::Open(uint64_t key)
+	{
+		if (m_File != nullptr)
+		{
+			std::fclose(m_File);
+		}
+
+		m_File = std::fopen(GetPath(key).c_str(), "rb");
+
+		if (m_File == nullptr)
+		{
+			return false;
+		}
+
+		const bool valid = std::fread(&m_Header, sizeof(m_Header), 1, m_File) == 1 &&
+			m_Header.Magic == CacheMagic && m_Header.Version == Version && m_Header.Key == key &&
+			std::fseek(m_File, 0, SEEK_END) == 0 && static_cast<uint64_t>(std::ftell(m_File)) == GetEntrySize(m_Header) &&
+			std::fseek(m_File, sizeof(m_Header), SEEK_SET) == 0;
+
+		if (!valid)
+		{
+			std::fclose(m_File);
+			m_File = nullptr;
+		}
+
+		return valid;
+	}
+
+	bool TextureCache::ReadRows(void* destination, uint64_t rowPitch, uint64_t rowSize, uint32_t rowCount)
+	{
+		uint8_t* target = static_cast<uint8_t*>(destination);
+
+		// Tightly packed rows go in one read
+		if (rowPitch == rowSize)
+		{
+			return std::fread(target, rowSize * rowCount, 1, m_File) == 1;
+		}
+
+		for (uint32_t row = 0; row < rowCount; row++)
+		{
+			if (std::fread(target + row * rowPitch, rowSize, 1, m_File) != 1)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool TextureCache::Write(const TextureCacheHeader& header, const std::vector<std::vector<uint8_t>>& mips) const
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_Directory, error);
+
+		const std::string path = GetPath(header.Key);
+		const std::string temporaryPath = path + ".tmp";
+
+		std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+
+		if (file == nullptr)
+		{
+			return false;
+		}
+
+		TextureCacheHeader written = header;
+		written.Magic = CacheMagic;
+		written.Version = Version;
+
+		bool success = std::fwrite(&written, sizeof(written), 1, file) == 1;
+
+		for (const std::vector<uint8_t>& mip : mips)
+		{
+			success = success && std::fwrite(mip.data(), mip.size(), 1, file) == 1;
+		}
+
+		success = std::fclose(file) == 0 && success;
+
+		if (success)
+		{
+			std::filesystem::rename(temporaryPath, path, error);
+			success = !error;
+		}
+
+		if (!success)
+		{
+			std::filesystem::remove(temporaryPath, error);
+		}
+
+		return success;
+	}
+
+	void TextureCache::Remove(uint64_t key)
+	{
+		if (m_File != nullptr && m_Header.Key == key)
+		{
+			std::fclose(m_File);
+			m_File = nullptr;
+		}
+
+		std::error_code error;
+		std::filesystem::remove(GetPath(key), error);
+	}
+
+	std::string TextureCache::GetPath(uint64_t key) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016" PRIx64 ".tex", key);
+
+		return (std::filesystem::path(m_Directory) / name).string();
+	}
+}
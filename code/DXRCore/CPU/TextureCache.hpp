@@ -0,0 +1,77 @@
+#pragma once
+
+#include "TextureFormat.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cpu
+{
+	// 64-bit hash of a block of memory, 8 bytes at a time. Only meant to tell files apart, not to be secure.
+	uint64_t HashMemory(const void* data, size_t size, uint64_t seed = 0);
+
+	// Start of a cache file. The mips follow from largest to smallest, each GetRowCount rows of GetRowPitch bytes
+	// without any padding.
+	struct TextureCacheHeader
+	{
+		uint32_t Magic = 0;
+		uint32_t Version = 0;
+		uint64_t Key = 0;
+
+		TextureFormat Format = TextureFormat::RGBA8;
+		uint32_t Width = 0;
+		uint32_t Height = 0;
+		uint32_t MipCount = 0;
+	};
+
+	// Encoded textures on disk, so block compression only runs the first time a texture is loaded. Every entry is one
+	// file in the directory, named after a key that the caller hashes from the source file and the encode settings.
+	// Entries of older versions of the encoders are never opened, as the version is part of the key.
+	class TextureCache
+	{
+	public:
+		// Bumped whenever an encoder changes its output
+		static constexpr uint32_t Version = 1;
+
+		explicit TextureCache(std::string directory);
+		~TextureCache();
+
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		static uint64_t GetKey(uint64_t sourceHash, TextureFormat format, uint32_t mipCount);
+
+		// Opens the entry for reading. Fails when there is no entry, or when it does not have the expected size.
+		bool Open(uint64_t key);
+
+		const TextureCacheHeader& GetHeader() const
+		{
+			return m_Header;
+		}
+
+		// Reads the next rowCount rows of rowSize bytes of the opened entry. The rows are rowPitch bytes apart in the
+		// destination, which can be a mapped upload buffer.
+		bool ReadRows(void* destination, uint64_t rowPitch, uint64_t rowSize, uint32_t rowCount);
+
+		// Writes an entry through a temporary file, so an interrupted write never leaves a broken entry behind
+		bool Write(const TextureCacheHeader& header, const std::vector<std::vector<uint8_t>>& mips) const;
+
+		// Deletes the entry, closing it first when it is the opened one
+		void Remove(uint64_t key);
+
+		const std::string& GetDirectory() const
+		{
+			return m_Directory;
+		}
+
+	private:
+		std::string GetPath(uint64_t key) const;
+
+		std::string m_Directory;
+
+		std::FILE* m_File = nullptr;
+		TextureCacheHeader m_Header;
+	};
+}
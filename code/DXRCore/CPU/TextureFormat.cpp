@@ -0,0 +1,323 @@
+#include "TextureFormat.hpp"
+#include "BlockCompression.hpp"
+#include "SIMD.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstring>
+
+namespace cpu
+{
+	namespace
+	{
+		uint32_t FloatBits(float value)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return bits;
+		}
+
+		float BitsFloat(uint32_t bits)
+		{
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		// Clamps negative numbers and NaN to 0, for the formats without sign
+		float ClampPositive(float value)
+		{
+			return value > 0.0f ? value : 0.0f;
+		}
+
+		// Float without sign with a 5 bit exponent, like the channels of R11G11B10. Works like FloatToHalf, with a
+		// shorter mantissa.
+		uint32_t FloatToSmallFloat(float value, uint32_t mantissaBits, uint32_t maxValue)
+		{
+			const uint32_t shift = 23 - mantissaBits;
+			const uint32_t denormalMagic = ((127u - 15u) + shift + 1u) << 23;
+
+			uint32_t bits = FloatBits(ClampPositive(value));
+
+			if (bits >= (127u + 16u) << 23)
+			{
+				return maxValue;
+			}
+
+			if (bits < (113u << 23))
+			{
+				return FloatBits(BitsFloat(bits) + BitsFloat(denormalMagic)) - denormalMagic;
+			}
+
+			bits += ((15u - 127u) << 23) + (1u << (shift - 1)) - 1u + ((bits >> shift) & 1u);
+
+			return std::min(bits >> shift, maxValue);
+		}
+	}
+
+	bool IsBlockCompressed(TextureFormat format)
+	{
+		return format == TextureFormat::BC1 || format == TextureFormat::BC7 || format == TextureFormat::BC6H;
+	}
+
+	uint32_t GetBytesPerPixel(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::RGBA32F:
+			return 16;
+		case TextureFormat::RGBA16F:
+			return 8;
+		default:
+			return 4;
+		}
+	}
+
+	uint32_t GetBytesPerBlock(TextureFormat format)
+	{
+		return format == TextureFormat::BC1 ? 8 : 16;
+	}
+
+	uint64_t GetRowPitch(TextureFormat format, uint32_t width)
+	{
+		if (IsBlockCompressed(format))
+		{
+			return static_cast<uint64_t>((width + 3) / 4) * GetBytesPerBlock(format);
+		}
+
+		return static_cast<uint64_t>(width) * GetBytesPerPixel(format);
+	}
+
+	uint32_t GetRowCount(TextureFormat format, uint32_t height)
+	{
+		return IsBlockCompressed(format) ? (height + 3) / 4 : height;
+	}
+
+	uint16_t FloatToHalf(float value)
+	{
+		constexpr uint32_t FloatInfinity = 255u << 23;
+		constexpr uint32_t HalfMax = (127u + 16u) << 23;
+		constexpr uint32_t DenormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+		uint32_t bits = FloatBits(value);
+		const uint32_t sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		uint32_t half;
+
+		if (bits >= HalfMax)
+		{
+			// Infinity, or NaN with a quiet bit
+			half = bits > FloatInfinity ? 0x7E00u : 0x7C00u;
+		}
+		else if (bits < (113u << 23))
+		{
+			// Too small for a normal half, the float addition rounds the denormal into place
+			half = FloatBits(BitsFloat(bits) + BitsFloat(DenormalMagic)) - DenormalMagic;
+		}
+		else
+		{
+			const uint32_t mantissaOdd = (bits >> 13) & 1;
+
+			bits += ((15u - 127u) << 23) + 0xFFFu;
+			bits += mantissaOdd;
+			half = bits >> 13;
+		}
+
+		return static_cast<uint16_t>(half | (sign >> 16));
+	}
+
+	float HalfToFloat(uint16_t value)
+	{
+		constexpr uint32_t ShiftedExponent = 0x7C00u << 13;
+
+		uint32_t bits = (value & 0x7FFFu) << 13;
+		const uint32_t exponent = bits & ShiftedExponent;
+
+		bits += (127u - 15u) << 23;
+
+		if (exponent == ShiftedExponent)
+		{
+			// Infinity or NaN
+			bits += (128u - 16u) << 23;
+		}
+		else if (exponent == 0)
+		{
+			// Denormal, renormalized with a float subtraction
+			bits += 1u << 23;
+			bits = FloatBits(BitsFloat(bits) - BitsFloat(113u << 23));
+		}
+
+		return BitsFloat(bits | ((value & 0x8000u) << 16));
+	}
+
+	uint32_t PackR11G11B10(const Float3& color)
+	{
+		const uint32_t r = FloatToSmallFloat(color.x, 6, 0x7BF);
+		const uint32_t g = FloatToSmallFloat(color.y, 6, 0x7BF);
+		const uint32_t b = FloatToSmallFloat(color.z, 5, 0x3DF);
+
+		return r | (g << 11) | (b << 22);
+	}
+
+	Float3 UnpackR11G11B10(uint32_t packed)
+	{
+		return Float3(HalfToFloat(static_cast<uint16_t>((packed & 0x7FFu) << 4)),
+			HalfToFloat(static_cast<uint16_t>(((packed >> 11) & 0x7FFu) << 4)),
+			HalfToFloat(static_cast<uint16_t>(((packed >> 22) & 0x3FFu) << 5)));
+	}
+
+	uint32_t PackRGB9E5(const Float3& color)
+	{
+		// Largest value the format holds: 511/512 * 2^16
+		constexpr float MaxValue = 65408.0f;
+
+		const float r = std::min(ClampPositive(color.x), MaxValue);
+		const float g = std::min(ClampPositive(color.y), MaxValue);
+		const float b = std::min(ClampPositive(color.z), MaxValue);
+		const float maxChannel = std::max({ r, g, b });
+
+		if (maxChannel < 1.0e-20f)
+		{
+			return 0;
+		}
+
+		// The exponent of the largest channel plus one, biased by 15, so that channel gets all 9 bits. Read from the
+		// bits of the float, which is floor(log2(maxChannel)).
+		int32_t exponent = std::max(-16, static_cast<int32_t>(FloatBits(maxChannel) >> 23) - 127) + 16;
+		float scale = BitsFloat(static_cast<uint32_t>(127 + 24 - exponent) << 23);
+
+		if (static_cast<uint32_t>(maxChannel * scale + 0.5f) == 512)
+		{
+			exponent++;
+			scale *= 0.5f;
+		}
+
+		const uint32_t rm = static_cast<uint32_t>(r * scale + 0.5f);
+		const uint32_t gm = static_cast<uint32_t>(g * scale + 0.5f);
+		const uint32_t bm = static_cast<uint32_t>(b * scale + 0.5f);
+
+		return rm | (gm << 9) | (bm << 18) | (static_cast<uint32_t>(exponent) << 27);
+	}
+
+	Float3 UnpackRGB9E5(uint32_t packed)
+	{
+		const float scale = BitsFloat((127u + (packed >> 27) - 24u) << 23);
+
+		return Float3((packed & 0x1FFu) * scale, ((packed >> 9) & 0x1FFu) * scale, ((packed >> 18) & 0x1FFu) * scale);
+	}
+
+	uint32_t GetMipCount(uint32_t width, uint32_t height)
+	{
+		uint32_t count = 1;
+
+		while (width > 1 || height > 1)
+		{
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+			count++;
+		}
+
+		return count;
+	}
+
+	void GenerateMip(const Image& source, Image& mip)
+	{
+		const uint32_t sourceWidth = source.GetWidth();
+		const uint32_t sourceHeight = source.GetHeight();
+		const uint32_t width = std::max(sourceWidth / 2, 1u);
+		const uint32_t height = std::max(sourceHeight / 2, 1u);
+
+		mip.Resize(width, height);
+
+		ThreadPool::Get().ParallelFor(height, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				const Vector4 quarter = Splat4(0.25f);
+
+				for (uint32_t y = static_cast<uint32_t>(begin); y < end; y++)
+				{
+					const uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+					const uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
+
+					const Float4* row0 = &source(0, y0);
+					const Float4* row1 = &source(0, y1);
+					Float4* target = &mip(0, y);
+
+					for (uint32_t x = 0; x < width; x++)
+					{
+						const uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+						const uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+
+						// A Float4 is exactly one Vector4
+						const Vector4 top = Add4(Load4(&row0[x0].x), Load4(&row0[x1].x));
+						const Vector4 bottom = Add4(Load4(&row1[x0].x), Load4(&row1[x1].x));
+
+						Store4(&target[x].x, Mul4(Add4(top, bottom), quarter));
+					}
+				}
+			});
+	}
+
+	void ConvertPixels(const Image& image, TextureFormat format, void* destination, uint64_t rowPitch)
+	{
+		if (IsBlockCompressed(format))
+		{
+			CompressImage(image, format, destination, rowPitch);
+			return;
+		}
+
+		const uint32_t width = image.GetWidth();
+
+		ThreadPool::Get().ParallelFor(image.GetHeight(), 1, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				for (uint32_t y = static_cast<uint32_t>(begin); y < end; y++)
+				{
+					const Float4* source = &image(0, y);
+					uint8_t* row = static_cast<uint8_t*>(destination) + y * rowPitch;
+
+					switch (format)
+					{
+					case TextureFormat::RGBA8:
+						for (uint32_t x = 0; x < width; x++)
+						{
+							row[x * 4 + 0] = static_cast<uint8_t>(Saturate(source[x].x) * 255.0f + 0.5f);
+							row[x * 4 + 1] = static_cast<uint8_t>(Saturate(source[x].y) * 255.0f + 0.5f);
+							row[x * 4 + 2] = static_cast<uint8_t>(Saturate(source[x].z) * 255.0f + 0.5f);
+							row[x * 4 + 3] = static_cast<uint8_t>(Saturate(source[x].w) * 255.0f + 0.5f);
+						}
+						break;
+
+					case TextureFormat::RGBA32F:
+						std::memcpy(row, source, width * sizeof(Float4));
+						break;
+
+					case TextureFormat::RGBA16F:
+						for (uint32_t x = 0; x < width; x++)
+						{
+							const uint16_t half[4] = { FloatToHalf(source[x].x), FloatToHalf(source[x].y), FloatToHalf(source[x].z), FloatToHalf(source[x].w) };
+							std::memcpy(row + x * sizeof(half), half, sizeof(half));
+						}
+						break;
+
+					case TextureFormat::R11G11B10F:
+						for (uint32_t x = 0; x < width; x++)
+						{
+							const uint32_t packed = PackR11G11B10(Float3(source[x].x, source[x].y, source[x].z));
+							std::memcpy(row + x * sizeof(packed), &packed, sizeof(packed));
+						}
+						break;
+
+					case TextureFormat::RGB9E5:
+						for (uint32_t x = 0; x < width; x++)
+						{
+							const uint32_t packed = PackRGB9E5(Float3(source[x].x, source[x].y, source[x].z));
+							std::memcpy(row + x * sizeof(packed), &packed, sizeof(packed));
+						}
+						break;
+
+					default:
+						break;
+					}
+				}
+			});
+	}
+}
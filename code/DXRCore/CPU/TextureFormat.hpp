@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Image.hpp"
+
+#include <cstdint>
+
+namespace cpu
+{
+	// Formats a texture can be stored in on the GPU. The float formats are meant for HDR data.
+	enum class TextureFormat : uint8_t
+	{
+		// 4 bytes, clamped to [0, 1]
+		RGBA8,
+
+		// 16 bytes, exact
+		RGBA32F,
+
+		// 8 bytes, 10 bits of mantissa per channel
+		RGBA16F,
+
+		// 4 bytes without alpha, 6 bits of mantissa for red and green and 5 for blue
+		R11G11B10F,
+
+		// 4 bytes without alpha, 9 bits of mantissa per channel with one shared exponent
+		RGB9E5,
+
+		// The block compressed formats store 4x4 pixels in 8 (BC1) or 16 bytes, see BlockCompression.hpp. BC1 is RGB
+		// at 0.5 bytes per pixel, BC7 RGBA at 1 byte and BC6H unsigned half RGB at 1 byte.
+		BC1,
+		BC7,
+		BC6H
+	};
+
+	bool IsBlockCompressed(TextureFormat format);
+
+	// Only for the formats that are not block compressed
+	uint32_t GetBytesPerPixel(TextureFormat format);
+	uint32_t GetBytesPerBlock(TextureFormat format);
+
+	// Bytes in one row of pixels, or in one row of blocks for the block compressed formats, and the number of those
+	// rows in an image of the size
+	uint64_t GetRowPitch(TextureFormat format, uint32_t width);
+	uint32_t GetRowCount(TextureFormat format, uint32_t height);
+
+	// Round to nearest even. Values too large for the format become the largest finite value, except in RGBA16F
+	// where they become infinity like in every other half conversion. The formats without sign clamp to 0.
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+	uint32_t PackR11G11B10(const Float3& color);
+	Float3 UnpackR11G11B10(uint32_t packed);
+
+	uint32_t PackRGB9E5(const Float3& color);
+	Float3 UnpackRGB9E5(uint32_t packed);
+
+	// Mip levels down to 1x1
+	uint32_t GetMipCount(uint32_t width, uint32_t height);
+
+	// Halves the image in both directions with a 2x2 box filter, four channels at the time and one row per thread.
+	// The last row or column of an odd size is averaged with itself.
+	void GenerateMip(const Image& source, Image& mip);
+
+	// Converts every pixel of the image into the format, one row per thread. Rows are rowPitch bytes apart. The block
+	// compressed formats go through CompressImage.
+	void ConvertPixels(const Image& image, TextureFormat format, void* destination, uint64_t rowPitch);
+}
@@ -0,0 +1,146 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace cpu
+{
+	namespace
+	{
+		// The pool whose job the thread runs chunks of, and the index of the thread in that job
+		thread_local const ThreadPool* t_JobPool = nullptr;
+		thread_local uint32_t t_JobThreadIndex = 0;
+	}
+
+	ThreadPool& ThreadPool::Get()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// The calling thread is one of the threads
+		for (uint32_t i = 1; i < threadCount; i++)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerMain, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Exit = true;
+		}
+
+		m_WakeCondition.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint64_t count, uint64_t grainSize, const std::function<void(uint64_t, uint64_t, uint32_t)>& func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		grainSize = std::max<uint64_t>(grainSize, 1);
+
+		// Called from a chunk of a job of this pool, which holds m_JobMutex or is waited for by the thread that does.
+		// Waiting for the workers would deadlock, so the chunks run here.
+		if (t_JobPool == this)
+		{
+			for (uint64_t begin = 0; begin < count; begin += grainSize)
+			{
+				func(begin, std::min(begin + grainSize, count), t_JobThreadIndex);
+			}
+
+			return;
+		}
+
+		// Small jobs are not worth waking the workers for
+		if (m_Workers.empty() || count <= grainSize)
+		{
+			func(0, count, 0);
+			return;
+		}
+
+		std::lock_guard<std::mutex> jobLock(m_JobMutex);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Job = &func;
+			m_JobCount = count;
+			m_JobGrain = grainSize;
+			m_NextChunk = 0;
+			m_ActiveWorkers = static_cast<uint32_t>(m_Workers.size());
+			m_Generation++;
+		}
+
+		m_WakeCondition.notify_all();
+
+		RunChunks(0);
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+		m_Job = nullptr;
+	}
+
+	void ThreadPool::WorkerMain(uint32_t threadIndex)
+	{
+		uint64_t generation = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeCondition.wait(lock, [&]() { return m_Exit || m_Generation != generation; });
+
+				if (m_Exit)
+				{
+					return;
+				}
+
+				generation = m_Generation;
+			}
+
+			RunChunks(threadIndex);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_ActiveWorkers--;
+			}
+
+			m_DoneCondition.notify_one();
+		}
+	}
+
+	void ThreadPool::RunChunks(uint32_t threadIndex)
+	{
+		t_JobPool = this;
+		t_JobThreadIndex = threadIndex;
+
+		while (true)
+		{
+			const uint64_t begin = m_NextChunk.fetch_add(m_JobGrain);
+
+			if (begin >= m_JobCount)
+			{
+				break;
+			}
+
+			(*m_Job)(begin, std::min(begin + m_JobGrain, m_JobCount), threadIndex);
+		}
+
+		t_JobPool = nullptr;
+	}
+}
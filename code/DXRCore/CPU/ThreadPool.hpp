@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu
+{
+	// A fixed set of worker threads that execute parallel-for style jobs. The calling thread joins in on the work,
+	// so a pool created with N threads keeps N cores busy.
+	class ThreadPool
+	{
+	public:
+		// The global pool used by the CPU backend. It is sized to the number of hardware threads.
+		static ThreadPool& Get();
+
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Runs func(begin, end, threadIndex) over [0, count) in chunks of grainSize and blocks until all chunks are done.
+		// func may call ParallelFor itself. The nested range then runs on the thread that calls it, with its index, as
+		// the other threads are busy with the outer job.
+		void ParallelFor(uint64_t count, uint64_t grainSize, const std::function<void(uint64_t, uint64_t, uint32_t)>& func);
+
+		uint32_t GetThreadCount() const
+		{
+			return static_cast<uint32_t>(m_Workers.size()) + 1;
+		}
+
+	private:
+		void WorkerMain(uint32_t threadIndex);
+		void RunChunks(uint32_t threadIndex);
+
+		std::vector<std::thread> m_Workers;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_WakeCondition;
+		std::condition_variable m_DoneCondition;
+
+		// Current job. Only one job runs at the time, ParallelFor serializes callers with m_JobMutex.
+		std::mutex m_JobMutex;
+		const std::function<void(uint64_t, uint64_t, uint32_t)>* m_Job = nullptr;
+		uint64_t m_JobCount = 0;
+		uint64_t m_JobGrain = 1;
+		std::atomic<uint64_t> m_NextChunk{ 0 };
+		uint32_t m_ActiveWorkers = 0;
+		uint64_t m_Generation = 0;
+
+		bool m_Exit = false;
+	};
+}
@@ -0,0 +1,192 @@
+#include "TileScheduler.hpp"
+#include "Random.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace cpu
+{
+	namespace
+	{
+		inline uint64_t PackRange(uint32_t begin, uint32_t end)
+		{
+			return static_cast<uint64_t>(end) << 32 | begin;
+		}
+
+		inline uint32_t RangeBegin(uint64_t range)
+		{
+			return static_cast<uint32_t>(range);
+		}
+
+		inline uint32_t RangeEnd(uint64_t range)
+		{
+			return static_cast<uint32_t>(range >> 32);
+		}
+
+		inline double Seconds(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+		{
+			return std::chrono::duration<double>(end - start).count();
+		}
+	}
+
+	TileScheduler::TileScheduler(ThreadPool& threadPool, uint32_t tileSize)
+		: m_ThreadPool(threadPool)
+		, m_TileSize(std::max(tileSize, 1u))
+	{
+	}
+
+	void TileScheduler::SetTileSize(uint32_t tileSize)
+	{
+		m_TileSize = std::max(tileSize, 1u);
+	}
+
+	void TileScheduler::Dispatch(uint32_t width, uint32_t height, const Kernel& kernel)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		const uint32_t threadCount = m_ThreadPool.GetThreadCount();
+
+		m_Width = width;
+		m_Height = height;
+		m_TilesX = (width + m_TileSize - 1) / m_TileSize;
+
+		const uint32_t tileCount = m_TilesX * ((height + m_TileSize - 1) / m_TileSize);
+
+		m_Statistics.TileCount = tileCount;
+		m_Statistics.Threads.assign(threadCount, {});
+
+		if (tileCount == 0)
+		{
+			m_Statistics.Time = 0.0;
+			return;
+		}
+
+		if (m_QueueCount != threadCount)
+		{
+			m_Queues = std::make_unique<TileQueue[]>(threadCount);
+			m_QueueCount = threadCount;
+		}
+
+		// Neighbouring tiles go to the same thread, so a thread that does not steal works through one area of the image
+		for (uint32_t i = 0; i < threadCount; i++)
+		{
+			const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * i / threadCount);
+			const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * (i + 1) / threadCount);
+
+			m_Queues[i].Range.store(PackRange(begin, end), std::memory_order_relaxed);
+		}
+
+		// One job per thread. A thread that wakes up late finds its queue stolen and helps with what is left.
+		m_ThreadPool.ParallelFor(threadCount, 1, [&](uint64_t, uint64_t, uint32_t threadIndex)
+			{
+				RunThread(threadIndex, kernel);
+			});
+
+		m_Statistics.Time = Seconds(start, std::chrono::steady_clock::now());
+
+		for (DispatchThreadStatistics& thread : m_Statistics.Threads)
+		{
+			thread.IdleTime = std::max(m_Statistics.Time - thread.BusyTime, 0.0);
+		}
+	}
+
+	void TileScheduler::RunThread(uint32_t threadIndex, const Kernel& kernel)
+	{
+		Random random(threadIndex, 0x7113);
+
+		double busyTime = 0.0;
+		uint32_t tileCount = 0;
+		uint32_t stealCount = 0;
+
+		while (true)
+		{
+			uint32_t tileIndex;
+
+			while (PopTile(threadIndex, tileIndex))
+			{
+				const auto start = std::chrono::steady_clock::now();
+				kernel(GetTile(tileIndex), threadIndex);
+				busyTime += Seconds(start, std::chrono::steady_clock::now());
+
+				tileCount++;
+			}
+
+			if (!Steal(threadIndex, random))
+			{
+				break;
+			}
+
+			stealCount++;
+		}
+
+		// Written once at the end, the entries of the threads share cache lines
+		DispatchThreadStatistics& statistics = m_Statistics.Threads[threadIndex];
+		statistics.BusyTime += busyTime;
+		statistics.TileCount += tileCount;
+		statistics.StealCount += stealCount;
+	}
+
+	bool TileScheduler::PopTile(uint32_t threadIndex, uint32_t& tileIndex)
+	{
+		std::atomic<uint64_t>& queue = m_Queues[threadIndex].Range;
+		uint64_t range = queue.load(std::memory_order_acquire);
+
+		while (RangeBegin(range) < RangeEnd(range))
+		{
+			if (queue.compare_exchange_weak(range, PackRange(RangeBegin(range) + 1, RangeEnd(range)), std::memory_order_acq_rel))
+			{
+				tileIndex = RangeBegin(range);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool TileScheduler::Steal(uint32_t threadIndex, Random& random)
+	{
+		// Starting at a random victim keeps the thieves from all going after the same thread
+		const uint32_t first = random.Next() % m_QueueCount;
+
+		for (uint32_t i = 0; i < m_QueueCount; i++)
+		{
+			const uint32_t victim = (first + i) % m_QueueCount;
+
+			if (victim == threadIndex)
+			{
+				continue;
+			}
+
+			std::atomic<uint64_t>& queue = m_Queues[victim].Range;
+			uint64_t range = queue.load(std::memory_order_acquire);
+
+			while (RangeBegin(range) < RangeEnd(range))
+			{
+				const uint32_t begin = RangeBegin(range);
+				const uint32_t end = RangeEnd(range);
+				const uint32_t split = end - (end - begin + 1) / 2;
+
+				if (queue.compare_exchange_weak(range, PackRange(begin, split), std::memory_order_acq_rel))
+				{
+					// Nobody else writes to an empty queue, only its owner refills it
+					m_Queues[threadIndex].Range.store(PackRange(split, end), std::memory_order_release);
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	Tile TileScheduler::GetTile(uint32_t tileIndex) const
+	{
+		Tile tile;
+		tile.X = (tileIndex % m_TilesX) * m_TileSize;
+		tile.Y = (tileIndex / m_TilesX) * m_TileSize;
+		tile.Width = std::min(m_TileSize, m_Width - tile.X);
+		tile.Height = std::min(m_TileSize, m_Height - tile.Y);
+
+		return tile;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace cpu
+{
+	class Random;
+	class ThreadPool;
+
+	// Rectangle of pixels handed to a dispatch kernel. Tiles at the right and bottom edge can be smaller than the tile size.
+	struct Tile
+	{
+		uint32_t X;
+		uint32_t Y;
+		uint32_t Width;
+		uint32_t Height;
+	};
+
+	struct DispatchThreadStatistics
+	{
+		// Time spent in the kernel
+		double BusyTime = 0.0;
+
+		// Rest of the dispatch: waking up, looking for work and waiting for the other threads to finish
+		double IdleTime = 0.0;
+
+		uint32_t TileCount = 0;
+		uint32_t StealCount = 0;
+	};
+
+	struct DispatchStatistics
+	{
+		double Time = 0.0;
+		uint32_t TileCount = 0;
+
+		std::vector<DispatchThreadStatistics> Threads;
+	};
+
+	// Runs a kernel over a 2D grid in tiles, the CPU version of DispatchRays. Every thread starts with its own
+	// contiguous block of tiles and takes them from the front. A thread that runs out steals the back half of the
+	// block of another thread, so the load stays balanced when some tiles cost many times more than others.
+	class TileScheduler
+	{
+	public:
+		using Kernel = std::function<void(const Tile& tile, uint32_t threadIndex)>;
+
+		// 16x16 pixels of Float4 is 4 KB of output, which leaves most of the L1 cache for the traversal
+		static constexpr uint32_t DefaultTileSize = 16;
+
+		explicit TileScheduler(ThreadPool& threadPool, uint32_t tileSize = DefaultTileSize);
+
+		// Calls kernel once per tile of the width x height grid and blocks until all tiles are done. The thread index
+		// is below ThreadPool::GetThreadCount(), so it can index per thread data.
+		void Dispatch(uint32_t width, uint32_t height, const Kernel& kernel);
+
+		void SetTileSize(uint32_t tileSize);
+
+		uint32_t GetTileSize() const
+		{
+			return m_TileSize;
+		}
+
+		// Timings of the last dispatch
+		const DispatchStatistics& GetStatistics() const
+		{
+			return m_Statistics;
+		}
+
+	private:
+		// The tiles of a dispatch never change, so a deque is a range of tile indices. Begin and end are packed in one
+		// 64-bit value, which lets the owner and the thieves update it with a single compare and swap.
+		struct alignas(64) TileQueue
+		{
+			std::atomic<uint64_t> Range{ 0 };
+		};
+
+		void RunThread(uint32_t threadIndex, const Kernel& kernel);
+
+		// Takes the next tile from the front of the queue of the thread
+		bool PopTile(uint32_t threadIndex, uint32_t& tileIndex);
+
+		// Moves the back half of the queue of another thread into the (empty) queue of this thread
+		bool Steal(uint32_t threadIndex, Random& random);
+
+		Tile GetTile(uint32_t tileIndex) const;
+
+		ThreadPool& m_ThreadPool;
+		uint32_t m_TileSize;
+
+		std::unique_ptr<TileQueue[]> m_Queues;
+		uint32_t m_QueueCount = 0;
+
+		// Grid of the current dispatch
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+		uint32_t m_TilesX = 0;
+
+		DispatchStatistics m_Statistics;
+	};
+}
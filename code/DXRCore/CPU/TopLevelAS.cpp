@@ -0,0 +1,153 @@
+#include "TopLevelAS.hpp"
+#include "ThreadPool.hpp"
+
+namespace cpu
+{
+	void TopLevelAS::Build(const InstanceDesc* instances, uint32_t count)
+	{
+		SetInstances(instances, count);
+		BuildHierarchy();
+	}
+
+	void TopLevelAS::BuildHierarchy()
+	{
+		BVH bvh;
+		bvh.Build(m_WorldBounds.data(), static_cast<uint32_t>(m_WorldBounds.size()));
+
+		m_BVH.Build(bvh);
+
+		if (m_AllowUpdate)
+		{
+			m_BinaryBVH = std::move(bvh);
+		}
+		else
+		{
+			m_BinaryBVH = BVH();
+		}
+	}
+
+	bool TopLevelAS::Update(const InstanceDesc* instances, uint32_t count)
+	{
+		if (!m_AllowUpdate || count != m_Instances.size() || m_BinaryBVH.GetNodes().empty())
+		{
+			Build(instances, count);
+			return true;
+		}
+
+		SetInstances(instances, count);
+
+		m_BinaryBVH.Refit(m_WorldBounds.data());
+
+		if (m_BinaryBVH.ComputeSAHCost() > m_BinaryBVH.GetStatistics().SAHCost * m_RebuildThreshold)
+		{
+			BuildHierarchy();
+			return true;
+		}
+
+		m_BVH.Build(m_BinaryBVH);
+		return false;
+	}
+
+	void TopLevelAS::SetInstances(const InstanceDesc* instances, uint32_t count)
+	{
+		m_Instances.resize(count);
+		m_WorldBounds.resize(count);
+
+		// The inverse transforms are the bulk of the work with many instances
+		ThreadPool::Get().ParallelFor(count, 4 * 1024, [&](uint64_t begin, uint64_t end, uint32_t)
+			{
+				for (uint64_t i = begin; i < end; i++)
+				{
+					Instance& instance = m_Instances[i];
+					instance.Desc = instances[i];
+					instance.WorldToObject = instances[i].Transform.Inverse();
+
+					m_WorldBounds[i] = instances[i].Transform.TransformBounds(instances[i].AccelerationStructure->GetBounds());
+				}
+			});
+
+		m_Bounds = AABB();
+
+		for (const AABB& bounds : m_WorldBounds)
+		{
+			m_Bounds.Grow(bounds);
+		}
+	}
+
+	Ray TopLevelAS::ToObjectSpace(const Instance& instance, const Ray& ray)
+	{
+		// The direction is not normalized, so t values in object space are the same as in world space
+		Ray objectRay = ray;
+		objectRay.Origin = instance.WorldToObject.TransformPoint(ray.Origin);
+		objectRay.Direction = instance.WorldToObject.TransformVector(ray.Direction);
+
+		return objectRay;
+	}
+
+	uint32_t TopLevelAS::GetInstanceRayFlags(const Instance& instance, uint32_t flags)
+	{
+		constexpr uint32_t cullFlags = RayFlagCullBackFacingTriangles | RayFlagCullFrontFacingTriangles;
+
+		if (instance.Desc.Flags & InstanceFlagTriangleCullDisable)
+		{
+			return flags & ~cullFlags;
+		}
+
+		// Front and back swap places when the instance winds its front faces the other way
+		const uint32_t cull = flags & cullFlags;
+
+		if ((instance.Desc.Flags & InstanceFlagTriangleFrontCounterClockwise) && (cull == RayFlagCullBackFacingTriangles || cull == RayFlagCullFrontFacingTriangles))
+		{
+			return flags ^ cullFlags;
+		}
+
+		return flags;
+	}
+
+	bool TopLevelAS::Intersect(Ray& ray, Hit& hit, uint32_t flags, uint32_t instanceInclusionMask, uint32_t rayContributionToHitGroupIndex) const
+	{
+		bool found = false;
+
+		m_BVH.Intersect(ray, [&](uint32_t instanceIndex, Ray& r)
+			{
+				const Instance& instance = m_Instances[instanceIndex];
+
+				if ((instance.Desc.InstanceMask & instanceInclusionMask) == 0)
+				{
+					return;
+				}
+
+				Ray objectRay = ToObjectSpace(instance, r);
+
+				if (instance.Desc.AccelerationStructure->Intersect(objectRay, hit, GetInstanceRayFlags(instance, flags)))
+				{
+					r.TMax = objectRay.TMax;
+
+					hit.InstanceIndex = instanceIndex;
+					hit.InstanceID = instance.Desc.InstanceID;
+
+					// Every BLAS has a single geometry, so the geometry contribution is always 0
+					hit.HitGroupIndex = rayContributionToHitGroupIndex + instance.Desc.InstanceContributionToHitGroupIndex;
+
+					found = true;
+				}
+			});
+
+		return found;
+	}
+
+	bool TopLevelAS::Occluded(const Ray& ray, uint32_t flags, uint32_t instanceInclusionMask) const
+	{
+		return m_BVH.Occluded(ray, [&](uint32_t instanceIndex, const Ray& r)
+			{
+				const Instance& instance = m_Instances[instanceIndex];
+
+				if ((instance.Desc.InstanceMask & instanceInclusionMask) == 0)
+				{
+					return false;
+				}
+
+				return instance.Desc.AccelerationStructure->Occluded(ToObjectSpace(instance, r), GetInstanceRayFlags(instance, flags));
+			});
+	}
+}
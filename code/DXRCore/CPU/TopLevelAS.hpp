@@ -0,0 +1,118 @@
+#pragma once
+
+#include "BottomLevelAS.hpp"
+#include "BVH8.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	// Same values as D3D12_RAYTRACING_INSTANCE_FLAGS
+	enum InstanceFlags : uint32_t
+	{
+		InstanceFlagNone = 0x0,
+		InstanceFlagTriangleCullDisable = 0x1,
+		InstanceFlagTriangleFrontCounterClockwise = 0x2,
+		InstanceFlagForceOpaque = 0x4,
+		InstanceFlagForceNonOpaque = 0x8
+	};
+
+	// Mirrors D3D12_RAYTRACING_INSTANCE_DESC, with a pointer to the CPU acceleration structure instead of a GPU address
+	struct InstanceDesc
+	{
+		Transform3x4 Transform;
+		uint32_t InstanceID : 24;
+		uint32_t InstanceMask : 8;
+		uint32_t InstanceContributionToHitGroupIndex : 24;
+		uint32_t Flags : 8;
+		const BottomLevelAS* AccelerationStructure;
+	};
+
+	// CPU counterpart of a top level acceleration structure. It is a BVH over the world space bounds of the instances,
+	// the instances only point to their bottom level structure, so many instances can share one.
+	class TopLevelAS
+	{
+	public:
+		// Keeps the binary hierarchy over the instances after the next Build, so Update can refit it
+		void SetAllowUpdate(bool allowUpdate)
+		{
+			m_AllowUpdate = allowUpdate;
+		}
+
+		// Update rebuilds once the SAH cost of the refitted hierarchy is more than this many times the cost after the
+		// last build
+		void SetRebuildThreshold(float threshold)
+		{
+			m_RebuildThreshold = threshold;
+		}
+
+		void Build(const InstanceDesc* instances, uint32_t count);
+
+		// Takes the new transforms and bottom level structures of the same instances as the last Build, and refits the
+		// hierarchy to them. Rebuilds when updates are not allowed, the instance count changed, or the refit went over
+		// the rebuild threshold. Returns true when it rebuilt.
+		bool Update(const InstanceDesc* instances, uint32_t count);
+
+		// World space closest hit query, with the same arguments as TraceRay. The ray is transformed into object space
+		// once per instance that it reaches. The hit's InstanceIndex is the index into the instance array
+		// (InstanceIndex() in HLSL) and its HitGroupIndex is the hit group record that the GPU would run.
+		bool Intersect(Ray& ray, Hit& hit, uint32_t flags, uint32_t instanceInclusionMask = 0xFF, uint32_t rayContributionToHitGroupIndex = 0) const;
+
+		// World space any hit query
+		bool Occluded(const Ray& ray, uint32_t flags, uint32_t instanceInclusionMask = 0xFF) const;
+
+		const InstanceDesc& GetInstance(uint32_t instanceIndex) const
+		{
+			return m_Instances[instanceIndex].Desc;
+		}
+
+		const Transform3x4& GetWorldToObject(uint32_t instanceIndex) const
+		{
+			return m_Instances[instanceIndex].WorldToObject;
+		}
+
+		uint32_t GetInstanceCount() const
+		{
+			return static_cast<uint32_t>(m_Instances.size());
+		}
+
+		AABB GetBounds() const
+		{
+			return m_Bounds;
+		}
+
+		size_t GetMemory() const
+		{
+			return m_Instances.size() * sizeof(Instance) + m_BVH.GetNodeMemory() + m_BinaryBVH.GetNodes().size() * sizeof(BVHNode);
+		}
+
+	private:
+		struct Instance
+		{
+			InstanceDesc Desc;
+			Transform3x4 WorldToObject;
+		};
+
+		// Brings a world space ray into the space of an instance
+		static Ray ToObjectSpace(const Instance& instance, const Ray& ray);
+
+		// Applies the triangle facing flags of an instance to the ray flags
+		static uint32_t GetInstanceRayFlags(const Instance& instance, uint32_t flags);
+
+		// Copies the instances and computes their world space bounds
+		void SetInstances(const InstanceDesc* instances, uint32_t count);
+		void BuildHierarchy();
+
+		std::vector<Instance> m_Instances;
+		std::vector<AABB> m_WorldBounds;
+
+		BVH8 m_BVH;
+		AABB m_Bounds;
+
+		bool m_AllowUpdate = false;
+		float m_RebuildThreshold = 1.5f;
+
+		// Only kept when updates are allowed
+		BVH m_BinaryBVH;
+	};
+}
@@ -0,0 +1,329 @@
+#include "Backend.hpp"
+#include "ThreadPool.hpp"
+#include "Wavefront.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace cpu
+{
+	namespace
+	{
+		// Paths that go through the stages together. Large enough to keep every thread busy in every stage, small enough
+		// that the queues stay in the last level cache of most machines.
+		constexpr uint32_t BatchSize = 64 * 1024;
+
+		// Rays per chunk of a stage, and per chunk of a compaction
+		constexpr uint32_t StageGrainSize = 1024;
+		constexpr uint32_t CompactChunkSize = 4096;
+
+		// Calls write(i, slot) for every i < count for which keep(i) is true, with the slots packed densely in the order
+		// of i. Every chunk counts its survivors in parallel, a prefix sum gives the first slot of every chunk, and the
+		// chunks then write in parallel.
+		template<typename Keep, typename Write>
+		uint32_t Compact(ThreadPool& threadPool, uint32_t count, Keep&& keep, Write&& write)
+		{
+			const uint32_t chunkCount = (count + CompactChunkSize - 1) / CompactChunkSize;
+			std::vector<uint32_t> offsets(chunkCount + 1, 0);
+
+			threadPool.ParallelFor(chunkCount, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint64_t chunk = begin; chunk < end; chunk++)
+					{
+						const uint32_t first = static_cast<uint32_t>(chunk) * CompactChunkSize;
+						const uint32_t last = std::min(first + CompactChunkSize, count);
+
+						uint32_t survivors = 0;
+
+						for (uint32_t i = first; i < last; i++)
+						{
+							survivors += keep(i) ? 1 : 0;
+						}
+
+						offsets[chunk + 1] = survivors;
+					}
+				});
+
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				offsets[chunk + 1] += offsets[chunk];
+			}
+
+			threadPool.ParallelFor(chunkCount, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint64_t chunk = begin; chunk < end; chunk++)
+					{
+						const uint32_t first = static_cast<uint32_t>(chunk) * CompactChunkSize;
+						const uint32_t last = std::min(first + CompactChunkSize, count);
+
+						uint32_t slot = offsets[chunk];
+
+						for (uint32_t i = first; i < last; i++)
+						{
+							if (keep(i))
+							{
+								write(i, slot++);
+							}
+						}
+					}
+				});
+
+			return offsets[chunkCount];
+		}
+	}
+
+	void RayQueue::Resize(uint32_t capacity)
+	{
+		OriginX.resize(capacity);
+		OriginY.resize(capacity);
+		OriginZ.resize(capacity);
+
+		DirectionX.resize(capacity);
+		DirectionY.resize(capacity);
+		DirectionZ.resize(capacity);
+
+		TMin.resize(capacity);
+		TMax.resize(capacity);
+
+		Index.resize(capacity);
+
+		Count = 0;
+	}
+
+	void WavefrontQueues::Resize(uint32_t pathCount)
+	{
+		Weight.resize(pathCount);
+		Radiance.resize(pathCount);
+
+		Extension.Resize(pathCount);
+		Next.Resize(pathCount);
+		// The shadow rays towards the light come first, then those towards the sky
+		Shadow.Resize(pathCount * 2);
+
+		Hits.resize(pathCount);
+		Direct.resize(pathCount);
+		SkyDirect.resize(pathCount);
+		SkyDirection.resize(pathCount);
+		NextWeight.resize(pathCount);
+		Flags.resize(pathCount);
+	}
+
+	// Produces the same image as the recursive renderer. The radiance of TraceRadiance is unrolled into a sum over the
+	// bounces: every hit adds its ambient and, when its shadow ray reaches the light, its direct light, both scaled by
+	// the weight of the path so far. A shadowed hit also ends the path, as the recursive version multiplies the
+	// reflection by the shadow.
+	void Backend::RenderWavefront(const FrameDesc& frame, uint64_t& rayCount)
+	{
+		const Scene& scene = *frame.Scene;
+		WavefrontQueues& queues = m_Wavefront;
+
+		const uint32_t width = m_Frame.GetWidth();
+		const uint32_t pixelCount = width * m_Frame.GetHeight();
+		const uint32_t batchSize = std::min(pixelCount, BatchSize);
+
+		queues.Resize(batchSize);
+
+		for (uint32_t batchStart = 0; batchStart < pixelCount; batchStart += batchSize)
+		{
+			const uint32_t pathCount = std::min(batchSize, pixelCount - batchStart);
+
+			// Generation: one primary ray per pixel, in scanline order
+			m_ThreadPool.ParallelFor(pathCount, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint32_t path = static_cast<uint32_t>(begin); path < end; path++)
+					{
+						const uint32_t pixel = batchStart + path;
+
+						queues.Extension.SetRay(path, GetPrimaryRay(frame, pixel % width, pixel / width), path);
+						queues.Weight[path] = Float3(1.0f);
+						queues.Radiance[path] = Float3(0.0f);
+					}
+				});
+
+			queues.Extension.Count = pathCount;
+
+			for (uint32_t depth = 0; queues.Extension.Count > 0; depth++)
+			{
+				const uint32_t rayCountInQueue = queues.Extension.Count;
+				rayCount += rayCountInQueue;
+
+				// Extension: the closest hit of every ray in the queue
+				m_ThreadPool.ParallelFor(rayCountInQueue, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+					{
+						for (uint32_t i = static_cast<uint32_t>(begin); i < end; i++)
+						{
+							Ray ray = queues.Extension.GetRay(i);
+
+							queues.Hits[i] = Hit();
+							scene.TLAS.Intersect(ray, queues.Hits[i], RayFlagCullBackFacingTriangles);
+						}
+					});
+
+				// Shading: ends the paths that missed or hit a procedural primitive, and prepares the direct light and the
+				// reflection ray of every other hit
+				m_ThreadPool.ParallelFor(rayCountInQueue, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+					{
+						for (uint32_t i = static_cast<uint32_t>(begin); i < end; i++)
+						{
+							const uint32_t path = queues.Extension.Index[i];
+							const Ray ray = queues.Extension.GetRay(i);
+							const Hit& hit = queues.Hits[i];
+							const Float3 weight = queues.Weight[path];
+
+							Float3 pathRadiance;
+							if (EndsPath(frame, ray, hit.IsValid() ? &hit : nullptr, depth, pathRadiance))
+							{
+								queues.Radiance[path] += weight * pathRadiance;
+								queues.Flags[i] = 0;
+								continue;
+							}
+
+							const SurfaceHit surface = GetSurfaceHit(frame, ray, hit);
+
+							queues.Direct[i] = weight * (surface.Color * GetDirectLight(frame, surface.Normal) * frame.Diffuse);
+
+							uint8_t flags = WavefrontQueues::ShadeFlagLit;
+
+							if (frame.SkyLight == nullptr)
+							{
+								queues.Radiance[path] += weight * surface.Color * frame.Ambient;
+							}
+							else
+							{
+								Float3 light;
+								Ray skyRay;
+
+								if (GetSkyLight(frame, surface, batchStart + path, depth, light, skyRay))
+								{
+									queues.SkyDirect[i] = weight * light;
+									queues.SkyDirection[i] = skyRay.Direction;
+									flags |= WavefrontQueues::ShadeFlagSky;
+								}
+							}
+
+							if (!frame.Shadows)
+							{
+								flags |= WavefrontQueues::ShadeFlagVisible;
+							}
+
+							if (surface.Reflectance > 0.001f)
+							{
+								queues.NextWeight[i] = weight * GetReflectionWeight(ray, surface);
+								queues.Next.SetRay(i, GetReflectionRay(ray, surface), path);
+								flags |= WavefrontQueues::ShadeFlagReflect;
+							}
+
+							queues.Flags[i] = flags;
+						}
+					});
+
+				// Shadow: one occlusion ray per shaded hit, and one per hit lit by the sky, gathered into a dense queue first
+				if (frame.Shadows)
+				{
+					const uint32_t lightRayCount = Compact(m_ThreadPool, rayCountInQueue,
+						[&](uint32_t i)
+						{
+							return (queues.Flags[i] & WavefrontQueues::ShadeFlagLit) != 0;
+						},
+						[&](uint32_t i, uint32_t slot)
+						{
+							const Float3 position = Float3(queues.Extension.OriginX[i], queues.Extension.OriginY[i], queues.Extension.OriginZ[i]) +
+								Float3(queues.Extension.DirectionX[i], queues.Extension.DirectionY[i], queues.Extension.DirectionZ[i]) * queues.Hits[i].T;
+
+							queues.Shadow.SetRay(slot, GetShadowRay(frame, position), i);
+						});
+
+					const uint32_t skyRayCount = Compact(m_ThreadPool, rayCountInQueue,
+						[&](uint32_t i)
+						{
+							return (queues.Flags[i] & WavefrontQueues::ShadeFlagSky) != 0;
+						},
+						[&](uint32_t i, uint32_t slot)
+						{
+							Ray skyRay;
+							skyRay.Origin = Float3(queues.Extension.OriginX[i], queues.Extension.OriginY[i], queues.Extension.OriginZ[i]) +
+								Float3(queues.Extension.DirectionX[i], queues.Extension.DirectionY[i], queues.Extension.DirectionZ[i]) * queues.Hits[i].T;
+							skyRay.Direction = queues.SkyDirection[i];
+							skyRay.TMin = 0.01f;
+							skyRay.TMax = 1000.0f;
+
+							queues.Shadow.SetRay(lightRayCount + slot, skyRay, i);
+						});
+
+					queues.Shadow.Count = lightRayCount + skyRayCount;
+					rayCount += queues.Shadow.Count;
+
+					// A hit can have both kinds of shadow ray, so they write to different arrays
+					m_ThreadPool.ParallelFor(queues.Shadow.Count, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+						{
+							for (uint32_t i = static_cast<uint32_t>(begin); i < end; i++)
+							{
+								const bool occluded = scene.TLAS.Occluded(queues.Shadow.GetRay(i), frame.ShadowRayFlags);
+
+								if (i >= lightRayCount)
+								{
+									queues.SkyDirect[queues.Shadow.Index[i]] = occluded ? Float3(0.0f) : queues.SkyDirect[queues.Shadow.Index[i]];
+								}
+								else if (!occluded)
+								{
+									queues.Flags[queues.Shadow.Index[i]] |= WavefrontQueues::ShadeFlagVisible;
+								}
+							}
+						});
+				}
+
+				// Connection: hits add the light of the sky, lit hits add their direct light, and pass their weight on to
+				// their reflection ray
+				m_ThreadPool.ParallelFor(rayCountInQueue, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+					{
+						for (uint32_t i = static_cast<uint32_t>(begin); i < end; i++)
+						{
+							const uint8_t flags = queues.Flags[i];
+							const uint32_t path = queues.Extension.Index[i];
+
+							if (flags & WavefrontQueues::ShadeFlagSky)
+							{
+								queues.Radiance[path] += queues.SkyDirect[i];
+							}
+
+							if ((flags & WavefrontQueues::ShadeFlagVisible) == 0)
+							{
+								continue;
+							}
+
+							queues.Radiance[path] += queues.Direct[i];
+
+							if (flags & WavefrontQueues::ShadeFlagReflect)
+							{
+								queues.Weight[path] = queues.NextWeight[i];
+							}
+						}
+					});
+
+				// The reflection rays of the lit hits make up the extension queue of the next bounce
+				constexpr uint8_t continueFlags = WavefrontQueues::ShadeFlagVisible | WavefrontQueues::ShadeFlagReflect;
+
+				queues.Extension.Count = Compact(m_ThreadPool, rayCountInQueue,
+					[&](uint32_t i)
+					{
+						return (queues.Flags[i] & continueFlags) == continueFlags;
+					},
+					[&](uint32_t i, uint32_t slot)
+					{
+						queues.Extension.SetRay(slot, queues.Next.GetRay(i), queues.Next.Index[i]);
+					});
+			}
+
+			m_ThreadPool.ParallelFor(pathCount, StageGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+				{
+					for (uint32_t path = static_cast<uint32_t>(begin); path < end; path++)
+					{
+						const uint32_t pixel = batchStart + path;
+						const Float3& radiance = queues.Radiance[path];
+
+						m_Frame(pixel % width, pixel / width) = { radiance.x, radiance.y, radiance.z, 1.0f };
+					}
+				});
+		}
+	}
+}
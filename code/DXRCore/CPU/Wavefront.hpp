@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Math.hpp"
+
+#include <vector>
+
+namespace cpu
+{
+	// Rays in structure of arrays layout. Index is the path (extension rays) or the extension ray (shadow rays) that the
+	// ray belongs to.
+	struct RayQueue
+	{
+		std::vector<float> OriginX;
+		std::vector<float> OriginY;
+		std::vector<float> OriginZ;
+
+		std::vector<float> DirectionX;
+		std::vector<float> DirectionY;
+		std::vector<float> DirectionZ;
+
+		std::vector<float> TMin;
+		std::vector<float> TMax;
+
+		std::vector<uint32_t> Index;
+
+		uint32_t Count = 0;
+
+		void Resize(uint32_t capacity);
+
+		Ray GetRay(uint32_t i) const
+		{
+			Ray ray;
+			ray.Origin = Float3(OriginX[i], OriginY[i], OriginZ[i]);
+			ray.Direction = Float3(DirectionX[i], DirectionY[i], DirectionZ[i]);
+			ray.TMin = TMin[i];
+			ray.TMax = TMax[i];
+
+			return ray;
+		}
+
+		void SetRay(uint32_t i, const Ray& ray, uint32_t index)
+		{
+			OriginX[i] = ray.Origin.x;
+			OriginY[i] = ray.Origin.y;
+			OriginZ[i] = ray.Origin.z;
+
+			DirectionX[i] = ray.Direction.x;
+			DirectionY[i] = ray.Direction.y;
+			DirectionZ[i] = ray.Direction.z;
+
+			TMin[i] = ray.TMin;
+			TMax[i] = ray.TMax;
+
+			Index[i] = index;
+		}
+	};
+
+	// Everything the stages of the wavefront renderer hand to each other. Paths are one per pixel of the current batch,
+	// the other arrays have one entry per ray of the extension queue.
+	struct WavefrontQueues
+	{
+		enum ShadeFlags : uint8_t
+		{
+			// The hit was shaded and waits for its shadow ray
+			ShadeFlagLit = 0x1,
+
+			// The shadow ray reached the light
+			ShadeFlagVisible = 0x2,
+
+			// The surface reflects, Next holds the reflection ray
+			ShadeFlagReflect = 0x4,
+
+			// SkyDirect holds the light of the sky. The shadow stage clears it when the sky ray is blocked.
+			ShadeFlagSky = 0x8
+		};
+
+		// Per path: weight of the ray that continues the path, and the radiance gathered so far
+		std::vector<Float3> Weight;
+		std::vector<Float3> Radiance;
+
+		RayQueue Extension;
+		RayQueue Next;
+		RayQueue Shadow;
+
+		// Per extension ray: the closest hit, the direct light that the shadow ray decides on, the light and direction
+		// of the sky light, the weight of the reflection ray and the ShadeFlags
+		std::vector<Hit> Hits;
+		std::vector<Float3> Direct;
+		std::vector<Float3> SkyDirect;
+		std::vector<Float3> SkyDirection;
+		std::vector<Float3> NextWeight;
+		std::vector<uint8_t> Flags;
+
+		void Resize(uint32_t pathCount);
+	};
+}
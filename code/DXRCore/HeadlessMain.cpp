@@ -0,0 +1,55 @@
+#include <Utils/CLI.hpp>
+#include <Renderer/Renderer.hpp>
+
+#include <CPU/Backend.hpp>
+
+#include <chrono>
+#include <cstdio>
+
+extern Renderer* CreateSample();
+
+// Runs a sample on the CPU backend without a window or a device, on any platform. Takes the same arguments as the
+// samples. Renders '-frames=' frames, or until the image converged with '-accumulate', or else a single frame, and
+// writes them to '-output=' when it is set.
+int main(int argc, char** argv)
+{
+	ParseCLI(argc, argv);
+
+	Renderer* renderer = CreateSample();
+	renderer->Initialize();
+
+	const uint64_t frameLimit = GetCLI().FrameCount != 0 ? GetCLI().FrameCount : GetCLI().Accumulate ? 0 : 1;
+
+	const auto startTime = std::chrono::high_resolution_clock::now();
+	auto oldTime = startTime;
+	uint64_t frameCount = 0;
+	uint64_t rayCount = 0;
+
+	while (frameLimit == 0 || frameCount < frameLimit)
+	{
+		auto newTime = std::chrono::high_resolution_clock::now();
+		auto dT = std::chrono::duration<float>(newTime - oldTime).count();
+		oldTime = newTime;
+
+		renderer->Update(dT);
+
+		const bool running = renderer->Render();
+
+		rayCount += Renderer::GetCPUBackend()->GetStatistics().RayCount;
+		frameCount++;
+
+		if (!running)
+		{
+			break;
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	printf("Rendered %llu frames in %.2f s | MRays/s: %f\n", static_cast<unsigned long long>(frameCount), seconds, rayCount / (seconds * 1.0e6));
+
+	renderer->Shutdown();
+	delete renderer;
+
+	return 0;
+}
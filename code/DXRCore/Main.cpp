@@ -3,6 +3,9 @@
 #include <Utils/CLI.hpp>
 #include <Renderer/Renderer.hpp>
 
+#include <CPU/Backend.hpp>
+#include <CPU/Benchmark.hpp>
+
 #include <chrono>
 
 extern Renderer* CreateSample();
@@ -37,6 +40,36 @@ int CALLBACK WinMain(UNUSED HINSTANCE instance, HINSTANCE, UNUSED LPSTR cmdLine,
 
 	CreateConsole();
 
+	if (GetCLI().Benchmark)
+	{
+		cpu::BenchmarkDesc desc = {};
+
+		if (GetCLI().BenchmarkTriangleCount != 0)
+		{
+			desc.TriangleCount = GetCLI().BenchmarkTriangleCount;
+		}
+
+		if (GetCLI().BenchmarkPrimitiveCount != 0)
+		{
+			desc.PrimitiveCount = GetCLI().BenchmarkPrimitiveCount;
+		}
+
+		const bool passed = cpu::RunBenchmarks(desc);
+
+		// Keep the console open until the results are read, only when asked for and the console has a window
+		if (GetCLI().Wait && GetConsoleWindow() != nullptr)
+		{
+			FILE* stream;
+			freopen_s(&stream, "CONIN$", "r", stdin);
+
+			printf("Press enter to exit\n");
+			getchar();
+		}
+
+		FreeConsole();
+		return passed ? 0 : 1;
+	}
+
 	SetThreadDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
 
 	Renderer* renderer = CreateSample();
@@ -45,10 +78,17 @@ int CALLBACK WinMain(UNUSED HINSTANCE instance, HINSTANCE, UNUSED LPSTR cmdLine,
 	auto oldTime = std::chrono::high_resolution_clock::now();
 	float elapsedTime = 0.0f;
 	uint32_t frameCount = 0;
+	uint64_t totalFrameCount = 0;
+	uint64_t rayCount = 0;
 
 	MSG msg = {};
 	while (msg.message != WM_QUIT)
 	{
+		if (GetCLI().FrameCount != 0 && totalFrameCount >= GetCLI().FrameCount)
+		{
+			break;
+		}
+
 		auto newTime = std::chrono::high_resolution_clock::now();
 		auto delta = newTime - oldTime;
 		auto dT = static_cast<float>(delta.count()) * 1.0e-9f;
@@ -60,13 +100,26 @@ int CALLBACK WinMain(UNUSED HINSTANCE instance, HINSTANCE, UNUSED LPSTR cmdLine,
 		{
 			char buffer[128];
 
-			sprintf_s(buffer, "FPS: %f\n", frameCount / elapsedTime);
+			if (Renderer::GetCPUBackend() != nullptr)
+			{
+				sprintf_s(buffer, "FPS: %f | MRays/s: %f\n", frameCount / elapsedTime, rayCount / (elapsedTime * 1.0e6f));
+				printf("%s", buffer);
+			}
+			else
+			{
+				sprintf_s(buffer, "FPS: %f | Frame time: %.2f ms | Latency: %.2f ms\n", frameCount / elapsedTime, elapsedTime * 1000.0f / frameCount, renderer->GetLatency());
+			}
+
 			OutputDebugStringA(buffer);
 
 			elapsedTime = 0.0f;
 			frameCount = 0;
+			rayCount = 0;
 		}
 
+		// The input of the frame is read from here on
+		renderer->WaitForNextFrame();
+
 		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
 		{
 			TranslateMessage(&msg);
@@ -74,9 +127,20 @@ int CALLBACK WinMain(UNUSED HINSTANCE instance, HINSTANCE, UNUSED LPSTR cmdLine,
 		}
 
 		renderer->Update(dT);
-		renderer->Render();
+
+		// The CPU backend is done once it converged with '-accumulate'
+		if (!renderer->Render())
+		{
+			break;
+		}
+
+		if (Renderer::GetCPUBackend() != nullptr)
+		{
+			rayCount += Renderer::GetCPUBackend()->GetStatistics().RayCount;
+		}
 
 		frameCount++;
+		totalFrameCount++;
 	}
 
 	if (GetCLI().Console)
@@ -0,0 +1,96 @@
+#include "pch.hpp"
+#include "BufferPool.hpp"
+
+#include "Device.hpp"
+
+#include <Renderer/Helper.hpp>
+
+Microsoft::WRL::ComPtr<ID3D12Resource> BufferPool::Acquire(PooledBufferType type, uint64_t size)
+{
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	const uint32_t slot = m_Pool.Acquire(static_cast<uint32_t>(type), size, cmdQueue.GetCompletedFence());
+
+	if (slot == cpu::ResourcePool::InvalidSlot)
+	{
+		return CreateBuffer(type, cpu::ResourcePool::GetSizeClass(size));
+	}
+
+	return std::move(m_Buffers[slot]);
+}
+
+void BufferPool::Release(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer)
+{
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	Store(m_Pool.Release(static_cast<uint32_t>(type), buffer->GetDesc().Width, cmdQueue.GetLastFence()), std::move(buffer));
+}
+
+void BufferPool::Release(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer, ID3D12CommandList* cmdList)
+{
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	const uint64_t owner = reinterpret_cast<uint64_t>(cmdList);
+
+	Store(m_Pool.ReleaseAfterSubmit(static_cast<uint32_t>(type), buffer->GetDesc().Width, owner), std::move(buffer));
+}
+
+void BufferPool::Submit(ID3D12CommandList* const* cmdLists, uint32_t count, uint64_t fence)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		m_Pool.Submit(reinterpret_cast<uint64_t>(cmdLists[i]), fence);
+	}
+}
+
+void BufferPool::Trim(uint64_t maxFreeSize)
+{
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	m_Evicted.clear();
+	m_Pool.Trim(cmdQueue.GetCompletedFence(), maxFreeSize, m_Evicted);
+
+	for (uint32_t slot : m_Evicted)
+	{
+		m_Buffers[slot] = nullptr;
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> BufferPool::CreateBuffer(PooledBufferType type, uint64_t size)
+{
+	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+
+	switch (type)
+	{
+	case PooledBufferType::Scratch:
+		AllocateUAVBuffer(size, &buffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
+		break;
+	case PooledBufferType::AccelerationStructure:
+		AllocateUAVBuffer(size, &buffer, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"AccelerationStructure");
+		break;
+	case PooledBufferType::Upload:
+		buffer = Device::GetDevice().GetMemoryAllocator().CreateBuffer(MemoryType::Upload, size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+		buffer->SetName(L"InstanceDescs");
+		break;
+	}
+
+	return buffer;
+}
+
+void BufferPool::Store(uint32_t slot, Microsoft::WRL::ComPtr<ID3D12Resource> buffer)
+{
+	if (slot >= m_Buffers.size())
+	{
+		m_Buffers.resize(slot + 1);
+	}
+
+	m_Buffers[slot] = std::move(buffer);
+}
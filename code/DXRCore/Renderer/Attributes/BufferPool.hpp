@@ -0,0 +1,54 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <vector>
+
+#include <DXRCore/CPU/ResourcePool.hpp>
+
+enum class PooledBufferType : uint32_t
+{
+	// Default heap with unordered access, for the scratch memory of builds
+	Scratch,
+	// Default heap in the acceleration structure state, for the results of builds
+	AccelerationStructure,
+	// Upload heap, for the instances of the TLAS
+	Upload,
+};
+
+// Reuses the buffers of acceleration structure builds, so moving instances or rebuilding a mesh does not create
+// resources. A released buffer goes back into the pool and is handed out again once the GPU has finished the work
+// that used it. Buffers that are dropped instead of released are simply destroyed.
+class BufferPool
+{
+public:
+	// A buffer of at least size bytes, in the initial state of its type
+	Microsoft::WRL::ComPtr<ID3D12Resource> Acquire(PooledBufferType type, uint64_t size);
+
+	// Returns the buffer to the pool once the work submitted so far has completed
+	void Release(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer);
+
+	// Returns the buffer to the pool once the command list, which has work recorded that uses it, has been submitted
+	// and has completed
+	void Release(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer, ID3D12CommandList* cmdList);
+
+	// Called by the command queue for every submission
+	void Submit(ID3D12CommandList* const* cmdLists, uint32_t count, uint64_t fence);
+
+	// Destroys the released buffers the GPU is done with, oldest first, until at most maxFreeSize bytes are pooled
+	void Trim(uint64_t maxFreeSize);
+
+	uint64_t GetFreeSize() const
+	{
+		return m_Pool.GetFreeSize();
+	}
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(PooledBufferType type, uint64_t size);
+	void Store(uint32_t slot, Microsoft::WRL::ComPtr<ID3D12Resource> buffer);
+
+	cpu::ResourcePool m_Pool;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> m_Buffers;
+	std::vector<uint32_t> m_Evicted;
+};
@@ -32,19 +32,22 @@ void CommandQueue::Initialize()
 	}
 }
 
-uint64_t CommandQueue::ExecuteCommandLists(const std::vector<ID3D12GraphicsCommandList7*> cmdLists)
+uint64_t CommandQueue::ExecuteCommandLists(ID3D12GraphicsCommandList7* const* cmdLists, uint32_t count)
 {
-	for (auto cmdList : cmdLists)
+	for (uint32_t i = 0; i < count; i++)
 	{
-		cmdList->Close();
+		cmdLists[i]->Close();
 	}
 
-	ID3D12CommandList* const* cmdListsRaw = reinterpret_cast<ID3D12CommandList* const*>(cmdLists.data());
+	ID3D12CommandList* const* cmdListsRaw = reinterpret_cast<ID3D12CommandList* const*>(cmdLists);
 
-	m_CommandQueue->ExecuteCommandLists(static_cast<uint32_t>(cmdLists.size()), cmdListsRaw);
+	m_CommandQueue->ExecuteCommandLists(count, cmdListsRaw);
 
 	auto fence = Signal();
 
+	// Pooled buffers released into these command lists can be reused once the fence completes
+	Device::GetDevice().GetBufferPool().Submit(cmdListsRaw, count, fence);
+
 	return fence;
 }
 
@@ -5,8 +5,27 @@ class CommandQueue
 public:
 	void Initialize();
 
-	uint64_t ExecuteCommandLists(const std::vector<ID3D12GraphicsCommandList7*> cmdList);
+	// Closes the command lists and submits them in order. Returns the fence that completes with them.
+	uint64_t ExecuteCommandLists(ID3D12GraphicsCommandList7* const* cmdLists, uint32_t count);
+
+	uint64_t ExecuteCommandList(ID3D12GraphicsCommandList7* cmdList)
+	{
+		return ExecuteCommandLists(&cmdList, 1);
+	}
+
 	void WaitForFence(uint64_t fence);
+	bool IsFenceCompleted(uint64_t fence);
+
+	uint64_t GetCompletedFence()
+	{
+		return m_Fence->GetCompletedValue();
+	}
+
+	// Fence of the last submission
+	uint64_t GetLastFence() const
+	{
+		return m_FenceValue;
+	}
 
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> GetCommandQueue() const
 	{
@@ -19,7 +38,6 @@ protected:
 	CommandQueue() = default;
 private:
 	uint64_t Signal();
-	bool IsFenceCompleted(uint64_t fence);
 
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_CommandQueue;
 	Microsoft::WRL::ComPtr<ID3D12Fence> m_Fence;
@@ -0,0 +1,40 @@
+#include "pch.hpp"
+#include "ConstantAllocator.hpp"
+
+#include "Device.hpp"
+
+#include <CPU/ThreadPool.hpp>
+
+// Room for the frames in flight with thousands of views and lights each
+static constexpr uint64_t RingSize = 16ull * 1024 * 1024;
+
+// Taken by a thread at the time, the first allocation of a thread in a frame takes one
+static constexpr uint64_t ChunkSize = 64ull * 1024;
+
+void ConstantAllocator::Initialize()
+{
+	auto& device = Device::GetDevice();
+
+	m_Buffer = device.GetMemoryAllocator().CreateBuffer(MemoryType::Upload, RingSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+	m_Buffer->SetName(L"Constants");
+
+	// Upload heaps can stay mapped for their whole lifetime
+	uint8_t* data = nullptr;
+	CD3DX12_RANGE readRange(0, 0);
+	m_Buffer->Map(0, &readRange, reinterpret_cast<void**>(&data));
+
+	auto Wait = [](uint64_t fence)
+	{
+		auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+		cmdQueue.WaitForFence(fence);
+
+		return cmdQueue.GetCompletedFence();
+	};
+
+	m_Allocator = std::make_unique<cpu::FrameAllocator>(data, m_Buffer->GetGPUVirtualAddress(), RingSize, cpu::ThreadPool::Get().GetThreadCount(), ChunkSize, Wait);
+}
+
+void ConstantAllocator::EndFrame(uint64_t fence)
+{
+	m_Allocator->EndFrame(fence, Device::GetDevice().GetCommandQueue().GetCompletedFence());
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <memory>
+
+#include <DXRCore/CPU/FrameAllocator.hpp>
+
+#include <DXRCore/Utils/Assert.hpp>
+
+// Constant buffers of the frame, for root constant buffer views, so a frame can have any number of cameras and lights
+// instead of what fits in the 64 DWORDs of the root signature. The memory comes from one persistently mapped upload
+// buffer, see cpu::FrameAllocator.
+class ConstantAllocator
+{
+public:
+	void Initialize();
+
+	// Copies a struct of Shared.hpp into the frame and returns the address to bind it with. The passes pass the thread
+	// index they are recorded on.
+	template<typename T>
+	D3D12_GPU_VIRTUAL_ADDRESS Allocate(const T& value, uint32_t threadIndex = 0)
+	{
+		const uint64_t address = m_Allocator->Allocate(value, threadIndex);
+		ASSERT(address != 0, "The constants of one frame do not fit in the constant ring");
+
+		return address;
+	}
+
+	// Space to write a struct of Shared.hpp into, valid until the end of the frame
+	template<typename T>
+	T* Allocate(D3D12_GPU_VIRTUAL_ADDRESS& address, uint32_t threadIndex = 0)
+	{
+		T* constants = m_Allocator->Allocate<T>(address, threadIndex);
+		ASSERT(constants != nullptr, "The constants of one frame do not fit in the constant ring");
+
+		return constants;
+	}
+
+	// Called once the frame is submitted with its fence
+	void EndFrame(uint64_t fence);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_Buffer;
+	std::unique_ptr<cpu::FrameAllocator> m_Allocator;
+};
@@ -4,34 +4,162 @@
 
 #include <Utils/Assert.hpp>
 
-void DescriptorHeap::Initialize(HeapType type)
+#include <algorithm>
+
+void DescriptorHeap::Initialize(HeapType type, uint32_t capacity)
 {
 	auto device = Device::GetDevice().GetInternalDevice();
-	
-	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-	desc.Type = type == HeapType::RTV ? D3D12_DESCRIPTOR_HEAP_TYPE_RTV : D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	desc.Flags = type == HeapType::RTV ? D3D12_DESCRIPTOR_HEAP_FLAGS::D3D12_DESCRIPTOR_HEAP_FLAG_NONE : D3D12_DESCRIPTOR_HEAP_FLAGS::D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	desc.NodeMask = 0;
-	desc.NumDescriptors = 32;
 
-	device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&m_Heap));
+	m_Type = type == HeapType::RTV ? D3D12_DESCRIPTOR_HEAP_TYPE_RTV : D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	m_IncreaseSize = device->GetDescriptorHandleIncrementSize(m_Type);
+
+	m_Heap = CreateHeap(capacity, false);
 
-	m_IncreaseSize = device->GetDescriptorHandleIncrementSize(type == HeapType::RTV ? D3D12_DESCRIPTOR_HEAP_TYPE_RTV : D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	if (type == HeapType::Shader)
+	{
+		m_ShaderVisibleHeap = CreateHeap(capacity, true);
+	}
+
+	m_Allocator.Reset(capacity);
 }
 
-uint32_t DescriptorHeap::GetNextIndex()
+uint32_t DescriptorHeap::Allocate(uint32_t count)
 {
-	ASSERT(m_CurrentIndex + 1 < m_MaxIndex, "Heap is too small");
+	uint32_t index = m_Allocator.Allocate(count);
+
+	if (index == cpu::DescriptorAllocator::InvalidIndex)
+	{
+		// Frees of finished frames might make room without growing
+		m_Allocator.Reclaim(Device::GetDevice().GetCommandQueue().GetCompletedFence());
+		index = m_Allocator.Allocate(count);
+	}
+
+	if (index == cpu::DescriptorAllocator::InvalidIndex)
+	{
+		Grow(count);
+		index = m_Allocator.Allocate(count);
+	}
 
-	return ++m_CurrentIndex;
+	ASSERT(index != cpu::DescriptorAllocator::InvalidIndex, "Failed to allocate descriptors");
+
+	return index;
+}
+
+void DescriptorHeap::Free(uint32_t index, uint32_t count)
+{
+	m_Allocator.Free(index, count);
 }
 
 CD3DX12_CPU_DESCRIPTOR_HANDLE DescriptorHeap::GetCPUHandle(uint32_t index)
 {
+	if (m_ShaderVisibleHeap != nullptr)
+	{
+		m_DirtyBegin = std::min(m_DirtyBegin, index);
+		m_DirtyEnd = std::max(m_DirtyEnd, index + 1);
+	}
+
 	return CD3DX12_CPU_DESCRIPTOR_HANDLE(m_Heap->GetCPUDescriptorHandleForHeapStart(), static_cast<int32_t>(index), m_IncreaseSize);
 }
 
 CD3DX12_GPU_DESCRIPTOR_HANDLE DescriptorHeap::GetGPUHandle(uint32_t index)
 {
-	return CD3DX12_GPU_DESCRIPTOR_HANDLE(m_Heap->GetGPUDescriptorHandleForHeapStart(), static_cast<int32_t>(index), m_IncreaseSize);
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(m_ShaderVisibleHeap->GetGPUDescriptorHandleForHeapStart(), static_cast<int32_t>(index), m_IncreaseSize);
+}
+
+void DescriptorHeap::Commit()
+{
+	if (m_DirtyBegin >= m_DirtyEnd)
+	{
+		return;
+	}
+
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	// One copy of the whole range, as views are mostly written in a row when a scene is loaded
+	CD3DX12_CPU_DESCRIPTOR_HANDLE source(m_Heap->GetCPUDescriptorHandleForHeapStart(), static_cast<int32_t>(m_DirtyBegin), m_IncreaseSize);
+	CD3DX12_CPU_DESCRIPTOR_HANDLE destination(m_ShaderVisibleHeap->GetCPUDescriptorHandleForHeapStart(), static_cast<int32_t>(m_DirtyBegin), m_IncreaseSize);
+
+	device->CopyDescriptorsSimple(m_DirtyEnd - m_DirtyBegin, destination, source, m_Type);
+
+	m_DirtyBegin = ~0u;
+	m_DirtyEnd = 0;
+}
+
+void DescriptorHeap::EndFrame(uint64_t fence)
+{
+	m_Allocator.EndFrame(fence);
+
+	for (auto& heap : m_FrameRetiredHeaps)
+	{
+		m_RetiredHeaps.push_back({ std::move(heap), fence });
+	}
+
+	m_FrameRetiredHeaps.clear();
+
+	const uint64_t completedFence = Device::GetDevice().GetCommandQueue().GetCompletedFence();
+
+	m_Allocator.Reclaim(completedFence);
+
+	auto retired = std::remove_if(m_RetiredHeaps.begin(), m_RetiredHeaps.end(), [completedFence](const RetiredHeap& heap)
+	{
+		return heap.Fence <= completedFence;
+	});
+
+	m_RetiredHeaps.erase(retired, m_RetiredHeaps.end());
+}
+
+Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> DescriptorHeap::CreateHeap(uint32_t capacity, bool shaderVisible) const
+{
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+	desc.Type = m_Type;
+	desc.Flags = shaderVisible ? D3D12_DESCRIPTOR_HEAP_FLAGS::D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAGS::D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	desc.NodeMask = 0;
+	desc.NumDescriptors = capacity;
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap;
+	ASSERT(SUCCEEDED(device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap))), "Failed to create a descriptor heap");
+
+	return heap;
+}
+
+void DescriptorHeap::Grow(uint32_t count)
+{
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	const uint32_t usedEnd = m_Allocator.GetUsedEnd();
+	uint32_t capacity = std::max(m_Allocator.GetCapacity() * 2, usedEnd + count);
+
+	if (m_ShaderVisibleHeap != nullptr)
+	{
+		ASSERT(usedEnd + count <= D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1, "Shader visible descriptor heaps can not be any larger");
+		capacity = std::min<uint32_t>(capacity, D3D12_MAX_SHADER_VISIBLE_DESCRIPTOR_HEAP_SIZE_TIER_1);
+	}
+
+	// Only the CPU reads the heap the views are written into, so the old one can go right away
+	auto heap = CreateHeap(capacity, false);
+
+	if (usedEnd > 0)
+	{
+		device->CopyDescriptorsSimple(usedEnd, heap->GetCPUDescriptorHandleForHeapStart(), m_Heap->GetCPUDescriptorHandleForHeapStart(), m_Type);
+	}
+
+	m_Heap = heap;
+
+	// The frames in flight still read the old shader visible heap. The new one gets every descriptor with the next
+	// commit, and gets bound from the next frame on.
+	if (m_ShaderVisibleHeap != nullptr)
+	{
+		m_FrameRetiredHeaps.push_back(std::move(m_ShaderVisibleHeap));
+		m_ShaderVisibleHeap = CreateHeap(capacity, true);
+
+		if (usedEnd > 0)
+		{
+			m_DirtyBegin = 0;
+			m_DirtyEnd = std::max(m_DirtyEnd, usedEnd);
+		}
+	}
+
+	m_Allocator.Grow(capacity);
 }
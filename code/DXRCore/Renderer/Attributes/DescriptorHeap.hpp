@@ -1,32 +1,79 @@
 #pragma once
 
+#include <vector>
+
+#include <DXRCore/CPU/DescriptorAllocator.hpp>
+
 enum class HeapType
 {
 	RTV,
 	Shader
 };
 
+// Descriptors of one type, addressed by indices that stay valid for as long as they are allocated. Views are written
+// into a heap that only the CPU sees, and Commit copies the ones written since the last commit into the shader visible
+// heap. That lets the heap grow: the new heaps get every descriptor copied into them, and the old shader visible heap
+// is kept until the frames in flight are done with it.
 class DescriptorHeap
 {
 public:
-	void Initialize(HeapType type);
+	void Initialize(HeapType type, uint32_t capacity = 1024);
+
+	// First index of count contiguous descriptors. Grows the heap when no free range is large enough.
+	uint32_t Allocate(uint32_t count = 1);
 
-	uint32_t GetNextIndex();
+	// The descriptors are reused once the GPU has finished the frame that freed them
+	void Free(uint32_t index, uint32_t count = 1);
+
+	// Handle to write a view into, which the next Commit copies to the shader visible heap
 	CD3DX12_CPU_DESCRIPTOR_HANDLE GetCPUHandle(uint32_t index);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE GetGPUHandle(uint32_t index);
 
+	// Copies the descriptors written since the last commit into the shader visible heap. Called before the heap is
+	// bound for a frame.
+	void Commit();
+
+	// Ends the frame that was submitted with the fence. Frees and heaps that were replaced by a larger one during the
+	// frame wait for it.
+	void EndFrame(uint64_t fence);
+
+	// The shader visible heap, or the only heap of render target views
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> GetHeap() const
 	{
-		return m_Heap;
+		return m_ShaderVisibleHeap != nullptr ? m_ShaderVisibleHeap : m_Heap;
+	}
+
+	uint32_t GetCapacity() const
+	{
+		return m_Allocator.GetCapacity();
 	}
+
 protected:
 	friend class Renderer;
 	DescriptorHeap() = default;
 private:
+	struct RetiredHeap
+	{
+		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> Heap;
+		uint64_t Fence = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> CreateHeap(uint32_t capacity, bool shaderVisible) const;
+	void Grow(uint32_t count);
+
+	D3D12_DESCRIPTOR_HEAP_TYPE m_Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+
+	// Views are written into the heap on the CPU. Only shader heaps have a shader visible copy.
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_Heap;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> m_ShaderVisibleHeap;
 
+	cpu::DescriptorAllocator m_Allocator;
 	uint32_t m_IncreaseSize = 0;
-	uint32_t m_CurrentIndex = 0;
-	uint32_t m_MaxIndex = 32;
-};
 
+	// Descriptors written since the last commit
+	uint32_t m_DirtyBegin = ~0u;
+	uint32_t m_DirtyEnd = 0;
+
+	std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> m_FrameRetiredHeaps;
+	std::vector<RetiredHeap> m_RetiredHeaps;
+};
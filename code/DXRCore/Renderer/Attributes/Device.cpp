@@ -22,8 +22,33 @@ void Device::Initialize()
 
 	g_Device = this;
 
+	m_MemoryAllocator = std::make_unique<MemoryAllocator>();
+	m_BufferPool = std::make_unique<BufferPool>();
+
 	m_CommandQueue = std::unique_ptr<CommandQueue>(new CommandQueue());
 	m_CommandQueue->Initialize();
+
+	m_UploadBatcher = std::make_unique<UploadBatcher>();
+	m_UploadBatcher->Initialize();
+
+	m_ConstantAllocator = std::make_unique<ConstantAllocator>();
+	m_ConstantAllocator->Initialize();
+
+	// A missing or outdated file just means every root signature is serialized once more
+	m_PipelineCache = std::make_unique<cpu::PipelineCache>(GetCLI().PipelineCachePath.empty() ? "PipelineCache.bin" : GetCLI().PipelineCachePath);
+	m_PipelineCache->Load();
+}
+
+const Device::PipelineObjects* Device::FindPipeline(uint64_t key) const
+{
+	auto pipeline = m_Pipelines.find(key);
+
+	return pipeline != m_Pipelines.end() ? &pipeline->second : nullptr;
+}
+
+void Device::StorePipeline(uint64_t key, PipelineObjects objects)
+{
+	m_Pipelines[key] = std::move(objects);
 }
 
 void Device::CreateAdapter()
@@ -169,4 +194,5 @@ void Device::Debug(UNUSED D3D12_MESSAGE_CATEGORY Category, UNUSED D3D12_MESSAGE_
 void Device::Flush()
 {
 	m_CommandQueue->Flush();
+	m_MemoryAllocator->Defragment();
 }
\ No newline at end of file
@@ -2,7 +2,15 @@
 
 #include <wrl/client.h>
 
+#include <unordered_map>
+
+#include <CPU/PipelineCache.hpp>
+
+#include <Renderer/Attributes/BufferPool.hpp>
 #include <Renderer/Attributes/CommandQueue.hpp>
+#include <Renderer/Attributes/ConstantAllocator.hpp>
+#include <Renderer/Attributes/MemoryAllocator.hpp>
+#include <Renderer/Attributes/UploadBatcher.hpp>
 
 class Device
 {
@@ -21,6 +29,46 @@ public:
 		return *m_CommandQueue;
 	}
 
+	MemoryAllocator& GetMemoryAllocator()
+	{
+		return *m_MemoryAllocator;
+	}
+
+	BufferPool& GetBufferPool()
+	{
+		return *m_BufferPool;
+	}
+
+	UploadBatcher& GetUploadBatcher()
+	{
+		return *m_UploadBatcher;
+	}
+
+	// Constant buffers that live until the GPU finished the frame
+	ConstantAllocator& GetConstantAllocator()
+	{
+		return *m_ConstantAllocator;
+	}
+
+	// Serialized root signatures of earlier runs, by the hash of their description
+	cpu::PipelineCache& GetPipelineCache()
+	{
+		return *m_PipelineCache;
+	}
+
+	// Objects of the pipelines created since startup, by the key of their pipeline, so a pipeline that is created again
+	// reuses the compiled state object. D3D12 can not write a ray tracing state object to disk.
+	struct PipelineObjects
+	{
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
+		Microsoft::WRL::ComPtr<ID3D12RootSignature> LocalRootSignature;
+		Microsoft::WRL::ComPtr<ID3D12StateObject> StateObject;
+	};
+
+	const PipelineObjects* FindPipeline(uint64_t key) const;
+	void StorePipeline(uint64_t key, PipelineObjects objects);
+
+	// Waits for the GPU, after which every released buffer can be freed and the empty heaps destroyed
 	void Flush();
 
 protected:
@@ -39,6 +87,13 @@ private:
 	Microsoft::WRL::ComPtr<ID3D12Device5> m_Device;
 
 	std::unique_ptr<class CommandQueue> m_CommandQueue;
+	std::unique_ptr<MemoryAllocator> m_MemoryAllocator;
+	std::unique_ptr<BufferPool> m_BufferPool;
+	std::unique_ptr<UploadBatcher> m_UploadBatcher;
+	std::unique_ptr<ConstantAllocator> m_ConstantAllocator;
+	std::unique_ptr<cpu::PipelineCache> m_PipelineCache;
+
+	std::unordered_map<uint64_t, PipelineObjects> m_Pipelines;
 
 	bool m_HasDebugLayersEnabled = false;
 };
@@ -0,0 +1,180 @@
+#include "pch.hpp"
+#include "MemoryAllocator.hpp"
+
+#include "Device.hpp"
+
+#include <Utils/Assert.hpp>
+
+#include <algorithm>
+
+namespace
+{
+	uint32_t GetReferenceCount(ID3D12Resource* resource)
+	{
+		resource->AddRef();
+		return resource->Release();
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D12Resource> MemoryAllocator::CreateBuffer(MemoryType type, uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState)
+{
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size, flags);
+
+	// Buffers are always placed at multiples of 64KB
+	const D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &bufferDesc);
+
+	Buffer buffer;
+	cpu::TLSFAllocator::Allocation allocation;
+
+	for (uint32_t i = 0; i < m_Heaps.size() && allocation.Handle == cpu::TLSFAllocator::InvalidHandle; i++)
+	{
+		if (m_Heaps[i] != nullptr && m_Heaps[i]->Type == type)
+		{
+			allocation = m_Heaps[i]->Allocator.Allocate(info.SizeInBytes, info.Alignment);
+			buffer.Heap = i;
+		}
+	}
+
+	if (allocation.Handle == cpu::TLSFAllocator::InvalidHandle)
+	{
+		buffer.Heap = CreateHeap(type, std::max(HeapSize, info.SizeInBytes));
+		allocation = m_Heaps[buffer.Heap]->Allocator.Allocate(info.SizeInBytes, info.Alignment);
+	}
+
+	ASSERT(allocation.Handle != cpu::TLSFAllocator::InvalidHandle, "Failed to allocate memory for a buffer");
+
+	buffer.Handle = allocation.Handle;
+
+	ASSERT(SUCCEEDED(device->CreatePlacedResource(m_Heaps[buffer.Heap]->D3D12Heap.Get(), allocation.Offset, &bufferDesc, initialState, nullptr, IID_PPV_ARGS(&buffer.Resource))), "Failed to create a placed buffer");
+
+	auto resource = buffer.Resource;
+	m_Buffers.push_back(std::move(buffer));
+
+	return resource;
+}
+
+void MemoryAllocator::Collect()
+{
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	const uint64_t lastFence = cmdQueue.GetLastFence();
+
+	for (size_t i = 0; i < m_Buffers.size();)
+	{
+		if (GetReferenceCount(m_Buffers[i].Resource.Get()) > 1)
+		{
+			i++;
+			continue;
+		}
+
+		m_Buffers[i].Fence = lastFence;
+		m_ReleasedBuffers.push_back(std::move(m_Buffers[i]));
+
+		m_Buffers[i] = std::move(m_Buffers.back());
+		m_Buffers.pop_back();
+	}
+
+	const uint64_t completedFence = cmdQueue.GetCompletedFence();
+
+	auto released = std::remove_if(m_ReleasedBuffers.begin(), m_ReleasedBuffers.end(), [this, completedFence](Buffer& buffer)
+	{
+		if (buffer.Fence > completedFence)
+		{
+			return false;
+		}
+
+		buffer.Resource = nullptr;
+		m_Heaps[buffer.Heap]->Allocator.Free(buffer.Handle);
+
+		return true;
+	});
+
+	m_ReleasedBuffers.erase(released, m_ReleasedBuffers.end());
+}
+
+void MemoryAllocator::Defragment()
+{
+	Collect();
+
+	bool keptHeap[static_cast<uint32_t>(MemoryType::Count)] = {};
+
+	for (auto& heap : m_Heaps)
+	{
+		if (heap == nullptr || !heap->Allocator.IsEmpty())
+		{
+			continue;
+		}
+
+		const uint32_t type = static_cast<uint32_t>(heap->Type);
+
+		// Only a heap of the default size is worth keeping around
+		if (!keptHeap[type] && heap->Allocator.GetSize() == HeapSize)
+		{
+			keptHeap[type] = true;
+			continue;
+		}
+
+		heap = nullptr;
+	}
+
+	while (!m_Heaps.empty() && m_Heaps.back() == nullptr)
+	{
+		m_Heaps.pop_back();
+	}
+}
+
+MemoryAllocator::Statistics MemoryAllocator::GetStatistics() const
+{
+	Statistics statistics;
+	statistics.BufferCount = static_cast<uint32_t>(m_Buffers.size() + m_ReleasedBuffers.size());
+
+	for (const auto& heap : m_Heaps)
+	{
+		if (heap == nullptr)
+		{
+			continue;
+		}
+
+		const cpu::TLSFAllocator::Statistics heapStatistics = heap->Allocator.GetStatistics();
+
+		statistics.HeapSize += heap->Allocator.GetSize();
+		statistics.UsedSize += heapStatistics.UsedSize;
+		statistics.LargestFreeSize = std::max(statistics.LargestFreeSize, heapStatistics.LargestFreeSize);
+		statistics.HeapCount++;
+		statistics.FreeRangeCount += heapStatistics.FreeRangeCount;
+	}
+
+	return statistics;
+}
+
+uint32_t MemoryAllocator::CreateHeap(MemoryType type, uint64_t size)
+{
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	auto heap = std::make_unique<Heap>();
+	heap->Type = type;
+	heap->Allocator.Reset(size);
+
+	D3D12_HEAP_DESC desc = {};
+	desc.SizeInBytes = size;
+	desc.Properties = CD3DX12_HEAP_PROPERTIES(type == MemoryType::Upload ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT);
+	desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+	ASSERT(SUCCEEDED(device->CreateHeap(&desc, IID_PPV_ARGS(&heap->D3D12Heap))), "Failed to create a heap");
+
+	// The slot of a destroyed heap is reused
+	for (uint32_t i = 0; i < m_Heaps.size(); i++)
+	{
+		if (m_Heaps[i] == nullptr)
+		{
+			m_Heaps[i] = std::move(heap);
+			return i;
+		}
+	}
+
+	m_Heaps.push_back(std::move(heap));
+	return static_cast<uint32_t>(m_Heaps.size() - 1);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <memory>
+#include <vector>
+
+#include <DXRCore/CPU/TLSFAllocator.hpp>
+
+enum class MemoryType : uint32_t
+{
+	Default,
+	Upload,
+	Count
+};
+
+// Places buffers in a few large heaps instead of creating a committed resource, and its own allocation, for each one.
+// The ranges of the heaps are managed by a TLSF allocator. A buffer lives for as long as anything besides the allocator
+// references it, after which Collect gives its range back once the GPU has finished the frames that could use it.
+class MemoryAllocator
+{
+public:
+	// Size of a heap. Larger buffers get a heap of their own.
+	static constexpr uint64_t HeapSize = 64ull * 1024 * 1024;
+
+	struct Statistics
+	{
+		uint64_t HeapSize = 0;
+		uint64_t UsedSize = 0;
+		uint64_t LargestFreeSize = 0;
+		uint32_t HeapCount = 0;
+		uint32_t BufferCount = 0;
+		uint32_t FreeRangeCount = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(MemoryType type, uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState);
+
+	// Frees the ranges of buffers that were released since the last call, and of the ones whose frames have finished.
+	// Called once a frame.
+	void Collect();
+
+	// Destroys the heaps without buffers in them, except one of each type to allocate from. Buffers are never moved,
+	// their addresses are in views and instances all over the renderer.
+	void Defragment();
+
+	Statistics GetStatistics() const;
+
+private:
+	struct Heap
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> D3D12Heap;
+		cpu::TLSFAllocator Allocator;
+		MemoryType Type = MemoryType::Default;
+	};
+
+	struct Buffer
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		uint32_t Heap = 0;
+		uint32_t Handle = cpu::TLSFAllocator::InvalidHandle;
+
+		// Frame in which the buffer was released, it is kept until the frame has finished
+		uint64_t Fence = 0;
+	};
+
+	uint32_t CreateHeap(MemoryType type, uint64_t size);
+
+	// Heaps are destroyed by resetting their pointer, so the indices of the others stay the same
+	std::vector<std::unique_ptr<Heap>> m_Heaps;
+
+	std::vector<Buffer> m_Buffers;
+	std::vector<Buffer> m_ReleasedBuffers;
+};
@@ -7,23 +7,25 @@
 #include <DXRCore/Renderer/Helper.hpp>
 #include <DXRCore/Renderer/Renderer.hpp>
 
-void Mesh::BuildBLAS()
+#include <algorithm>
+
+Mesh::~Mesh()
+{
+	if (auto* shaderHeap = Renderer::GetShaderHeap())
+	{
+		shaderHeap->Free(m_NormalSRV);
+		shaderHeap->Free(m_UV0SRV);
+		shaderHeap->Free(m_IndexSRV);
+	}
+}
+
+UploadToken Mesh::BuildD3D12BLAS()
 {
 	ASSERT(m_IndexSize == sizeof(uint32_t) || m_IndexSize == sizeof(uint16_t), "Incorrect index size specified.");
 	ASSERT(m_IndexBuffer != nullptr, "Index buffer was not present");
 	ASSERT(m_PositionBuffer != nullptr, "Position buffer was not present");
 
-	D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
-	geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-	geometryDesc.Triangles.IndexBuffer = m_IndexBuffer->GetGPUVirtualAddress();
-	geometryDesc.Triangles.IndexCount = static_cast<UINT>(m_IndexBuffer->GetDesc().Width) / m_IndexSize;
-	geometryDesc.Triangles.IndexFormat = m_IndexSize == sizeof(uint32_t) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
-	geometryDesc.Triangles.Transform3x4 = 0;
-	geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-	geometryDesc.Triangles.VertexCount = static_cast<UINT>(m_PositionBuffer->GetDesc().Width) / (sizeof(float) * 3); // float3
-	geometryDesc.Triangles.VertexBuffer.StartAddress = m_PositionBuffer->GetGPUVirtualAddress();
-	geometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
-	geometryDesc.Flags = m_Flags;
+	D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = GetGeometryDesc();
 
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS blasInput = {};
 	blasInput.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
@@ -32,6 +34,11 @@ void Mesh::BuildBLAS()
 	blasInput.NumDescs = 1;
 	blasInput.pGeometryDescs = &geometryDesc;
 
+	if (m_AllowUpdate)
+	{
+		blasInput.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+	}
+
 	auto device = Device::GetDevice().GetInternalDevice();
 
 	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
@@ -39,44 +46,124 @@ void Mesh::BuildBLAS()
 
 	ASSERT(info.ResultDataMaxSizeInBytes > 0, "Failed to get prebuild data");
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> scratchResource;
-	AllocateUAVBuffer(device.Get(), info.ScratchDataSizeInBytes, &scratchResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
-	AllocateUAVBuffer(device.Get(), info.ResultDataMaxSizeInBytes, &m_BLAS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"BottomLevelAccelerationStructure");
+	uint64_t scratchSize = m_AllowUpdate ? std::max(info.ScratchDataSizeInBytes, info.UpdateScratchDataSizeInBytes) : info.ScratchDataSizeInBytes;
+
+	// A rebuild gives the buffers of the last build back to the pool. The frames in flight and the open batch can still
+	// be using them, so they are only reused once the batch completes.
+	auto& pool = Device::GetDevice().GetBufferPool();
+	auto& batcher = Device::GetDevice().GetUploadBatcher();
+
+	batcher.Recycle(PooledBufferType::AccelerationStructure, std::move(m_BLAS));
+	batcher.Recycle(PooledBufferType::Scratch, std::move(m_ScratchBuffer));
+
+	auto scratchResource = pool.Acquire(PooledBufferType::Scratch, scratchSize);
+	m_BLAS = pool.Acquire(PooledBufferType::AccelerationStructure, info.ResultDataMaxSizeInBytes);
+
+	m_GeometryDirty = false;
+	m_UpdateCount = 0;
 
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelBuildDesc = {};
 	bottomLevelBuildDesc.Inputs = blasInput;
 	bottomLevelBuildDesc.ScratchAccelerationStructureData = scratchResource->GetGPUVirtualAddress();
 	bottomLevelBuildDesc.DestAccelerationStructureData = m_BLAS->GetGPUVirtualAddress();
 
-	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
-	auto cmdList = CreateCommandList();
+	// Builds of many meshes go to the GPU together. Each build has its own scratch buffer, so they need no barriers.
+	batcher.GetCommandList()->BuildRaytracingAccelerationStructure(&bottomLevelBuildDesc, 0, nullptr);
 
-	cmdList.CommandList->BuildRaytracingAccelerationStructure(&bottomLevelBuildDesc, 0, nullptr);
+	const UploadToken token = batcher.GetToken();
+
+	if (m_AllowUpdate)
+	{
+		m_ScratchBuffer = scratchResource;
+	}
+	else
+	{
+		batcher.Recycle(PooledBufferType::Scratch, scratchResource);
+	}
 
-	// consider making batches rather calling the commandqueue once per mesh
-	auto fence = cmdQueue.ExecuteCommandLists({ cmdList.CommandList.Get()});
-	cmdQueue.WaitForFence(fence);
+	return token;
 }
 
-void Mesh::SetBufferData(Microsoft::WRL::ComPtr<ID3D12Resource>& buffer, uint64_t numComponents, uint64_t componentSize, const void* data)
+void Mesh::UpdateD3D12BLAS(ID3D12GraphicsCommandList7* cmdList)
 {
-	auto device = Device::GetDevice().GetInternalDevice();
+	ASSERT(m_BLAS != nullptr, "The BLAS needs to be built before it can be updated");
+	ASSERT(m_AllowUpdate, "The BLAS was not built with updates allowed");
+
+	D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = GetGeometryDesc();
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS blasInput = {};
+	blasInput.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	blasInput.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+	blasInput.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+	blasInput.NumDescs = 1;
+	blasInput.pGeometryDescs = &geometryDesc;
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelBuildDesc = {};
+	bottomLevelBuildDesc.ScratchAccelerationStructureData = m_ScratchBuffer->GetGPUVirtualAddress();
+	bottomLevelBuildDesc.DestAccelerationStructureData = m_BLAS->GetGPUVirtualAddress();
+
+	// The inputs are the same as in the build, so a rebuild fits in the same buffer
+	if (++m_UpdateCount < m_RebuildInterval)
+	{
+		blasInput.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+		bottomLevelBuildDesc.SourceAccelerationStructureData = m_BLAS->GetGPUVirtualAddress();
+	}
+	else
+	{
+		m_UpdateCount = 0;
+	}
 
-	AllocateUploadBuffer(device.Get(), data, numComponents * componentSize, &buffer);
+	bottomLevelBuildDesc.Inputs = blasInput;
+
+	cmdList->BuildRaytracingAccelerationStructure(&bottomLevelBuildDesc, 0, nullptr);
+
+	auto barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_BLAS.Get());
+	cmdList->ResourceBarrier(1, &barrier);
 }
 
-void Mesh::CreateSRV(Microsoft::WRL::ComPtr<ID3D12Resource> res, uint32_t size, uint32_t numComponents, uint32_t& srv)
+D3D12_RAYTRACING_GEOMETRY_DESC Mesh::GetGeometryDesc() const
 {
-	if (srv != static_cast<uint32_t>(-1))
+	D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
+	geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+	geometryDesc.Triangles.IndexBuffer = m_IndexBuffer->GetGPUVirtualAddress();
+	geometryDesc.Triangles.IndexCount = static_cast<UINT>(m_IndexBuffer->GetDesc().Width) / m_IndexSize;
+	geometryDesc.Triangles.IndexFormat = m_IndexSize == sizeof(uint32_t) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+	geometryDesc.Triangles.Transform3x4 = 0;
+	geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+	geometryDesc.Triangles.VertexCount = static_cast<UINT>(m_PositionBuffer->GetDesc().Width) / (sizeof(float) * 3); // float3
+	geometryDesc.Triangles.VertexBuffer.StartAddress = m_PositionBuffer->GetGPUVirtualAddress();
+	geometryDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(float) * 3;
+	geometryDesc.Flags = m_Flags;
+
+	return geometryDesc;
+}
+
+void Mesh::SetBufferData(Microsoft::WRL::ComPtr<ID3D12Resource>& buffer, uint64_t numComponents, uint64_t componentSize, const void* data)
+{
+	AllocateUploadBuffer(data, numComponents * componentSize, &buffer);
+}
+
+void Mesh::RetireBuffer(Microsoft::WRL::ComPtr<ID3D12Resource> buffer)
+{
+	if (buffer == nullptr)
 	{
 		return;
 	}
 
+	// The open batch is submitted after every frame that used the buffer, so it completes after them
+	Device::GetDevice().GetUploadBatcher().Retain(std::move(buffer));
+}
+
+void Mesh::CreateSRV(Microsoft::WRL::ComPtr<ID3D12Resource> res, uint32_t size, uint32_t numComponents, uint32_t& srv)
+{
 	ASSERT(m_VertexCount > 0, "Vertex count was zero");
 
 	auto* shaderHeap = Renderer::GetShaderHeap();
 	auto device = Device::GetDevice().GetInternalDevice();
-	srv = shaderHeap->GetNextIndex();
+
+	// A new buffer gets a new view, the frames in flight can still read the old one
+	shaderHeap->Free(srv);
+	srv = shaderHeap->Allocate();
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
 	desc.Format = DXGI_FORMAT_UNKNOWN;
@@ -1,18 +1,36 @@
 #pragma once
 
+#if defined(DXR_HEADLESS)
+// Headless builds only have the CPU backend, which gets no command lists
+struct ID3D12GraphicsCommandList7;
+#else
 #include <d3d12.h>
 #include <wrl/client.h>
+#endif
 
 #include <type_traits>
 
 #include <DirectXMath.h>
 
 #include <DXRCore/Utils/Assert.hpp>
+#include <DXRCore/Utils/CLI.hpp>
 
+#include <DXRCore/CPU/BottomLevelAS.hpp>
+
+#include <DXRCore/Renderer/Attributes/UploadToken.hpp>
+
+// The D3D12 half of Mesh is in Mesh.cpp, the CPU half in MeshCPU.cpp. Headless builds, with DXR_HEADLESS defined,
+// only have the CPU half and do not include d3d12.h.
 class Mesh
 {
 public:
 	Mesh() = default;
+#if !defined(DXR_HEADLESS)
+	~Mesh();
+#endif
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
 
 	template<typename T>
 	void SetPositionBuffer(uint64_t numPositions, const T* data);
@@ -26,8 +44,32 @@ public:
 	template<typename T>
 	void SetIndexBuffer(uint64_t numIndices, const T* data);
 
-	void BuildBLAS();
+	// Builds the next BLAS with ALLOW_UPDATE, so new positions can be refitted into it instead of building it again.
+	// Must be set before BuildBLAS.
+	void SetAllowUpdate(bool allowUpdate)
+	{
+		m_AllowUpdate = allowUpdate;
+		m_CPUBLAS.SetAllowUpdate(allowUpdate);
+	}
+
+	// A refit keeps the tree of the last build, which fits worse the further the vertices move. With the D3D12
+	// backend the BLAS gets rebuilt after this many refits, the CPU backend rebuilds when the SAH cost has grown by the
+	// threshold of cpu::BottomLevelAS instead.
+	void SetRebuildInterval(uint32_t interval)
+	{
+		m_RebuildInterval = interval;
+	}
+
+	// Records the build into the upload batcher instead of waiting for it. The TLAS build flushes the batch before it
+	// reads the BLAS, the token is for anything else that needs it finished.
+	UploadToken BuildBLAS();
 
+	// Records a refit of the BLAS to the current positions into the command list, or a rebuild once the rebuild
+	// interval has passed. TLAS::Build(cmdList) calls this for every mesh that got new positions. The CPU backend
+	// refits right away, without a command list.
+	void UpdateBLAS(ID3D12GraphicsCommandList7* cmdList);
+
+#if !defined(DXR_HEADLESS)
 	D3D12_GPU_VIRTUAL_ADDRESS GetBLASAddress() const
 	{
 		return m_BLAS->GetGPUVirtualAddress();
@@ -37,11 +79,33 @@ public:
 	{
 		m_Flags = flags; 
 	}
+#endif
+
+	const cpu::BottomLevelAS& GetCPUBLAS() const
+	{
+		return m_CPUBLAS;
+	}
+
+	const cpu::TriangleMesh& GetCPUMesh() const
+	{
+		return m_CPUMesh;
+	}
 
 private:
 	friend class TLAS;
 
+	// True once BuildBLAS was called, with either backend
+	bool IsBuilt() const;
+
+#if !defined(DXR_HEADLESS)
+	UploadToken BuildD3D12BLAS();
+	void UpdateD3D12BLAS(ID3D12GraphicsCommandList7* cmdList);
+
 	void SetBufferData(Microsoft::WRL::ComPtr<ID3D12Resource>& buffer, uint64_t numComponents, uint64_t componentSize, const void* data);
+
+	// Keeps a replaced buffer alive until every frame in flight that can read it has completed
+	void RetireBuffer(Microsoft::WRL::ComPtr<ID3D12Resource> buffer);
+	D3D12_RAYTRACING_GEOMETRY_DESC GetGeometryDesc() const;
 	void CreateSRV(Microsoft::WRL::ComPtr<ID3D12Resource> res, uint32_t size, uint32_t numComponents, uint32_t& srv);
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_PositionBuffer;
@@ -52,15 +116,29 @@ private:
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_BLAS;
 
-	uint64_t m_VertexCount = static_cast<uint64_t>(-1);
-	uint64_t m_IndexCount = static_cast<uint64_t>(-1);
+	// Kept for updates, large enough for both a build and an update
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_ScratchBuffer;
 
 	uint32_t m_NormalSRV = static_cast<uint32_t>(-1);
 	uint32_t m_UV0SRV = static_cast<uint32_t>(-1);
 	uint32_t m_IndexSRV = static_cast<uint32_t>(-1);
 
-	uint32_t m_IndexSize = static_cast<uint32_t>(-1);
 	D3D12_RAYTRACING_GEOMETRY_FLAGS m_Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+#endif
+
+	bool m_AllowUpdate = false;
+	bool m_GeometryDirty = false;
+	uint32_t m_UpdateCount = 0;
+	uint32_t m_RebuildInterval = 16;
+
+	uint64_t m_VertexCount = static_cast<uint64_t>(-1);
+	uint64_t m_IndexCount = static_cast<uint64_t>(-1);
+
+	uint32_t m_IndexSize = static_cast<uint32_t>(-1);
+
+	// Only used with the CPU backend
+	cpu::TriangleMesh m_CPUMesh;
+	cpu::BottomLevelAS m_CPUBLAS;
 };
 
 template<typename T>
@@ -76,7 +154,22 @@ inline void Mesh::SetPositionBuffer(uint64_t numPositions, const T* data)
 
 	ASSERT(m_VertexCount == numPositions, "There are too few/too many positions compared to the current set vertex count");
 
-	SetBufferData(m_PositionBuffer, numPositions, sizeof(T), data);
+	// New positions for a built BLAS get refitted by the next TLAS::Build(cmdList)
+	if (IsBuilt())
+	{
+		m_GeometryDirty = true;
+	}
+
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		RetireBuffer(std::move(m_PositionBuffer));
+		SetBufferData(m_PositionBuffer, numPositions, sizeof(T), data);
+		return;
+	}
+#endif
+
+	m_CPUMesh.SetPositions(numPositions, reinterpret_cast<const cpu::Float3*>(data));
 }
 
 template<typename T>
@@ -92,12 +185,20 @@ inline void Mesh::SetNormalBuffer(uint64_t numNormals, const T* data)
 
 	ASSERT(m_VertexCount == numNormals, "There are too few/too many normals compared to the current set vertex count");
 
-	SetBufferData(m_NormalBuffer, numNormals, sizeof(T), data);
-	CreateSRV(m_NormalBuffer, sizeof(T), static_cast<uint32_t>(numNormals), m_NormalSRV);
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		SetBufferData(m_NormalBuffer, numNormals, sizeof(T), data);
+		CreateSRV(m_NormalBuffer, sizeof(T), static_cast<uint32_t>(numNormals), m_NormalSRV);
+		return;
+	}
+#endif
+
+	m_CPUMesh.SetNormals(numNormals, reinterpret_cast<const cpu::Float3*>(data));
 }
 
 template<typename T>
-inline void Mesh::SetUV0Buffer(uint64_t numUV0, const T* data)
+inline void Mesh::SetUV0Buffer(uint64_t numUV0, [[maybe_unused]] const T* data)
 {
 	static_assert(sizeof(T) == 2 * sizeof(float), "Size of the uv0s is not correct. It must be 3 32-bit floating point values (12 bytes)");
 	static_assert(std::is_floating_point_v<decltype(T::x)>, "Type of the uv0s is not a floating point value");
@@ -109,8 +210,14 @@ inline void Mesh::SetUV0Buffer(uint64_t numUV0, const T* data)
 
 	ASSERT(m_VertexCount == numUV0, "There are too few/too many uv0s compared to the current set vertex count");
 
-	SetBufferData(m_UV0Buffer, numUV0, sizeof(T), data);
-	CreateSRV(m_UV0Buffer, sizeof(T), static_cast<uint32_t>(numUV0), m_UV0SRV);
+	// None of the CPU shading uses texture coordinates
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		SetBufferData(m_UV0Buffer, numUV0, sizeof(T), data);
+		CreateSRV(m_UV0Buffer, sizeof(T), static_cast<uint32_t>(numUV0), m_UV0SRV);
+	}
+#endif
 }
 
 template<typename T>
@@ -121,8 +228,16 @@ inline void Mesh::SetIndexBuffer(uint64_t numIndices, const T* data)
 	m_IndexCount = numIndices;
 	m_IndexSize = sizeof(T);
 
-	SetBufferData(m_IndexBuffer, numIndices, sizeof(T), data);
-	CreateSRV(m_IndexBuffer, sizeof(T), static_cast<uint32_t>(numIndices), m_IndexSRV);
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		SetBufferData(m_IndexBuffer, numIndices, sizeof(T), data);
+		CreateSRV(m_IndexBuffer, sizeof(T), static_cast<uint32_t>(numIndices), m_IndexSRV);
+		return;
+	}
+#endif
+
+	m_CPUMesh.SetIndices(numIndices, data, sizeof(T));
 }
 
 class MeshInstance
@@ -133,14 +248,19 @@ public:
 		m_Mesh = mesh;
 	}
 
+#if !defined(DXR_HEADLESS)
 	D3D12_GPU_VIRTUAL_ADDRESS GetBLASAddress() const
 	{
 		return m_Mesh->GetBLASAddress();
 	}
+#endif
 
+#if defined(_MSC_VER)
+	// MSVC only, the samples use the setters so they build with any compiler
 	_declspec(property(put = SetRotation)) DirectX::XMFLOAT4 Rotation;
 	_declspec(property(put = SetTranslation)) DirectX::XMFLOAT3 Translation;
 	_declspec(property(put = SetScale)) DirectX::XMFLOAT3 Scale;
+#endif
 
 	void SetTranslation(const DirectX::XMFLOAT3& translation)
 	{
@@ -163,11 +283,18 @@ public:
 	void SetReflectanceCoefficient(float reflectance)
 	{
 		m_Reflectance = reflectance;
+		IsDirty = true;
+	}
+
+	float GetReflectanceCoefficient() const
+	{
+		return m_Reflectance;
 	}
 
 	void SetColor(const DirectX::XMFLOAT4& color)
 	{
 		m_Color = color;
+		IsDirty = true;
 	}
 
 	DirectX::XMMATRIX GetMatrix() const
@@ -0,0 +1,53 @@
+// Built without the precompiled header, d3d12.h pulls in Windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "Mesh.hpp"
+
+// The part of Mesh that builds without D3D12: the CPU backend, and the choice between the backends
+
+bool Mesh::IsBuilt() const
+{
+#if !defined(DXR_HEADLESS)
+	if (m_BLAS != nullptr)
+	{
+		return true;
+	}
+#endif
+
+	return m_CPUBLAS.GetTriangleMesh() != nullptr;
+}
+
+UploadToken Mesh::BuildBLAS()
+{
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		return BuildD3D12BLAS();
+	}
+#endif
+
+	ASSERT(m_CPUMesh.GetTriangleCount() > 0, "Index buffer was not present");
+	ASSERT(!m_CPUMesh.GetPositions().empty(), "Position buffer was not present");
+
+	m_CPUBLAS.Build(m_CPUMesh);
+	m_GeometryDirty = false;
+
+	return 0;
+}
+
+void Mesh::UpdateBLAS([[maybe_unused]] ID3D12GraphicsCommandList7* cmdList)
+{
+	m_GeometryDirty = false;
+
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		UpdateD3D12BLAS(cmdList);
+		return;
+	}
+#endif
+
+	m_CPUBLAS.Update();
+}
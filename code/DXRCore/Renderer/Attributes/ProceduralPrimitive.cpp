@@ -2,26 +2,80 @@
 #include "ProceduralPrimitive.hpp"
 
 #include "Device.hpp"
+#include "DescriptorHeap.hpp"
 
 #include <Renderer/Helper.hpp>
+#include <Renderer/Renderer.hpp>
 
-void ProceduralPrimitive::AddEntry(const Entry& entry)
+#include <CPU/ThreadPool.hpp>
+
+#include <chrono>
+#include <cstring>
+
+static double Seconds(std::chrono::high_resolution_clock::time_point start)
 {
-	m_Entries.push_back(entry);
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 }
 
-void ProceduralPrimitive::BuildBLAS()
+static_assert(sizeof(D3D12_RAYTRACING_AABB) == sizeof(cpu::AABB), "The CPU AABB must have the same layout as D3D12_RAYTRACING_AABB");
+
+ProceduralPrimitive::~ProceduralPrimitive()
 {
-	ASSERT(!m_Entries.empty(), "No procedural primitive entries in the BLAS");
+	if (auto* shaderHeap = Renderer::GetShaderHeap())
+	{
+		shaderHeap->Free(m_EntrySRV);
+	}
+}
 
+UploadToken ProceduralPrimitive::BuildD3D12BLAS()
+{
 	auto device = Device::GetDevice().GetInternalDevice();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// The entries are written once into staging memory and copied to the default heap, which the BLAS build and the
+	// intersection shader read at full speed. Large sets are written by all threads of the CPU thread pool.
+	uint64_t bufferSize = sizeof(Entry) * m_Entries.size();
+
+	auto& batcher = Device::GetDevice().GetUploadBatcher();
+
+	AllocateUAVBuffer(bufferSize, &m_AABBs, D3D12_RESOURCE_STATE_COMMON, L"ProceduralPrimitiveEntries");
+
+	StagingAllocation staging = batcher.AllocateStaging(bufferSize);
+	Entry* mappedEntries = reinterpret_cast<Entry*>(staging.CPUAddress);
+
+	cpu::ThreadPool::Get().ParallelFor(m_Entries.size(), EntryGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+	{
+		std::memcpy(mappedEntries + begin, m_Entries.data() + begin, sizeof(Entry) * (end - begin));
+	});
 
-	AllocateUploadBuffer(device.Get(), m_Entries.data(), sizeof(Entry), &m_AABBs);
+	// The staging memory pins the open batch, so the copy, the build and the buffers recycled below all stay in it
+	auto* cmdList = staging.CommandList;
+
+	// The buffer gets promoted from common to copy dest by the copy
+	cmdList->CopyBufferRegion(m_AABBs.Get(), 0, staging.Resource, staging.Offset, bufferSize);
+
+	auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_AABBs.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	cmdList->ResourceBarrier(1, &barrier);
+
+	// The same buffer holds the primitives for the intersection shader. The buffer is new, so it gets a new view, as
+	// the frames in flight can still read the old one.
+	auto* shaderHeap = Renderer::GetShaderHeap();
+	shaderHeap->Free(m_EntrySRV);
+	m_EntrySRV = shaderHeap->Allocate();
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
+	desc.Format = DXGI_FORMAT_UNKNOWN;
+	desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	desc.Buffer.StructureByteStride = sizeof(Entry);
+	desc.Buffer.NumElements = static_cast<uint32_t>(m_Entries.size());
+
+	device->CreateShaderResourceView(m_AABBs.Get(), &desc, shaderHeap->GetCPUHandle(m_EntrySRV));
 
 	D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc = {};
 	geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
 	geometryDesc.AABBs.AABBs = { m_AABBs->GetGPUVirtualAddress(), sizeof(Entry) };
-	geometryDesc.AABBs.AABBCount = m_Entries.size();
+	geometryDesc.AABBs.AABBCount = static_cast<UINT>(m_Entries.size());
 	geometryDesc.Flags = m_Flags;
 
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS blasInput = {};
@@ -36,20 +90,31 @@ void ProceduralPrimitive::BuildBLAS()
 
 	ASSERT(info.ResultDataMaxSizeInBytes > 0, "Failed to get prebuild data");
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> scratchResource;
-	AllocateUAVBuffer(device.Get(), info.ScratchDataSizeInBytes, &scratchResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
-	AllocateUAVBuffer(device.Get(), info.ResultDataMaxSizeInBytes, &m_BLAS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"BottomLevelAccelerationStructure");
+	// See Mesh::BuildBLAS
+	auto& pool = Device::GetDevice().GetBufferPool();
+	batcher.Recycle(PooledBufferType::AccelerationStructure, std::move(m_BLAS));
+
+	auto scratchResource = pool.Acquire(PooledBufferType::Scratch, info.ScratchDataSizeInBytes);
+	m_BLAS = pool.Acquire(PooledBufferType::AccelerationStructure, info.ResultDataMaxSizeInBytes);
 
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC bottomLevelBuildDesc = {};
 	bottomLevelBuildDesc.Inputs = blasInput;
 	bottomLevelBuildDesc.ScratchAccelerationStructureData = scratchResource->GetGPUVirtualAddress();
 	bottomLevelBuildDesc.DestAccelerationStructureData = m_BLAS->GetGPUVirtualAddress();
 
-	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
-	auto cmdList = CreateCommandList();
+	m_Statistics.UploadTime = Seconds(start);
+	start = std::chrono::high_resolution_clock::now();
+
+	cmdList->BuildRaytracingAccelerationStructure(&bottomLevelBuildDesc, 0, nullptr);
+
+	const UploadToken token = batcher.GetToken();
+	batcher.Recycle(PooledBufferType::Scratch, scratchResource);
+
+	// Submits the batch now, if it filled up while it was pinned
+	staging.Release();
 
-	cmdList.CommandList->BuildRaytracingAccelerationStructure(&bottomLevelBuildDesc, 0, nullptr);
+	// Only the recording, the copy and the build run on the GPU with the next flush of the upload batcher
+	m_Statistics.BuildTime = Seconds(start);
 
-	auto fence = cmdQueue.ExecuteCommandLists({ cmdList.CommandList.Get() });
-	cmdQueue.WaitForFence(fence);
+	return token;
 }
\ No newline at end of file
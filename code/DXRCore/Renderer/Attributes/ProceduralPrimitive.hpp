@@ -1,25 +1,83 @@
 #pragma once
 
+#if !defined(DXR_HEADLESS)
 #include <d3d12.h>
 #include <wrl/client.h>
+#endif
 
 #include <DirectXMath.h>
 
+#include <functional>
+#include <vector>
+
 #include <DXRCore/Utils/Assert.hpp>
 
+#include <DXRCore/CPU/BottomLevelAS.hpp>
+#include <DXRCore/Shaders/Primitives.hpp>
+
+#include <DXRCore/Renderer/Attributes/UploadToken.hpp>
+
+// The D3D12 half of ProceduralPrimitive is in ProceduralPrimitive.cpp, the CPU half in ProceduralPrimitiveCPU.cpp, see
+// Mesh
 class ProceduralPrimitive
 {
 public:
+	// Same layout as primitives::PrimitiveEntry, which the intersection shader reads. The AABB has the layout of
+	// D3D12_RAYTRACING_AABB.
 	struct alignas(8) Entry
 	{
-		D3D12_RAYTRACING_AABB AABB;
-		DirectX::XMFLOAT3 Position;
-		float Padding;
+		cpu::AABB AABB;
+		primitives::Primitive Primitive;
 	};
+
+	ProceduralPrimitive() = default;
+#if !defined(DXR_HEADLESS)
+	~ProceduralPrimitive();
+#endif
+
+	ProceduralPrimitive(const ProceduralPrimitive&) = delete;
+	ProceduralPrimitive& operator=(const ProceduralPrimitive&) = delete;
+
+	// Entry with the AABB that fits the primitive
+	static Entry MakeEntry(const primitives::Primitive& primitive);
 	
+	// Timings of the last BuildBLAS, and of the GenerateEntries calls before it. With D3D12 the build time is the time
+	// to record the build, as it runs with the other work of the upload batcher.
+	struct BuildStatistics
+	{
+		uint64_t EntryCount = 0;
+
+		double GenerateTime = 0.0;
+		double UploadTime = 0.0;
+		double BuildTime = 0.0;
+	};
+
 	void AddEntry(const Entry& entry);
-	void BuildBLAS();
+
+	// Appends count entries with a single copy
+	void AddEntries(const Entry* entries, uint64_t count);
+
+	// Appends count entries made by generator(index), which is called from all threads of the CPU thread pool. Meant
+	// for sets of millions of entries, like particles or point clouds.
+	void GenerateEntries(uint64_t count, const std::function<Entry(uint64_t index)>& generator);
+
+	void Reserve(uint64_t count)
+	{
+		m_Entries.reserve(count);
+	}
+
+	uint64_t GetEntryCount() const
+	{
+		return m_Entries.size();
+	}
+
+	// Mask of the types of the entries, by 1 << type, for a permutation of the intersection shader without the others
+	uint32_t GetPrimitiveTypes() const;
+
+	// Records the upload of the entries and the build into the upload batcher, see Mesh::BuildBLAS
+	UploadToken BuildBLAS();
 	
+#if !defined(DXR_HEADLESS)
 	D3D12_GPU_VIRTUAL_ADDRESS GetBLASAddress() const
 	{
 		return m_BLAS->GetGPUVirtualAddress();
@@ -29,22 +87,59 @@ public:
 	{
 		m_Flags = flags;
 	}
+#endif
+
+	// Descriptor heap index of the structured buffer of entries
+	uint32_t GetEntrySRV() const
+	{
+		return m_EntrySRV;
+	}
 
 	void SetHitGroupIndex(uint32_t hitGroupIndex)
 	{
 		m_HitGroupIdx = hitGroupIndex;
 	}
 
+	const cpu::BottomLevelAS& GetCPUBLAS() const
+	{
+		return m_CPUBLAS;
+	}
+
+	const BuildStatistics& GetBuildStatistics() const
+	{
+		return m_Statistics;
+	}
+
 private:
 	friend class TLAS;
 
-	std::vector<Entry> m_Entries;
+	// Entries per chunk of the parallel loops, large enough that a chunk takes longer than handing it to a thread
+	static constexpr uint64_t EntryGrainSize = 16384;
+
+#if !defined(DXR_HEADLESS)
+	UploadToken BuildD3D12BLAS();
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_AABBs;
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_BLAS;
 
-	uint32_t m_HitGroupIdx = 0;
 	D3D12_RAYTRACING_GEOMETRY_FLAGS m_Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+#endif
+
+	std::vector<Entry> m_Entries;
+
+	// Stays -1 with the CPU backend
+	uint32_t m_EntrySRV = static_cast<uint32_t>(-1);
+
+	uint32_t m_HitGroupIdx = 0;
+
+	BuildStatistics m_Statistics;
+
+	// Time of the GenerateEntries calls since the last BuildBLAS, which reports it in m_Statistics
+	double m_PendingGenerateTime = 0.0;
+
+	// Only used with the CPU backend
+	cpu::ProceduralGeometry m_CPUGeometry;
+	cpu::BottomLevelAS m_CPUBLAS;
 };
 
 class ProceduralPrimitiveInstance
@@ -55,14 +150,19 @@ public:
 		m_ProceduralPrimitive = primitive;
 	}
 
+#if !defined(DXR_HEADLESS)
 	D3D12_GPU_VIRTUAL_ADDRESS GetBLASAddress() const
 	{
 		return m_ProceduralPrimitive->GetBLASAddress();
 	}
+#endif
 
+#if defined(_MSC_VER)
+	// See MeshInstance
 	_declspec(property(put = SetRotation)) DirectX::XMFLOAT4 Rotation;
 	_declspec(property(put = SetTranslation)) DirectX::XMFLOAT3 Translation;
 	_declspec(property(put = SetScale)) DirectX::XMFLOAT3 Scale;
+#endif
 
 	void SetTranslation(const DirectX::XMFLOAT3& translation)
 	{
@@ -85,11 +185,13 @@ public:
 	void SetReflectanceCoefficient(float reflectance)
 	{
 		m_Reflectance = reflectance;
+		IsDirty = true;
 	}
 
 	void SetColor(const DirectX::XMFLOAT4& color)
 	{
 		m_Color = color;
+		IsDirty = true;
 	}
 
 	DirectX::XMMATRIX GetMatrix() const
@@ -0,0 +1,115 @@
+// Built without the precompiled header, d3d12.h pulls in Windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "ProceduralPrimitive.hpp"
+
+#include <DXRCore/Utils/CLI.hpp>
+
+#include <DXRCore/CPU/ThreadPool.hpp>
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+
+// The part of ProceduralPrimitive that builds without D3D12: the entries, the CPU backend, and the choice between the
+// backends
+
+static double Seconds(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static_assert(sizeof(ProceduralPrimitive::Entry) == sizeof(primitives::PrimitiveEntry), "The entry must have the same layout as primitives::PrimitiveEntry");
+static_assert(offsetof(ProceduralPrimitive::Entry, Primitive) == offsetof(primitives::PrimitiveEntry, Primitive), "The entry must have the same layout as primitives::PrimitiveEntry");
+
+ProceduralPrimitive::Entry ProceduralPrimitive::MakeEntry(const primitives::Primitive& primitive)
+{
+	Entry entry = {};
+	primitives::GetPrimitiveBounds(primitive, entry.AABB.Min, entry.AABB.Max);
+	entry.Primitive = primitive;
+
+	return entry;
+}
+
+void ProceduralPrimitive::AddEntry(const Entry& entry)
+{
+	m_Entries.push_back(entry);
+}
+
+void ProceduralPrimitive::AddEntries(const Entry* entries, uint64_t count)
+{
+	m_Entries.insert(m_Entries.end(), entries, entries + count);
+}
+
+uint32_t ProceduralPrimitive::GetPrimitiveTypes() const
+{
+	uint32_t types = 0;
+
+	for (const Entry& entry : m_Entries)
+	{
+		types |= 1u << entry.Primitive.Type;
+	}
+
+	return types;
+}
+
+void ProceduralPrimitive::GenerateEntries(uint64_t count, const std::function<Entry(uint64_t index)>& generator)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint64_t first = m_Entries.size();
+	m_Entries.resize(first + count);
+
+	Entry* entries = m_Entries.data() + first;
+	cpu::ThreadPool::Get().ParallelFor(count, EntryGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+	{
+		for (uint64_t i = begin; i < end; ++i)
+		{
+			entries[i] = generator(i);
+		}
+	});
+
+	m_PendingGenerateTime += Seconds(start);
+}
+
+UploadToken ProceduralPrimitive::BuildBLAS()
+{
+	ASSERT(!m_Entries.empty(), "No procedural primitive entries in the BLAS");
+	ASSERT(m_Entries.size() <= UINT_MAX, "Too many procedural primitive entries for one geometry");
+
+	m_Statistics.EntryCount = m_Entries.size();
+	m_Statistics.GenerateTime = m_PendingGenerateTime;
+	m_Statistics.UploadTime = 0.0;
+	m_Statistics.BuildTime = 0.0;
+
+	m_PendingGenerateTime = 0.0;
+
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		return BuildD3D12BLAS();
+	}
+#endif
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Copied in parallel, a rebuild replaces the previous primitives
+	m_CPUGeometry.Resize(m_Entries.size());
+	cpu::ThreadPool::Get().ParallelFor(m_Entries.size(), EntryGrainSize, [&](uint64_t begin, uint64_t end, uint32_t)
+	{
+		for (uint64_t i = begin; i < end; ++i)
+		{
+			m_CPUGeometry.SetPrimitive(i, m_Entries[i].AABB, m_Entries[i].Primitive);
+		}
+	});
+
+	m_Statistics.UploadTime = Seconds(start);
+	start = std::chrono::high_resolution_clock::now();
+
+	m_CPUBLAS.Build(m_CPUGeometry);
+
+	m_Statistics.BuildTime = Seconds(start);
+	return 0;
+}
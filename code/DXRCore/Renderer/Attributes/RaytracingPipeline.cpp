@@ -5,6 +5,144 @@
 
 #include <Utils/Error.hpp>
 #include <Utils/Assert.hpp>
+#include <Utils/CLI.hpp>
+
+#include <CPU/PipelineCache.hpp>
+#include <CPU/ShaderTable.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Hashes what the serialized root signature is made of, so it can be looked up without serializing it first
+	uint64_t GetRootSignatureKey(const D3D12_ROOT_SIGNATURE_DESC& desc)
+	{
+		cpu::PipelineKey key;
+		key.AddValue(desc.NumParameters);
+		key.AddValue(desc.NumStaticSamplers);
+		key.AddValue(desc.Flags);
+
+		for (uint32_t i = 0; i < desc.NumParameters; i++)
+		{
+			const D3D12_ROOT_PARAMETER& parameter = desc.pParameters[i];
+
+			key.AddValue(parameter.ParameterType);
+			key.AddValue(parameter.ShaderVisibility);
+
+			switch (parameter.ParameterType)
+			{
+			case D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE:
+				key.AddValue(parameter.DescriptorTable.NumDescriptorRanges);
+				key.Add(parameter.DescriptorTable.pDescriptorRanges, parameter.DescriptorTable.NumDescriptorRanges * sizeof(D3D12_DESCRIPTOR_RANGE));
+				break;
+			case D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
+				key.AddValue(parameter.Constants);
+				break;
+			default:
+				key.AddValue(parameter.Descriptor);
+				break;
+			}
+		}
+
+		key.Add(desc.pStaticSamplers, desc.NumStaticSamplers * sizeof(D3D12_STATIC_SAMPLER_DESC));
+
+		return key.Get();
+	}
+
+	// Hashes everything that goes into the state object. The DXIL is hashed in full, as a shader can change without
+	// changing its size.
+	uint64_t GetPipelineKey(const RaytracingPipelineDesc& desc, uint64_t rootSignatureKey, uint64_t localRootSignatureKey)
+	{
+		cpu::PipelineKey key;
+		key.AddValue(rootSignatureKey);
+		key.AddValue(localRootSignatureKey);
+		key.Add(desc.ShaderCode.pShaderBytecode, desc.ShaderCode.BytecodeLength);
+		key.Add(desc.RayGenEntry.EntryName);
+
+		key.AddValue(static_cast<uint32_t>(desc.HitGroups.size()));
+
+		for (const auto& hit : desc.HitGroups)
+		{
+			key.Add(hit.ClosestHit);
+			key.Add(hit.AnyHit);
+			key.Add(hit.Intersection);
+			key.Add(hit.HitGroup);
+			key.AddValue(hit.Type);
+		}
+
+		key.AddValue(static_cast<uint32_t>(desc.MissShaders.size()));
+
+		for (const auto& miss : desc.MissShaders)
+		{
+			key.Add(miss.EntryName);
+		}
+
+		key.AddValue(desc.PayloadSize);
+		key.AddValue(desc.AttributeSize);
+		key.AddValue(desc.RecursionDepth);
+
+		return key.Get();
+	}
+
+	bool HasLocalRootSignature(const RaytracingPipelineDesc& desc)
+	{
+		return desc.LocalRootSignatureDesc.NumParameters > 0;
+	}
+
+	// Where the arguments of the local root signature go in a shader record
+	cpu::ShaderRecordLayout GetRecordLayout(const D3D12_ROOT_SIGNATURE_DESC& desc)
+	{
+		cpu::ShaderRecordLayout layout;
+
+		for (uint32_t i = 0; i < desc.NumParameters; i++)
+		{
+			const D3D12_ROOT_PARAMETER& parameter = desc.pParameters[i];
+
+			if (parameter.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS)
+			{
+				layout.AddConstants(parameter.Constants.Num32BitValues);
+			}
+			else
+			{
+				layout.AddDescriptor();
+			}
+		}
+
+		ASSERT(layout.GetStride() <= cpu::MaxShaderRecordSize, "The local root arguments do not fit into a shader record");
+
+		return layout;
+	}
+
+	// Upload heap memory is read by the GPU in place, the table never changes once it is written
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreateShaderTable(const cpu::ShaderTable& table, const wchar_t* name)
+	{
+		auto device = Device::GetDevice().GetInternalDevice();
+
+		// A table without records still gets a buffer, so its address can be set
+		const uint64_t size = std::max<uint64_t>(table.GetSize(), cpu::ShaderRecordAlignment);
+
+		CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_NONE);
+		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+
+		if (FAILED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer))))
+		{
+			FatalError("Failed to create a shader table");
+		}
+
+		uint8_t* mappedData = nullptr;
+		CD3DX12_RANGE readRange(0, 0);
+		buffer->Map(0, &readRange, reinterpret_cast<void**>(&mappedData));
+		memcpy(mappedData, table.GetData(), table.GetSize());
+		buffer->Unmap(0, nullptr);
+
+		buffer->SetName(name);
+
+		return buffer;
+	}
+}
 
 RaytracingPipeline::RaytracingPipeline(std::string_view, void*)
 {
@@ -15,171 +153,229 @@ RaytracingPipeline::RaytracingPipeline(std::string_view, void*)
 
 RaytracingPipeline::RaytracingPipeline(const RaytracingPipelineDesc& desc)
 {
-	CreateGlobalRootSignature(desc);
-	CreatePipeline(desc);
+	// The CPU backend runs the shading in C++, so there is nothing to create
+	if (GetCLI().Backend == RenderBackend::CPU)
+	{
+		return;
+	}
+
+	RaytracingPipelineDesc localDesc = desc;
+	localDesc.LocalRootSignatureDesc.Flags |= D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
+
+	const uint64_t localRootSignatureKey = HasLocalRootSignature(desc) ? GetRootSignatureKey(localDesc.LocalRootSignatureDesc) : 0;
+	const HRESULT hr = Create(localDesc, GetRootSignatureKey(desc.RootSignatureDesc), localRootSignatureKey);
+
+	if (FAILED(hr))
+	{
+		FatalError("Failed to create a ray tracing state object. HResult: 0x%08X", hr);
+	}
+}
+
+RaytracingPipeline* RaytracingPipeline::Recompile(const D3D12_SHADER_BYTECODE& shaderCode, uint32_t recursionDepth) const
+{
+	RaytracingPipelineDesc desc = m_Desc;
+	desc.ShaderCode = shaderCode;
+	desc.RecursionDepth = recursionDepth;
+
+	// The root signatures are the same, and their descs are no longer around to create them from. The records of the
+	// hit groups are written again with the identifiers of the new state object.
+	RaytracingPipeline* pipeline = new RaytracingPipeline();
+	pipeline->m_RootSignature = m_RootSignature;
+	pipeline->m_LocalRootSignature = m_LocalRootSignature;
+	pipeline->m_HitGroupLayout = m_HitGroupLayout;
+	pipeline->m_HitGroupTable = m_HitGroupTable;
+	pipeline->m_HitGroupRecords = m_HitGroupRecords;
+
+	if (FAILED(pipeline->Create(desc, m_RootSignatureKey, m_LocalRootSignatureKey)))
+	{
+		delete pipeline;
+		return nullptr;
+	}
+
+	return pipeline;
+}
+
+HRESULT RaytracingPipeline::Create(const RaytracingPipelineDesc& desc, uint64_t rootSignatureKey, uint64_t localRootSignatureKey)
+{
+	auto& device = Device::GetDevice();
+
+	const uint64_t key = GetPipelineKey(desc, rootSignatureKey, localRootSignatureKey);
+
+	if (HasLocalRootSignature(desc))
+	{
+		m_HitGroupLayout = GetRecordLayout(desc.LocalRootSignatureDesc);
+	}
+
+	// A pipeline that was created before keeps its root signatures, which its state object was created with
+	if (const Device::PipelineObjects* objects = device.FindPipeline(key))
+	{
+		m_RootSignature = objects->RootSignature;
+		m_LocalRootSignature = objects->LocalRootSignature;
+		m_Pipeline = objects->StateObject;
+	}
+	else
+	{
+		if (m_RootSignature == nullptr)
+		{
+			CreateRootSignature(desc.RootSignatureDesc, rootSignatureKey, m_RootSignature);
+		}
+
+		if (m_LocalRootSignature == nullptr && HasLocalRootSignature(desc))
+		{
+			CreateRootSignature(desc.LocalRootSignatureDesc, localRootSignatureKey, m_LocalRootSignature);
+		}
+
+		const HRESULT hr = CreatePipeline(desc);
+
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		device.StorePipeline(key, { m_RootSignature, m_LocalRootSignature, m_Pipeline });
+
+		// Rewrites the file only when a root signature was serialized for this pipeline
+		device.GetPipelineCache().Save();
+	}
+
 	CreateShaderTables(desc);
+
+	m_Desc = desc;
+	m_Desc.RootSignatureDesc = {};
+	m_Desc.LocalRootSignatureDesc = {};
+	m_Desc.ShaderCode = {};
+	m_RootSignatureKey = rootSignatureKey;
+	m_LocalRootSignatureKey = localRootSignatureKey;
+
+	return S_OK;
 }
 
-void RaytracingPipeline::CreateGlobalRootSignature(const RaytracingPipelineDesc& desc)
+void RaytracingPipeline::CreateRootSignature(const D3D12_ROOT_SIGNATURE_DESC& desc, uint64_t key, Microsoft::WRL::ComPtr<ID3D12RootSignature>& rootSignature) const
 {
 	auto device = Device::GetDevice().GetInternalDevice();
+	auto& cache = Device::GetDevice().GetPipelineCache();
+
+	// The blob of an earlier run skips the serialization. A blob the driver does not take is serialized again.
+	if (const std::vector<uint8_t>* cached = cache.Find(key))
+	{
+		if (SUCCEEDED(device->CreateRootSignature(1, cached->data(), cached->size(), IID_PPV_ARGS(&rootSignature))))
+		{
+			return;
+		}
+
+		cache.Remove(key);
+	}
 
 	Microsoft::WRL::ComPtr<ID3DBlob> blob;
 	Microsoft::WRL::ComPtr<ID3DBlob> error;
 
-	auto hr = D3D12SerializeRootSignature(&desc.RootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &blob, &error);
+	auto hr = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &blob, &error);
 
 	if (FAILED(hr))
 	{
 		if (error != nullptr)
 		{
-			FatalError("Failed to serialize the global root signature.\nError returned: %s", error->GetBufferPointer());
+			FatalError("Failed to serialize a root signature.\nError returned: %s", error->GetBufferPointer());
 		}
 		else
 		{
-			FatalError("Failed to serialize the global root signature.");
+			FatalError("Failed to serialize a root signature.");
 		}
 	}
 
-	hr = device->CreateRootSignature(1, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&m_RootSignature));
+	hr = device->CreateRootSignature(1, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&rootSignature));
 
 	if (FAILED(hr))
 	{
 		FatalError("Failed to create a root signature");
 	}
+
+	// Written to disk by Create, once for all root signatures of the pipeline
+	cache.Store(key, blob->GetBufferPointer(), blob->GetBufferSize());
 }
 
 void RaytracingPipeline::CreateShaderTables(const RaytracingPipelineDesc& desc)
 {
-	// we do not support local root signatures (yet). support would mean that the buffer creation needs to be more flexable.
+	Microsoft::WRL::ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
 
-	auto device = Device::GetDevice().GetInternalDevice();
+	if (FAILED(m_Pipeline.As(&stateObjectProperties)))
+	{
+		FatalError("Failed to get the shader identifiers of the ray tracing pipeline");
+	}
 
-	void* rayGenShaderIdentifier;
-	//void* missShaderIdentifier;
-	//void* hitGroupShaderIdentifier;
+	// The ray generation and miss records are only the identifiers
+	const cpu::ShaderRecordLayout identifierLayout;
 
-	auto GetShaderIdentifiers = [&](auto* stateObjectProperties)
-		{
-			rayGenShaderIdentifier = stateObjectProperties->GetShaderIdentifier(desc.RayGenEntry.EntryName.data());
-			//missShaderIdentifier = stateObjectProperties->GetShaderIdentifier(desc.MissShaders[0].EntryName.data());
-			//hitGroupShaderIdentifier = stateObjectProperties->GetShaderIdentifier(desc.HitGroups[0].HitGroup.data());
-		};
+	cpu::ShaderTable rayGen(identifierLayout, 1);
+	rayGen.SetIdentifier(0, stateObjectProperties->GetShaderIdentifier(desc.RayGenEntry.EntryName.data()));
 
-	// Get shader identifiers.
-	uint32_t shaderIdentifierSize;
+	m_RayGenShaderTable = CreateShaderTable(rayGen, L"Ray Generation Shader Table");
 
-	Microsoft::WRL::ComPtr<ID3D12StateObjectProperties> stateObjectProperties;
+	cpu::ShaderTable miss(identifierLayout, static_cast<uint32_t>(desc.MissShaders.size()));
 
-	auto hr = m_Pipeline.As(&stateObjectProperties);
-	if (FAILED(hr))
+	for (uint32_t i = 0; i < desc.MissShaders.size(); i++)
 	{
-		FatalError("...");
+		miss.SetIdentifier(i, stateObjectProperties->GetShaderIdentifier(desc.MissShaders[i].EntryName.data()));
 	}
-	GetShaderIdentifiers(stateObjectProperties.Get());
-	shaderIdentifierSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 
-	const uint32_t shaderRecordAlignment = D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT;
+	m_MissShaderTable = CreateShaderTable(miss, L"Miss Shader Table");
 
-	auto Align = [](UINT size, UINT alignment) {
-		return (size + (alignment - 1)) & ~(alignment - 1);
-		};
+	m_HitGroupIdentifiers.resize(desc.HitGroups.size());
 
-	// Ray Gen 
+	for (uint32_t i = 0; i < desc.HitGroups.size(); i++)
 	{
-		UINT shaderRecordSize = Align(shaderIdentifierSize, shaderRecordAlignment);
-		UINT tableSize = shaderRecordSize;
-
-		// Create buffer
-		CD3DX12_RESOURCE_DESC descShader = CD3DX12_RESOURCE_DESC::Buffer(tableSize, D3D12_RESOURCE_FLAG_NONE);
-		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
+		memcpy(m_HitGroupIdentifiers[i].data(), stateObjectProperties->GetShaderIdentifier(desc.HitGroups[i].HitGroup.data()), cpu::ShaderIdentifierSize);
+	}
 
-		device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&descShader,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&m_RayGenShaderTable)
-		);
+	WriteHitGroupTable();
+}
 
-		// Map and copy data
-		uint8_t* mappedData = nullptr;
-		m_RayGenShaderTable->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
-		memcpy(mappedData, rayGenShaderIdentifier, shaderIdentifierSize);
-		m_RayGenShaderTable->Unmap(0, nullptr);
+void RaytracingPipeline::SetHitGroupTable(cpu::ShaderTable table, std::vector<uint32_t> hitGroups)
+{
+	ASSERT(table.GetStride() == m_HitGroupLayout.GetStride(), "The hit group table was not created by this pipeline");
+	ASSERT(table.GetRecordCount() == hitGroups.size(), "Every record needs a hit group");
 
-		m_RayGenShaderTable->SetName(L"Ray Generation Shader Table");
-	}
+	m_HitGroupTable = std::move(table);
+	m_HitGroupRecords = std::move(hitGroups);
 
-	// Miss
+	if (m_Pipeline == nullptr)
 	{
-		UINT shaderRecordSize = Align(shaderIdentifierSize, shaderRecordAlignment);
-		UINT tableSize = shaderRecordSize * static_cast<uint32_t>(desc.MissShaders.size());
+		return;
+	}
 
-		CD3DX12_RESOURCE_DESC descShader = CD3DX12_RESOURCE_DESC::Buffer(tableSize, D3D12_RESOURCE_FLAG_NONE);
-		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
+	// The frames in flight can still be reading the old table
+	Device::GetDevice().GetUploadBatcher().Retain(std::move(m_HitShaderTable));
 
-		device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&descShader,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&m_MissShaderTable)
-		);
+	WriteHitGroupTable();
+}
 
-		uint8_t* mappedData = nullptr;
-		m_MissShaderTable->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
+void RaytracingPipeline::WriteHitGroupTable()
+{
+	// Until SetHitGroupTable, every hit group has one record, with its local root arguments all 0
+	if (m_HitGroupRecords.empty())
+	{
+		cpu::ShaderTable table(m_HitGroupLayout, static_cast<uint32_t>(m_HitGroupIdentifiers.size()));
 
-		uint32_t offset = 0;
-		for (const auto& miss : desc.MissShaders)
+		for (uint32_t i = 0; i < m_HitGroupIdentifiers.size(); i++)
 		{
-			auto* missShader = stateObjectProperties->GetShaderIdentifier(miss.EntryName.data());
-			memcpy(mappedData + offset * shaderIdentifierSize, missShader, shaderIdentifierSize);
-
-			offset++;
+			table.SetIdentifier(i, m_HitGroupIdentifiers[i].data());
 		}
 
-		m_MissShaderTable->Unmap(0, nullptr);
-		m_RayGenShaderTable->SetName(L"Miss Shader Table");
+		m_HitShaderTable = CreateShaderTable(table, L"Hit Group Shader Table");
+		return;
 	}
 
-	// Hit
+	for (uint32_t i = 0; i < m_HitGroupRecords.size(); i++)
 	{
-		const UINT shaderRecordSize = Align(shaderIdentifierSize, shaderRecordAlignment);
-		const UINT tableSize = shaderRecordSize * static_cast<uint32_t>(desc.HitGroups.size());
-
-		CD3DX12_RESOURCE_DESC descShader = CD3DX12_RESOURCE_DESC::Buffer(tableSize, D3D12_RESOURCE_FLAG_NONE);
-		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
-
-		device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&descShader,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&m_HitShaderTable)
-		);
-
-		uint8_t* mappedData = nullptr;
-		m_HitShaderTable->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
+		ASSERT(m_HitGroupRecords[i] < m_HitGroupIdentifiers.size(), "A record points to a hit group that is not in the pipeline");
 
-		uint32_t offset = 0;
-		for (const auto& hit : desc.HitGroups)
-		{
-			auto* hitGroup = stateObjectProperties->GetShaderIdentifier(hit.HitGroup.data());
-			memcpy(mappedData + offset * shaderIdentifierSize, hitGroup, shaderIdentifierSize);
-
-			offset++;
-		}
-
-		m_HitShaderTable->Unmap(0, nullptr);
-		m_RayGenShaderTable->SetName(L"Hit Group Shader Table");
+		m_HitGroupTable.SetIdentifier(i, m_HitGroupIdentifiers[m_HitGroupRecords[i]].data());
 	}
+
+	m_HitShaderTable = CreateShaderTable(m_HitGroupTable, L"Hit Group Shader Table");
 }
 
-void RaytracingPipeline::CreatePipeline(const RaytracingPipelineDesc& desc)
+HRESULT RaytracingPipeline::CreatePipeline(const RaytracingPipelineDesc& desc)
 {
 	auto device = Device::GetDevice().GetInternalDevice();
 
@@ -221,7 +417,20 @@ void RaytracingPipeline::CreatePipeline(const RaytracingPipelineDesc& desc)
 	auto* shaderConfig = pipeline.CreateSubobject<CD3DX12_RAYTRACING_SHADER_CONFIG_SUBOBJECT>();
 	shaderConfig->Config(desc.PayloadSize, desc.AttributeSize);
 
-	// create local root signatures
+	// The local root signature goes to every hit group, so each of their records has the same layout
+	if (m_LocalRootSignature != nullptr)
+	{
+		auto* localRS = pipeline.CreateSubobject<CD3DX12_LOCAL_ROOT_SIGNATURE_SUBOBJECT>();
+		localRS->SetRootSignature(m_LocalRootSignature.Get());
+
+		auto* association = pipeline.CreateSubobject<CD3DX12_SUBOBJECT_TO_EXPORTS_ASSOCIATION_SUBOBJECT>();
+		association->SetSubobjectToAssociate(*localRS);
+
+		for (const auto& hit : desc.HitGroups)
+		{
+			association->AddExport(hit.HitGroup.data());
+		}
+	}
 
 	auto* globalRS = pipeline.CreateSubobject<CD3DX12_GLOBAL_ROOT_SIGNATURE_SUBOBJECT>();
 	globalRS->SetRootSignature(m_RootSignature.Get());
@@ -229,10 +438,5 @@ void RaytracingPipeline::CreatePipeline(const RaytracingPipelineDesc& desc)
 	auto pipelineConfig = pipeline.CreateSubobject<CD3DX12_RAYTRACING_PIPELINE_CONFIG_SUBOBJECT>();
 	pipelineConfig->Config(desc.RecursionDepth);
 
-	auto hr = device->CreateStateObject(pipeline, IID_PPV_ARGS(&m_Pipeline));
-
-	if (FAILED(hr))
-	{
-		FatalError("Failed to create a ray tracing state object. HResult: 0x%08X", hr);
-	}
+	return device->CreateStateObject(pipeline, IID_PPV_ARGS(&m_Pipeline));
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <string_view>
 #include <vector>
@@ -8,6 +9,8 @@
 
 #include <wrl/client.h>
 
+#include <DXRCore/CPU/ShaderTable.hpp>
+
 struct HitGroupEntry
 {
 	HitGroupEntry(std::wstring_view closestHit, std::wstring_view anyHit, std::wstring_view intersection, std::wstring_view hitGroup, D3D12_HIT_GROUP_TYPE type)
@@ -45,6 +48,10 @@ struct RaytracingPipelineDesc
 {
 	D3D12_ROOT_SIGNATURE_DESC RootSignatureDesc;
 
+	// Local root signature of every hit group, or no parameters when their records only hold the identifier. It gets
+	// the local flag, and its arguments are written into the records with SetHitGroupTable.
+	D3D12_ROOT_SIGNATURE_DESC LocalRootSignatureDesc = {};
+
 	RayGenEntry RayGenEntry;
 	std::vector<HitGroupEntry> HitGroups;
 	std::vector<MissShaderEntry> MissShaders;
@@ -85,29 +92,81 @@ public:
 		return m_RayGenShaderTable;
 	}
 
+	// Stride of the miss table, whose records are only the identifiers
 	constexpr uint64_t GetShaderTableSize() const
 	{
 		return D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 	}
 
+	// Stride of the hit group table, which grows with the local root arguments
+	uint64_t GetHitGroupStride() const
+	{
+		return m_HitGroupLayout.GetStride();
+	}
+
+	// A table of records laid out for the local root signature of the hit groups, for SetHitGroupTable
+	cpu::ShaderTable CreateHitGroupTable(uint32_t recordCount) const
+	{
+		return cpu::ShaderTable(m_HitGroupLayout, recordCount);
+	}
+
+	// Replaces the hit group table, which has one record per hit group until then. Record i is the hit group at
+	// hitGroups[i] in the desc, with the local root arguments that were written into the table. Pipelines recompiled
+	// from this one keep the records.
+	void SetHitGroupTable(cpu::ShaderTable table, std::vector<uint32_t> hitGroups);
+
+	// The records and hit groups of the last SetHitGroupTable, empty before it, to change a few records and set again
+	const cpu::ShaderTable& GetHitGroupRecords() const
+	{
+		return m_HitGroupTable;
+	}
+
+	const std::vector<uint32_t>& GetHitGroupRecordHitGroups() const
+	{
+		return m_HitGroupRecords;
+	}
+
 	RaytracingPipeline(const RaytracingPipelineDesc& desc);
+
+	// Creates a pipeline with the root signature, shaders and hit groups of this one, from other DXIL such as a
+	// permutation compiled at runtime. The names of the desc this pipeline was created with need to still be valid,
+	// which string literals are. Returns nullptr when the state object can not be created from the code.
+	RaytracingPipeline* Recompile(const D3D12_SHADER_BYTECODE& shaderCode, uint32_t recursionDepth) const;
 protected:
 	friend class Renderer;
 	RaytracingPipeline(std::string_view name, void* shaderCode);
 
 private:
-	void CreateGlobalRootSignature(const RaytracingPipelineDesc& desc);
-	//void CreateLocalRootSignatures();
+	RaytracingPipeline() = default;
+
+	HRESULT Create(const RaytracingPipelineDesc& desc, uint64_t rootSignatureKey, uint64_t localRootSignatureKey);
+
+	// Takes the serialized root signature from the pipeline cache when it has the key
+	void CreateRootSignature(const D3D12_ROOT_SIGNATURE_DESC& desc, uint64_t key, Microsoft::WRL::ComPtr<ID3D12RootSignature>& rootSignature) const;
 
 	void CreateShaderTables(const RaytracingPipelineDesc& desc);
+	void WriteHitGroupTable();
+
+	HRESULT CreatePipeline(const RaytracingPipelineDesc& desc);
 
-	void CreatePipeline(const RaytracingPipelineDesc& desc);
+	// The desc without the root signature and the shader code, which are only valid while the pipeline is created
+	RaytracingPipelineDesc m_Desc = {};
+	uint64_t m_RootSignatureKey = 0;
+	uint64_t m_LocalRootSignatureKey = 0;
 
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> m_RootSignature;
+	Microsoft::WRL::ComPtr<ID3D12RootSignature> m_LocalRootSignature;
 	Microsoft::WRL::ComPtr<ID3D12StateObject> m_Pipeline;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_RayGenShaderTable;
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_HitShaderTable;
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_MissShaderTable;
+
+	cpu::ShaderRecordLayout m_HitGroupLayout;
+	std::vector<std::array<uint8_t, cpu::ShaderIdentifierSize>> m_HitGroupIdentifiers;
+
+	// The records of SetHitGroupTable, kept to be written again with the identifiers of a recompiled pipeline
+	cpu::ShaderTable m_HitGroupTable;
+	std::vector<uint32_t> m_HitGroupRecords;
 };
 
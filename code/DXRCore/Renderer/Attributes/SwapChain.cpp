@@ -8,6 +8,16 @@
 #include <Utils/Assert.hpp>
 #include <Utils/Error.hpp>
 
+#include <iterator>
+
+SwapChain::~SwapChain()
+{
+    if (m_FrameLatencyWaitableObject != nullptr)
+    {
+        CloseHandle(m_FrameLatencyWaitableObject);
+    }
+}
+
 void SwapChain::Initialize(HWND hwnd, uint32_t width, uint32_t height)
 {
     m_TearingSupported = 1;
@@ -39,6 +49,13 @@ void SwapChain::Initialize(HWND hwnd, uint32_t width, uint32_t height)
     swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
     swapChainDesc.Flags = m_TearingSupported ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING : 0;
 
+    if (GetCLI().LowLatency)
+    {
+        swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
+
+    m_Flags = swapChainDesc.Flags;
+
     ID3D12CommandQueue* pCommandQueue = device.GetCommandQueue().GetCommandQueue().Get();
 
     Microsoft::WRL::ComPtr<IDXGISwapChain1> swapChain1;
@@ -67,45 +84,80 @@ void SwapChain::Initialize(HWND hwnd, uint32_t width, uint32_t height)
         m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&m_BackBuffers[i]));
     }
 
-    for (uint32_t i = 0; i < 2; i++)
+    if (GetCLI().LowLatency)
     {
-        device.GetInternalDevice()->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_CommandListAllocator[i]));
-        device.GetInternalDevice()->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_CommandListAllocator[i].Get(), nullptr, IID_PPV_ARGS(&m_CommandList[i]));
+        // A single queued frame, the next one is only started once it has been picked up for display
+        ASSERT(SUCCEEDED(m_SwapChain->SetMaximumFrameLatency(1)), "Failed to set the frame latency");
+        m_FrameLatencyWaitableObject = m_SwapChain->GetFrameLatencyWaitableObject();
     }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_TimerFrequency = frequency.QuadPart;
 }
 
-void SwapChain::Present(Microsoft::WRL::ComPtr<ID3D12Resource> renderTarget)
+void SwapChain::WaitForNextFrame()
 {
-	auto device = Device::GetDevice().GetInternalDevice();
-	auto& commandQueue = Device::GetDevice().GetCommandQueue();
-    auto& cmdList = m_CommandList[m_FrameNumber % 2];
-
-    if (m_FrameNumber > 1)
+    if (m_FrameLatencyWaitableObject != nullptr)
     {
-        m_CommandListAllocator[m_FrameNumber % 2]->Reset();
-        cmdList->Reset(m_CommandListAllocator[m_FrameNumber % 2].Get(), nullptr);
+        WaitForSingleObjectEx(m_FrameLatencyWaitableObject, 1000, TRUE);
     }
 
-	CD3DX12_RESOURCE_BARRIER barriers[2];
-	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
-	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_BackBuffers[m_CurrentBackBuffer].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    m_FrameStartTime = time.QuadPart;
+}
+
+void SwapChain::CopyToBackBuffer(ID3D12GraphicsCommandList7* cmdList, ID3D12Resource* renderTarget)
+{
+    ID3D12Resource* backBuffer = m_BackBuffers[m_CurrentBackBuffer].Get();
+
+    CD3DX12_RESOURCE_BARRIER barriers[2];
+    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
+
+    cmdList->ResourceBarrier(2, barriers);
+    cmdList->CopyResource(backBuffer, renderTarget);
+
+    barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(backBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
 
-	cmdList->ResourceBarrier(2, barriers);
-	cmdList->CopyResource(m_BackBuffers[m_CurrentBackBuffer].Get(), renderTarget.Get());
+    cmdList->ResourceBarrier(2, barriers);
+}
 
-	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(renderTarget.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
-	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_BackBuffers[m_CurrentBackBuffer].Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
+void SwapChain::Present()
+{
+    // The back buffers are only written by the command queue that presents them, which keeps the copies in order with
+    // the presents. The renderer limits how far ahead the CPU runs.
+    m_SwapChain->Present(m_VSyncEnabled ? 1 : 0, m_TearingSupported ? DXGI_PRESENT_ALLOW_TEARING : 0);
+    m_CurrentBackBuffer = m_SwapChain->GetCurrentBackBufferIndex();
 
-	cmdList->ResourceBarrier(2, barriers);
+    UINT presentCount = 0;
 
-	m_FenceValues[m_CurrentBackBuffer] = commandQueue.ExecuteCommandLists({cmdList.Get()});
+    if (SUCCEEDED(m_SwapChain->GetLastPresentCount(&presentCount)))
+    {
+        m_PresentTimes[presentCount % std::size(m_PresentTimes)] = { presentCount, m_FrameStartTime };
+    }
+
+    UpdateLatency();
+}
+
+void SwapChain::UpdateLatency()
+{
+    // Fails until the first frame is displayed, and while DXGI can not tell when frames are displayed
+    DXGI_FRAME_STATISTICS statistics = {};
 
-	m_SwapChain->Present(m_VSyncEnabled ? 1 : 0, m_TearingSupported ? DXGI_PRESENT_ALLOW_TEARING : 0);
-	m_CurrentBackBuffer = m_SwapChain->GetCurrentBackBufferIndex();
+    if (FAILED(m_SwapChain->GetFrameStatistics(&statistics)))
+    {
+        return;
+    }
 
-	commandQueue.WaitForFence(m_FenceValues[m_CurrentBackBuffer]);
+    const PresentTime& present = m_PresentTimes[statistics.PresentCount % std::size(m_PresentTimes)];
 
-    m_FrameNumber++;
+    if (present.PresentCount == statistics.PresentCount && statistics.SyncQPCTime.QuadPart > present.StartTime)
+    {
+        m_Latency = static_cast<float>((statistics.SyncQPCTime.QuadPart - present.StartTime) * 1000.0 / m_TimerFrequency);
+    }
 }
 
 void SwapChain::Resize(uint32_t width, uint32_t height)
@@ -115,17 +167,16 @@ void SwapChain::Resize(uint32_t width, uint32_t height)
         backBuffer.Reset();
     }
 
-    auto desc = m_BackBuffers[0]->GetDesc();
-
-    if (FAILED(m_SwapChain->ResizeBuffers(ms_BackBufferCount, width, height, desc.Format, desc.Flags)))
+    // The flags must match the ones the swap chain was created with
+    if (FAILED(m_SwapChain->ResizeBuffers(ms_BackBufferCount, width, height, DXGI_FORMAT_UNKNOWN, m_Flags)))
     {
         DebugBreak();
     }
 
-	for (uint32_t i = 0; i < ms_BackBufferCount; i++)
-	{
-		m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&m_BackBuffers[i]));
-	}
+    for (uint32_t i = 0; i < ms_BackBufferCount; i++)
+    {
+        m_SwapChain->GetBuffer(i, IID_PPV_ARGS(&m_BackBuffers[i]));
+    }
 
     m_CurrentBackBuffer = m_SwapChain->GetCurrentBackBufferIndex();
 }
\ No newline at end of file
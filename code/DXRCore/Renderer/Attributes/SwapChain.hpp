@@ -1,14 +1,30 @@
 #pragma once
 
-#include <queue>
-
 class SwapChain
 {
 public:
+	~SwapChain();
+
 	void Initialize(HWND hwnd, uint32_t width, uint32_t height);
-	void Present(Microsoft::WRL::ComPtr<ID3D12Resource> renderTarget);
+
+	// With '-low-latency', blocks until the swap chain can take another frame. Called before the input of a frame is
+	// read, which is the start of the latency that GetLatency measures.
+	void WaitForNextFrame();
+
+	// Records the copy of the render target into the current back buffer
+	void CopyToBackBuffer(ID3D12GraphicsCommandList7* cmdList, ID3D12Resource* renderTarget);
+
+	// Presents the back buffer that CopyToBackBuffer was recorded for. The copy must have been submitted before.
+	void Present();
+
 	void Resize(uint32_t width, uint32_t height);
 
+	// Milliseconds between the start of a recent frame and it being displayed, or 0 when DXGI has not reported it
+	float GetLatency() const
+	{
+		return m_Latency;
+	}
+
 	static constexpr uint32_t GetBackBufferCount()
 	{
 		return ms_BackBufferCount;
@@ -19,28 +35,31 @@ protected:
 private:
 	static constexpr uint32_t ms_BackBufferCount = 2u;
 
-	Microsoft::WRL::ComPtr<IDXGISwapChain4> m_SwapChain;
-	Microsoft::WRL::ComPtr<ID3D12Resource> m_BackBuffers[ms_BackBufferCount];
-
-	uint64_t m_FenceValues[ms_BackBufferCount];
-
-	struct CommandList
+	struct PresentTime
 	{
-		uint64_t FenceValue;
-		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> CmdList;
-		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+		uint32_t PresentCount = 0;
+		int64_t StartTime = 0;
 	};
 
-	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> m_CommandList[2];
-	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_CommandListAllocator[2];
+	void UpdateLatency();
 
-	uint64_t m_FrameNumber = 0;
+	Microsoft::WRL::ComPtr<IDXGISwapChain4> m_SwapChain;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_BackBuffers[ms_BackBufferCount];
+
+	// Only created with '-low-latency'
+	HANDLE m_FrameLatencyWaitableObject = nullptr;
 
+	uint32_t m_Flags = 0;
 	uint32_t m_CurrentBackBuffer;
 
+	// Start of the frames that are queued for presentation, by their present count
+	PresentTime m_PresentTimes[8];
+	int64_t m_FrameStartTime = 0;
+	int64_t m_TimerFrequency = 1;
+	float m_Latency = 0.0f;
+
 	uint32_t m_TearingSupported : 1;
 	uint32_t m_VSyncEnabled : 1;
 };
 
 static_assert(SwapChain::GetBackBufferCount() > 1, "The back buffer count needs to be more than 1");
-
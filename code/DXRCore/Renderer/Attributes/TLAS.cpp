@@ -4,32 +4,34 @@
 #include "Device.hpp"
 #include "Mesh.hpp"
 #include "ProceduralPrimitive.hpp"
+#include "RaytracingPipeline.hpp"
 
 #include <Renderer/Helper.hpp>
 
 #include <2_Lighting/Shaders/Shared.hpp> // i hate this...
 
-void TLAS::AddMesh(MeshInstance* mesh)
-{
-	mesh->IsDirty = true; // Ensure that it is labeled as dirty, so we rebuild the tlas
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 
-	m_Meshes.push_back(mesh);
-}
+static_assert(sizeof(cpu::PackedInstanceDesc) == sizeof(D3D12_RAYTRACING_INSTANCE_DESC) &&
+	offsetof(cpu::PackedInstanceDesc, AccelerationStructure) == offsetof(D3D12_RAYTRACING_INSTANCE_DESC, AccelerationStructure),
+	"The instances are packed as D3D12_RAYTRACING_INSTANCE_DESC");
 
-void TLAS::AddProceduralPrimitive(ProceduralPrimitiveInstance* primitive)
+void TLAS::BuildD3D12()
 {
-	primitive->IsDirty = true; // Ensure that it is labeled as dirty, so we rebuild the tlas
+	GatherInstances();
 
-	m_ProceduralPrimitives.push_back(primitive);
-}
+	m_InstanceCount = m_Instances.GetCount();
+	m_UpdateCount = 0;
+	m_RebuildPending = false;
 
-void TLAS::Build()
-{
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+	// Every build allows updates, a refit of the instances is far cheaper than building the TLAS again
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS tlasInput = {};
 	tlasInput.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 	tlasInput.Flags = buildFlags;
-	tlasInput.NumDescs = static_cast<uint32_t>(m_Meshes.size() + m_ProceduralPrimitives.size());
+	tlasInput.NumDescs = m_InstanceCount;
 	tlasInput.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 
 	auto device = Device::GetDevice().GetInternalDevice();
@@ -38,12 +40,43 @@ void TLAS::Build()
 	device->GetRaytracingAccelerationStructurePrebuildInfo(&tlasInput, &info);
 	ASSERT(info.ResultDataMaxSizeInBytes > 0, "...");
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> scratchResource;
-	AllocateUAVBuffer(device.Get(), info.ScratchDataSizeInBytes, &scratchResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
-	AllocateUAVBuffer(device.Get(), info.ResultDataMaxSizeInBytes, &m_TLAS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"TopLevelAccelerationStructure");
+	// Building again, after instances were added, reuses the buffers of the last build once the GPU is done with them
+	auto& pool = Device::GetDevice().GetBufferPool();
+	auto& batcher = Device::GetDevice().GetUploadBatcher();
 
-	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> meshes;
-	meshes.reserve(m_Meshes.size() + m_ProceduralPrimitives.size());
+	batcher.Recycle(PooledBufferType::Scratch, std::move(m_ScratchResource));
+	batcher.Recycle(PooledBufferType::AccelerationStructure, std::move(m_TLAS));
+
+	m_ScratchResource = pool.Acquire(PooledBufferType::Scratch, std::max(info.ScratchDataSizeInBytes, info.UpdateScratchDataSizeInBytes));
+	m_TLAS = pool.Acquire(PooledBufferType::AccelerationStructure, info.ResultDataMaxSizeInBytes);
+
+	WriteInstanceDescs();
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelBuildDesc = {};
+	tlasInput.InstanceDescs = m_InstanceDescs->GetGPUVirtualAddress();
+	topLevelBuildDesc.Inputs = tlasInput;
+	topLevelBuildDesc.DestAccelerationStructureData = m_TLAS->GetGPUVirtualAddress();
+	topLevelBuildDesc.ScratchAccelerationStructureData = m_ScratchResource->GetGPUVirtualAddress();
+
+	// Goes into the same batch as the BLAS builds and uploads recorded before it, behind a barrier for all of them, so
+	// the whole scene costs one submission and one wait
+	auto* cmdList = batcher.GetCommandList();
+
+	auto barrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+	cmdList->ResourceBarrier(1, &barrier);
+
+	cmdList->BuildRaytracingAccelerationStructure(&topLevelBuildDesc, 0, nullptr);
+
+	batcher.Wait(batcher.GetToken());
+
+	ClearDirtyFlags();
+}
+
+void TLAS::WriteHitGroupRecords(RaytracingPipeline& pipeline) const
+{
+	// Same instances in the same order as GetInstanceDescs, so the record of an instance is at its index
+	std::vector<hlsl::Mesh> meshData;
+	std::vector<uint32_t> hitGroups;
 
 	for (const auto& mesh : m_Meshes)
 	{
@@ -52,25 +85,16 @@ void TLAS::Build()
 			continue;
 		}
 
-		D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
-		instanceDesc.InstanceMask = 1;
-		instanceDesc.AccelerationStructure = mesh->GetBLASAddress();
-		instanceDesc.InstanceID = 0;
-		
-		auto transform = mesh->GetMatrix();
-		auto m = XMMatrixTranspose(transform);
-
-		for (int i = 0; i < 3; ++i)
-		{
-			instanceDesc.Transform[i][0] = DirectX::XMVectorGetX(m.r[i]);
-			instanceDesc.Transform[i][1] = DirectX::XMVectorGetY(m.r[i]);
-			instanceDesc.Transform[i][2] = DirectX::XMVectorGetZ(m.r[i]);
-			instanceDesc.Transform[i][3] = DirectX::XMVectorGetW(m.r[i]);
-		}
+		hlsl::Mesh model = {};
 
-		//instanceDesc.Transform[0][0] = instanceDesc.Transform[1][1] = instanceDesc.Transform[2][2] = 1;
+		model.Color = mesh->m_Color;
+		model.Reflectance = mesh->m_Reflectance;
+		model.IndexIdx = mesh->m_Mesh->m_IndexSRV;
+		model.NormalIdx = mesh->m_Mesh->m_NormalSRV;
+		model.UV0Idx = mesh->m_Mesh->m_UV0SRV;
 
-		meshes.push_back(instanceDesc);
+		meshData.push_back(model);
+		hitGroups.push_back(0);
 	}
 
 	for (const auto& primitive : m_ProceduralPrimitives)
@@ -80,69 +104,35 @@ void TLAS::Build()
 			continue;
 		}
 
-
-		D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
-		instanceDesc.InstanceMask = 1;
-		instanceDesc.AccelerationStructure = primitive->GetBLASAddress();
-		instanceDesc.InstanceID = 0;
-		instanceDesc.InstanceContributionToHitGroupIndex = primitive->m_ProceduralPrimitive->m_HitGroupIdx;
-
-		auto transform = primitive->GetMatrix();
-		auto m = XMMatrixTranspose(transform);
-
-		for (int i = 0; i < 3; ++i)
-		{
-			instanceDesc.Transform[i][0] = DirectX::XMVectorGetX(m.r[i]);
-			instanceDesc.Transform[i][1] = DirectX::XMVectorGetY(m.r[i]);
-			instanceDesc.Transform[i][2] = DirectX::XMVectorGetZ(m.r[i]);
-			instanceDesc.Transform[i][3] = DirectX::XMVectorGetW(m.r[i]);
-		}
-
-		//instanceDesc.Transform[0][0] = instanceDesc.Transform[1][1] = instanceDesc.Transform[2][2] = 1;
-
-		meshes.push_back(instanceDesc);
+		hitGroups.push_back(primitive->m_ProceduralPrimitive->m_HitGroupIdx);
 	}
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> instanceDesc;
-	AllocateUploadBuffer(device.Get(), meshes.data(), sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * meshes.size(), &instanceDesc, L"InstanceDescs");
-
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelBuildDesc = {};
-	tlasInput.InstanceDescs = instanceDesc->GetGPUVirtualAddress();
-	topLevelBuildDesc.Inputs = tlasInput;
-	topLevelBuildDesc.DestAccelerationStructureData = m_TLAS->GetGPUVirtualAddress();
-	topLevelBuildDesc.ScratchAccelerationStructureData = scratchResource->GetGPUVirtualAddress();
-
-	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
-	auto cmdList = CreateCommandList();
+	cpu::ShaderTable table = pipeline.CreateHitGroupTable(static_cast<uint32_t>(hitGroups.size()));
 
-	cmdList.CommandList->BuildRaytracingAccelerationStructure(&topLevelBuildDesc, 0, nullptr);
+	for (uint32_t i = 0; i < meshData.size(); i++)
+	{
+		table.SetConstants(i, 0, meshData[i]);
+	}
 
-	// consider making batches rather calling the commandqueue once per mesh
-	auto fence = cmdQueue.ExecuteCommandLists({ cmdList.CommandList.Get() });
-	cmdQueue.WaitForFence(fence);
+	pipeline.SetHitGroupTable(std::move(table), std::move(hitGroups));
+}
 
-	std::vector<hlsl::Mesh> meshData;
-	meshData.reserve(m_Meshes.size());
+void TLAS::UpdateHitGroupRecords(RaytracingPipeline& pipeline) const
+{
+	cpu::ShaderTable table = pipeline.GetHitGroupRecords();
 
-	for (const auto& mesh : m_Meshes)
+	// Nothing to update before WriteHitGroupRecords, or after the instances changed without it
+	if (table.GetRecordCount() != m_Instances.GetCount())
 	{
-		hlsl::Mesh model = {};
-
-		model.Color = mesh->m_Color;
-		model.Reflectance = mesh->m_Reflectance;
-		model.IndexIdx = mesh->m_Mesh->m_IndexSRV;
-		model.NormalIdx = mesh->m_Mesh->m_NormalSRV;
-		model.UV0Idx = mesh->m_Mesh->m_UV0SRV;
-
-		meshData.push_back(model);
+		return;
 	}
 
-	AllocateUploadBuffer(device.Get(), meshData.data(), sizeof(hlsl::Mesh) * meshData.size(), &m_GeometryData);
-}
+	const uint32_t offset = table.GetLayout().GetArgumentOffset(0);
 
-void TLAS::Build(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
-{
-	bool isDirty = false;
+	bool changed = false;
+	uint32_t index = 0;
+
+	// Same order as WriteHitGroupRecords. The material is compared as well, as moving an instance also makes it dirty.
 	for (const auto& mesh : m_Meshes)
 	{
 		if (mesh == nullptr || !mesh)
@@ -152,37 +142,102 @@ void TLAS::Build(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
 
 		if (mesh->IsDirty)
 		{
-			// We found a mesh that needs to be updated. Rebuild/refit is needed
-			isDirty = true;
-			break;
+			hlsl::Mesh model = {};
+			memcpy(&model, table.GetRecord(index) + offset, sizeof(model));
+
+			if (memcmp(&model.Color, &mesh->m_Color, sizeof(model.Color)) != 0 || model.Reflectance != mesh->m_Reflectance)
+			{
+				model.Color = mesh->m_Color;
+				model.Reflectance = mesh->m_Reflectance;
+
+				table.SetConstants(index, 0, model);
+				changed = true;
+			}
 		}
+
+		index++;
 	}
 
+	if (changed)
+	{
+		pipeline.SetHitGroupTable(std::move(table), pipeline.GetHitGroupRecordHitGroups());
+	}
+}
+
+void TLAS::UpdateD3D12(ID3D12GraphicsCommandList7* cmdList)
+{
 	// Check if the TLAS is dirty
-	if (!isDirty)
+	if (!UpdateDirtyGeometry(cmdList))
 	{
 		return;
 	}
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+	WriteInstanceDescs();
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
 	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS tlasInput = {};
 	tlasInput.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 	tlasInput.Flags = buildFlags;
-	tlasInput.NumDescs = static_cast<uint32_t>(m_Meshes.size());
+	tlasInput.NumDescs = m_InstanceCount;
 	tlasInput.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+	tlasInput.InstanceDescs = m_InstanceDescs->GetGPUVirtualAddress();
 
-	auto device = Device::GetDevice().GetInternalDevice();
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelBuildDesc = {};
+	topLevelBuildDesc.DestAccelerationStructureData = m_TLAS->GetGPUVirtualAddress();
+	topLevelBuildDesc.ScratchAccelerationStructureData = m_ScratchResource->GetGPUVirtualAddress();
 
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
-	device->GetRaytracingAccelerationStructurePrebuildInfo(&tlasInput, &info);
-	ASSERT(info.ResultDataMaxSizeInBytes > 0, "...");
+	// Refit in place, and rebuild into the same buffer once in a while so the tree does not degrade. A refit keeps the
+	// bounds of the old BLAS, so a rebuild is also needed when an instance got another one.
+	if (!m_RebuildPending && ++m_UpdateCount < m_RebuildInterval)
+	{
+		tlasInput.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+		topLevelBuildDesc.SourceAccelerationStructureData = m_TLAS->GetGPUVirtualAddress();
+	}
+	else
+	{
+		m_UpdateCount = 0;
+		m_RebuildPending = false;
+	}
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> scratchResource;
-	AllocateUAVBuffer(device.Get(), info.ScratchDataSizeInBytes, &scratchResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, L"ScratchResource");
-	AllocateUAVBuffer(device.Get(), info.ResultDataMaxSizeInBytes, &m_TLAS, D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, L"TopLevelAccelerationStructure");
+	topLevelBuildDesc.Inputs = tlasInput;
 
-	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> meshes;
-	meshes.reserve(m_Meshes.size());
+	cmdList->BuildRaytracingAccelerationStructure(&topLevelBuildDesc, 0, nullptr);
+
+	auto barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_TLAS.Get());
+	cmdList->ResourceBarrier(1, &barrier);
+
+	ClearDirtyFlags();
+}
+
+void TLAS::WriteInstanceDescs()
+{
+	// The frames in flight can still read the instances of the last build or update, so they go back to the pool and
+	// the instances are written into a buffer that the GPU is done with. Once the pool holds a few of them, moving
+	// instances no longer creates any resources.
+	auto& pool = Device::GetDevice().GetBufferPool();
+	const uint64_t size = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * m_Instances.GetCount();
+
+	pool.Release(PooledBufferType::Upload, std::move(m_InstanceDescs));
+	m_InstanceDescs = pool.Acquire(PooledBufferType::Upload, size);
+
+	void* mappedData = nullptr;
+	CD3DX12_RANGE readRange(0, 0);
+	m_InstanceDescs->Map(0, &readRange, &mappedData);
+
+	// Upload heaps are write-combined, the instances are written once and in whole cache lines, on every thread
+	m_Instances.Pack(static_cast<cpu::PackedInstanceDesc*>(mappedData));
+
+#if defined _DEBUG
+	// Reads the write-combined memory back, which is slow, so only in debug builds
+	ValidateInstanceDescs(static_cast<const cpu::PackedInstanceDesc*>(mappedData));
+#endif
+
+	m_InstanceDescs->Unmap(0, nullptr);
+}
+
+void TLAS::ValidateInstanceDescs(const cpu::PackedInstanceDesc* descs) const
+{
+	uint32_t index = 0;
 
 	for (const auto& mesh : m_Meshes)
 	{
@@ -191,36 +246,19 @@ void TLAS::Build(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList)
 			continue;
 		}
 
-		D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
-		instanceDesc.InstanceMask = 1;
-		instanceDesc.AccelerationStructure = mesh->GetBLASAddress();
-		instanceDesc.InstanceID = 0;
-
-		auto transform = mesh->GetMatrix();
-		auto m = XMMatrixTranspose(transform);
+		ASSERT(descs[index].AccelerationStructure == mesh->GetBLASAddress(), "Instance %u points to an old BLAS", index);
+		index++;
+	}
 
-		for (int i = 0; i < 3; ++i)
+	for (const auto& primitive : m_ProceduralPrimitives)
+	{
+		if (primitive == nullptr || !primitive)
 		{
-			instanceDesc.Transform[i][0] = DirectX::XMVectorGetX(m.r[i]);
-			instanceDesc.Transform[i][1] = DirectX::XMVectorGetY(m.r[i]);
-			instanceDesc.Transform[i][2] = DirectX::XMVectorGetZ(m.r[i]);
-			instanceDesc.Transform[i][3] = DirectX::XMVectorGetW(m.r[i]);
+			continue;
 		}
 
-		meshes.push_back(instanceDesc);
+		ASSERT(descs[index].AccelerationStructure == primitive->GetBLASAddress(), "Instance %u points to an old BLAS", index);
+		ASSERT(descs[index].InstanceID == primitive->m_ProceduralPrimitive->m_EntrySRV, "Instance %u points to old entries", index);
+		index++;
 	}
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> instanceDesc;
-	AllocateUploadBuffer(device.Get(), meshes.data(), sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * meshes.size(), &instanceDesc, L"InstanceDescs");
-
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelBuildDesc = {};
-	tlasInput.InstanceDescs = instanceDesc->GetGPUVirtualAddress();
-	topLevelBuildDesc.Inputs = tlasInput;
-	topLevelBuildDesc.DestAccelerationStructureData = m_TLAS->GetGPUVirtualAddress();
-	topLevelBuildDesc.ScratchAccelerationStructureData = scratchResource->GetGPUVirtualAddress();
-
-	cmdList->BuildRaytracingAccelerationStructure(&topLevelBuildDesc, 0, nullptr);
-
-	auto barrier = CD3DX12_RESOURCE_BARRIER::UAV(m_TLAS.Get());
-	cmdList->ResourceBarrier(1, &barrier);
 }
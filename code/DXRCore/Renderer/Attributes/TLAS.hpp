@@ -1,10 +1,18 @@
 #pragma once
 
+#if defined(DXR_HEADLESS)
+struct ID3D12GraphicsCommandList7;
+#else
 #include <d3d12.h>
 #include <wrl/client.h>
+#endif
 
 #include <unordered_set>
 
+#include <DXRCore/CPU/InstanceStore.hpp>
+#include <DXRCore/CPU/Scene.hpp>
+
+// The D3D12 half of TLAS is in TLAS.cpp, the instances and the CPU half in TLASCPU.cpp, see Mesh
 class TLAS
 {
 public:
@@ -12,24 +20,112 @@ public:
 
 	void AddMesh(class MeshInstance* mesh);
 	void AddProceduralPrimitive(class ProceduralPrimitiveInstance* primitive);
+	// Builds the TLAS from scratch and waits for it
 	void Build();
-	void Build(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> cmdList);
 
+	// Per frame update. Records a refit of every BLAS whose mesh got new positions, and a refit of the TLAS when an
+	// instance moved, into the command list. The TLAS gets rebuilt instead of refitted once every rebuild interval.
+	// The instances must be the same as in the last Build(). The CPU backend updates right away, without a command list.
+	// With the pipeline of WriteHitGroupRecords, the records of the meshes whose color or reflectance changed are
+	// written into its hit group table again.
+	void Build(ID3D12GraphicsCommandList7* cmdList, class RaytracingPipeline* pipeline = nullptr);
+
+	// See Mesh::SetRebuildInterval
+	void SetRebuildInterval(uint32_t interval)
+	{
+		m_RebuildInterval = interval;
+	}
+
+#if !defined(DXR_HEADLESS)
 	D3D12_GPU_VIRTUAL_ADDRESS GetVirtualAddress() const
 	{
 		return m_TLAS->GetGPUVirtualAddress();
 	}
+#endif
+
+	// Points every instance to a hit group record of its own, the one at its index in the TLAS, instead of to the
+	// record of its hit group. Takes effect with the next Build().
+	void SetPerInstanceRecords(bool enable)
+	{
+		m_PerInstanceRecords = enable;
+	}
+
+#if !defined(DXR_HEADLESS)
+	// Gives the pipeline a hit group table with a record for every instance. The record of a mesh holds its hlsl::Mesh
+	// in the constants of the first local root parameter, so the closest hit shader gets it without a lookup. Needs to
+	// be written again when the color or reflectance of an instance changes, which Build(cmdList, pipeline) does.
+	void WriteHitGroupRecords(class RaytracingPipeline& pipeline) const;
+#endif
 
-	D3D12_GPU_VIRTUAL_ADDRESS GetGeometryData() const
+	const cpu::Scene& GetCPUScene() const
 	{
-		return m_GeometryData->GetGPUVirtualAddress();
+		return m_CPUScene;
 	}
 
 private:
+	void BuildCPU();
+	void UpdateCPU();
+
+#if !defined(DXR_HEADLESS)
+	void BuildD3D12();
+	void UpdateD3D12(ID3D12GraphicsCommandList7* cmdList);
+
+	// Writes the hlsl::Mesh of the dirty meshes into the records of WriteHitGroupRecords, when it changed
+	void UpdateHitGroupRecords(class RaytracingPipeline& pipeline) const;
+
+	// Packs m_Instances straight into a new upload buffer
+	void WriteInstanceDescs();
+
+	// Asserts that the packed instances point to the current BLAS and entries of the instances
+	void ValidateInstanceDescs(const cpu::PackedInstanceDesc* descs) const;
+#endif
+
+	// Refits the BLAS of every mesh with new positions, and takes the BLAS address and entries of every instance again
+	// in case its BLAS was built anew. Returns true when an instance or a BLAS changed.
+	bool UpdateDirtyGeometry(ID3D12GraphicsCommandList7* cmdList);
+
+	// Stores the BLAS address and instance ID of an instance, and returns true when either of them changed
+	bool UpdateReferences(uint32_t index, uint64_t blasAddress, uint32_t instanceID);
+
+	// Fills m_Instances from the instances, in the same order as the hit group records
+	void GatherInstances();
+
+	// Copies the transform and material of a MeshInstance or ProceduralPrimitiveInstance into m_Instances
+	template<typename T>
+	void UpdateInstance(uint32_t index, const T& instance);
+
+	void GetCPUInstanceDescs(std::vector<cpu::InstanceDesc>& instanceDescs) const;
+	void ClearDirtyFlags();
+
+#if !defined(DXR_HEADLESS)
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_TLAS;
-	Microsoft::WRL::ComPtr<ID3D12Resource> m_GeometryData;
+
+	// Kept for updates, large enough for both a build and an update
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_ScratchResource;
+
+	// Taken from the buffer pool for every build and update, so an update never overwrites the instances that the GPU
+	// is still using
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_InstanceDescs;
+#endif
+
+	uint32_t m_InstanceCount = 0;
+
+	uint32_t m_UpdateCount = 0;
+	uint32_t m_RebuildInterval = 16;
+
+	// Set when an instance points to another BLAS than at the last build, which the next update rebuilds for
+	bool m_RebuildPending = false;
+
+	bool m_PerInstanceRecords = false;
 
 	std::vector<class MeshInstance*> m_Meshes;
 	std::vector<class ProceduralPrimitiveInstance*> m_ProceduralPrimitives;
+
+	// What the instances looked like at the last build or update, one entry per instance. Only the instances that
+	// moved are copied in again, their transforms are computed when they are packed.
+	cpu::InstanceStore m_Instances;
+
+	// Only used with the CPU backend
+	cpu::Scene m_CPUScene;
 };
 
@@ -0,0 +1,324 @@
+// Built without the precompiled header, d3d12.h pulls in Windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "TLAS.hpp"
+
+#include "Mesh.hpp"
+#include "ProceduralPrimitive.hpp"
+
+#include <DXRCore/Utils/Assert.hpp>
+#include <DXRCore/Utils/CLI.hpp>
+
+// The part of TLAS that builds without D3D12: the instances, the CPU backend, and the choice between the backends
+
+// The CPU backend has no GPU addresses, it finds the BLAS through the instances
+template<typename T>
+static uint64_t GetBLASAddress([[maybe_unused]] const T& instance)
+{
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		return instance.GetBLASAddress();
+	}
+#endif
+
+	return 0;
+}
+
+void TLAS::AddMesh(MeshInstance* mesh)
+{
+	mesh->IsDirty = true; // Ensure that it is labeled as dirty, so we rebuild the tlas
+
+	m_Meshes.push_back(mesh);
+}
+
+void TLAS::AddProceduralPrimitive(ProceduralPrimitiveInstance* primitive)
+{
+	primitive->IsDirty = true; // Ensure that it is labeled as dirty, so we rebuild the tlas
+
+	m_ProceduralPrimitives.push_back(primitive);
+}
+
+void TLAS::Build()
+{
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		BuildD3D12();
+		return;
+	}
+#endif
+
+	BuildCPU();
+}
+
+void TLAS::Build([[maybe_unused]] ID3D12GraphicsCommandList7* cmdList, [[maybe_unused]] RaytracingPipeline* pipeline)
+{
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		// Before the update clears the dirty flags
+		if (pipeline != nullptr)
+		{
+			UpdateHitGroupRecords(*pipeline);
+		}
+
+		UpdateD3D12(cmdList);
+		return;
+	}
+#endif
+
+	UpdateCPU();
+}
+
+bool TLAS::UpdateDirtyGeometry(ID3D12GraphicsCommandList7* cmdList)
+{
+	bool isDirty = false;
+	uint32_t index = 0;
+
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh == nullptr || !mesh)
+		{
+			continue;
+		}
+
+		// Instances can share a mesh, its BLAS is only refitted for the first one
+		if (mesh->m_Mesh->m_GeometryDirty)
+		{
+			mesh->m_Mesh->UpdateBLAS(cmdList);
+			isDirty = true;
+		}
+
+		// BuildBLAS can move the BLAS to another buffer of the pool
+		if (UpdateReferences(index, GetBLASAddress(*mesh), 0))
+		{
+			isDirty = true;
+		}
+
+		if (mesh->IsDirty)
+		{
+			UpdateInstance(index, *mesh);
+			isDirty = true;
+		}
+
+		index++;
+	}
+
+	for (const auto& primitive : m_ProceduralPrimitives)
+	{
+		if (primitive == nullptr || !primitive)
+		{
+			continue;
+		}
+
+		// Building the BLAS again also creates the descriptor of the entries anew
+		if (UpdateReferences(index, GetBLASAddress(*primitive), primitive->m_ProceduralPrimitive->m_EntrySRV))
+		{
+			isDirty = true;
+		}
+
+		if (primitive->IsDirty)
+		{
+			UpdateInstance(index, *primitive);
+			isDirty = true;
+		}
+
+		index++;
+	}
+
+	ASSERT(index == m_Instances.GetCount(), "Instances were added or removed since the last full build of the TLAS");
+
+	return isDirty;
+}
+
+bool TLAS::UpdateReferences(uint32_t index, uint64_t blasAddress, uint32_t instanceID)
+{
+	ASSERT(index < m_Instances.GetCount(), "Instances were added since the last full build of the TLAS");
+
+	if (m_Instances.GetAccelerationStructure(index) == blasAddress && m_Instances.GetInstanceID(index) == instanceID)
+	{
+		return false;
+	}
+
+	m_Instances.SetAccelerationStructure(index, blasAddress);
+	m_Instances.SetInstanceID(index, instanceID);
+	m_RebuildPending = true;
+
+	return true;
+}
+
+void TLAS::GatherInstances()
+{
+	m_Instances.Clear();
+	m_Instances.Reserve(static_cast<uint32_t>(m_Meshes.size() + m_ProceduralPrimitives.size()));
+
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh == nullptr || !mesh)
+		{
+			continue;
+		}
+
+		const uint32_t index = m_Instances.GetCount();
+		m_Instances.Add(GetBLASAddress(*mesh), 0, m_PerInstanceRecords ? index : 0);
+
+		UpdateInstance(index, *mesh);
+	}
+
+	for (const auto& primitive : m_ProceduralPrimitives)
+	{
+		if (primitive == nullptr || !primitive)
+		{
+			continue;
+		}
+
+		// The intersection shader finds its entries through InstanceID()
+		const uint32_t index = m_Instances.GetCount();
+		const uint32_t hitGroupIndex = primitive->m_ProceduralPrimitive->m_HitGroupIdx;
+		m_Instances.Add(GetBLASAddress(*primitive), primitive->m_ProceduralPrimitive->m_EntrySRV, m_PerInstanceRecords ? index : hitGroupIndex);
+
+		UpdateInstance(index, *primitive);
+	}
+}
+
+template<typename T>
+void TLAS::UpdateInstance(uint32_t index, const T& instance)
+{
+	ASSERT(index < m_Instances.GetCount(), "Instances were added since the last full build of the TLAS");
+
+	m_Instances.SetTranslation(index, { instance.m_Translation.x, instance.m_Translation.y, instance.m_Translation.z });
+	m_Instances.SetRotation(index, { instance.m_Rotation.x, instance.m_Rotation.y, instance.m_Rotation.z, instance.m_Rotation.w });
+	m_Instances.SetScale(index, { instance.m_Scale.x, instance.m_Scale.y, instance.m_Scale.z });
+	m_Instances.SetColor(index, { instance.m_Color.x, instance.m_Color.y, instance.m_Color.z, instance.m_Color.w });
+	m_Instances.SetReflectance(index, instance.m_Reflectance);
+}
+
+void TLAS::GetCPUInstanceDescs(std::vector<cpu::InstanceDesc>& instanceDescs) const
+{
+	// Same instance order as the D3D12 path, so the instance index of a hit points to the same mesh data
+	instanceDescs.clear();
+	instanceDescs.reserve(m_Meshes.size() + m_ProceduralPrimitives.size());
+
+	auto AddInstance = [this, &instanceDescs](const cpu::BottomLevelAS& blas, uint32_t hitGroupIndex)
+		{
+			cpu::InstanceDesc instanceDesc = {};
+			instanceDesc.Transform = m_Instances.GetTransform(static_cast<uint32_t>(instanceDescs.size()));
+			instanceDesc.InstanceMask = 1;
+			instanceDesc.InstanceID = 0;
+			instanceDesc.InstanceContributionToHitGroupIndex = hitGroupIndex;
+			instanceDesc.AccelerationStructure = &blas;
+
+			instanceDescs.push_back(instanceDesc);
+		};
+
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh == nullptr || !mesh)
+		{
+			continue;
+		}
+
+		AddInstance(mesh->m_Mesh->GetCPUBLAS(), 0);
+	}
+
+	for (const auto& primitive : m_ProceduralPrimitives)
+	{
+		if (primitive == nullptr || !primitive)
+		{
+			continue;
+		}
+
+		AddInstance(primitive->m_ProceduralPrimitive->GetCPUBLAS(), primitive->m_ProceduralPrimitive->m_HitGroupIdx);
+	}
+}
+
+void TLAS::ClearDirtyFlags()
+{
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh != nullptr)
+		{
+			mesh->IsDirty = false;
+		}
+	}
+
+	for (const auto& primitive : m_ProceduralPrimitives)
+	{
+		if (primitive != nullptr)
+		{
+			primitive->IsDirty = false;
+		}
+	}
+}
+
+void TLAS::BuildCPU()
+{
+	GatherInstances();
+
+	std::vector<cpu::InstanceDesc> instances;
+	GetCPUInstanceDescs(instances);
+
+	m_CPUScene.Meshes.clear();
+	m_CPUScene.Meshes.reserve(m_Meshes.size());
+
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh == nullptr || !mesh)
+		{
+			continue;
+		}
+
+		cpu::MeshData model = {};
+		model.Color = { mesh->m_Color.x, mesh->m_Color.y, mesh->m_Color.z, mesh->m_Color.w };
+		model.Reflectance = mesh->m_Reflectance;
+		model.Mesh = &mesh->m_Mesh->GetCPUMesh();
+
+		m_CPUScene.Meshes.push_back(model);
+	}
+
+	m_CPUScene.TLAS.SetAllowUpdate(true);
+	m_CPUScene.TLAS.Build(instances.data(), static_cast<uint32_t>(instances.size()));
+	m_CPUScene.Version++;
+
+	ClearDirtyFlags();
+}
+
+void TLAS::UpdateCPU()
+{
+	if (!UpdateDirtyGeometry(nullptr))
+	{
+		return;
+	}
+
+	// The CPU backend shades with its own copy of the material of every mesh, in the same order as BuildCPU
+	uint32_t meshIndex = 0;
+
+	for (const auto& mesh : m_Meshes)
+	{
+		if (mesh == nullptr || !mesh)
+		{
+			continue;
+		}
+
+		if (mesh->IsDirty)
+		{
+			cpu::MeshData& model = m_CPUScene.Meshes[meshIndex];
+			model.Color = { mesh->m_Color.x, mesh->m_Color.y, mesh->m_Color.z, mesh->m_Color.w };
+			model.Reflectance = mesh->m_Reflectance;
+		}
+
+		meshIndex++;
+	}
+
+	std::vector<cpu::InstanceDesc> instances;
+	GetCPUInstanceDescs(instances);
+
+	// Refits, or rebuilds once the refit has grown the SAH cost past the threshold of cpu::TopLevelAS
+	m_CPUScene.TLAS.Update(instances.data(), static_cast<uint32_t>(instances.size()));
+	m_CPUScene.Version++;
+
+	ClearDirtyFlags();
+}
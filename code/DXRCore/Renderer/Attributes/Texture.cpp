@@ -4,86 +4,204 @@
 #include "Device.hpp"
 #include "DescriptorHeap.hpp"
 
+#include <cstring>
+#include <vector>
+
 #include <stb_image.h>
 
+#include <CPU/TextureCache.hpp>
+
 #include <Utils/Assert.hpp>
-#include <Utils/Error.hpp>
 
 #include <Renderer/Helper.hpp>
 #include <Renderer/Renderer.hpp>
 
-Texture::Texture(const std::string_view path)
-	: m_SRV(static_cast<uint32_t>(-1))
-	, m_IsHDR(false)
+static DXGI_FORMAT GetDXGIFormat(cpu::TextureFormat format)
 {
-	ASSERT(path.find("../") != static_cast<size_t>(-1), "'../' was missing from the texture path. Add it to make sure it points to the correct directory, so it can read the file.");
-
-	void* data = nullptr;
-	m_IsHDR = path.find(".hdr") != static_cast<size_t>(-1);
+	switch (format)
+	{
+	case cpu::TextureFormat::RGBA32F:
+		return DXGI_FORMAT_R32G32B32A32_FLOAT;
+	case cpu::TextureFormat::RGBA16F:
+		return DXGI_FORMAT_R16G16B16A16_FLOAT;
+	case cpu::TextureFormat::R11G11B10F:
+		return DXGI_FORMAT_R11G11B10_FLOAT;
+	case cpu::TextureFormat::RGB9E5:
+		return DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
+	case cpu::TextureFormat::BC1:
+		return DXGI_FORMAT_BC1_UNORM;
+	case cpu::TextureFormat::BC7:
+		return DXGI_FORMAT_BC7_UNORM;
+	case cpu::TextureFormat::BC6H:
+		return DXGI_FORMAT_BC6H_UF16;
+	default:
+		return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
 
+void Texture::CreateResource(const std::vector<uint8_t>& file, const std::string_view path, const TextureDesc& desc)
+{
 	int32_t width;
 	int32_t height;
 	int32_t nrChannels;
 
-	if (m_IsHDR)
+	if (file.empty() || stbi_info_from_memory(file.data(), static_cast<int32_t>(file.size()), &width, &height, &nrChannels) == 0)
 	{
-		data = stbi_loadf(path.data(), &width, &height, &nrChannels, 4);
+		FailedToLoad(path);
 	}
-	else
+
+	m_Format = m_IsHDR ? desc.HDRFormat : desc.LDRFormat;
+
+	// Block compression needs the largest mip to be a whole number of blocks
+	if (cpu::IsBlockCompressed(m_Format) && (width % 4 != 0 || height % 4 != 0))
 	{
-		data = stbi_load(path.data(), &width, &height, &nrChannels, 4);
+		m_Format = m_IsHDR ? cpu::TextureFormat::RGB9E5 : cpu::TextureFormat::RGBA8;
 	}
 
-	if (data == nullptr)
-	{
-		char workingDir[128];
-		GetCurrentDirectoryA(128, workingDir);
+	const uint32_t mipCount = desc.GenerateMips ? cpu::GetMipCount(width, height) : 1;
+
+	cpu::TextureCache cache{ std::string(desc.CacheDirectory) };
+	const uint64_t key = cpu::TextureCache::GetKey(cpu::HashMemory(file.data(), file.size()), m_Format, mipCount);
+	const bool cached = !desc.CacheDirectory.empty() && cache.Open(key);
+
+	// Without a cache entry, the mips are generated from a float copy of the pixels and then encoded. HDR files are
+	// decoded either way, for the alias tables of the sky.
+	std::vector<std::vector<uint8_t>> mips;
 
-		FatalError("Failed to load texture data.\n\nFile path: %s.\nWorking directory: %s.\nstbi failure reason: %s", path.data(), workingDir, stbi_failure_reason());
+	if (!cached || m_IsHDR)
+	{
+		cpu::Image image;
+		DecodeImage(file, path, m_IsHDR, image, m_SkyDistribution);
+
+		if (!cached)
+		{
+			mips.resize(mipCount);
+
+			cpu::Image mip;
+
+			for (uint32_t level = 0; level < mipCount; level++)
+			{
+				const cpu::Image& source = level == 0 ? image : mip;
+				const uint64_t rowPitch = cpu::GetRowPitch(m_Format, source.GetWidth());
+
+				mips[level].resize(rowPitch * cpu::GetRowCount(m_Format, source.GetHeight()));
+				cpu::ConvertPixels(source, m_Format, mips[level].data(), rowPitch);
+
+				if (level + 1 < mipCount)
+				{
+					cpu::Image next;
+					cpu::GenerateMip(source, next);
+					mip = std::move(next);
+				}
+			}
+
+			if (!desc.CacheDirectory.empty())
+			{
+				cpu::TextureCacheHeader header;
+				header.Key = key;
+				header.Format = m_Format;
+				header.Width = width;
+				header.Height = height;
+				header.MipCount = mipCount;
+
+				cache.Write(header, mips);
+			}
+		}
 	}
 
 	auto device = Device::GetDevice().GetInternalDevice();
-	auto resourceDesc = CD3DX12_RESOURCE_DESC::Tex2D(m_IsHDR ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R8G8B8A8_UNORM, width, height, 1, 1);
+	auto resourceDesc = CD3DX12_RESOURCE_DESC::Tex2D(GetDXGIFormat(m_Format), width, height, 1, static_cast<UINT16>(mipCount));
 	auto heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
 
 	ASSERT(SUCCEEDED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Resource))), "Failed to create image resource");
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> intermediate;
+	m_Memory = device->GetResourceAllocationInfo(0, 1, &resourceDesc).SizeInBytes;
 
-	auto size = GetRequiredIntermediateSize(m_Resource.Get(), 0, 1);
-	resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
-	heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto& batcher = Device::GetDevice().GetUploadBatcher();
 
-	ASSERT(SUCCEEDED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &resourceDesc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&intermediate))), "Failed to create image resource");
+	UINT64 uploadSize;
+	device->GetCopyableFootprints(&resourceDesc, 0, mipCount, 0, nullptr, nullptr, nullptr, &uploadSize);
 
-	auto cmdList = CreateCommandList();
-	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+	// The footprints are placed at the staging memory, so their offsets point into the staging buffer
+	StagingAllocation staging = batcher.AllocateStaging(uploadSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
 
-	D3D12_SUBRESOURCE_DATA resData = {};
-	resData.pData = data;
-	resData.RowPitch = width * (m_IsHDR ? 4 * sizeof(float) : 4 * sizeof(uint8_t));
-	resData.SlicePitch = resData.RowPitch * height;
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(mipCount);
+	std::vector<UINT> rowCounts(mipCount);
+	std::vector<UINT64> rowSizes(mipCount);
 
-	UpdateSubresources(cmdList.CommandList.Get(), m_Resource.Get(), intermediate.Get(), 0, 0, 1, &resData);
+	device->GetCopyableFootprints(&resourceDesc, 0, mipCount, staging.Offset, layouts.data(), rowCounts.data(), rowSizes.data(), nullptr);
 
-	auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_Resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	// Cached mips are read from disk straight into the staging memory, freshly encoded ones are copied in
+	for (uint32_t level = 0; level < mipCount; level++)
+	{
+		uint8_t* target = staging.CPUAddress + (layouts[level].Offset - staging.Offset);
+		const uint64_t rowPitch = layouts[level].Footprint.RowPitch;
+
+		if (cached)
+		{
+			ASSERT(cache.ReadRows(target, rowPitch, rowSizes[level], rowCounts[level]), "Failed to read mip %u from the texture cache", level);
+			continue;
+		}
+
+		for (uint32_t row = 0; row < rowCounts[level]; row++)
+		{
+			std::memcpy(target + row * rowPitch, mips[level].data() + row * rowSizes[level], rowSizes[level]);
+		}
+	}
 
-	cmdList.CommandList->ResourceBarrier(1, &barrier);
+	auto* cmdList = staging.CommandList;
 
-	auto fence = cmdQueue.ExecuteCommandLists({ cmdList.CommandList.Get() });
-	cmdQueue.WaitForFence(fence);
+	for (uint32_t level = 0; level < mipCount; level++)
+	{
+		CD3DX12_TEXTURE_COPY_LOCATION destination(m_Resource.Get(), level);
+		CD3DX12_TEXTURE_COPY_LOCATION source(staging.Resource, layouts[level]);
+
+		cmdList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+	}
+
+	auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_Resource.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	cmdList->ResourceBarrier(1, &barrier);
+
+	// The copies run with the next flush of the batcher, which happens before the next frame
+	m_UploadToken = batcher.GetToken();
+	staging.Release();
 
 	auto* heap = Renderer::GetShaderHeap();
-	m_SRV = heap->GetNextIndex();
+	m_SRV = heap->Allocate();
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Texture2D.MipLevels = mipCount;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Format = GetDXGIFormat(m_Format);
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC desc = {};
-	desc.Texture2D.MipLevels = 1;
-	desc.Texture2D.MostDetailedMip = 0;
-	desc.Format = m_IsHDR ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R8G8B8A8_UNORM;
-	desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	device->CreateShaderResourceView(m_Resource.Get(), &srvDesc, heap->GetCPUHandle(m_SRV));
 
-	device->CreateShaderResourceView(m_Resource.Get(), &desc, heap->GetCPUHandle(m_SRV));
+	if (m_IsHDR)
+	{
+		const auto& entries = m_SkyDistribution.GetEntries();
+		AllocateUploadBuffer(entries.data(), entries.size() * sizeof(sky::AliasEntry), &m_SkyDistributionBuffer, L"Sky Distribution");
 
-	stbi_image_free(data);
+		m_SkyDistributionSRV = heap->Allocate();
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC bufferDesc = {};
+		bufferDesc.Format = DXGI_FORMAT_UNKNOWN;
+		bufferDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		bufferDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+		bufferDesc.Buffer.StructureByteStride = sizeof(sky::AliasEntry);
+		bufferDesc.Buffer.NumElements = static_cast<uint32_t>(entries.size());
+
+		device->CreateShaderResourceView(m_SkyDistributionBuffer.Get(), &bufferDesc, heap->GetCPUHandle(m_SkyDistributionSRV));
+	}
+}
+
+Texture::~Texture()
+{
+	// The frames in flight can still read the views, the heap only reuses them once those are done
+	if (auto* heap = Renderer::GetShaderHeap())
+	{
+		heap->Free(m_SRV);
+		heap->Free(m_SkyDistributionSRV);
+	}
 }
@@ -1,25 +1,113 @@
 #pragma once
 
+#if !defined(DXR_HEADLESS)
 #include <d3d12.h>
 #include <wrl/client.h>
+#endif
 
 #include <string_view>
+#include <vector>
 
+#include <DXRCore/CPU/Image.hpp>
+#include <DXRCore/CPU/SkyDistribution.hpp>
+#include <DXRCore/CPU/TextureFormat.hpp>
+
+#include <DXRCore/Renderer/Attributes/UploadToken.hpp>
+
+struct TextureDesc
+{
+	// Format of .hdr files on the GPU. BC6H takes a sixteenth of the memory of RGBA32F, RGB9E5 and R11G11B10F a
+	// quarter. All three drop the alpha channel.
+	cpu::TextureFormat HDRFormat = cpu::TextureFormat::BC6H;
+
+	// Format of other files on the GPU. BC7 takes a quarter of the memory of RGBA8, BC1 an eighth without alpha.
+	cpu::TextureFormat LDRFormat = cpu::TextureFormat::BC7;
+
+	// Where the encoded mips are kept between runs, relative to the working directory. Empty disables the cache.
+	std::string_view CacheDirectory = "TextureCache";
+
+	// Generates every mip level down to 1x1 on the CPU, so lookups with a large footprint stay in the cache
+	bool GenerateMips = true;
+};
+
+// The D3D12 half of Texture is in Texture.cpp, the decoding and the CPU half in TextureCPU.cpp, see Mesh
 class Texture
 {
 public:
-	Texture(const std::string_view path);
+	Texture(const std::string_view path, const TextureDesc& desc = {});
+#if !defined(DXR_HEADLESS)
+	~Texture();
+#endif
+
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
 
 	uint32_t GetSRV() const
 	{
 		return m_SRV;
 	}
 
+	const cpu::Image& GetCPUImage() const
+	{
+		return m_CPUImage;
+	}
+
+	// Alias tables for importance sampling an HDR texture as an equirectangular sky, see Shaders/SkySampling.hpp.
+	// Only built for .hdr files.
+	const cpu::SkyDistribution& GetSkyDistribution() const
+	{
+		return m_SkyDistribution;
+	}
+
+	cpu::TextureFormat GetFormat() const
+	{
+		return m_Format;
+	}
+
+	// Size of the GPU resource with all its mips
+	uint64_t GetMemory() const
+	{
+		return m_Memory;
+	}
+
+	// Batch of the upload batcher that copies the mips to the GPU
+	UploadToken GetUploadToken() const
+	{
+		return m_UploadToken;
+	}
+
+	// StructuredBuffer<sky::AliasEntry> with the tables, or -1 when there are none
+	uint32_t GetSkyDistributionSRV() const
+	{
+		return m_SkyDistributionSRV;
+	}
+
 private:
+	// Decodes the file into an image, and builds the alias tables of the sky from it for HDR files
+	static void DecodeImage(const std::vector<uint8_t>& file, const std::string_view path, bool isHDR, cpu::Image& image, cpu::SkyDistribution& skyDistribution);
+	static void FailedToLoad(const std::string_view path);
+
+#if !defined(DXR_HEADLESS)
+	// Encodes the mips of the file, or reads them from the texture cache, and records their upload
+	void CreateResource(const std::vector<uint8_t>& file, const std::string_view path, const TextureDesc& desc);
+
 	Microsoft::WRL::ComPtr<ID3D12Resource> m_Resource;
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_SkyDistributionBuffer;
+#endif
 
 	uint32_t m_SRV;
 
+	cpu::TextureFormat m_Format = cpu::TextureFormat::RGBA8;
+	uint64_t m_Memory = 0;
+
+	UploadToken m_UploadToken = 0;
+
+	uint32_t m_SkyDistributionSRV;
+	cpu::SkyDistribution m_SkyDistribution;
+
 	bool m_IsHDR;
+
+	// Only used with the CPU backend
+	cpu::Image m_CPUImage;
 };
 
@@ -0,0 +1,113 @@
+// Built without the precompiled header, d3d12.h pulls in Windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "Texture.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+// pch.cpp holds the implementation in the Visual Studio build
+#if defined(DXR_HEADLESS)
+#define STB_IMAGE_IMPLEMENTATION
+#endif
+#include <stb_image.h>
+
+#include <Utils/Assert.hpp>
+#include <Utils/CLI.hpp>
+#include <Utils/Error.hpp>
+
+// The part of Texture that builds without D3D12: reading and decoding the file, and the CPU backend
+
+// The whole file, which is both decoded and hashed into the key of the texture cache
+static std::vector<uint8_t> ReadTextureFile(const std::string_view path)
+{
+	std::vector<uint8_t> bytes;
+	std::FILE* file = std::fopen(path.data(), "rb");
+
+	if (file == nullptr)
+	{
+		return bytes;
+	}
+
+	std::fseek(file, 0, SEEK_END);
+	bytes.resize(static_cast<size_t>(std::ftell(file)));
+	std::fseek(file, 0, SEEK_SET);
+
+	if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size())
+	{
+		bytes.clear();
+	}
+
+	std::fclose(file);
+	return bytes;
+}
+
+void Texture::FailedToLoad(const std::string_view path)
+{
+	const std::string workingDir = std::filesystem::current_path().string();
+
+	FatalError("Failed to load texture data.\n\nFile path: %s.\nWorking directory: %s.\nstbi failure reason: %s", path.data(), workingDir.c_str(), stbi_failure_reason());
+}
+
+void Texture::DecodeImage(const std::vector<uint8_t>& file, const std::string_view path, bool isHDR, cpu::Image& image, cpu::SkyDistribution& skyDistribution)
+{
+	int32_t width;
+	int32_t height;
+	int32_t nrChannels;
+
+	void* data = nullptr;
+	const int32_t size = static_cast<int32_t>(file.size());
+
+	if (isHDR)
+	{
+		data = stbi_loadf_from_memory(file.data(), size, &width, &height, &nrChannels, 4);
+	}
+	else
+	{
+		data = stbi_load_from_memory(file.data(), size, &width, &height, &nrChannels, 4);
+	}
+
+	if (data == nullptr)
+	{
+		FailedToLoad(path);
+	}
+
+	image.Resize(width, height);
+
+	if (isHDR)
+	{
+		image.SetPixels(static_cast<const float*>(data));
+		skyDistribution.Build(image);
+	}
+	else
+	{
+		image.SetPixels(static_cast<const uint8_t*>(data));
+	}
+
+	stbi_image_free(data);
+}
+
+Texture::Texture(const std::string_view path, [[maybe_unused]] const TextureDesc& desc)
+	: m_SRV(static_cast<uint32_t>(-1))
+	, m_SkyDistributionSRV(static_cast<uint32_t>(-1))
+	, m_IsHDR(false)
+{
+	ASSERT(path.find("../") != static_cast<size_t>(-1), "'../' was missing from the texture path. Add it to make sure it points to the correct directory, so it can read the file.");
+
+	m_IsHDR = path.find(".hdr") != static_cast<size_t>(-1);
+
+	const std::vector<uint8_t> file = ReadTextureFile(path);
+
+#if !defined(DXR_HEADLESS)
+	if (GetCLI().Backend != RenderBackend::CPU)
+	{
+		CreateResource(file, path, desc);
+		return;
+	}
+#endif
+
+	DecodeImage(file, path, m_IsHDR, m_CPUImage, m_SkyDistribution);
+}
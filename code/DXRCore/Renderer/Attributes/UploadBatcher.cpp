@@ -0,0 +1,300 @@
+#include "pch.hpp"
+#include "UploadBatcher.hpp"
+
+#include "Device.hpp"
+
+#include <Renderer/Helper.hpp>
+
+#include <Utils/Assert.hpp>
+
+#include <cstring>
+#include <utility>
+
+// Large enough for an 8K BC6H sky with all its mips
+static constexpr uint64_t StagingSize = 64ull * 1024 * 1024;
+
+static constexpr uint64_t MaxRetainedSize = 256ull * 1024 * 1024;
+
+void UploadBatcher::Initialize()
+{
+	auto device = Device::GetDevice().GetInternalDevice();
+	auto heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(StagingSize);
+
+	ASSERT(SUCCEEDED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_StagingBuffer))), "Failed to create the staging buffer");
+	m_StagingBuffer->SetName(L"StagingBuffer");
+
+	// Upload heaps can stay mapped for their whole lifetime
+	CD3DX12_RANGE readRange(0, 0);
+	m_StagingBuffer->Map(0, &readRange, reinterpret_cast<void**>(&m_StagingData));
+
+	m_Staging.Reset(StagingSize);
+}
+
+StagingAllocation::~StagingAllocation()
+{
+	Release();
+}
+
+StagingAllocation::StagingAllocation(StagingAllocation&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+StagingAllocation& StagingAllocation::operator=(StagingAllocation&& other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+
+		Resource = other.Resource;
+		Offset = other.Offset;
+		CPUAddress = other.CPUAddress;
+		CommandList = other.CommandList;
+		m_Batcher = other.m_Batcher;
+
+		other.m_Batcher = nullptr;
+	}
+
+	return *this;
+}
+
+void StagingAllocation::Release()
+{
+	if (m_Batcher != nullptr)
+	{
+		m_Batcher->Unpin();
+		m_Batcher = nullptr;
+	}
+}
+
+ID3D12GraphicsCommandList7* UploadBatcher::OpenBatch()
+{
+	if (m_IsRecording)
+	{
+		return m_Open.CommandList.Get();
+	}
+
+	Retire();
+
+	if (!m_FreeBatches.empty())
+	{
+		m_Open.CommandList = std::move(m_FreeBatches.back().CommandList);
+		m_Open.CommandAllocator = std::move(m_FreeBatches.back().CommandAllocator);
+		m_FreeBatches.pop_back();
+
+		m_Open.CommandAllocator->Reset();
+		m_Open.CommandList->Reset(m_Open.CommandAllocator.Get(), nullptr);
+	}
+	else
+	{
+		auto cmdList = CreateCommandList();
+
+		m_Open.CommandList = cmdList.CommandList;
+		m_Open.CommandAllocator = cmdList.CommandAllocator;
+	}
+
+	m_IsRecording = true;
+
+	return m_Open.CommandList.Get();
+}
+
+StagingAllocation UploadBatcher::AllocateStaging(uint64_t size, uint64_t alignment)
+{
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	// The allocation belongs to the open batch, so there has to be one
+	OpenBatch();
+
+	uint64_t offset = m_Staging.Allocate(size, alignment);
+
+	while (offset == cpu::RingAllocator::InvalidOffset)
+	{
+		if (!m_Submitted.empty())
+		{
+			cmdQueue.WaitForFence(m_Submitted.front().Fence);
+			Retire();
+		}
+		else if (m_Staging.HasOpenAllocations() && m_PinCount == 0)
+		{
+			// The open batch fills the ring by itself, and all of its copies are recorded, so it can go
+			Flush();
+			OpenBatch();
+		}
+		else
+		{
+			break;
+		}
+
+		offset = m_Staging.Allocate(size, alignment);
+	}
+
+	StagingAllocation allocation;
+	allocation.CommandList = m_Open.CommandList.Get();
+	allocation.m_Batcher = this;
+
+	m_PinCount++;
+
+	if (offset != cpu::RingAllocator::InvalidOffset)
+	{
+		allocation.Resource = m_StagingBuffer.Get();
+		allocation.Offset = offset;
+		allocation.CPUAddress = m_StagingData + offset;
+
+		return allocation;
+	}
+
+	// Larger than the whole ring, or the ring is full with the pinned memory of the open batch
+	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+
+	auto device = Device::GetDevice().GetInternalDevice();
+	auto heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+
+	ASSERT(SUCCEEDED(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer))), "Failed to create a staging buffer");
+
+	CD3DX12_RANGE readRange(0, 0);
+	buffer->Map(0, &readRange, reinterpret_cast<void**>(&allocation.CPUAddress));
+
+	allocation.Resource = buffer.Get();
+	m_Open.Resources.push_back(buffer);
+
+	return allocation;
+}
+
+void UploadBatcher::Unpin()
+{
+	ASSERT(m_PinCount > 0, "Staging memory was released more often than it was allocated");
+
+	if (--m_PinCount == 0 && m_FlushPending)
+	{
+		Flush();
+	}
+}
+
+UploadToken UploadBatcher::UploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size)
+{
+	StagingAllocation staging = AllocateStaging(size, sizeof(float) * 4);
+	std::memcpy(staging.CPUAddress, data, size);
+
+	staging.CommandList->CopyBufferRegion(destination, destinationOffset, staging.Resource, staging.Offset, size);
+
+	return m_OpenBatch;
+}
+
+void UploadBatcher::Retain(Microsoft::WRL::ComPtr<ID3D12Resource> resource)
+{
+	OpenBatch();
+
+	const uint64_t size = resource->GetDesc().Width;
+	m_Open.Resources.push_back(std::move(resource));
+
+	AddRetainedSize(size);
+}
+
+void UploadBatcher::Recycle(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer)
+{
+	if (buffer == nullptr)
+	{
+		return;
+	}
+
+	const uint64_t size = buffer->GetDesc().Width;
+	Device::GetDevice().GetBufferPool().Release(type, std::move(buffer), OpenBatch());
+
+	AddRetainedSize(size);
+}
+
+void UploadBatcher::AddRetainedSize(uint64_t size)
+{
+	m_RetainedSize += size;
+
+	if (m_RetainedSize > MaxRetainedSize)
+	{
+		FlushWhenUnpinned();
+	}
+}
+
+void UploadBatcher::FlushWhenUnpinned()
+{
+	if (m_PinCount > 0)
+	{
+		m_FlushPending = true;
+		return;
+	}
+
+	Flush();
+}
+
+void UploadBatcher::Flush()
+{
+	if (!m_IsRecording)
+	{
+		return;
+	}
+
+	ASSERT(m_PinCount == 0, "The batch was flushed while its staging memory is pinned, its copies may not be recorded yet");
+
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	m_Open.Token = m_OpenBatch++;
+	m_Open.Fence = cmdQueue.ExecuteCommandList(m_Open.CommandList.Get());
+	m_Staging.CloseBatch(m_Open.Fence);
+
+	m_Submitted.push_back(std::move(m_Open));
+	m_Open = Batch();
+
+	m_IsRecording = false;
+	m_FlushPending = false;
+	m_RetainedSize = 0;
+}
+
+void UploadBatcher::Wait(UploadToken token)
+{
+	if (token == m_OpenBatch)
+	{
+		Flush();
+	}
+
+	for (const Batch& batch : m_Submitted)
+	{
+		if (batch.Token == token)
+		{
+			Device::GetDevice().GetCommandQueue().WaitForFence(batch.Fence);
+			break;
+		}
+	}
+
+	Retire();
+}
+
+bool UploadBatcher::IsComplete(UploadToken token)
+{
+	// An open batch without any work has nothing to wait for
+	if (token == m_OpenBatch)
+	{
+		return !m_IsRecording;
+	}
+
+	Retire();
+
+	return m_Submitted.empty() || token < m_Submitted.front().Token;
+}
+
+void UploadBatcher::Retire()
+{
+	auto& cmdQueue = Device::GetDevice().GetCommandQueue();
+
+	while (!m_Submitted.empty() && cmdQueue.IsFenceCompleted(m_Submitted.front().Fence))
+	{
+		Batch& batch = m_Submitted.front();
+
+		m_CompletedFence = batch.Fence;
+		batch.Resources.clear();
+
+		m_FreeBatches.push_back(std::move(batch));
+		m_Submitted.pop_front();
+	}
+
+	m_Staging.Release(m_CompletedFence);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include <deque>
+#include <vector>
+
+#include <DXRCore/CPU/RingAllocator.hpp>
+
+#include <DXRCore/Renderer/Attributes/BufferPool.hpp>
+#include <DXRCore/Renderer/Attributes/UploadToken.hpp>
+
+class UploadBatcher;
+
+// Space in the staging buffer, or in a buffer of its own when it does not fit in there. The memory belongs to the batch
+// that was open when it was allocated, and the allocation pins that batch: the batcher does not submit it while the
+// allocation is alive, so the copy from it always goes into CommandList, the command list of that batch.
+class StagingAllocation
+{
+public:
+	StagingAllocation() = default;
+	~StagingAllocation();
+
+	StagingAllocation(StagingAllocation&& other) noexcept;
+	StagingAllocation& operator=(StagingAllocation&& other) noexcept;
+
+	StagingAllocation(const StagingAllocation&) = delete;
+	StagingAllocation& operator=(const StagingAllocation&) = delete;
+
+	// Unpins the batch before the allocation goes out of scope. The copies from the memory have to be recorded.
+	void Release();
+
+	ID3D12Resource* Resource = nullptr;
+	uint64_t Offset = 0;
+	uint8_t* CPUAddress = nullptr;
+
+	ID3D12GraphicsCommandList7* CommandList = nullptr;
+
+private:
+	friend class UploadBatcher;
+
+	UploadBatcher* m_Batcher = nullptr;
+};
+
+// Collects uploads, copies and BLAS builds into one command list, instead of a submission and a wait per resource.
+// The batch goes to the command queue on Flush, which the TLAS build and the frame do before anything reads the
+// resources, so the GPU runs it first. Staging memory comes from a ring in one persistently mapped upload buffer and
+// is reused once the batch that copied from it has completed.
+//
+// The batch can also fill up by itself, with retained buffers or with staging memory. While staging memory of the
+// batch is pinned, it is then submitted only once the last StagingAllocation is released.
+class UploadBatcher
+{
+public:
+	void Initialize();
+
+	// Command list of the open batch, to record builds into
+	ID3D12GraphicsCommandList7* GetCommandList()
+	{
+		return OpenBatch();
+	}
+
+	// The open batch, which everything recorded since the last Flush belongs to
+	UploadToken GetToken() const
+	{
+		return m_OpenBatch;
+	}
+
+	// Mapped memory that the open batch copies from, see StagingAllocation. Waits for older batches when the ring is
+	// full. When the open batch fills the ring by itself, it is flushed, or when it is pinned, the memory comes from a
+	// buffer of its own.
+	StagingAllocation AllocateStaging(uint64_t size, uint64_t alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+	// Copies data into staging memory and records a copy into the destination buffer, which must be in the common or
+	// copy dest state
+	UploadToken UploadBuffer(ID3D12Resource* destination, uint64_t destinationOffset, const void* data, uint64_t size);
+
+	// Keeps a resource that the open batch uses, like the scratch buffer of a build, alive until the batch completes
+	void Retain(Microsoft::WRL::ComPtr<ID3D12Resource> resource);
+
+	// Returns a pooled buffer to the buffer pool, which hands it out again once the open batch and everything submitted
+	// before it have completed
+	void Recycle(PooledBufferType type, Microsoft::WRL::ComPtr<ID3D12Resource> buffer);
+
+	// Submits the open batch, if anything was recorded into it. Staging memory of the batch must not be pinned.
+	void Flush();
+
+	// Submits the batch when it is still open and blocks until the GPU has finished it. Staging memory of the batch must
+	// not be pinned.
+	void Wait(UploadToken token);
+	bool IsComplete(UploadToken token);
+
+private:
+	struct Batch
+	{
+		UploadToken Token = 0;
+		uint64_t Fence = 0;
+
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> CommandList;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> Resources;
+	};
+
+	// Opens a batch when none is recording, and returns its command list
+	ID3D12GraphicsCommandList7* OpenBatch();
+
+	// Flushes the open batch once the buffers it holds on to get too large
+	void AddRetainedSize(uint64_t size);
+
+	// Flushes the open batch right away, or once it is no longer pinned
+	void FlushWhenUnpinned();
+
+	void Unpin();
+
+	// Releases the staging memory, resources and command lists of the completed batches
+	void Retire();
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> m_StagingBuffer;
+	uint8_t* m_StagingData = nullptr;
+	cpu::RingAllocator m_Staging;
+
+	Batch m_Open;
+	bool m_IsRecording = false;
+
+	// Staging allocations of the open batch that are alive, and whether it filled up while they were
+	uint32_t m_PinCount = 0;
+	bool m_FlushPending = false;
+
+	// Bytes of the resources retained or recycled by the open batch. Large batches are flushed early, so that scratch
+	// buffers do not pile up when thousands of BLASes are built at startup.
+	uint64_t m_RetainedSize = 0;
+
+	std::deque<Batch> m_Submitted;
+
+	// Command lists and allocators of completed batches, to reset instead of creating new ones
+	std::vector<Batch> m_FreeBatches;
+	uint64_t m_CompletedFence = 0;
+
+	UploadToken m_OpenBatch = 1;
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Identifies the batch of the upload batcher that an upload or build was recorded into. Without D3D12 everything is
+// done right away, and the token is always 0.
+using UploadToken = uint64_t;
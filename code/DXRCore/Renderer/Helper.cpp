@@ -14,3 +14,40 @@ CommandList CreateCommandList(D3D12_COMMAND_LIST_TYPE type)
 
     return cmdList;
 }
+
+void AllocateUAVBuffer(UINT64 bufferSize, ID3D12Resource** ppResource, D3D12_RESOURCE_STATES initialResourceState, const wchar_t* resourceName)
+{
+    auto& memoryAllocator = Device::GetDevice().GetMemoryAllocator();
+
+    auto buffer = memoryAllocator.CreateBuffer(
+        MemoryType::Default,
+        bufferSize,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+        initialResourceState == D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE ? D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE : D3D12_RESOURCE_STATE_COMMON);
+
+    if (resourceName)
+    {
+        buffer->SetName(resourceName);
+    }
+
+    *ppResource = buffer.Detach();
+}
+
+void AllocateUploadBuffer(const void* pData, UINT64 datasize, ID3D12Resource** ppResource, const wchar_t* resourceName)
+{
+    auto& memoryAllocator = Device::GetDevice().GetMemoryAllocator();
+
+    auto buffer = memoryAllocator.CreateBuffer(MemoryType::Upload, datasize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+    if (resourceName)
+    {
+        buffer->SetName(resourceName);
+    }
+
+    void* pMappedData;
+    buffer->Map(0, nullptr, &pMappedData);
+    memcpy(pMappedData, pData, datasize);
+    buffer->Unmap(0, nullptr);
+
+    *ppResource = buffer.Detach();
+}
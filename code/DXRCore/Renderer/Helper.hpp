@@ -14,43 +14,8 @@ struct CommandList
 CommandList CreateCommandList(D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT);
 
 
-// Helper functions made by microsoft for convenience (https://github.com/microsoft/DirectX-Graphics-Samples/tree/master/Samples/Desktop/D3D12Raytracing)
+// Helper functions made by microsoft for convenience (https://github.com/microsoft/DirectX-Graphics-Samples/tree/master/Samples/Desktop/D3D12Raytracing),
+// changed to place the buffers in the heaps of the memory allocator instead of creating committed resources
 
-inline void AllocateUAVBuffer(ID3D12Device* pDevice, UINT64 bufferSize, ID3D12Resource** ppResource, D3D12_RESOURCE_STATES initialResourceState = D3D12_RESOURCE_STATE_COMMON, const wchar_t* resourceName = nullptr)
-{
-	auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-	ASSERT(SUCCEEDED(pDevice->CreateCommittedResource(
-		&uploadHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&bufferDesc,
-		initialResourceState == D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE ? D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE : D3D12_RESOURCE_STATE_COMMON,
-		nullptr,
-		IID_PPV_ARGS(ppResource))), "...");
-
-	if (resourceName)
-	{
-		(*ppResource)->SetName(resourceName);
-	}
-}
-
-inline void AllocateUploadBuffer(ID3D12Device* pDevice, const void* pData, UINT64 datasize, ID3D12Resource** ppResource, const wchar_t* resourceName = nullptr)
-{
-	auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(datasize);
-	ASSERT(SUCCEEDED(pDevice->CreateCommittedResource(
-		&uploadHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&bufferDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(ppResource))), "....");
-	if (resourceName)
-	{
-		(*ppResource)->SetName(resourceName);
-	}
-	void* pMappedData;
-	(*ppResource)->Map(0, nullptr, &pMappedData);
-	memcpy(pMappedData, pData, datasize);
-	(*ppResource)->Unmap(0, nullptr);
-}
\ No newline at end of file
+void AllocateUAVBuffer(UINT64 bufferSize, ID3D12Resource** ppResource, D3D12_RESOURCE_STATES initialResourceState = D3D12_RESOURCE_STATE_COMMON, const wchar_t* resourceName = nullptr);
+void AllocateUploadBuffer(const void* pData, UINT64 datasize, ID3D12Resource** ppResource, const wchar_t* resourceName = nullptr);
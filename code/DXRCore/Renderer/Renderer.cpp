@@ -9,43 +9,63 @@
 
 #include "Helper.hpp" 
 
+#include <CPU/Backend.hpp>
+#include <CPU/JobRecorder.hpp>
+#include <CPU/ThreadPool.hpp>
+
 #include <Utils/CLI.hpp>
 #include <Utils/Error.hpp>
 #include <Utils/Assert.hpp>
 
 #include <DirectXMath.h>
 
-Renderer* g_Renderer = nullptr;
+#include <algorithm>
+#include <filesystem>
 
-using namespace DirectX;
+// Defined in RendererCPU.cpp, which headless builds have as well
+extern Renderer* g_Renderer;
 
-DescriptorHeap* Renderer::GetShaderHeap()
-{
-	return g_Renderer->m_ShaderHeap;
-}
+// Released build buffers that stay pooled, beyond this the oldest ones are destroyed
+static constexpr uint64_t MaxPooledBufferSize = 256ull * 1024 * 1024;
 
-Renderer::Renderer()
-	: m_Device(nullptr)
-	, m_HWND(nullptr)
-	, m_Width(1280)
-	, m_Height(720)
-{
-}
+// Frames the CPU records ahead of the GPU, unless '-frames-in-flight' says otherwise
+static constexpr uint32_t DefaultFramesInFlight = 2;
+static constexpr uint32_t MaxFramesInFlight = 4;
+
+// Frames between two checks for written shader sources with '-shader-directory'
+static constexpr uint64_t ShaderReloadInterval = 30;
+
+// Command lists the passes of a frame are split into at most, more lists cost more to submit than they save
+static constexpr uint32_t MaxPassCommandLists = 8;
 
-Renderer::Renderer(uint32_t width, uint32_t height)
-	: m_Device(nullptr)
-	, m_HWND(nullptr)
-	, m_Width(width)
-	, m_Height(height)
+using namespace DirectX;
+
+DescriptorHeap* Renderer::GetShaderHeap()
 {
+	return g_Renderer != nullptr ? g_Renderer->m_ShaderHeap : nullptr;
 }
 
 Renderer::~Renderer()
 {
+	for (const auto& retired : m_RetiredPipelines)
+	{
+		delete retired.Pipeline;
+	}
+
+	delete m_ShaderCompileService;
+	delete m_ShaderCompiler;
+	delete m_PassRecorder;
+	delete m_CPUBackend;
 }
 
 void Renderer::Initialize()
 {
+	if (GetCLI().Backend == RenderBackend::CPU)
+	{
+		InitializeCPU();
+		return;
+	}
+
 	CreateRenderWindow();
 
 	m_Device = new Device();
@@ -55,17 +75,38 @@ void Renderer::Initialize()
 	m_SwapChain->Initialize(m_HWND, m_Width, m_Height);
 
 	m_RTVHeap = new DescriptorHeap();
-	m_RTVHeap->Initialize(HeapType::RTV);
+	m_RTVHeap->Initialize(HeapType::RTV, 16);
 
 	m_ShaderHeap = new DescriptorHeap();
 	m_ShaderHeap->Initialize(HeapType::Shader);
 	
-	m_RTV = m_RTVHeap->GetNextIndex();
-	m_UAV = m_ShaderHeap->GetNextIndex();
+	m_RTV = m_RTVHeap->Allocate();
+	m_UAV = m_ShaderHeap->Allocate();
 
 	CreateRenderTarget();
 	CreateCommandLists();
 
+	if (!GetCLI().ShaderDirectory.empty())
+	{
+		m_ShaderCompiler = new cpu::ShaderCompiler();
+
+		if (m_ShaderCompiler->Initialize())
+		{
+			// Half of the cores compile, so the frames keep going while they do
+			const uint32_t threadCount = std::max(cpu::ThreadPool::Get().GetThreadCount() / 2, 1u);
+			const cpu::ShaderCompiler& compiler = *m_ShaderCompiler;
+
+			m_ShaderCompileService = new cpu::ShaderCompileService([&compiler](const cpu::ShaderCompileDesc& desc, std::vector<uint8_t>& code, std::string& errors)
+			{
+				return compiler.Compile(desc, code, errors);
+			}, m_ShaderCompiler->GetVersion(), "ShaderCache.bin", threadCount);
+		}
+		else
+		{
+			printf("Failed to load dxcompiler.dll, the precompiled shaders are used instead\n");
+		}
+	}
+
 	g_Renderer = this;
 
 	InitializeSample();
@@ -73,35 +114,222 @@ void Renderer::Initialize()
 
 void Renderer::Shutdown()
 {
-	m_Device->GetCommandQueue().Flush();
+	if (m_Device != nullptr)
+	{
+		m_Device->GetCommandQueue().Flush();
+	}
 }
 
-void Renderer::Render()
+void Renderer::WaitForNextFrame()
 {
-	auto& commandQueue = m_Device->GetCommandQueue();
-	auto& cmdList = m_CommandList[m_FrameNumber % 2];
+	if (m_SwapChain != nullptr)
+	{
+		m_SwapChain->WaitForNextFrame();
+	}
+}
 
-	if (m_FrameNumber > 1)
+bool Renderer::Render()
+{
+	if (m_CPUBackend != nullptr)
 	{
-		//commandQueue.WaitForFence(m_FenceValue[m_FrameNumber % 2]);
+		return RenderCPU();
+	}
 
-		m_CommandListAllocator[m_FrameNumber % 2]->Reset();
-		cmdList->Reset(m_CommandListAllocator[m_FrameNumber % 2].Get(), nullptr);
+	auto& commandQueue = m_Device->GetCommandQueue();
+	auto& frame = m_Frames[m_FrameNumber % m_Frames.size()];
+
+	// The GPU has to be done with the last frame that used these before they are reset. Waiting here is what keeps the
+	// CPU at most the frames in flight ahead.
+	commandQueue.WaitForFence(frame.Fence);
+
+	frame.CommandAllocator->Reset();
+	frame.CommandList->Reset(frame.CommandAllocator.Get(), nullptr);
+
+	for (auto& allocator : frame.PassCommandAllocators)
+	{
+		allocator->Reset();
 	}
 
+	UpdatePipeline();
+
+	auto& cmdList = frame.CommandList;
+
+	// Uploads recorded since the last frame go to the GPU before the frame that uses them
+	m_Device->GetUploadBatcher().Flush();
+	m_Device->GetBufferPool().Trim(MaxPooledBufferSize);
+	m_Device->GetMemoryAllocator().Collect();
+
 	float color[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
 
 	cmdList->ClearRenderTargetView(m_RTVHeap->GetCPUHandle(m_RTV), color, 0, nullptr);
 
+	// Views written since the last frame go into the shader visible heap, which might have grown since then
+	m_ShaderHeap->Commit();
 	cmdList->SetDescriptorHeaps(1, m_ShaderHeap->GetHeap().GetAddressOf());
 
 	RenderSample(cmdList);
 
-	commandQueue.ExecuteCommandLists({ cmdList.Get() });
+	// The copy to the back buffer comes after every pass
+	if (m_PassRecorder->GetJobCount() > 0)
+	{
+		AddPass([this](ID3D12GraphicsCommandList7* passCmdList, UNUSED uint32_t threadIndex)
+		{
+			m_SwapChain->CopyToBackBuffer(passCmdList, m_RenderTarget.Get());
+		}, 0.0f);
+	}
+	else
+	{
+		m_SwapChain->CopyToBackBuffer(cmdList.Get(), m_RenderTarget.Get());
+	}
+
+	const uint32_t passCommandListCount = RecordPasses(frame);
+
+	m_SubmittedCommandLists.clear();
+	m_SubmittedCommandLists.push_back(cmdList.Get());
+
+	for (uint32_t i = 0; i < passCommandListCount; i++)
+	{
+		m_SubmittedCommandLists.push_back(m_PassCommandLists[i].Get());
+	}
+
+	frame.Fence = commandQueue.ExecuteCommandLists(m_SubmittedCommandLists.data(), static_cast<uint32_t>(m_SubmittedCommandLists.size()));
 
-	m_SwapChain->Present(m_RenderTarget);
+	m_ShaderHeap->EndFrame(frame.Fence);
+	m_RTVHeap->EndFrame(frame.Fence);
+	m_Device->GetConstantAllocator().EndFrame(frame.Fence);
+
+	m_SwapChain->Present();
 
 	m_FrameNumber++;
+	return true;
+}
+
+void Renderer::AddPass(Pass pass, float cost)
+{
+	m_PassRecorder->Add([this, pass = std::move(pass)](uint32_t chunk, uint32_t threadIndex)
+	{
+		pass(m_PassCommandLists[chunk].Get(), threadIndex);
+	}, cost);
+}
+
+ConstantAllocator& Renderer::GetConstantAllocator()
+{
+	return m_Device->GetConstantAllocator();
+}
+
+uint32_t Renderer::RecordPasses(Frame& frame)
+{
+	if (m_PassRecorder->GetJobCount() == 0)
+	{
+		return 0;
+	}
+
+	auto device = Device::GetDevice().GetInternalDevice();
+
+	const uint32_t maxChunkCount = static_cast<uint32_t>(frame.PassCommandAllocators.size());
+
+	// Created closed, without an allocator, on this thread
+	while (m_PassCommandLists.size() < std::min(maxChunkCount, m_PassRecorder->GetJobCount()))
+	{
+		ComPtr<ID3D12GraphicsCommandList7> cmdList;
+		ASSERT(SUCCEEDED(device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&cmdList))), "Failed to create a command list");
+
+		m_PassCommandLists.push_back(cmdList);
+	}
+
+	ID3D12DescriptorHeap* shaderHeap = m_ShaderHeap->GetHeap().Get();
+
+	// A thread can record several chunks, and their lists stay open until they are submitted. An allocator can only
+	// back one open list, so every chunk has an allocator of its own.
+	return m_PassRecorder->Record(maxChunkCount, [this, &frame, shaderHeap](uint32_t chunk, UNUSED uint32_t threadIndex)
+	{
+		auto& cmdList = m_PassCommandLists[chunk];
+
+		cmdList->Reset(frame.PassCommandAllocators[chunk].Get(), nullptr);
+		cmdList->SetDescriptorHeaps(1, &shaderHeap);
+	});
+}
+
+void Renderer::CreatePipeline(const RaytracingPipelineDesc& desc, const std::string& sourceFile, std::vector<cpu::ShaderDefine> defines)
+{
+	m_Pipeline = new RaytracingPipeline(desc);
+
+	if (m_ShaderCompileService == nullptr)
+	{
+		return;
+	}
+
+	cpu::ShaderCompileDesc shader;
+	shader.SourcePath = (std::filesystem::path(GetCLI().ShaderDirectory) / sourceFile).string();
+	shader.Defines = std::move(defines);
+
+#if defined _DEBUG
+	shader.Debug = true;
+#endif
+
+	m_PipelineRecursionDepth = desc.RecursionDepth;
+
+	if (GetCLI().RecursionDepth > 0)
+	{
+		m_PipelineRecursionDepth = GetCLI().RecursionDepth;
+		shader.Defines.push_back({ "RECURSION_DEPTH", std::to_string(m_PipelineRecursionDepth) });
+	}
+
+	m_ShaderPermutation = m_ShaderCompileService->Add(std::move(shader));
+}
+
+void Renderer::UpdatePipeline()
+{
+	if (m_ShaderCompileService == nullptr)
+	{
+		return;
+	}
+
+	const uint64_t completedFence = m_Device->GetCommandQueue().GetCompletedFence();
+
+	auto retired = std::remove_if(m_RetiredPipelines.begin(), m_RetiredPipelines.end(), [completedFence](const RetiredPipeline& pipeline)
+	{
+		if (pipeline.Fence > completedFence)
+		{
+			return false;
+		}
+
+		delete pipeline.Pipeline;
+		return true;
+	});
+
+	m_RetiredPipelines.erase(retired, m_RetiredPipelines.end());
+
+	if (m_FrameNumber % ShaderReloadInterval == 0)
+	{
+		m_ShaderCompileService->Reload();
+	}
+
+	std::vector<uint8_t> code;
+	std::string errors;
+
+	if (m_Pipeline == nullptr || !m_ShaderCompileService->TakeResult(m_ShaderPermutation, code, errors))
+	{
+		return;
+	}
+
+	// Holds the warnings when it did compile
+	if (!errors.empty())
+	{
+		printf("%s\n", errors.c_str());
+	}
+
+	RaytracingPipeline* pipeline = code.empty() ? nullptr : m_Pipeline->Recompile({ code.data(), code.size() }, m_PipelineRecursionDepth);
+
+	if (pipeline == nullptr)
+	{
+		printf("The shaders failed to compile or link, the last pipeline is kept\n");
+		return;
+	}
+
+	// Frames that are still in flight use the pipeline that is swapped out
+	m_RetiredPipelines.push_back({ m_Pipeline, m_Device->GetCommandQueue().GetLastFence() });
+	m_Pipeline = pipeline;
 }
 
 void Renderer::Resize(uint32_t width, uint32_t height)
@@ -114,12 +342,23 @@ void Renderer::Resize(uint32_t width, uint32_t height)
 	m_Width = std::max(width, 1u);
 	m_Height = std::max(height, 1u);
 
+	if (m_CPUBackend != nullptr)
+	{
+		m_CPUBackend->Resize(m_Width, m_Height);
+		return;
+	}
+
 	m_Device->Flush();
 
 	CreateRenderTarget();
 	m_SwapChain->Resize(m_Width, m_Height);
 }
 
+float Renderer::GetLatency() const
+{
+	return m_SwapChain != nullptr ? m_SwapChain->GetLatency() : 0.0f;
+}
+
 void Renderer::CreateRenderWindow()
 {
 	std::wstring windowName = L"Intro to DirectX Raytracing | " + ms_SampleName;
@@ -193,13 +432,36 @@ void Renderer::CreateCommandLists()
 {
 	auto device = Device::GetDevice().GetInternalDevice();
 
-	for (uint32_t i = 0; i < 2; i++)
+	const uint32_t framesInFlight = GetCLI().FramesInFlight != 0 ? GetCLI().FramesInFlight : DefaultFramesInFlight;
+
+	m_Frames.resize(std::clamp(framesInFlight, 1u, MaxFramesInFlight));
+
+	auto& threadPool = cpu::ThreadPool::Get();
+
+	m_PassRecorder = new cpu::JobRecorder(threadPool);
+
+	for (auto& frame : m_Frames)
 	{
-		device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_CommandListAllocator[i]));
-		device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_CommandListAllocator[i].Get(), nullptr, IID_PPV_ARGS(&m_CommandList[i]));
+		device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame.CommandAllocator));
+		device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, frame.CommandAllocator.Get(), nullptr, IID_PPV_ARGS(&frame.CommandList));
+
+		// Every frame resets its command list, which has to be closed for that
+		frame.CommandList->Close();
+
+		frame.PassCommandAllocators.resize(std::min(threadPool.GetThreadCount(), MaxPassCommandLists));
+
+		for (auto& allocator : frame.PassCommandAllocators)
+		{
+			device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator));
+		}
 	}
 }
 
+bool Renderer::IsKeyDown(uint32_t key)
+{
+	return (GetAsyncKeyState(static_cast<int>(key)) & 0x8000) != 0;
+}
+
 LRESULT Renderer::WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	if (message == WM_CREATE)
@@ -1,45 +1,161 @@
 #pragma once
 
+#if !defined(DXR_HEADLESS)
 #include <wrl/client.h>
 #include <dxgi1_6.h>
+#else
+struct ID3D12GraphicsCommandList7;
+#endif
 
-#define SAMPLE(x) Renderer* CreateSample() { return new x();} std::wstring Renderer::ms_SampleName = L#x;
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
+#include <DXRCore/CPU/ShaderCompiler.hpp>
+
+namespace cpu
+{
+	class Backend;
+	class JobRecorder;
+}
+
+struct RaytracingPipelineDesc;
+
+#define SAMPLE(x) Renderer* CreateSample() { return new x();} std::wstring Renderer::ms_SampleName = L"" #x;
+
+// Headless builds, with DXR_HEADLESS defined, only have the CPU backend. They are driven by HeadlessMain.cpp instead of
+// Main.cpp, and leave out everything of the renderer that needs a window or D3D12.
 class Renderer
 {
 public:
+	// Virtual key codes of the arrow keys, see IsKeyDown. Letters are their upper case character.
+	enum Key : uint32_t
+	{
+		KeyLeft = 0x25,
+		KeyUp = 0x26,
+		KeyRight = 0x27,
+		KeyDown = 0x28
+	};
+
+#if !defined(DXR_HEADLESS)
 	static class DescriptorHeap* GetShaderHeap();
+#endif
+
+	// Returns the CPU backend when the application runs with '-backend=cpu', otherwise nullptr
+	static cpu::Backend* GetCPUBackend();
 
 	Renderer();
 	Renderer(uint32_t width, uint32_t height);
-	~Renderer();
+	virtual ~Renderer();
 
 	void Initialize();
 	void Shutdown();
 
-	void Render();
+#if !defined(DXR_HEADLESS)
+	// Blocks until a new frame can be started, see '-low-latency'. Called before the input of the frame is read.
+	void WaitForNextFrame();
+#endif
+
+	// Returns false once the sample is done, which is after the CPU backend converged with '-accumulate'
+	bool Render();
 	virtual void Update([[maybe_unused]] float deltaTime) {};
 
 	virtual void InitializeSample() {};
+
+	// Called instead of RenderSample when the CPU backend is used. The sample fills in a cpu::FrameDesc and renders it.
+	virtual void RenderSampleCPU(cpu::Backend&) {};
+
+	// Whether the key is held down. Always false in headless builds, which have no keyboard.
+	static bool IsKeyDown(uint32_t key);
+
+#if !defined(DXR_HEADLESS)
 	virtual void RenderSample(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7>) {};
 
+	// Records a pass of the frame into the command list it gets. The thread index is the one to allocate constants
+	// with, see ConstantAllocator.
+	using Pass = std::function<void(ID3D12GraphicsCommandList7*, uint32_t threadIndex)>;
+
+	// Adds a pass to the current frame, from RenderSample. After RenderSample returns the passes are recorded on the
+	// threads of cpu::ThreadPool, each into a command list with the shader heap bound, and they are submitted after the
+	// command list of RenderSample in the order they were added. Passes recorded into the same command list share its
+	// state, passes in different ones do not. The cost is only compared between passes, to split them evenly over the
+	// threads.
+	void AddPass(Pass pass, float cost = 1.0f);
+
+	// Root constant buffer views for RenderSample and the passes, valid until the GPU has finished the frame
+	class ConstantAllocator& GetConstantAllocator();
+
+	// Creates m_Pipeline from the precompiled library of the desc, from InitializeSample. With '-shader-directory',
+	// sourceFile in that directory is compiled as well on background threads, with the defines and '-recursion-depth'.
+	// The pipeline is swapped for the compiled permutation once it is done, and again whenever one of its source files
+	// is written. A permutation that fails to compile keeps the pipeline that was there.
+	void CreatePipeline(const RaytracingPipelineDesc& desc, const std::string& sourceFile, std::vector<cpu::ShaderDefine> defines = {});
+
 	void Resize(uint32_t width, uint32_t height);
 
+	// Milliseconds between the start of a frame and it being displayed, or 0 when it is not known
+	float GetLatency() const;
+#endif
+
 private:
+	// Creates the CPU backend, which runs headless. There is no window, D3D12 device or swap chain, the attributes keep
+	// their data on the CPU instead.
+	void InitializeCPU();
+	bool RenderCPU();
+
+#if !defined(DXR_HEADLESS)
+	// Everything the CPU records for a frame, reused once the GPU has finished the frame
+	struct Frame
+	{
+		// Records RenderSample
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList7> CommandList;
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CommandAllocator;
+
+		// One per command list of the passes, for as many as the frame splits them into
+		std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> PassCommandAllocators;
+
+		uint64_t Fence = 0;
+	};
+
+	// A pipeline that was swapped out, deleted once the GPU finished the frames that used it
+	struct RetiredPipeline
+	{
+		class RaytracingPipeline* Pipeline = nullptr;
+		uint64_t Fence = 0;
+	};
+
 	void CreateRenderWindow();
 	void CreateRenderTarget();
 	void CreateCommandLists();
 
+	// Records the passes added during RenderSample, and returns the number of command lists they were recorded into
+	uint32_t RecordPasses(Frame& frame);
+
+	// Swaps in the pipeline of a newly compiled permutation, and deletes the retired pipelines the GPU is done with
+	void UpdatePipeline();
+
 	static LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+#endif
 
 protected:
+	cpu::Backend* m_CPUBackend = nullptr;
+
+	uint64_t m_FrameNumber = 0;
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+
+	static std::wstring ms_SampleName;
+
+#if !defined(DXR_HEADLESS)
 	template<typename T>
 	using ComPtr = Microsoft::WRL::ComPtr<T>;
 
-	class Device* m_Device;
-	class SwapChain* m_SwapChain;
+	class Device* m_Device = nullptr;
+	class SwapChain* m_SwapChain = nullptr;
 
-	HWND m_HWND;
+	HWND m_HWND = nullptr;
 
 	class DescriptorHeap* m_RTVHeap = nullptr;
 	class DescriptorHeap* m_ShaderHeap = nullptr;
@@ -50,16 +166,23 @@ protected:
 	uint32_t m_RTV;
 	uint32_t m_UAV;
 
-	ComPtr<ID3D12GraphicsCommandList7> m_CommandList[2];
-	ComPtr<ID3D12CommandAllocator> m_CommandListAllocator[2];
+	// One per frame in flight
+	std::vector<Frame> m_Frames;
 
-	uint64_t m_FrameNumber = 0;
+	cpu::JobRecorder* m_PassRecorder = nullptr;
 
-	uint64_t m_FenceValue[2] = {};
+	// One per chunk of passes. A command list can be reset as soon as it is submitted, only the allocators have to wait
+	// for the GPU.
+	std::vector<ComPtr<ID3D12GraphicsCommandList7>> m_PassCommandLists;
+	std::vector<ID3D12GraphicsCommandList7*> m_SubmittedCommandLists;
 
-	uint32_t m_Width;
-	uint32_t m_Height;
+	// Only created with '-shader-directory'
+	cpu::ShaderCompiler* m_ShaderCompiler = nullptr;
+	cpu::ShaderCompileService* m_ShaderCompileService = nullptr;
+	cpu::ShaderCompileService::Handle m_ShaderPermutation = 0;
+	uint32_t m_PipelineRecursionDepth = 0;
 
-	static std::wstring ms_SampleName;
+	std::vector<RetiredPipeline> m_RetiredPipelines;
+#endif
 };
 
@@ -0,0 +1,126 @@
+// Built without the precompiled header, d3d12.h pulls in Windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include "Renderer.hpp"
+
+#include <CPU/Backend.hpp>
+
+#include <Utils/CLI.hpp>
+#include <Utils/Error.hpp>
+
+#include <cstdio>
+
+// The part of Renderer that builds without D3D12: the CPU backend, and in headless builds the whole renderer
+
+Renderer* g_Renderer = nullptr;
+
+cpu::Backend* Renderer::GetCPUBackend()
+{
+	return g_Renderer != nullptr ? g_Renderer->m_CPUBackend : nullptr;
+}
+
+Renderer::Renderer()
+	: m_Width(1280)
+	, m_Height(720)
+{
+}
+
+Renderer::Renderer(uint32_t width, uint32_t height)
+	: m_Width(width)
+	, m_Height(height)
+{
+}
+
+void Renderer::InitializeCPU()
+{
+	m_CPUBackend = new cpu::Backend(m_Width, m_Height);
+
+	if (GetCLI().Wavefront)
+	{
+		m_CPUBackend->SetRenderMode(cpu::RenderMode::Wavefront);
+	}
+
+	if (GetCLI().Accumulate)
+	{
+		cpu::AccumulationDesc desc = {};
+
+		if (GetCLI().AccumulationVarianceTarget > 0.0f)
+		{
+			desc.VarianceTarget = GetCLI().AccumulationVarianceTarget;
+		}
+
+		desc.TimeBudget = GetCLI().AccumulationTimeBudget;
+
+		m_CPUBackend->SetAccumulation(true, desc);
+	}
+
+	g_Renderer = this;
+
+	InitializeSample();
+}
+
+bool Renderer::RenderCPU()
+{
+	RenderSampleCPU(*m_CPUBackend);
+
+	// While accumulating, only the converged image is written, after which the sample is done
+	const bool accumulating = m_CPUBackend->IsAccumulating();
+
+	if (accumulating && !m_CPUBackend->IsConverged())
+	{
+		m_FrameNumber++;
+		return true;
+	}
+
+	if (accumulating)
+	{
+		const auto& statistics = m_CPUBackend->GetAccumulationStatistics();
+
+		printf("Converged after %u samples in %.2f s, largest variance %g\n", statistics.SampleCount, statistics.Time, statistics.MaxVariance);
+	}
+
+	if (!GetCLI().OutputPath.empty())
+	{
+		const unsigned long long frameNumber = m_FrameNumber;
+
+		char path[512];
+		snprintf(path, sizeof(path), "%s_%05llu.ppm", GetCLI().OutputPath.c_str(), frameNumber);
+
+		if (!m_CPUBackend->WriteFrame(path))
+		{
+			FatalError("Failed to write frame %llu to '%s'", frameNumber, path);
+		}
+	}
+
+	m_FrameNumber++;
+	return !accumulating;
+}
+
+#if defined(DXR_HEADLESS)
+Renderer::~Renderer()
+{
+	delete m_CPUBackend;
+}
+
+// Without D3D12 the CPU backend is the only one, whatever '-backend' says
+void Renderer::Initialize()
+{
+	InitializeCPU();
+}
+
+void Renderer::Shutdown()
+{
+}
+
+bool Renderer::Render()
+{
+	return RenderCPU();
+}
+
+bool Renderer::IsKeyDown([[maybe_unused]] uint32_t key)
+{
+	return false;
+}
+#endif
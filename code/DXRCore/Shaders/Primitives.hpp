@@ -0,0 +1,562 @@
+#pragma once
+
+// Analytic primitives for intersection shaders. This file is compiled as HLSL by the samples and as C++ by the CPU
+// backend, so it only uses the part of both languages that they share. Rays are given in the object space of the
+// instance, the direction does not need to be normalized.
+
+#if __cplusplus
+#include "../CPU/Math.hpp"
+
+#define OUT(type) type&
+#else
+#define OUT(type) out type
+#endif
+
+#ifndef CONSTANT
+#if __cplusplus
+#define CONSTANT constexpr
+#else
+#define CONSTANT static const
+#endif
+#endif
+
+// Mask of the primitive types, by 1 << type, that the intersection code handles. Permutations compiled for a scene
+// that only has some of the types leave out the others.
+#ifndef PRIMITIVE_TYPES
+#define PRIMITIVE_TYPES 0x1F
+#endif
+
+namespace primitives
+{
+#if __cplusplus
+	// The HLSL intrinsics used below
+	using uint = uint32_t;
+	using float3 = cpu::Float3;
+	using float4 = cpu::Float4;
+
+	using std::abs;
+	using std::acos;
+	using std::cos;
+	using std::max;
+	using std::min;
+	using std::pow;
+	using std::sqrt;
+
+	inline float dot(const float3& a, const float3& b)
+	{
+		return cpu::Dot(a, b);
+	}
+
+	inline float length(const float3& a)
+	{
+		return cpu::Length(a);
+	}
+
+	inline float3 normalize(const float3& a)
+	{
+		return cpu::Normalize(a);
+	}
+
+	inline float sign(float x)
+	{
+		return x > 0.0f ? 1.0f : (x < 0.0f ? -1.0f : 0.0f);
+	}
+
+	inline float clamp(float x, float low, float high)
+	{
+		return min(max(x, low), high);
+	}
+#endif
+
+	CONSTANT uint PRIMITIVE_SPHERE = 0;
+	CONSTANT uint PRIMITIVE_TORUS = 1;
+	CONSTANT uint PRIMITIVE_BOX = 2;
+	CONSTANT uint PRIMITIVE_CYLINDER = 3;
+	CONSTANT uint PRIMITIVE_CAPSULE = 4;
+
+	// Tori, cylinders and capsules are centered on Position and point along the z axis
+	struct Primitive
+	{
+		uint Type;
+		float3 Position;
+
+		// Sphere: x = radius
+		// Torus: x = radius of the ring, y = radius of the tube
+		// Box: xyz = half of the size
+		// Cylinder: x = radius, y = half of the height
+		// Capsule: x = radius, y = half of the length of the segment between the two caps
+		float4 Parameters;
+	};
+
+	// Element of the AABB buffer of a ProceduralPrimitive. The box comes first, so the buffer can be passed to the BLAS
+	// build as it is, with the element size as stride.
+	struct PrimitiveEntry
+	{
+		float3 BoundsMin;
+		float3 BoundsMax;
+		primitives::Primitive Primitive;
+	};
+
+	// False for the types that are compiled out, whatever the type of the primitive
+	inline bool IsPrimitiveType(Primitive primitive, uint type)
+	{
+		return (PRIMITIVE_TYPES & (1u << type)) != 0 && primitive.Type == type;
+	}
+
+	// Keeps the closest t in [tMin, t)
+	inline void AddCandidate(float candidate, float tMin, OUT(float) t)
+	{
+		if (candidate >= tMin && candidate < t)
+		{
+			t = candidate;
+		}
+	}
+
+	inline bool IntersectSphere(float3 ro, float3 rd, float radius, float tMin, float tMax, OUT(float) t)
+	{
+		t = tMax;
+
+		const float a = dot(rd, rd);
+		const float h = -dot(rd, ro);
+		const float c = dot(ro, ro) - radius * radius;
+		const float discriminant = h * h - a * c;
+
+		if (discriminant < 0.0f)
+		{
+			return false;
+		}
+
+		const float s = sqrt(discriminant);
+
+		AddCandidate((h - s) / a, tMin, t);
+		AddCandidate((h + s) / a, tMin, t);
+
+		return t < tMax;
+	}
+
+	// Newton steps on the implicit torus (|p|^2 + R^2 - r^2)^2 - 4 R^2 (x^2 + y^2) along a normalized direction. The
+	// closed form below cancels away about three digits in single precision and can be off the surface by a third of
+	// the tube. Near the root the implicit function keeps its precision, so four steps bring t back to float precision,
+	// also on the slower convergence close to a double root. Steps that would leave the tube are the tangent of a
+	// grazing ray and are not taken.
+	inline float RefineTorusRoot(float3 ro, float3 rd, float Ra2, float ra2, float t)
+	{
+		const float maxStep = sqrt(ra2);
+
+		for (int i = 0; i < 4; i++)
+		{
+			const float3 p = ro + rd * t;
+			const float g = dot(p, p) + Ra2 - ra2;
+
+			const float f = g * g - 4.0f * Ra2 * (p.x * p.x + p.y * p.y);
+			const float df = 4.0f * g * dot(p, rd) - 8.0f * Ra2 * (p.x * rd.x + p.y * rd.y);
+
+			const float step = f / df;
+
+			if (abs(step) < maxStep)
+			{
+				t -= step;
+			}
+		}
+
+		return t;
+	}
+
+	// https://iquilezles.org/articles/intersectors/ (torus), with the ring in the xy plane. Solves the quartic in
+	// closed form, which needs a normalized direction, and refines the closest root.
+	inline bool IntersectTorus(float3 ro, float3 rd, float ringRadius, float tubeRadius, float tMin, float tMax, OUT(float) t)
+	{
+		t = tMax;
+
+		const float scale = length(rd);
+		rd = rd * (1.0f / scale);
+		tMin *= scale;
+		tMax *= scale;
+
+		const float Ra2 = ringRadius * ringRadius;
+		const float ra2 = tubeRadius * tubeRadius;
+
+		const float m = dot(ro, ro);
+		const float n = dot(ro, rd);
+
+		// Bounding sphere
+		const float outer = ringRadius + tubeRadius;
+		if (n * n - m + outer * outer < 0.0f)
+		{
+			return false;
+		}
+
+		const float k = (m - ra2 - Ra2) * 0.5f;
+		float k3 = n;
+		float k2 = n * n + Ra2 * rd.z * rd.z + k;
+		float k1 = k * n + Ra2 * ro.z * rd.z;
+		float k0 = k * k + Ra2 * ro.z * ro.z - Ra2 * ra2;
+
+		// Solve for 1 / t when c1 is close to zero, which keeps the resolvent away from its unstable case
+		float po = 1.0f;
+
+		if (abs(k3 * (k3 * k3 - k2) + k1) < 0.01f)
+		{
+			po = -1.0f;
+
+			const float tmp = k1;
+			k1 = k3;
+			k3 = tmp;
+
+			k0 = 1.0f / k0;
+			k1 = k1 * k0;
+			k2 = k2 * k0;
+			k3 = k3 * k0;
+		}
+
+		float c2 = 2.0f * k2 - 3.0f * k3 * k3;
+		float c1 = k3 * (k3 * k3 - k2) + k1;
+		float c0 = k3 * (k3 * (-3.0f * k3 * k3 + 4.0f * k2) - 8.0f * k1) + 4.0f * k0;
+
+		c2 /= 3.0f;
+		c1 *= 2.0f;
+		c0 /= 3.0f;
+
+		const float Q = c2 * c2 + c0;
+		const float R = 3.0f * c0 * c2 - c2 * c2 * c2 - c1 * c1;
+
+		float h = R * R - Q * Q * Q;
+		float z;
+
+		if (h < 0.0f)
+		{
+			// Four real roots
+			const float sQ = sqrt(Q);
+			z = 2.0f * sQ * cos(acos(R / (sQ * Q)) / 3.0f);
+		}
+		else
+		{
+			// Two real roots
+			const float sQ = pow(sqrt(h) + abs(R), 1.0f / 3.0f);
+			z = sign(R) * abs(sQ + Q / sQ);
+		}
+
+		z = c2 - z;
+
+		float d1 = z - 3.0f * c2;
+		float d2 = z * z - 3.0f * c0;
+
+		if (abs(d1) < 1.0e-4f)
+		{
+			if (d2 < 0.0f)
+			{
+				return false;
+			}
+
+			d2 = sqrt(d2);
+		}
+		else
+		{
+			if (d1 < 0.0f)
+			{
+				return false;
+			}
+
+			d1 = sqrt(d1 * 0.5f);
+			d2 = c1 / d1;
+		}
+
+		t = tMax;
+
+		h = d1 * d1 - z + d2;
+		if (h > 0.0f)
+		{
+			h = sqrt(h);
+
+			float t1 = -d1 - h - k3;
+			float t2 = -d1 + h - k3;
+
+			AddCandidate(po < 0.0f ? 2.0f / t1 : t1, tMin, t);
+			AddCandidate(po < 0.0f ? 2.0f / t2 : t2, tMin, t);
+		}
+
+		h = d1 * d1 - z - d2;
+		if (h > 0.0f)
+		{
+			h = sqrt(h);
+
+			float t1 = d1 - h - k3;
+			float t2 = d1 + h - k3;
+
+			AddCandidate(po < 0.0f ? 2.0f / t1 : t1, tMin, t);
+			AddCandidate(po < 0.0f ? 2.0f / t2 : t2, tMin, t);
+		}
+
+		if (t >= tMax)
+		{
+			return false;
+		}
+
+		t = RefineTorusRoot(ro, rd, Ra2, ra2, t);
+
+		// Refining can move a root just inside the range out of it, which ReportHit must not get
+		const bool hit = t >= tMin && t < tMax;
+
+		t = (hit ? t : tMax) / scale;
+		return hit;
+	}
+
+	inline bool IntersectBox(float3 ro, float3 rd, float3 halfSize, float tMin, float tMax, OUT(float) t)
+	{
+		// Slabs as distances to both planes, so a zero direction component gives infinities of the right sign
+		t = tMax;
+
+		const float3 invD = float3(1.0f / rd.x, 1.0f / rd.y, 1.0f / rd.z);
+		const float3 t1 = (float3(0.0f, 0.0f, 0.0f) - halfSize - ro) * invD;
+		const float3 t2 = (halfSize - ro) * invD;
+
+		const float tNear = max(max(min(t1.x, t2.x), min(t1.y, t2.y)), min(t1.z, t2.z));
+		const float tFar = min(min(max(t1.x, t2.x), max(t1.y, t2.y)), max(t1.z, t2.z));
+
+		if (tNear > tFar)
+		{
+			return false;
+		}
+
+		AddCandidate(tNear, tMin, t);
+		AddCandidate(tFar, tMin, t);
+
+		return t < tMax;
+	}
+
+	inline bool IntersectCylinder(float3 ro, float3 rd, float radius, float halfHeight, float tMin, float tMax, OUT(float) t)
+	{
+		t = tMax;
+
+		// Side, where the hit lies between the caps
+		const float a = rd.x * rd.x + rd.y * rd.y;
+		const float b = ro.x * rd.x + ro.y * rd.y;
+		const float c = ro.x * ro.x + ro.y * ro.y - radius * radius;
+		const float discriminant = b * b - a * c;
+
+		if (a > 0.0f && discriminant >= 0.0f)
+		{
+			const float s = sqrt(discriminant);
+
+			const float t1 = (-b - s) / a;
+			const float t2 = (-b + s) / a;
+
+			if (abs(ro.z + rd.z * t1) <= halfHeight)
+			{
+				AddCandidate(t1, tMin, t);
+			}
+
+			if (abs(ro.z + rd.z * t2) <= halfHeight)
+			{
+				AddCandidate(t2, tMin, t);
+			}
+		}
+
+		// Caps, where the hit lies inside the radius
+		if (rd.z != 0.0f)
+		{
+			const float t1 = (halfHeight - ro.z) / rd.z;
+			const float t2 = (-halfHeight - ro.z) / rd.z;
+
+			const float x1 = ro.x + rd.x * t1;
+			const float y1 = ro.y + rd.y * t1;
+			const float x2 = ro.x + rd.x * t2;
+			const float y2 = ro.y + rd.y * t2;
+
+			if (x1 * x1 + y1 * y1 <= radius * radius)
+			{
+				AddCandidate(t1, tMin, t);
+			}
+
+			if (x2 * x2 + y2 * y2 <= radius * radius)
+			{
+				AddCandidate(t2, tMin, t);
+			}
+		}
+
+		return t < tMax;
+	}
+
+	inline bool IntersectCapsule(float3 ro, float3 rd, float radius, float halfLength, float tMin, float tMax, OUT(float) t)
+	{
+		t = tMax;
+
+		// Side, where the hit lies between the centers of the caps
+		const float a = rd.x * rd.x + rd.y * rd.y;
+		const float b = ro.x * rd.x + ro.y * rd.y;
+		const float c = ro.x * ro.x + ro.y * ro.y - radius * radius;
+		const float discriminant = b * b - a * c;
+
+		if (a > 0.0f && discriminant >= 0.0f)
+		{
+			const float s = sqrt(discriminant);
+
+			const float t1 = (-b - s) / a;
+			const float t2 = (-b + s) / a;
+
+			if (abs(ro.z + rd.z * t1) <= halfLength)
+			{
+				AddCandidate(t1, tMin, t);
+			}
+
+			if (abs(ro.z + rd.z * t2) <= halfLength)
+			{
+				AddCandidate(t2, tMin, t);
+			}
+		}
+
+		// Caps, the outer half of the sphere at either end of the segment
+		const float sphereA = dot(rd, rd);
+
+		for (int cap = 0; cap < 2; cap++)
+		{
+			const float side = cap == 0 ? 1.0f : -1.0f;
+			const float3 oc = float3(ro.x, ro.y, ro.z - side * halfLength);
+
+			const float h = dot(rd, oc);
+			const float sphereC = dot(oc, oc) - radius * radius;
+			const float sphereDiscriminant = h * h - sphereA * sphereC;
+
+			if (sphereDiscriminant >= 0.0f)
+			{
+				const float s = sqrt(sphereDiscriminant);
+
+				const float t1 = (-h - s) / sphereA;
+				const float t2 = (-h + s) / sphereA;
+
+				if ((oc.z + rd.z * t1) * side >= 0.0f)
+				{
+					AddCandidate(t1, tMin, t);
+				}
+
+				if ((oc.z + rd.z * t2) * side >= 0.0f)
+				{
+					AddCandidate(t2, tMin, t);
+				}
+			}
+		}
+
+		return t < tMax;
+	}
+
+	// Closest hit in [tMin, tMax) of a ray in the object space of the instance
+	inline bool IntersectPrimitive(Primitive primitive, float3 origin, float3 direction, float tMin, float tMax, OUT(float) t)
+	{
+		const float3 ro = origin - primitive.Position;
+		const float4 p = primitive.Parameters;
+
+		t = tMax;
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_SPHERE))
+		{
+			return IntersectSphere(ro, direction, p.x, tMin, tMax, t);
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_TORUS))
+		{
+			return IntersectTorus(ro, direction, p.x, p.y, tMin, tMax, t);
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_BOX))
+		{
+			return IntersectBox(ro, direction, float3(p.x, p.y, p.z), tMin, tMax, t);
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_CYLINDER))
+		{
+			return IntersectCylinder(ro, direction, p.x, p.y, tMin, tMax, t);
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_CAPSULE))
+		{
+			return IntersectCapsule(ro, direction, p.x, p.y, tMin, tMax, t);
+		}
+
+		return false;
+	}
+
+	// Object space normal at a point on the surface. Kept out of the intersection, so shadow rays do not pay for it.
+	inline float3 GetPrimitiveNormal(Primitive primitive, float3 position)
+	{
+		const float3 p = position - primitive.Position;
+		const float4 parameters = primitive.Parameters;
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_TORUS))
+		{
+			const float Ra2 = parameters.x * parameters.x;
+			const float ra2 = parameters.y * parameters.y;
+			const float k = dot(p, p) - ra2 - Ra2;
+
+			return normalize(float3(p.x * k, p.y * k, p.z * (k + 2.0f * Ra2)));
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_BOX))
+		{
+			// The face is the axis on which the point is closest to the side of the box
+			const float3 d = float3(abs(p.x) / parameters.x, abs(p.y) / parameters.y, abs(p.z) / parameters.z);
+
+			if (d.x >= d.y && d.x >= d.z)
+			{
+				return float3(sign(p.x), 0.0f, 0.0f);
+			}
+
+			if (d.y >= d.z)
+			{
+				return float3(0.0f, sign(p.y), 0.0f);
+			}
+
+			return float3(0.0f, 0.0f, sign(p.z));
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_CYLINDER))
+		{
+			const float side = sqrt(p.x * p.x + p.y * p.y) / parameters.x;
+			const float cap = abs(p.z) / parameters.y;
+
+			if (cap >= side)
+			{
+				return float3(0.0f, 0.0f, sign(p.z));
+			}
+
+			return normalize(float3(p.x, p.y, 0.0f));
+		}
+
+		if (IsPrimitiveType(primitive, PRIMITIVE_CAPSULE))
+		{
+			// From the closest point on the segment
+			const float z = clamp(p.z, -parameters.y, parameters.y);
+			return normalize(float3(p.x, p.y, p.z - z));
+		}
+
+		return normalize(p);
+	}
+
+	// Object space bounds, for the AABB that goes into the acceleration structure
+	inline void GetPrimitiveBounds(Primitive primitive, OUT(float3) boundsMin, OUT(float3) boundsMax)
+	{
+		const float4 p = primitive.Parameters;
+		float3 extent = float3(p.x, p.x, p.x);
+
+		if (primitive.Type == PRIMITIVE_TORUS)
+		{
+			extent = float3(p.x + p.y, p.x + p.y, p.y);
+		}
+		else if (primitive.Type == PRIMITIVE_BOX)
+		{
+			extent = float3(p.x, p.y, p.z);
+		}
+		else if (primitive.Type == PRIMITIVE_CYLINDER)
+		{
+			extent = float3(p.x, p.x, p.y);
+		}
+		else if (primitive.Type == PRIMITIVE_CAPSULE)
+		{
+			extent = float3(p.x, p.x, p.y + p.x);
+		}
+
+		boundsMin = primitive.Position - extent;
+		boundsMax = primitive.Position + extent;
+	}
+}
+
+#undef OUT
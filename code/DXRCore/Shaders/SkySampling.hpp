@@ -0,0 +1,156 @@
+#pragma once
+
+// Importance sampling of an equirectangular sky with alias tables. This file is compiled as HLSL by the samples and as
+// C++ by the CPU backend, like Primitives.hpp. The table is built on the CPU by cpu::SkyDistribution.
+//
+// The table holds height + width * height entries: first a marginal table that picks the row, then one conditional
+// table per row that picks the texel in it. Both picks take O(1), whatever the size of the sky.
+
+#if __cplusplus
+#include "../CPU/Math.hpp"
+
+#define OUT(type) type&
+#define BUFFER(type) const type*
+#else
+#define OUT(type) out type
+#define BUFFER(type) StructuredBuffer<type>
+#endif
+
+#ifndef CONSTANT
+#if __cplusplus
+#define CONSTANT constexpr
+#else
+#define CONSTANT static const
+#endif
+#endif
+
+namespace sky
+{
+#if __cplusplus
+	// The HLSL intrinsics used below
+	using uint = uint32_t;
+	using float2 = cpu::Float2;
+	using float3 = cpu::Float3;
+
+	using std::acos;
+	using std::atan2;
+	using std::cos;
+	using std::log2;
+	using std::max;
+	using std::min;
+	using std::sin;
+	using std::sqrt;
+
+	inline float clamp(float x, float low, float high)
+	{
+		return std::min(std::max(x, low), high);
+	}
+#endif
+
+	CONSTANT float SKY_PI = 3.14159265f;
+
+	struct AliasEntry
+	{
+		// Chance to keep this entry, otherwise Alias is taken
+		float Probability;
+		uint Alias;
+
+		// Chance that this entry gets picked in its table
+		float Pdf;
+	};
+
+	// Inverse of the lookup in MissMain and cpu::Image::SampleEquirectangular
+	inline float3 GetSkyDirection(float u, float v)
+	{
+		const float phi = u * 2.0f * SKY_PI - SKY_PI;
+		const float theta = (1.0f - v) * SKY_PI;
+		const float sinTheta = sin(theta);
+
+		return float3(sinTheta * cos(phi), sinTheta * sin(phi), -cos(theta));
+	}
+
+	inline float2 GetSkyUV(float3 direction)
+	{
+		const float phi = atan2(direction.y, direction.x) + SKY_PI;
+		const float theta = acos(clamp(-direction.z, -1.0f, 1.0f));
+
+		float2 uv = { phi / (2.0f * SKY_PI), 1.0f - (theta / SKY_PI) };
+		return uv;
+	}
+
+	// Mip level for a lookup by a cone of rays with the given spread angle around the direction. A texel near the poles
+	// covers less of the sphere horizontally, so the level goes up there, which keeps lookups at grazing angles to the
+	// horizon of the map from striding through memory.
+	inline float GetSkyMipLevel(float3 direction, float spreadAngle, uint width, uint height)
+	{
+		const float sinTheta = sqrt(max(1.0f - direction.z * direction.z, 1.0e-8f));
+
+		const float texelsU = spreadAngle * width / (2.0f * SKY_PI * sinTheta);
+		const float texelsV = spreadAngle * height / SKY_PI;
+
+		return max(log2(max(texelsU, texelsV)), 0.0f);
+	}
+
+	// Picks an entry of the table at offset with one random number. What is left of the random number after the
+	// pick is uniform again, and is returned in remapped.
+	inline uint SampleAliasTable(BUFFER(AliasEntry) entries, uint offset, uint count, float random, OUT(float) remapped)
+	{
+		const float scaled = random * count;
+		const uint index = min(uint(scaled), count - 1);
+		const float fraction = min(scaled - index, 0.99999994f);
+
+		const AliasEntry entry = entries[offset + index];
+
+		if (fraction < entry.Probability)
+		{
+			remapped = fraction / entry.Probability;
+			return index;
+		}
+
+		remapped = (fraction - entry.Probability) / (1.0f - entry.Probability);
+		return entry.Alias;
+	}
+
+	// Converts the chance of picking a texel into a density over solid angle. Every texel covers the same area in uv,
+	// but the rows near the poles cover less of the sphere.
+	inline float GetSkySolidAnglePdf(float texelPdf, uint width, uint height, float v)
+	{
+		const float sinTheta = sin(v * SKY_PI);
+
+		if (sinTheta <= 0.0f)
+		{
+			return 0.0f;
+		}
+
+		return texelPdf * (width * height) / (2.0f * SKY_PI * SKY_PI * sinTheta);
+	}
+
+	// Returns a direction towards the sky, picked in proportion to the luminance that reaches the camera from it, and
+	// its density over solid angle
+	inline float3 SampleSky(BUFFER(AliasEntry) entries, uint width, uint height, float2 random, OUT(float) pdf)
+	{
+		float offsetX;
+		float offsetY;
+
+		const uint row = SampleAliasTable(entries, 0, height, random.y, offsetY);
+		const uint column = SampleAliasTable(entries, height + row * width, width, random.x, offsetX);
+
+		const float u = (column + offsetX) / width;
+		const float v = (row + offsetY) / height;
+
+		pdf = GetSkySolidAnglePdf(entries[row].Pdf * entries[height + row * width + column].Pdf, width, height, v);
+
+		return GetSkyDirection(u, v);
+	}
+
+	// Density over solid angle with which SampleSky returns the direction
+	inline float GetSkyPdf(BUFFER(AliasEntry) entries, uint width, uint height, float3 direction)
+	{
+		const float2 uv = GetSkyUV(direction);
+
+		const uint column = min(uint(uv.x * width), width - 1);
+		const uint row = min(uint(uv.y * height), height - 1);
+
+		return GetSkySolidAnglePdf(entries[row].Pdf * entries[height + row * width + column].Pdf, width, height, uv.y);
+	}
+}
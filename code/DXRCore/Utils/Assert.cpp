@@ -1,8 +1,19 @@
-#include <pch.hpp>
-
 #include "Assert.hpp"
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Built without the precompiled header, so headless builds can use it as well
+#if !defined(DXR_HEADLESS)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
 
 void _Assert(bool expression, const std::string_view fmt, const std::string_view file, int line, ...)
 {
@@ -15,9 +26,14 @@ void _Assert(bool expression, const std::string_view fmt, const std::string_view
 	va_list args;
 
 	va_start(args, line);
-	vsprintf_s(message, fmt.data(), args);
+	vsnprintf(message, sizeof(message), fmt.data(), args);
 	va_end(args);
 
+#if defined(DXR_HEADLESS)
+	// Headless builds have no message box to ask what to do, so they stop
+	fprintf(stderr, "Assert: %s\nFile: %s\nLine: %i\n", message, file.data(), line);
+	abort();
+#else
 	sprintf_s(message, "%s\nFile: %s\nLine: %i", message, file.data(), line);
 
 	int ret = MessageBoxA(nullptr, message, "Intro to DirectX Raytracing | Assert", MB_ABORTRETRYIGNORE | MB_ICONERROR);
@@ -38,4 +54,5 @@ void _Assert(bool expression, const std::string_view fmt, const std::string_view
 		return;
 	}
 	}
+#endif
 }
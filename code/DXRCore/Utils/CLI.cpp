@@ -1,6 +1,20 @@
-#include <pch.hpp>
 #include "CLI.hpp"
+
 #include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
 
 CLI g_CLI = {};
 
@@ -9,22 +23,152 @@ const CLI& GetCLI()
 	return g_CLI;
 }
 
-void ParseCLI()
+// Returns true when one of the arguments is the flag, as a whole
+static bool HasArgument(const std::vector<std::string>& arguments, const std::string_view name)
+{
+	return std::find(arguments.begin(), arguments.end(), name) != arguments.end();
+}
+
+// Returns the value of an argument in the form of '-name=value'. name includes the '='.
+static std::string GetArgumentValue(const std::vector<std::string>& arguments, const std::string_view name)
 {
-	std::string cli = GetCommandLineA();
-	
-	if (cli.find("-console") != cli.npos)
+	for (const std::string& argument : arguments)
+	{
+		if (argument.size() >= name.size() && std::string_view(argument).substr(0, name.size()) == name)
+		{
+			return argument.substr(name.size());
+		}
+	}
+
+	return {};
+}
+
+static void ParseArguments(const std::vector<std::string>& arguments)
+{
+	if (HasArgument(arguments, "-console"))
 	{
 		g_CLI.Console = 1;
 	}
 
-	if (cli.find("-validation") != cli.npos)
+	if (HasArgument(arguments, "-validation"))
 	{
 		g_CLI.Validation = 1;
 	}
 
-	if (cli.find("-warp") != cli.npos)
+	if (HasArgument(arguments, "-warp"))
 	{
 		g_CLI.Warp = 1;
 	}
+
+	if (GetArgumentValue(arguments, "-backend=") == "cpu")
+	{
+		g_CLI.Backend = RenderBackend::CPU;
+	}
+
+	if (HasArgument(arguments, "-wavefront"))
+	{
+		g_CLI.Wavefront = 1;
+	}
+
+	if (HasArgument(arguments, "-accumulate"))
+	{
+		g_CLI.Accumulate = 1;
+	}
+
+	if (HasArgument(arguments, "-sky-light"))
+	{
+		g_CLI.SkyLight = 1;
+	}
+
+	if (HasArgument(arguments, "-low-latency"))
+	{
+		g_CLI.LowLatency = 1;
+	}
+
+	auto variance = GetArgumentValue(arguments, "-accumulate-variance=");
+
+	if (!variance.empty())
+	{
+		g_CLI.AccumulationVarianceTarget = std::strtof(variance.c_str(), nullptr);
+	}
+
+	auto budget = GetArgumentValue(arguments, "-accumulate-time=");
+
+	if (!budget.empty())
+	{
+		g_CLI.AccumulationTimeBudget = std::strtof(budget.c_str(), nullptr);
+	}
+
+	auto frames = GetArgumentValue(arguments, "-frames=");
+
+	if (!frames.empty())
+	{
+		g_CLI.FrameCount = static_cast<uint32_t>(std::strtoul(frames.c_str(), nullptr, 10));
+	}
+
+	auto framesInFlight = GetArgumentValue(arguments, "-frames-in-flight=");
+
+	if (!framesInFlight.empty())
+	{
+		g_CLI.FramesInFlight = static_cast<uint32_t>(std::strtoul(framesInFlight.c_str(), nullptr, 10));
+	}
+
+	auto recursionDepth = GetArgumentValue(arguments, "-recursion-depth=");
+
+	if (!recursionDepth.empty())
+	{
+		g_CLI.RecursionDepth = static_cast<uint32_t>(std::strtoul(recursionDepth.c_str(), nullptr, 10));
+	}
+
+	g_CLI.OutputPath = GetArgumentValue(arguments, "-output=");
+	g_CLI.ShaderDirectory = GetArgumentValue(arguments, "-shader-directory=");
+	g_CLI.PipelineCachePath = GetArgumentValue(arguments, "-pipeline-cache=");
+
+	if (HasArgument(arguments, "-benchmark"))
+	{
+		g_CLI.Benchmark = 1;
+		g_CLI.Console = 1;
+	}
+
+	if (HasArgument(arguments, "-wait"))
+	{
+		g_CLI.Wait = 1;
+	}
+
+	auto triangles = GetArgumentValue(arguments, "-benchmark-triangles=");
+
+	if (!triangles.empty())
+	{
+		g_CLI.BenchmarkTriangleCount = static_cast<uint32_t>(std::strtoul(triangles.c_str(), nullptr, 10));
+	}
+
+	auto primitives = GetArgumentValue(arguments, "-benchmark-primitives=");
+
+	if (!primitives.empty())
+	{
+		g_CLI.BenchmarkPrimitiveCount = static_cast<uint32_t>(std::strtoul(primitives.c_str(), nullptr, 10));
+	}
+}
+
+#if defined(_WIN32)
+void ParseCLI()
+{
+	std::vector<std::string> arguments;
+
+	// Split at the spaces, like the arguments of main. Quotes are not supported, so paths cannot have spaces.
+	std::istringstream stream(GetCommandLineA());
+	std::string argument;
+
+	while (stream >> argument)
+	{
+		arguments.push_back(std::move(argument));
+	}
+
+	ParseArguments(arguments);
+}
+#endif
+
+void ParseCLI(int argc, const char* const* argv)
+{
+	ParseArguments(std::vector<std::string>(argv, argv + argc));
 }
@@ -1,13 +1,76 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+
+enum class RenderBackend : uint8_t
+{
+	D3D12,
+	CPU
+};
 
 struct CLI
 {
 	uint8_t Validation : 1;
 	uint8_t Warp : 1;
 	uint8_t Console : 1;
+	uint8_t Benchmark : 1;
+
+	// The CPU backend renders in bounce-synchronous stages over ray queues instead of one path at a time
+	uint8_t Wavefront : 1;
+
+	// The CPU backend averages frames while the scene is static, and the application exits once the image converged
+	uint8_t Accumulate : 1;
+
+	// The samples with a sky dome light the scene with it on the CPU backend, instead of with a constant ambient term
+	uint8_t SkyLight : 1;
+
+	// The D3D12 backend waits for the swap chain before a frame is started, and lets at most one frame queue up for
+	// presentation, so the frame is built from the newest input
+	uint8_t LowLatency : 1;
+
+	// '-benchmark' waits for enter before it closes the console
+	uint8_t Wait : 1;
+
+	RenderBackend Backend;
+
+	// Number of frames to render before exiting. 0 means that it runs until the window is closed.
+	uint32_t FrameCount;
+
+	// Frames the CPU may record ahead of the GPU with the D3D12 backend. 0 means the default of the renderer.
+	uint32_t FramesInFlight;
+
+	// When set, the CPU backend writes every frame to '<OutputPath>_<frame>.ppm'
+	std::string OutputPath;
+
+	// When set, the D3D12 backend compiles the shaders of the sample from this directory at runtime, and compiles them
+	// again whenever they are written
+	std::string ShaderDirectory;
+
+	// Recursion depth of the shaders compiled at runtime. 0 keeps the depth of the sample.
+	uint32_t RecursionDepth;
+
+	// File of the serialized root signatures of the D3D12 backend. Empty means 'PipelineCache.bin' in the working
+	// directory.
+	std::string PipelineCachePath;
+
+	// Convergence criteria of '-accumulate'. 0 keeps the defaults of cpu::AccumulationDesc.
+	float AccumulationVarianceTarget;
+	float AccumulationTimeBudget;
+
+	// Triangle count of the generated mesh used by '-benchmark'
+	uint32_t BenchmarkTriangleCount;
+
+	// Procedural sphere count of the BLAS used by '-benchmark'
+	uint32_t BenchmarkPrimitiveCount;
 };
 
 const CLI& GetCLI();
-void ParseCLI();
\ No newline at end of file
+
+#if defined(_WIN32)
+// Parses the command line of the process
+void ParseCLI();
+#endif
+
+// Parses the arguments of main, for the builds without Win32
+void ParseCLI(int argc, const char* const* argv);
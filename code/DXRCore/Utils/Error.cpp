@@ -1,8 +1,19 @@
-#include <pch.hpp>
-
 #include "Error.hpp"
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Built without the precompiled header, so headless builds can use it as well
+#if !defined(DXR_HEADLESS)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#endif
 
 void FatalError(const std::string_view fmt, ...)
 {
@@ -10,9 +21,13 @@ void FatalError(const std::string_view fmt, ...)
 	va_list args;
 
 	va_start(args, fmt);
-	vsprintf_s(message, fmt.data(), args);
+	vsnprintf(message, sizeof(message), fmt.data(), args);
 	va_end(args);
 
+#if defined(DXR_HEADLESS)
+	fprintf(stderr, "%s\n", message);
+	exit(1);
+#else
 	MessageBoxA(nullptr, message, "Intro to DirectX Raytracing", MB_OK | MB_ICONERROR);
 
 	if (IsDebuggerPresent())
@@ -21,4 +36,5 @@ void FatalError(const std::string_view fmt, ...)
 	}
 
 	TerminateProcess(GetCurrentProcess(), 1);
+#endif
 }
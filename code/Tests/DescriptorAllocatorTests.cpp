@@ -0,0 +1,228 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/DescriptorAllocator.hpp>
+#include <DXRCore/CPU/Random.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	void TestFreedRangesWaitForTheirFrame()
+	{
+		DescriptorAllocator allocator(16);
+
+		CHECK(allocator.Allocate(4) == 0);
+		CHECK(allocator.Allocate(4) == 4);
+		CHECK(allocator.GetAllocatedCount() == 8);
+		CHECK(allocator.GetUsedEnd() == 8);
+
+		allocator.Free(0, 4);
+
+		// The frames in flight can still read the descriptors, so the range stays allocated
+		CHECK(allocator.GetAllocatedCount() == 8);
+		CHECK(allocator.Allocate(8) == 8);
+		CHECK(allocator.Allocate(4) == DescriptorAllocator::InvalidIndex);
+
+		allocator.EndFrame(1);
+		allocator.Reclaim(0);
+		CHECK(allocator.Allocate(4) == DescriptorAllocator::InvalidIndex);
+
+		allocator.Reclaim(1);
+		CHECK(allocator.GetAllocatedCount() == 12);
+		CHECK(allocator.Allocate(4) == 0);
+	}
+
+	void TestNeighboursMergeAndGrow()
+	{
+		DescriptorAllocator allocator(12);
+
+		for (uint32_t i = 0; i < 12; i += 3)
+		{
+			CHECK(allocator.Allocate(3) == i);
+		}
+
+		allocator.Free(3, 3);
+		allocator.Free(9, 3);
+		allocator.Free(6, 3);
+		allocator.EndFrame(1);
+		allocator.Reclaim(1);
+
+		// The three frees merged into one range, which also ends the part of the heap in use
+		CHECK(allocator.GetUsedEnd() == 3);
+		CHECK(allocator.Allocate(9) == 3);
+
+		CHECK(allocator.Allocate(1) == DescriptorAllocator::InvalidIndex);
+		allocator.Grow(20);
+		CHECK(allocator.GetCapacity() == 20);
+		CHECK(allocator.Allocate(8) == 12);
+		CHECK(allocator.Allocate(0) == DescriptorAllocator::InvalidIndex);
+	}
+
+	// Allocates, frees and grows at random against a state per index. An allocation has to take the start of the
+	// smallest free run it fits in, the lowest of equal ones, which only holds when freed neighbours are merged.
+	void TestRandomOperations()
+	{
+		enum class State : uint8_t
+		{
+			Free,
+			Allocated,
+			Pending
+		};
+
+		struct Range
+		{
+			uint32_t Index;
+			uint32_t Count;
+		};
+
+		DescriptorAllocator allocator(256);
+		Random random(17);
+
+		std::vector<State> states(256, State::Free);
+		std::vector<Range> allocated;
+		std::vector<std::pair<Range, uint64_t>> pending;
+		std::vector<Range> frameFrees;
+
+		uint64_t fence = 0;
+		uint32_t allocationCount = 0;
+
+		for (uint32_t step = 0; step < 100000; step++)
+		{
+			const uint32_t action = random.Next() % 32;
+
+			if (action < 14)
+			{
+				const uint32_t count = 1 + random.Next() % (random.Next() % 4 == 0 ? 64 : 8);
+
+				// The best fit in the states
+				uint32_t bestIndex = DescriptorAllocator::InvalidIndex;
+				uint32_t bestCount = ~0u;
+
+				for (uint32_t i = 0; i < states.size();)
+				{
+					uint32_t end = i;
+
+					while (end < states.size() && states[end] == State::Free)
+					{
+						end++;
+					}
+
+					if (end - i >= count && end - i < bestCount)
+					{
+						bestIndex = i;
+						bestCount = end - i;
+					}
+
+					i = end == i ? i + 1 : end;
+				}
+
+				const uint32_t index = allocator.Allocate(count);
+				CHECK(index == bestIndex);
+
+				if (index == DescriptorAllocator::InvalidIndex || index != bestIndex)
+				{
+					continue;
+				}
+
+				for (uint32_t i = index; i < index + count; i++)
+				{
+					states[i] = State::Allocated;
+				}
+
+				allocated.push_back({ index, count });
+				allocationCount++;
+			}
+			else if (action < 26)
+			{
+				if (allocated.empty())
+				{
+					continue;
+				}
+
+				const uint32_t pick = random.Next() % allocated.size();
+				const Range range = allocated[pick];
+
+				allocated[pick] = allocated.back();
+				allocated.pop_back();
+
+				allocator.Free(range.Index, range.Count);
+				frameFrees.push_back(range);
+
+				for (uint32_t i = range.Index; i < range.Index + range.Count; i++)
+				{
+					states[i] = State::Pending;
+				}
+			}
+			else if (action < 30)
+			{
+				fence++;
+				allocator.EndFrame(fence);
+
+				for (const Range& range : frameFrees)
+				{
+					pending.push_back({ range, fence });
+				}
+
+				frameFrees.clear();
+
+				// The GPU runs up to two frames behind
+				const uint64_t completedFence = fence - std::min<uint64_t>(fence, random.Next() % 3);
+				allocator.Reclaim(completedFence);
+
+				for (size_t i = 0; i < pending.size();)
+				{
+					if (pending[i].second <= completedFence)
+					{
+						for (uint32_t j = pending[i].first.Index; j < pending[i].first.Index + pending[i].first.Count; j++)
+						{
+							states[j] = State::Free;
+						}
+
+						pending[i] = pending.back();
+						pending.pop_back();
+					}
+					else
+					{
+						i++;
+					}
+				}
+			}
+			else if (states.size() < 4096)
+			{
+				const uint32_t capacity = static_cast<uint32_t>(states.size()) + 1 + random.Next() % 64;
+				allocator.Grow(capacity);
+				states.resize(capacity, State::Free);
+			}
+
+			uint32_t allocatedCount = 0;
+			uint32_t usedEnd = 0;
+
+			for (uint32_t i = 0; i < states.size(); i++)
+			{
+				if (states[i] != State::Free)
+				{
+					allocatedCount++;
+					usedEnd = i + 1;
+				}
+			}
+
+			CHECK(allocator.GetCapacity() == states.size());
+			CHECK(allocator.GetAllocatedCount() == allocatedCount);
+			CHECK(allocator.GetUsedEnd() == usedEnd);
+		}
+
+		CHECK(allocationCount > 10000);
+	}
+}
+
+int main()
+{
+	TestFreedRangesWaitForTheirFrame();
+	TestNeighboursMergeAndGrow();
+	TestRandomOperations();
+
+	return GetTestResult();
+}
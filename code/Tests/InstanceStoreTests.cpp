@@ -0,0 +1,117 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/InstanceStore.hpp>
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/SIMD.hpp>
+
+#include <cmath>
+
+using namespace cpu;
+
+namespace
+{
+	bool IsNear(const Transform3x4& a, const Transform3x4& b)
+	{
+		for (uint32_t row = 0; row < 3; row++)
+		{
+			for (uint32_t column = 0; column < 4; column++)
+			{
+				if (std::abs(a.m[row][column] - b.m[row][column]) > 1e-4f)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Enough instances for a few chunks of the thread pool, and a remainder that is not a multiple of the SIMD width.
+	// Every level this machine supports, the scalar one included.
+	void TestPack()
+	{
+		constexpr uint32_t InstanceCount = InstanceStore::PackGrainSize * 3 + 5;
+
+		Random random(25);
+		InstanceStore store;
+		store.Reserve(InstanceCount);
+
+		for (uint32_t i = 0; i < InstanceCount; i++)
+		{
+			const uint32_t index = store.Add(0x10000ull * (i + 1), i % 100, i % 7);
+			CHECK(index == i);
+
+			Float4 rotation = { random.NextFloat() - 0.5f, random.NextFloat() - 0.5f, random.NextFloat() - 0.5f, random.NextFloat() + 0.1f };
+			const float length = std::sqrt(rotation.x * rotation.x + rotation.y * rotation.y + rotation.z * rotation.z + rotation.w * rotation.w);
+
+			store.SetTranslation(i, { random.NextFloat() * 100.0f, random.NextFloat() * 100.0f, random.NextFloat() * 100.0f });
+			store.SetRotation(i, { rotation.x / length, rotation.y / length, rotation.z / length, rotation.w / length });
+			store.SetScale(i, { random.NextFloat() + 0.5f, random.NextFloat() + 0.5f, random.NextFloat() + 0.5f });
+			store.SetMask(i, static_cast<uint8_t>(1 + i % 255));
+		}
+
+		const SIMDLevel previousLevel = GetSIMDLevel();
+
+		for (SIMDLevel level : { SIMDLevel::Scalar, SIMDLevel::SSE4, SIMDLevel::AVX2 })
+		{
+			if (level > GetSupportedSIMDLevel())
+			{
+				continue;
+			}
+
+			SetSIMDLevel(level);
+
+			std::vector<PackedInstanceDesc> descs(InstanceCount);
+			store.Pack(descs.data());
+
+			uint32_t wrongCount = 0;
+
+			for (uint32_t i = 0; i < InstanceCount; i++)
+			{
+				const PackedInstanceDesc& desc = descs[i];
+
+				wrongCount += !IsNear(desc.Transform, store.GetTransform(i));
+				wrongCount += desc.AccelerationStructure != 0x10000ull * (i + 1) || desc.InstanceID != i % 100;
+				wrongCount += desc.InstanceContributionToHitGroupIndex != i % 7 || desc.InstanceMask != 1 + i % 255;
+			}
+
+			CHECK(wrongCount == 0);
+		}
+
+		SetSIMDLevel(previousLevel);
+	}
+
+	// The TLAS points instances to a BLAS that was built anew, and to its new entries, between full builds
+	void TestReferences()
+	{
+		InstanceStore store;
+
+		for (uint32_t i = 0; i < 9; i++)
+		{
+			store.Add(0x1000, 3);
+		}
+
+		store.SetAccelerationStructure(4, 0x2000);
+		store.SetInstanceID(4, 0xABCDEF);
+
+		CHECK(store.GetAccelerationStructure(4) == 0x2000 && store.GetInstanceID(4) == 0xABCDEF);
+		CHECK(store.GetAccelerationStructure(3) == 0x1000 && store.GetInstanceID(3) == 3);
+
+		std::vector<PackedInstanceDesc> descs(store.GetCount());
+		store.Pack(descs.data(), 0, store.GetCount());
+
+		for (uint32_t i = 0; i < store.GetCount(); i++)
+		{
+			CHECK(descs[i].AccelerationStructure == store.GetAccelerationStructure(i));
+			CHECK(descs[i].InstanceID == store.GetInstanceID(i));
+		}
+	}
+}
+
+int main()
+{
+	TestPack();
+	TestReferences();
+
+	return GetTestResult();
+}
@@ -0,0 +1,150 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/JobRecorder.hpp>
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/ThreadPool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	// Random costs, a few of them much larger than the others, split into any number of chunks
+	void TestPartitionCoversJobsInOrder()
+	{
+		Random random(20);
+		std::vector<RecordingChunk> chunks;
+
+		for (uint32_t test = 0; test < 2000; test++)
+		{
+			const uint32_t jobCount = random.Next() % 200;
+			const uint32_t maxChunkCount = random.Next() % 40;
+
+			std::vector<float> costs(jobCount);
+			double totalCost = 0.0;
+			float maxCost = 0.0f;
+
+			for (float& cost : costs)
+			{
+				cost = random.NextFloat() < 0.05f ? 100.0f * random.NextFloat() : random.NextFloat();
+				totalCost += cost;
+				maxCost = std::max(maxCost, cost);
+			}
+
+			PartitionJobs(costs, maxChunkCount, chunks);
+
+			CHECK(chunks.size() == std::min(std::max(maxChunkCount, 1u), jobCount));
+
+			uint32_t nextJob = 0;
+
+			for (const RecordingChunk& chunk : chunks)
+			{
+				CHECK(chunk.FirstJob == nextJob);
+				CHECK(chunk.JobCount > 0);
+
+				double cost = 0.0;
+
+				for (uint32_t job = chunk.FirstJob; job < chunk.FirstJob + chunk.JobCount && job < jobCount; job++)
+				{
+					cost += costs[job];
+				}
+
+				// A chunk goes over its share of the cost by at most the job that ends it
+				CHECK(cost <= totalCost / chunks.size() + maxCost + 1.0e-3);
+
+				nextJob = chunk.FirstJob + chunk.JobCount;
+			}
+
+			CHECK(nextJob == jobCount);
+		}
+	}
+
+	// Jobs write their index into the list of their chunk. Submitting the lists in chunk order has to give the jobs in
+	// the order they were added, and all jobs of a chunk are recorded by one thread after beginChunk.
+	void TestRecordKeepsOrder()
+	{
+		ThreadPool pool(4);
+		JobRecorder recorder(pool);
+		Random random(2020);
+
+		for (uint32_t test = 0; test < 200; test++)
+		{
+			const uint32_t jobCount = 1 + random.Next() % 500;
+			const uint32_t maxChunkCount = 1 + random.Next() % 16;
+
+			std::vector<std::vector<uint32_t>> lists(maxChunkCount);
+			std::vector<uint32_t> chunkThreads(maxChunkCount, ~0u);
+			std::atomic<uint32_t> wrongThreadCount{ 0 };
+
+			for (uint32_t job = 0; job < jobCount; job++)
+			{
+				recorder.Add([&, job](uint32_t chunk, uint32_t threadIndex)
+				{
+					wrongThreadCount += chunkThreads[chunk] != threadIndex;
+					lists[chunk].push_back(job);
+				}, random.NextFloat() < 0.1f ? 50.0f : 1.0f);
+			}
+
+			CHECK(recorder.GetJobCount() == jobCount);
+
+			const uint32_t chunkCount = recorder.Record(maxChunkCount, [&](uint32_t chunk, uint32_t threadIndex)
+			{
+				wrongThreadCount += threadIndex >= pool.GetThreadCount() || !lists[chunk].empty();
+				chunkThreads[chunk] = threadIndex;
+			});
+
+			CHECK(chunkCount == std::min(maxChunkCount, jobCount));
+			CHECK(recorder.GetChunks().size() == chunkCount);
+			CHECK(recorder.GetJobCount() == 0);
+			CHECK(wrongThreadCount == 0);
+
+			std::vector<uint32_t> submitted;
+
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				submitted.insert(submitted.end(), lists[chunk].begin(), lists[chunk].end());
+			}
+
+			bool inOrder = submitted.size() == jobCount;
+
+			for (uint32_t i = 0; i < submitted.size() && inOrder; i++)
+			{
+				inOrder = submitted[i] == i;
+			}
+
+			CHECK(inOrder);
+		}
+	}
+
+	// A job that uses the pool itself, like a pass that packs the instances of a TLAS
+	void TestJobsUseThePool()
+	{
+		ThreadPool pool(4);
+		JobRecorder recorder(pool);
+
+		std::atomic<uint64_t> sum{ 0 };
+
+		for (uint32_t job = 0; job < 32; job++)
+		{
+			recorder.Add([&](uint32_t, uint32_t)
+			{
+				pool.ParallelFor(10000, 100, [&](uint64_t begin, uint64_t end, uint32_t) { sum += end - begin; });
+			});
+		}
+
+		CHECK(recorder.Record(8, [](uint32_t, uint32_t) {}) == 8);
+		CHECK(sum == 32 * 10000);
+	}
+}
+
+int main()
+{
+	TestPartitionCoversJobsInOrder();
+	TestRecordKeepsOrder();
+	TestJobsUseThePool();
+
+	return GetTestResult();
+}
@@ -0,0 +1,224 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/PipelineCache.hpp>
+#include <DXRCore/CPU/Random.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace cpu;
+
+namespace
+{
+	using Blobs = std::unordered_map<uint64_t, std::vector<uint8_t>>;
+
+	std::string GetCachePath()
+	{
+		return (std::filesystem::temp_directory_path() / "DXRPipelineCacheTests.bin").string();
+	}
+
+	Blobs CreateBlobs(uint32_t count, Random& random)
+	{
+		Blobs blobs;
+
+		while (blobs.size() < count)
+		{
+			// Sizes of root signatures up to those of shaders, and an empty one
+			std::vector<uint8_t> data(blobs.empty() ? 0 : random.Next() % (random.Next() % 8 == 0 ? 65536 : 512));
+
+			for (uint8_t& byte : data)
+			{
+				byte = static_cast<uint8_t>(random.Next());
+			}
+
+			blobs[(static_cast<uint64_t>(random.Next()) << 32) | random.Next()] = std::move(data);
+		}
+
+		return blobs;
+	}
+
+	// Entries of the cache that are not in blobs or differ from them
+	uint32_t CountWrongEntries(const PipelineCache& cache, const Blobs& blobs)
+	{
+		uint32_t wrongCount = 0;
+
+		for (const auto& [key, data] : blobs)
+		{
+			const std::vector<uint8_t>* entry = cache.Find(key);
+			wrongCount += entry != nullptr && *entry != data;
+		}
+
+		uint32_t foundCount = 0;
+
+		for (const auto& [key, data] : blobs)
+		{
+			foundCount += cache.Find(key) != nullptr;
+		}
+
+		return wrongCount + (cache.GetEntryCount() - foundCount);
+	}
+
+	void TestKeys()
+	{
+		auto Key = [](std::wstring_view first, std::wstring_view second)
+		{
+			PipelineKey key;
+			key.Add(first);
+			key.Add(second);
+			return key.Get();
+		};
+
+		CHECK(Key(L"Lighting", L"ClosestHit") == Key(L"Lighting", L"ClosestHit"));
+		CHECK(Key(L"Lighting", L"ClosestHit") != Key(L"ClosestHit", L"Lighting"));
+
+		// Bytes moved from one value to the next give another key
+		CHECK(Key(L"ab", L"c") != Key(L"a", L"bc"));
+		CHECK(Key(L"abc", L"") != Key(L"", L"abc"));
+
+		// Many similar pipelines, which differ in a single small value
+		std::unordered_set<uint64_t> keys;
+
+		for (uint32_t depth = 0; depth < 64; depth++)
+		{
+			for (uint32_t flags = 0; flags < 256; flags++)
+			{
+				PipelineKey key;
+				key.Add(L"Reflections");
+				key.AddValue(depth);
+				key.AddValue(flags);
+				keys.insert(key.Get());
+			}
+		}
+
+		CHECK(keys.size() == 64 * 256);
+	}
+
+	void TestRoundTrip()
+	{
+		const std::string path = GetCachePath();
+		std::error_code error;
+		std::filesystem::remove(path, error);
+
+		Random random(21);
+		const Blobs blobs = CreateBlobs(500, random);
+
+		{
+			PipelineCache cache(path);
+			CHECK(!cache.Load());
+
+			for (const auto& [key, data] : blobs)
+			{
+				cache.Store(key, data.data(), data.size());
+			}
+
+			CHECK(cache.IsDirty());
+			CHECK(cache.Save());
+			CHECK(!cache.IsDirty());
+		}
+
+		PipelineCache loaded(path);
+		CHECK(loaded.Load());
+		CHECK(loaded.GetEntryCount() == blobs.size());
+		CHECK(CountWrongEntries(loaded, blobs) == 0);
+		CHECK(!loaded.IsDirty());
+
+		// Storing over a key replaces its blob, removing it drops it from the next file
+		const uint64_t replaced = blobs.begin()->first;
+		const uint64_t removed = std::next(blobs.begin())->first;
+		const uint8_t value = 42;
+
+		loaded.Store(replaced, &value, 1);
+		loaded.Remove(removed);
+		CHECK(loaded.Save());
+
+		PipelineCache reloaded(path);
+		CHECK(reloaded.Load());
+		CHECK(reloaded.GetEntryCount() == blobs.size() - 1);
+		CHECK(reloaded.Find(removed) == nullptr);
+		CHECK(reloaded.Find(replaced) != nullptr && *reloaded.Find(replaced) == std::vector<uint8_t>{ value });
+
+		std::filesystem::remove(path, error);
+	}
+
+	// A file cut off anywhere, or with a byte flipped anywhere, loads the entries in front of the damage and none that
+	// differ from what was stored
+	void TestDamagedFiles()
+	{
+		const std::string path = GetCachePath();
+		std::error_code error;
+
+		Random random(2121);
+		const Blobs blobs = CreateBlobs(100, random);
+
+		{
+			PipelineCache cache(path);
+
+			for (const auto& [key, data] : blobs)
+			{
+				cache.Store(key, data.data(), data.size());
+			}
+
+			CHECK(cache.Save());
+		}
+
+		std::vector<char> file;
+		{
+			std::ifstream stream(path, std::ios::binary);
+			file.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+		}
+
+		CHECK(file.size() > 1000);
+
+		auto Write = [&path](const std::vector<char>& bytes)
+		{
+			std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+			stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		};
+
+		for (uint32_t test = 0; test < 200; test++)
+		{
+			const size_t position = random.Next() % file.size();
+			std::vector<char> damaged = file;
+
+			if (test % 2 == 0)
+			{
+				damaged.resize(position);
+			}
+			else
+			{
+				damaged[position] = static_cast<char>(damaged[position] ^ (1 + random.Next() % 255));
+			}
+
+			Write(damaged);
+
+			PipelineCache cache(path);
+			cache.Load();
+
+			CHECK(cache.GetEntryCount() < blobs.size());
+			CHECK(CountWrongEntries(cache, blobs) == 0);
+		}
+
+		// A file of another version is not read at all
+		std::vector<char> otherVersion = file;
+		otherVersion[4] = static_cast<char>(PipelineCache::Version + 1);
+		Write(otherVersion);
+
+		PipelineCache cache(path);
+		CHECK(!cache.Load());
+		CHECK(cache.GetEntryCount() == 0);
+
+		std::filesystem::remove(path, error);
+	}
+}
+
+int main()
+{
+	TestKeys();
+	TestRoundTrip();
+	TestDamagedFiles();
+
+	return GetTestResult();
+}
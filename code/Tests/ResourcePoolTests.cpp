@@ -0,0 +1,223 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/ResourcePool.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	void TestSizeClasses()
+	{
+		CHECK(ResourcePool::GetSizeClass(1) == ResourcePool::MinSize);
+		CHECK(ResourcePool::GetSizeClass(ResourcePool::MinSize) == ResourcePool::MinSize);
+		CHECK(ResourcePool::GetSizeClass(1 << 20) == 1 << 20);
+		CHECK(ResourcePool::GetSizeClass((1 << 20) + 1) == (1 << 20) + (1 << 18));
+
+		Random random(16);
+
+		for (uint32_t i = 0; i < 100000; i++)
+		{
+			const uint64_t size = ResourcePool::MinSize + (static_cast<uint64_t>(random.Next()) << (random.Next() % 8));
+			const uint64_t sizeClass = ResourcePool::GetSizeClass(size);
+
+			// At most a fifth of the resource goes unused, and every size of a class gets the same class
+			CHECK(sizeClass >= size);
+			CHECK((sizeClass - size) * 5 < sizeClass);
+			CHECK(ResourcePool::GetSizeClass(sizeClass) == sizeClass);
+		}
+	}
+
+	void TestAcquireWaitsForFence()
+	{
+		ResourcePool pool;
+
+		const uint32_t first = pool.Release(0, 100000, 3);
+		const uint32_t second = pool.Release(0, 100000, 5);
+
+		CHECK(first != second);
+		CHECK(pool.GetFreeCount() == 2);
+		CHECK(pool.GetFreeSize() == 2 * ResourcePool::GetSizeClass(100000));
+
+		// Another kind or size class, or a fence that has not completed, finds nothing
+		CHECK(pool.Acquire(1, 100000, 10) == ResourcePool::InvalidSlot);
+		CHECK(pool.Acquire(0, 1000000, 10) == ResourcePool::InvalidSlot);
+		CHECK(pool.Acquire(0, 100000, 2) == ResourcePool::InvalidSlot);
+
+		// Any size of the class is served, oldest first
+		CHECK(pool.Acquire(0, 99000, 4) == first);
+		CHECK(pool.Acquire(0, 100000, 4) == ResourcePool::InvalidSlot);
+		CHECK(pool.Acquire(0, 100000, 5) == second);
+
+		CHECK(pool.GetFreeCount() == 0);
+		CHECK(pool.GetFreeSize() == 0);
+	}
+
+	void TestReleaseAfterSubmit()
+	{
+		ResourcePool pool;
+
+		const uint32_t slot = pool.ReleaseAfterSubmit(2, 300000, 7);
+		pool.ReleaseAfterSubmit(2, 300000, 8);
+
+		CHECK(pool.GetFreeCount() == 2);
+
+		// Not handed out before the work that uses it is submitted, however far the fences are
+		CHECK(pool.Acquire(2, 300000, ~0ull) == ResourcePool::InvalidSlot);
+
+		pool.Submit(7, 20);
+
+		CHECK(pool.Acquire(2, 300000, 19) == ResourcePool::InvalidSlot);
+		CHECK(pool.Acquire(2, 300000, 20) == slot);
+		CHECK(pool.Acquire(2, 300000, ~0ull) == ResourcePool::InvalidSlot);
+	}
+
+	void TestTrimEvictsOldestCompleted()
+	{
+		ResourcePool pool;
+
+		const uint32_t a = pool.Release(0, 1 << 20, 1);
+		const uint32_t b = pool.Release(1, 1 << 22, 2);
+		const uint32_t c = pool.Release(0, 1 << 20, 3);
+
+		std::vector<uint32_t> evicted;
+
+		// Only a and b have completed, c stays however much is asked for
+		pool.Trim(2, 0, evicted);
+
+		CHECK(evicted.size() == 2);
+		CHECK(evicted.size() == 2 && evicted[0] == a && evicted[1] == b);
+		CHECK(pool.GetFreeSize() == 1 << 20);
+
+		evicted.clear();
+		pool.Trim(3, 1 << 20, evicted);
+		CHECK(evicted.empty());
+
+		pool.Trim(3, 0, evicted);
+		CHECK(evicted.size() == 1 && evicted[0] == c);
+		CHECK(pool.GetFreeCount() == 0);
+	}
+
+	// Releases, acquires and trims at random against a list of the released resources, and checks that a slot is
+	// never in the pool twice and only comes out once its fence has completed
+	void TestRandomOperations()
+	{
+		struct Released
+		{
+			uint32_t Slot;
+			uint32_t Kind;
+			uint64_t SizeClass;
+			uint64_t Fence;
+		};
+
+		ResourcePool pool;
+		Random random(1016);
+
+		std::vector<Released> released;
+		uint64_t fence = 1;
+		uint64_t completedFence = 0;
+		uint32_t acquireCount = 0;
+
+		for (uint32_t step = 0; step < 50000; step++)
+		{
+			const uint32_t kind = random.Next() % 3;
+			const uint64_t size = ResourcePool::MinSize * (1 + random.Next() % 8);
+			const uint32_t action = random.Next() % 8;
+
+			if (action < 3)
+			{
+				const uint32_t slot = pool.Release(kind, size, fence);
+
+				for (const Released& entry : released)
+				{
+					CHECK(entry.Slot != slot);
+				}
+
+				released.push_back({ slot, kind, ResourcePool::GetSizeClass(size), fence });
+			}
+			else if (action < 6)
+			{
+				const uint32_t slot = pool.Acquire(kind, size, completedFence);
+
+				auto match = std::find_if(released.begin(), released.end(), [&](const Released& entry)
+				{
+					return entry.Kind == kind && entry.SizeClass == ResourcePool::GetSizeClass(size) && entry.Fence <= completedFence;
+				});
+
+				if (slot == ResourcePool::InvalidSlot)
+				{
+					CHECK(match == released.end());
+					continue;
+				}
+
+				auto entry = std::find_if(released.begin(), released.end(), [slot](const Released& entry) { return entry.Slot == slot; });
+
+				CHECK(entry != released.end());
+
+				if (entry != released.end())
+				{
+					CHECK(entry->Kind == kind);
+					CHECK(entry->SizeClass == ResourcePool::GetSizeClass(size));
+					CHECK(entry->Fence <= completedFence);
+					released.erase(entry);
+				}
+
+				acquireCount++;
+			}
+			else if (action < 7)
+			{
+				fence++;
+				completedFence = fence - 1 - random.Next() % 2;
+			}
+			else
+			{
+				std::vector<uint32_t> evicted;
+				const uint64_t maxFreeSize = static_cast<uint64_t>(random.Next() % 64) * ResourcePool::MinSize;
+
+				pool.Trim(completedFence, maxFreeSize, evicted);
+
+				for (uint32_t slot : evicted)
+				{
+					auto entry = std::find_if(released.begin(), released.end(), [slot](const Released& entry) { return entry.Slot == slot; });
+
+					CHECK(entry != released.end() && entry->Fence <= completedFence);
+
+					if (entry != released.end())
+					{
+						released.erase(entry);
+					}
+				}
+
+				// Stops at the size asked for, unless only resources that are still in use are left
+				const bool pendingLeft = std::any_of(released.begin(), released.end(), [&](const Released& entry) { return entry.Fence > completedFence; });
+				CHECK(pool.GetFreeSize() <= maxFreeSize || pendingLeft);
+			}
+
+			uint64_t freeSize = 0;
+
+			for (const Released& entry : released)
+			{
+				freeSize += entry.SizeClass;
+			}
+
+			CHECK(pool.GetFreeSize() == freeSize);
+			CHECK(pool.GetFreeCount() == released.size());
+		}
+
+		CHECK(acquireCount > 1000);
+	}
+}
+
+int main()
+{
+	TestSizeClasses();
+	TestAcquireWaitsForFence();
+	TestReleaseAfterSubmit();
+	TestTrimEvictsOldestCompleted();
+	TestRandomOperations();
+
+	return GetTestResult();
+}
@@ -0,0 +1,169 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/RingAllocator.hpp>
+
+#include <deque>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	struct Allocation
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t Fence;
+	};
+
+	bool Overlaps(const Allocation& a, const Allocation& b)
+	{
+		return a.Offset < b.Offset + b.Size && b.Offset < a.Offset + a.Size;
+	}
+
+	void TestAlignmentAndSkippedEnd()
+	{
+		RingAllocator ring(1024);
+
+		CHECK(ring.Allocate(600) == 0);
+		CHECK(ring.Allocate(16, 256) == 768);
+
+		// Does not fit before the end, so it starts at 0, which is still used by the first allocation
+		CHECK(ring.Allocate(300) == RingAllocator::InvalidOffset);
+
+		ring.CloseBatch(1);
+		ring.Release(1);
+
+		// The end of the ring is skipped and counts as used until the batch of the allocation is released
+		CHECK(ring.Allocate(300) == 0);
+		CHECK(ring.GetUsedSize() == 1024 - 784 + 300);
+
+		// The skipped end also counts against the room, so a size larger than the start of the head does not fit
+		CHECK(ring.Allocate(800) == RingAllocator::InvalidOffset);
+
+		CHECK(ring.Allocate(0) == RingAllocator::InvalidOffset);
+		CHECK(ring.Allocate(2048) == RingAllocator::InvalidOffset);
+	}
+
+	void TestBatchesReleaseInOrder()
+	{
+		RingAllocator ring(1000);
+
+		CHECK(ring.Allocate(400) == 0);
+		ring.CloseBatch(5);
+
+		CHECK(ring.Allocate(400) == 400);
+		ring.CloseBatch(7);
+
+		CHECK(!ring.HasOpenAllocations());
+		CHECK(ring.GetOldestFence() == 5);
+		CHECK(ring.Allocate(400) == RingAllocator::InvalidOffset);
+
+		// A fence between the two releases only the first batch
+		ring.Release(6);
+		CHECK(ring.GetOldestFence() == 7);
+		CHECK(ring.GetUsedSize() == 400);
+
+		// An empty batch is not tracked
+		ring.CloseBatch(8);
+		CHECK(ring.GetOldestFence() == 7);
+
+		ring.Release(7);
+		CHECK(ring.GetOldestFence() == 0);
+		CHECK(ring.GetUsedSize() == 0);
+	}
+
+	// Allocates random sizes and alignments while batches are closed and released out of step with them, and checks
+	// every allocation against the ones that are still in use
+	void TestRandomBatches()
+	{
+		constexpr uint64_t Capacity = 64 * 1024;
+
+		RingAllocator ring(Capacity);
+		Random random(15);
+
+		std::vector<Allocation> open;
+		std::deque<Allocation> closed;
+
+		uint64_t fence = 0;
+		uint64_t completedFence = 0;
+		uint32_t allocationCount = 0;
+
+		for (uint32_t step = 0; step < 200000; step++)
+		{
+			const uint32_t action = random.Next() % 16;
+
+			if (action < 12)
+			{
+				const uint64_t size = 1 + random.Next() % (random.Next() % 8 == 0 ? Capacity / 2 : 512);
+				const uint64_t alignment = 1ull << (random.Next() % 9);
+				const uint64_t offset = ring.Allocate(size, alignment);
+
+				if (offset == RingAllocator::InvalidOffset)
+				{
+					// With nothing in use, everything up to half the ring fits wherever the head is
+					CHECK(!(open.empty() && closed.empty() && size <= Capacity / 2));
+					continue;
+				}
+
+				const Allocation allocation = { offset, size, 0 };
+
+				CHECK(offset % alignment == 0);
+				CHECK(offset + size <= Capacity);
+
+				for (const Allocation& other : open)
+				{
+					CHECK(!Overlaps(allocation, other));
+				}
+
+				for (const Allocation& other : closed)
+				{
+					CHECK(!Overlaps(allocation, other));
+				}
+
+				open.push_back(allocation);
+				allocationCount++;
+			}
+			else if (action < 14)
+			{
+				fence++;
+				ring.CloseBatch(fence);
+
+				for (Allocation& allocation : open)
+				{
+					allocation.Fence = fence;
+					closed.push_back(allocation);
+				}
+
+				open.clear();
+				CHECK(!ring.HasOpenAllocations());
+			}
+			else
+			{
+				completedFence = std::min(fence, completedFence + 1 + random.Next() % 3);
+				ring.Release(completedFence);
+
+				while (!closed.empty() && closed.front().Fence <= completedFence)
+				{
+					closed.pop_front();
+				}
+
+				CHECK(ring.GetOldestFence() == (closed.empty() ? 0 : closed.front().Fence));
+			}
+
+			CHECK(ring.GetUsedSize() <= Capacity);
+		}
+
+		CHECK(allocationCount > 100000);
+	}
+}
+
+int main()
+{
+	TestAlignmentAndSkippedEnd();
+	TestBatchesReleaseInOrder();
+	TestRandomBatches();
+
+	return GetTestResult();
+}
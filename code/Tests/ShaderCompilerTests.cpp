@@ -0,0 +1,357 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/ShaderCompiler.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace cpu;
+
+namespace
+{
+	// Exit code that ctest counts as a skipped test, see SKIP_RETURN_CODE in CMakeLists.txt
+	constexpr int SkippedResult = 77;
+
+	std::filesystem::path GetDirectory()
+	{
+		return std::filesystem::temp_directory_path() / "DXRShaderCompilerTests";
+	}
+
+	void WriteFile(const std::filesystem::path& path, const std::string& text)
+	{
+		std::filesystem::create_directories(path.parent_path());
+
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file << text;
+		}
+
+		// File times can be as coarse as seconds, so every write moves the time on by one
+		static auto time = std::filesystem::file_time_type::clock::now();
+		time += std::chrono::seconds(1);
+
+		std::error_code error;
+		std::filesystem::last_write_time(path, time, error);
+	}
+
+	// A library that includes a file next to it, which includes one from the include directory
+	void WriteLibrary(const std::filesystem::path& directory)
+	{
+		WriteFile(directory / "Library.hlsl", "#include \"Shared.hpp\"\n[shader(\"raygeneration\")]\nvoid RayGenMain() {}\n");
+		WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#define COLOR float4(1, 0, 0, 1)\n");
+		WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 1.0f\n");
+	}
+
+	ShaderCompileDesc GetLibraryDesc(const std::filesystem::path& directory)
+	{
+		ShaderCompileDesc desc;
+		desc.SourcePath = (directory / "Library.hlsl").string();
+		desc.IncludeDirectories.push_back((directory / "Include").string());
+
+		return desc;
+	}
+
+	uint64_t HashSource(const ShaderCompileDesc& desc)
+	{
+		uint64_t hash = 0;
+		std::vector<std::string> files;
+
+		return HashShaderSource(desc.SourcePath, desc.IncludeDirectories, hash, files) ? hash : 0;
+	}
+
+	// Stands in for DXC: fails on '#error' in any of the files and else returns the text of the files and the defines,
+	// so an edit of any of them gives other code
+	bool CompileStandIn(const ShaderCompileDesc& desc, std::vector<uint8_t>& code, std::string& errors)
+	{
+		uint64_t hash = 0;
+		std::vector<std::string> files;
+
+		if (!HashShaderSource(desc.SourcePath, desc.IncludeDirectories, hash, files))
+		{
+			errors = "Failed to read " + desc.SourcePath;
+			return false;
+		}
+
+		std::string text;
+
+		for (const std::string& file : files)
+		{
+			std::ifstream stream(file, std::ios::binary);
+			text.append(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+		}
+
+		for (const ShaderDefine& define : desc.Defines)
+		{
+			text += define.Name + "=" + define.Value + "\n";
+		}
+
+		if (text.find("#error") != text.npos)
+		{
+			errors = desc.SourcePath + ": error: #error";
+			return false;
+		}
+
+		code.assign(text.begin(), text.end());
+		return true;
+	}
+
+	void TestSourceKeys()
+	{
+		const std::filesystem::path directory = GetDirectory();
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+
+		WriteLibrary(directory);
+		const ShaderCompileDesc desc = GetLibraryDesc(directory);
+
+		uint64_t hash = 0;
+		std::vector<std::string> files;
+		CHECK(HashShaderSource(desc.SourcePath, desc.IncludeDirectories, hash, files));
+		CHECK(files.size() == 3);
+		CHECK(hash != 0 && HashSource(desc) == hash);
+
+		const uint64_t key = GetShaderKey(desc, hash, 1);
+		CHECK(GetShaderKey(desc, hash, 1) == key);
+		CHECK(GetShaderKey(desc, hash, 2) != key);
+
+		// An edit of the include in the include directory changes the key, and undoing it gives the old key back
+		WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 2.0f\n");
+		CHECK(HashSource(desc) != hash);
+
+		WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 1.0f\n");
+		CHECK(HashSource(desc) == hash);
+
+		// Writing a file with the same text, or a file that is not included, keeps the key
+		WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#define COLOR float4(1, 0, 0, 1)\n");
+		WriteFile(directory / "Unused.hpp", "#error not included\n");
+		CHECK(HashSource(desc) == hash);
+
+		// An include next to the file comes before the one in the include directory
+		WriteFile(directory / "Common.hpp", "#define SCALE 1.0f\n");
+		CHECK(HashSource(desc) != hash);
+		std::filesystem::remove(directory / "Common.hpp", error);
+
+		// Another include directory with another file of the same name
+		ShaderCompileDesc other = desc;
+		other.IncludeDirectories = { (directory / "Other").string() };
+		WriteFile(directory / "Other" / "Common.hpp", "#define SCALE 3.0f\n");
+		CHECK(HashSource(other) != 0 && HashSource(other) != hash);
+
+		// A missing include fails
+		std::filesystem::remove(directory / "Include" / "Common.hpp", error);
+		CHECK(!HashShaderSource(desc.SourcePath, desc.IncludeDirectories, hash, files));
+
+		// Include cycles end
+		WriteFile(directory / "Include" / "Common.hpp", "#include \"../Shared.hpp\"\n");
+		CHECK(HashShaderSource(desc.SourcePath, desc.IncludeDirectories, hash, files));
+		CHECK(files.size() == 3);
+
+		std::filesystem::remove_all(directory, error);
+	}
+
+	void TestDefines()
+	{
+		ShaderCompileDesc desc;
+		desc.SourcePath = "Library.hlsl";
+		desc.Target = "lib_6_6";
+		desc.Defines = { { "REFLECTIONS", "1" }, { "USE_SKY", "" } };
+		desc.IncludeDirectories = { "Include" };
+
+		const std::vector<std::wstring> expected = { L"-T", L"lib_6_6", L"-D", L"REFLECTIONS=1", L"-D", L"USE_SKY", L"-I", L"Include", L"-O3", L"-Qstrip_debug", L"-Qstrip_reflect" };
+		CHECK(GetShaderArguments(desc) == expected);
+
+		// Shaders with an entry point, and debug builds
+		desc.Target = "cs_6_6";
+		desc.EntryPoint = "CSMain";
+		desc.Defines.clear();
+		desc.IncludeDirectories.clear();
+		desc.Debug = true;
+
+		const std::vector<std::wstring> expectedDebug = { L"-T", L"cs_6_6", L"-E", L"CSMain", L"-Od", L"-Zi", L"-Qembed_debug" };
+		CHECK(GetShaderArguments(desc) == expectedDebug);
+
+		// Every permutation has a key of its own, also those that only move a value from one define to another
+		auto Key = [](std::vector<ShaderDefine> defines)
+		{
+			ShaderCompileDesc permutation;
+			permutation.SourcePath = "Library.hlsl";
+			permutation.Defines = std::move(defines);
+
+			return GetShaderKey(permutation, 1, 1);
+		};
+
+		CHECK(Key({ { "RECURSION_DEPTH", "1" } }) == Key({ { "RECURSION_DEPTH", "1" } }));
+		CHECK(Key({ { "RECURSION_DEPTH", "1" } }) != Key({ { "RECURSION_DEPTH", "2" } }));
+		CHECK(Key({ { "RECURSION_DEPTH", "1" } }) != Key({}));
+		CHECK(Key({ { "A", "1" }, { "B", "" } }) != Key({ { "A", "" }, { "B", "1" } }));
+	}
+
+	void TestReload()
+	{
+		const std::filesystem::path directory = GetDirectory();
+		const std::string cachePath = (directory / "ShaderCache.bin").string();
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+
+		WriteLibrary(directory);
+
+		std::vector<uint8_t> code;
+		std::string errors;
+		{
+			ShaderCompileService service(CompileStandIn, 1, cachePath, 2);
+
+			ShaderCompileDesc desc = GetLibraryDesc(directory);
+			desc.Defines.push_back({ "RECURSION_DEPTH", "1" });
+
+			const ShaderCompileService::Handle handle = service.Add(desc);
+			service.Wait();
+
+			CHECK(service.TakeResult(handle, code, errors));
+			CHECK(!code.empty() && errors.empty());
+			CHECK(!service.TakeResult(handle, code, errors));
+			CHECK(service.GetCompileCount() == 1);
+
+			// Nothing changed
+			CHECK(service.Reload() == 0);
+
+			// An edit of the include in the include directory compiles it again, to other code
+			const std::vector<uint8_t> oldCode = code;
+			WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 2.0f\n");
+
+			CHECK(service.Reload() == 1);
+			service.Wait();
+
+			CHECK(service.TakeResult(handle, code, errors));
+			CHECK(!code.empty() && code != oldCode);
+			CHECK(service.Reload() == 0);
+
+			// A broken edit gives the errors without code
+			WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#error broken edit\n");
+
+			CHECK(service.Reload() == 1);
+			service.Wait();
+
+			CHECK(service.TakeResult(handle, code, errors));
+			CHECK(code.empty() && errors.find("#error") != errors.npos);
+			CHECK(service.GetCompileCount() == 3);
+
+			// Undoing both edits finds the first code in the cache
+			WriteFile(directory / "Shared.hpp", "#include \"Common.hpp\"\n#define COLOR float4(1, 0, 0, 1)\n");
+			WriteFile(directory / "Include" / "Common.hpp", "#define SCALE 1.0f\n");
+
+			CHECK(service.Reload() == 1);
+			service.Wait();
+
+			CHECK(service.TakeResult(handle, code, errors));
+			CHECK(code == oldCode);
+			CHECK(service.GetCompileCount() == 3);
+
+			// The cache is on disk once Wait returns, so the next start compiles nothing, while this one still runs
+			ShaderCompileService next(CompileStandIn, 1, cachePath, 1);
+			const ShaderCompileService::Handle nextHandle = next.Add(desc);
+			next.Wait();
+
+			std::vector<uint8_t> nextCode;
+			CHECK(next.TakeResult(nextHandle, nextCode, errors));
+			CHECK(nextCode == oldCode);
+			CHECK(next.GetCompileCount() == 0);
+
+			// Another compiler version does not use the code of this one
+			ShaderCompileService newer(CompileStandIn, 2, cachePath, 1);
+			newer.Add(desc);
+			newer.Wait();
+			CHECK(newer.GetCompileCount() == 1);
+		}
+
+		std::filesystem::remove_all(directory, error);
+	}
+
+	// Compiles the libraries of the samples in the code directory with DXC, or skips when it can not be loaded
+	int TestDXC(const std::filesystem::path& codeDirectory, const std::string& libraryPath)
+	{
+		ShaderCompiler compiler;
+
+		if (!compiler.Initialize(libraryPath))
+		{
+			printf("DXC not found, skipped\n");
+			return SkippedResult;
+		}
+
+		printf("DXC %llu.%llu\n", static_cast<unsigned long long>(compiler.GetVersion() >> 32), static_cast<unsigned long long>(compiler.GetVersion() & 0xFFFFFFFF));
+
+		struct Library
+		{
+			const char* Path;
+			std::vector<ShaderDefine> Defines;
+		};
+
+		// The permutations the samples compile with -shader-directory
+		const Library libraries[] =
+		{
+			{ "1_Basic/Shaders/RaytracingBasic.hlsl", {} },
+			{ "2_Lighting/Shaders/RaytracingLighting.hlsl", {} },
+			{ "3_Raytraced_Shadows/Shaders/RaytracingShadows.hlsl", {} },
+			{ "4_Raytraced_Reflections/Shaders/RaytracingReflections.hlsl", { { "REFLECTIONS", "0" } } },
+			{ "4_Raytraced_Reflections/Shaders/RaytracingReflections.hlsl", { { "REFLECTIONS", "1" }, { "RECURSION_DEPTH", "5" } } },
+			{ "5_Intersection_Shader/Shaders/RaytracingIntersection.hlsl", { { "REFLECTIONS", "1" }, { "PRIMITIVE_TYPES", "31" } } },
+			{ "5_Intersection_Shader/Shaders/RaytracingIntersection.hlsl", { { "REFLECTIONS", "0" }, { "PRIMITIVE_TYPES", "1" } } }
+		};
+
+		for (const Library& library : libraries)
+		{
+			ShaderCompileDesc desc;
+			desc.SourcePath = (codeDirectory / library.Path).string();
+			desc.Defines = library.Defines;
+
+			std::vector<uint8_t> code;
+			std::string errors;
+
+			if (!CHECK(compiler.Compile(desc, code, errors)))
+			{
+				printf("%s\n%s\n", library.Path, errors.c_str());
+				continue;
+			}
+
+			// DXIL comes in a DXBC container
+			CHECK(code.size() > 4 && std::memcmp(code.data(), "DXBC", 4) == 0);
+		}
+
+		// A broken library fails with the errors
+		const std::filesystem::path directory = GetDirectory();
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+
+		WriteFile(directory / "Broken.hlsl", "[shader(\"raygeneration\")]\nvoid RayGenMain() { undeclared = 1; }\n");
+
+		ShaderCompileDesc broken;
+		broken.SourcePath = (directory / "Broken.hlsl").string();
+
+		std::vector<uint8_t> code;
+		std::string errors;
+		CHECK(!compiler.Compile(broken, code, errors));
+		CHECK(code.empty() && errors.find("undeclared") != errors.npos);
+
+		std::filesystem::remove_all(directory, error);
+
+		return GetTestResult();
+	}
+}
+
+// '--dxc <code directory> [library]' compiles the sample libraries with DXC instead of running the other tests
+int main(int argc, char** argv)
+{
+	if (argc >= 3 && std::strcmp(argv[1], "--dxc") == 0)
+	{
+		return TestDXC(argv[2], argc >= 4 ? argv[3] : "");
+	}
+
+	TestSourceKeys();
+	TestDefines();
+	TestReload();
+
+	return GetTestResult();
+}
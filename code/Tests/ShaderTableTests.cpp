@@ -0,0 +1,195 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/ShaderTable.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace cpu;
+
+namespace
+{
+	ShaderRecordLayout CreateLayout(Random& random)
+	{
+		ShaderRecordLayout layout;
+		const uint32_t argumentCount = random.Next() % 8;
+
+		for (uint32_t i = 0; i < argumentCount; i++)
+		{
+			if (random.Next() % 2 == 0)
+			{
+				layout.AddDescriptor();
+			}
+			else
+			{
+				layout.AddConstants(1 + random.Next() % 16);
+			}
+		}
+
+		return layout;
+	}
+
+	// The layout of a hit group with a constant, a buffer and a few more constants
+	void TestKnownLayout()
+	{
+		ShaderRecordLayout layout;
+		CHECK(layout.AddConstants(1) == 0);
+		CHECK(layout.AddDescriptor() == 1);
+		CHECK(layout.AddConstants(3) == 2);
+
+		CHECK(layout.GetArgumentOffset(0) == 32);
+		CHECK(layout.GetArgumentOffset(1) == 40);
+		CHECK(layout.GetArgumentOffset(2) == 48);
+		CHECK(layout.GetArgumentSize(2) == 12);
+		CHECK(layout.GetRecordSize() == 60);
+		CHECK(layout.GetStride() == 64);
+
+		// Only the identifier
+		CHECK(ShaderRecordLayout().GetRecordSize() == ShaderIdentifierSize);
+		CHECK(ShaderRecordLayout().GetStride() == ShaderRecordAlignment);
+	}
+
+	void TestLayoutRules()
+	{
+		Random random(23);
+
+		for (uint32_t test = 0; test < 1000; test++)
+		{
+			const ShaderRecordLayout layout = CreateLayout(random);
+			uint32_t end = ShaderIdentifierSize;
+
+			for (uint32_t argument = 0; argument < layout.GetArgumentCount(); argument++)
+			{
+				const uint32_t offset = layout.GetArgumentOffset(argument);
+
+				// In order of the parameters, after the previous argument, without more padding than the alignment needs
+				CHECK(offset >= end);
+				CHECK(offset % (layout.IsDescriptor(argument) ? 8 : 4) == 0);
+				CHECK(offset - end < (layout.IsDescriptor(argument) ? 8u : 4u));
+				CHECK(layout.GetArgumentSize(argument) == 8 || !layout.IsDescriptor(argument));
+
+				end = offset + layout.GetArgumentSize(argument);
+			}
+
+			CHECK(layout.GetRecordSize() == end);
+			CHECK(layout.GetStride() % ShaderRecordAlignment == 0);
+			CHECK(layout.GetStride() >= end && layout.GetStride() - end < ShaderRecordAlignment);
+			CHECK(layout.GetStride() <= MaxShaderRecordSize);
+		}
+	}
+
+	// Random writes to a table, followed on a copy of its bytes, which must match after each of them. Writes to records
+	// or arguments that do not exist, or of the wrong kind, change nothing, and constants past the end of their argument
+	// are dropped, so the padding and everything outside the written argument stay as they were.
+	void TestWrites()
+	{
+		Random random(2323);
+
+		for (uint32_t test = 0; test < 200; test++)
+		{
+			const ShaderRecordLayout layout = CreateLayout(random);
+			const uint32_t recordCount = 1 + random.Next() % 16;
+
+			ShaderTable table(layout, recordCount);
+			CHECK(table.GetSize() == static_cast<uint64_t>(recordCount) * layout.GetStride());
+			CHECK(std::all_of(table.GetData(), table.GetData() + table.GetSize(), [](uint8_t byte) { return byte == 0; }));
+
+			std::vector<uint8_t> expected(table.GetSize(), 0);
+
+			for (uint32_t write = 0; write < 100; write++)
+			{
+				const uint32_t record = random.Next() % (recordCount + 1);
+				const uint32_t argument = random.Next() % (layout.GetArgumentCount() + 1);
+				const bool exists = record < recordCount && argument < layout.GetArgumentCount();
+				uint8_t* base = expected.data() + static_cast<size_t>(record) * layout.GetStride();
+
+				uint32_t values[24];
+
+				for (uint32_t& value : values)
+				{
+					value = random.Next();
+				}
+
+				switch (random.Next() % 3)
+				{
+				case 0:
+				{
+					table.SetIdentifier(record, values);
+
+					if (record < recordCount)
+					{
+						memcpy(base, values, ShaderIdentifierSize);
+					}
+
+					break;
+				}
+				case 1:
+				{
+					const uint64_t address = (static_cast<uint64_t>(values[0]) << 32) | values[1];
+					table.SetDescriptor(record, argument, address);
+
+					if (exists && layout.IsDescriptor(argument))
+					{
+						memcpy(base + layout.GetArgumentOffset(argument), &address, sizeof(address));
+					}
+
+					break;
+				}
+				default:
+				{
+					const uint32_t count = random.Next() % 20;
+					const uint32_t offset = random.Next() % 20;
+					table.SetConstants(record, argument, values, count, offset);
+
+					if (exists && !layout.IsDescriptor(argument))
+					{
+						const uint32_t valueCount = layout.GetArgumentSize(argument) / 4;
+
+						for (uint32_t i = offset; i < std::min(offset + count, valueCount); i++)
+						{
+							memcpy(base + layout.GetArgumentOffset(argument) + i * 4, &values[i - offset], 4);
+						}
+					}
+
+					break;
+				}
+				}
+
+				CHECK(memcmp(table.GetData(), expected.data(), expected.size()) == 0);
+			}
+		}
+	}
+
+	void TestStructConstants()
+	{
+		struct Material
+		{
+			float Color[3];
+			uint32_t TextureIndex;
+		};
+
+		ShaderRecordLayout layout;
+		const uint32_t material = layout.AddConstants(sizeof(Material) / 4);
+
+		ShaderTable table(layout, 3);
+		table.SetConstants(1, material, Material{ { 0.25f, 0.5f, 1.0f }, 7 });
+
+		Material read;
+		memcpy(&read, table.GetRecord(1) + layout.GetArgumentOffset(material), sizeof(read));
+
+		CHECK(read.Color[0] == 0.25f && read.Color[1] == 0.5f && read.Color[2] == 1.0f);
+		CHECK(read.TextureIndex == 7);
+		CHECK(table.GetRecord(1) == table.GetData() + table.GetStride());
+	}
+}
+
+int main()
+{
+	TestKnownLayout();
+	TestLayoutRules();
+	TestWrites();
+	TestStructConstants();
+
+	return GetTestResult();
+}
@@ -0,0 +1,189 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/Random.hpp>
+#include <DXRCore/CPU/TLSFAllocator.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	struct Live
+	{
+		uint32_t Handle;
+		uint64_t Size;
+		uint64_t Alignment;
+		uint32_t Tag;
+	};
+
+	void TestFreeMergesNeighbours()
+	{
+		TLSFAllocator allocator(1024);
+
+		const TLSFAllocator::Allocation a = allocator.Allocate(100);
+		const TLSFAllocator::Allocation b = allocator.Allocate(100, 64);
+		const TLSFAllocator::Allocation c = allocator.Allocate(100);
+
+		CHECK(a.Handle != TLSFAllocator::InvalidHandle && a.Offset == 0);
+		CHECK(b.Handle != TLSFAllocator::InvalidHandle && b.Offset == 128);
+		CHECK(c.Handle != TLSFAllocator::InvalidHandle);
+		CHECK(allocator.GetAllocationSize(b.Handle) == 100);
+		CHECK(allocator.Allocate(2048).Handle == TLSFAllocator::InvalidHandle);
+
+		// The padding in front of b stays free
+		TLSFAllocator::Statistics statistics = allocator.GetStatistics();
+		CHECK(statistics.UsedSize == 300);
+		CHECK(statistics.FreeSize == 1024 - 300);
+		CHECK(statistics.AllocationCount == 3);
+
+		allocator.Free(b.Handle);
+		allocator.Free(a.Handle);
+		allocator.Free(c.Handle);
+
+		statistics = allocator.GetStatistics();
+		CHECK(allocator.IsEmpty());
+		CHECK(statistics.FreeRangeCount == 1);
+		CHECK(statistics.LargestFreeSize == 1024);
+	}
+
+	// Allocates and frees at random, with data in a copy of the heap, and checks every allocation against the ones that
+	// are still in use. Then defragments, applies the moves to the copy in their order and checks that every allocation
+	// still holds its own data.
+	void TestRandomOperationsAndDefragment()
+	{
+		constexpr uint64_t HeapSize = 1 << 20;
+
+		TLSFAllocator allocator(HeapSize);
+		Random random(18);
+
+		std::vector<uint32_t> memory(HeapSize, 0);
+		std::vector<Live> live;
+		uint32_t nextTag = 1;
+		uint32_t allocationCount = 0;
+
+		auto Holds = [&](const Live& allocation)
+		{
+			const uint64_t offset = allocator.GetOffset(allocation.Handle);
+			return std::all_of(memory.begin() + offset, memory.begin() + offset + allocation.Size, [&](uint32_t value) { return value == allocation.Tag; });
+		};
+
+		for (uint32_t round = 0; round < 4; round++)
+		{
+			for (uint32_t step = 0; step < 20000; step++)
+			{
+				if (live.empty() || random.Next() % 5 < 3)
+				{
+					const uint64_t size = 1 + random.Next() % (random.Next() % 16 == 0 ? 32768 : 2048);
+					const uint64_t alignment = 1ull << (random.Next() % 9);
+					const uint64_t largestFree = allocator.GetStatistics().LargestFreeSize;
+
+					const TLSFAllocator::Allocation allocation = allocator.Allocate(size, alignment);
+
+					if (allocation.Handle == TLSFAllocator::InvalidHandle)
+					{
+						// A range of twice the size and the alignment is always found
+						CHECK(largestFree < 2 * (size + alignment));
+						continue;
+					}
+
+					CHECK(allocation.Offset % alignment == 0);
+					CHECK(allocation.Offset + size <= HeapSize);
+					CHECK(allocator.GetOffset(allocation.Handle) == allocation.Offset);
+					CHECK(allocator.GetAllocationSize(allocation.Handle) == size);
+
+					// Nothing else uses the range
+					CHECK(std::all_of(memory.begin() + allocation.Offset, memory.begin() + allocation.Offset + size, [](uint32_t value) { return value == 0; }));
+
+					std::fill(memory.begin() + allocation.Offset, memory.begin() + allocation.Offset + size, nextTag);
+					live.push_back({ allocation.Handle, size, alignment, nextTag++ });
+					allocationCount++;
+				}
+				else
+				{
+					const uint32_t pick = random.Next() % live.size();
+					const Live allocation = live[pick];
+
+					CHECK(Holds(allocation));
+
+					const uint64_t offset = allocator.GetOffset(allocation.Handle);
+					std::fill(memory.begin() + offset, memory.begin() + offset + allocation.Size, 0);
+
+					allocator.Free(allocation.Handle);
+					live[pick] = live.back();
+					live.pop_back();
+				}
+
+				uint64_t usedSize = 0;
+
+				for (const Live& allocation : live)
+				{
+					usedSize += allocation.Size;
+				}
+
+				const TLSFAllocator::Statistics statistics = allocator.GetStatistics();
+				CHECK(statistics.UsedSize == usedSize);
+				CHECK(statistics.UsedSize + statistics.FreeSize == HeapSize);
+				CHECK(statistics.AllocationCount == live.size());
+			}
+
+			std::vector<uint64_t> offsets;
+
+			for (const Live& allocation : live)
+			{
+				offsets.push_back(allocator.GetOffset(allocation.Handle));
+			}
+
+			std::vector<TLSFAllocator::Move> moves;
+			allocator.Defragment(moves);
+
+			// Copied in the order of the list, a range can overlap its old one
+			for (const TLSFAllocator::Move& move : moves)
+			{
+				CHECK(move.DestinationOffset < move.SourceOffset);
+				CHECK(allocator.GetOffset(move.Handle) == move.DestinationOffset);
+
+				std::memmove(memory.data() + move.DestinationOffset, memory.data() + move.SourceOffset, move.Size * sizeof(uint32_t));
+			}
+
+			uint64_t end = 0;
+
+			for (size_t i = 0; i < live.size(); i++)
+			{
+				const uint64_t offset = allocator.GetOffset(live[i].Handle);
+
+				CHECK(offset <= offsets[i]);
+				CHECK(offset % live[i].Alignment == 0);
+				CHECK(Holds(live[i]));
+
+				end = std::max(end, offset + live[i].Size);
+			}
+
+			// The free memory is left in one range at the end, apart from the padding of alignments
+			const TLSFAllocator::Statistics statistics = allocator.GetStatistics();
+			CHECK(statistics.LargestFreeSize == HeapSize - end);
+			CHECK(statistics.AllocationCount == live.size());
+
+			// Only the tags of the allocations are left, at their new offsets
+			std::fill(memory.begin(), memory.end(), 0);
+
+			for (const Live& allocation : live)
+			{
+				const uint64_t offset = allocator.GetOffset(allocation.Handle);
+				std::fill(memory.begin() + offset, memory.begin() + offset + allocation.Size, allocation.Tag);
+			}
+		}
+
+		CHECK(allocationCount > 10000);
+	}
+}
+
+int main()
+{
+	TestFreeMergesNeighbours();
+	TestRandomOperationsAndDefragment();
+
+	return GetTestResult();
+}
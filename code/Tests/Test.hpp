@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+// Failed checks of the test executable. A test keeps going after a failed check, so one run lists all of them.
+inline int g_FailedCheckCount = 0;
+
+inline bool Check(bool passed, const char* expression, const char* file, int line)
+{
+	if (!passed)
+	{
+		printf("%s(%d): check failed: %s\n", file, line, expression);
+		g_FailedCheckCount++;
+	}
+
+	return passed;
+}
+
+#define CHECK(expression) Check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+// Exit code of the test executable, for ctest
+inline int GetTestResult()
+{
+	if (g_FailedCheckCount > 0)
+	{
+		printf("%d checks failed\n", g_FailedCheckCount);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include "Test.hpp"
+
+#include <DXRCore/CPU/ThreadPool.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using namespace cpu;
+
+namespace
+{
+	// Every index is visited once, in chunks that start at multiples of the grain, and no two threads that run at the
+	// same time get the same thread index
+	void TestChunksAndThreadIndices()
+	{
+		ThreadPool pool(4);
+
+		for (uint64_t count : { 1ull, 7ull, 1000ull, 100003ull })
+		{
+			for (uint64_t grain : { 1ull, 16ull, 4096ull })
+			{
+				std::vector<std::atomic<uint32_t>> visits(count);
+				std::unique_ptr<std::atomic<bool>[]> running(new std::atomic<bool>[pool.GetThreadCount()]());
+				std::atomic<uint32_t> wrongChunkCount{ 0 };
+				std::atomic<uint32_t> sharedIndexCount{ 0 };
+
+				pool.ParallelFor(count, grain, [&](uint64_t begin, uint64_t end, uint32_t threadIndex)
+				{
+					if (threadIndex >= pool.GetThreadCount() || running[threadIndex].exchange(true))
+					{
+						sharedIndexCount++;
+					}
+
+					if (begin % grain != 0 || end - begin > grain || end > count)
+					{
+						wrongChunkCount++;
+					}
+
+					for (uint64_t i = begin; i < end && i < count; i++)
+					{
+						visits[i]++;
+					}
+
+					if (threadIndex < pool.GetThreadCount())
+					{
+						running[threadIndex] = false;
+					}
+				});
+
+				uint64_t wrongVisitCount = 0;
+
+				for (const auto& visit : visits)
+				{
+					wrongVisitCount += visit != 1;
+				}
+
+				CHECK(wrongVisitCount == 0);
+				CHECK(wrongChunkCount == 0);
+				CHECK(sharedIndexCount == 0);
+			}
+		}
+	}
+
+	// A ParallelFor from inside a chunk, like InstanceStore::Pack called from a pass, runs on the thread of the chunk
+	// instead of waiting for the pool it is part of
+	void TestNestedParallelFor()
+	{
+		ThreadPool pool(4);
+
+		constexpr uint64_t OuterCount = 64;
+		constexpr uint64_t InnerCount = 1000;
+
+		std::vector<std::atomic<uint32_t>> visits(OuterCount * InnerCount);
+		std::atomic<uint32_t> wrongThreadCount{ 0 };
+		std::atomic<uint32_t> wrongChunkCount{ 0 };
+
+		pool.ParallelFor(OuterCount, 1, [&](uint64_t begin, uint64_t end, uint32_t threadIndex)
+		{
+			for (uint64_t outer = begin; outer < end; outer++)
+			{
+				pool.ParallelFor(InnerCount, 64, [&](uint64_t innerBegin, uint64_t innerEnd, uint32_t innerThreadIndex)
+				{
+					wrongThreadCount += innerThreadIndex != threadIndex;
+					wrongChunkCount += innerBegin % 64 != 0 || innerEnd - innerBegin > 64;
+
+					for (uint64_t inner = innerBegin; inner < innerEnd; inner++)
+					{
+						visits[outer * InnerCount + inner]++;
+					}
+				});
+			}
+		});
+
+		uint64_t wrongVisitCount = 0;
+
+		for (const auto& visit : visits)
+		{
+			wrongVisitCount += visit != 1;
+		}
+
+		CHECK(wrongVisitCount == 0);
+		CHECK(wrongThreadCount == 0);
+		CHECK(wrongChunkCount == 0);
+
+		// The pool still runs jobs in parallel afterwards, also from other threads than the one that created it
+		std::atomic<uint64_t> sum{ 0 };
+		pool.ParallelFor(1000, 10, [&](uint64_t begin, uint64_t end, uint32_t) { sum += end - begin; });
+		CHECK(sum == 1000);
+	}
+
+	// A nested call into another pool is an ordinary job of that pool
+	void TestNestedOtherPool()
+	{
+		ThreadPool outerPool(2);
+		ThreadPool innerPool(3);
+
+		std::atomic<uint64_t> sum{ 0 };
+
+		outerPool.ParallelFor(8, 1, [&](uint64_t begin, uint64_t end, uint32_t)
+		{
+			for (uint64_t i = begin; i < end; i++)
+			{
+				innerPool.ParallelFor(100, 7, [&](uint64_t innerBegin, uint64_t innerEnd, uint32_t) { sum += innerEnd - innerBegin; });
+			}
+		});
+
+		CHECK(sum == 800);
+	}
+}
+
+int main()
+{
+	TestChunksAndThreadIndices();
+	TestNestedParallelFor();
+	TestNestedOtherPool();
+
+	return GetTestResult();
+}